@@ -5,6 +5,7 @@
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/printk.h>
 #include <tilck/common/string_util.h>
+#include <tilck/common/crd_base.h>
 #include <tilck/boot/common.h>
 
 #include "basic_term.h"
@@ -186,8 +187,9 @@ legacy_boot_load_initrd(void)
    if (!success)
       return false;
 
-   /* Compact initrd's clusters, if necessary */
-   initrd_size = rd_compact_clusters((void *)initrd_paddr, initrd_size);
+   /* Compact initrd's clusters, if necessary (not for compressed initrds) */
+   if (!crd_is_compressed((void *)initrd_paddr))
+      initrd_size = rd_compact_clusters((void *)initrd_paddr, initrd_size);
 
    /*
     * Increase initrd_size by 1 page in order to allow Tilck's kernel to
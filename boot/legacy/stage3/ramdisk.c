@@ -4,6 +4,7 @@
 
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/fat32_base.h>
+#include <tilck/common/crd_base.h>
 #include <tilck/common/printk.h>
 #include <tilck/common/color_defs.h>
 
@@ -181,6 +182,16 @@ load_fat_ramdisk(const char *load_str,
    // Read FAT's header
    read_sectors(free_mem, first_sec, 1 /* read just 1 sector */);
 
+   if (crd_is_compressed((void *)free_mem)) {
+
+      /*
+       * Compressed ramdisk (see crd_base.h): the kernel will decompress its
+       * chunks on demand. Just load the whole compressed image.
+       */
+      rd_size = ((struct crd_hdr *)free_mem)->compr_size;
+      goto load;
+   }
+
    // Do some sanity checks against data corruption
    if (!check_fat_header((void *)free_mem))
       goto corrupted;
@@ -200,6 +211,7 @@ load_fat_ramdisk(const char *load_str,
    // Finally we're able to determine how big is the fatpart (pure data)
    rd_size = fat_calculate_used_bytes((void *)free_mem);
 
+load:
    /* Calculate rd_size in sectors, rounding up at SECTOR_SIZE */
    rd_sectors = (rd_size + SECTOR_SIZE - 1) / SECTOR_SIZE;
 
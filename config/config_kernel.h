@@ -38,6 +38,9 @@
 
 #define PROCESS_CMDLINE_BUF_SIZE                  256
 #define MAX_MOUNTPOINTS                            16
+#define DCACHE_MAX_ENTRIES                        256
+#define DCACHE_HASH_BUCKETS                        64
+#define DCACHE_MAX_NAME_LEN                        32
 #define MAX_NESTED_INTERRUPTS                      32
 
 #define WTH_MAX_THREADS                            64
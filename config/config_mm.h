@@ -16,6 +16,8 @@
 
 #cmakedefine01 FORK_NO_COW
 #cmakedefine01 MMAP_NO_COW
+#cmakedefine01 MM_ZSWAP
+#cmakedefine01 MM_KSM
 
 
 /*
@@ -39,9 +41,18 @@
 #define USERMODE_VADDR_END   (KERNEL_BASE_VA) /* biggest user vaddr + 1 */
 #define MAX_BRK                  (0x40000000) /* +1 GB (virtual memory) */
 #define USER_MMAP_BEGIN               MAX_BRK /* +1 GB (virtual memory) */
-#define USER_MMAP_MIN_SZ            (16 * MB)
-#define USER_MMAP_MAX_SZ          (1024 * MB)
+#define USER_MMAP_END  (USERMODE_VADDR_END - 128 * MB) /* room for the stack */
+#define USER_INTERP_BASE        USER_MMAP_END /* ELF interpreter (ld.so) */
+#define USER_INTERP_MAX_SIZE        (64 * MB) /* below the stack */
+#define USER_MMAP_FAULT_AROUND_PAGES       16 /* MUST BE a power of 2 */
 #define USERMODE_STACK_ALIGN              16u
+#define TLB_FLUSH_ALL_THRESHOLD           32 /* pages, see tlb_gather */
+#define ZSWAP_DEFAULT_MIN_FREE_KB       1024 /* reclaim below this threshold */
+#define KSM_DEFAULT_PAGES_TO_SCAN        128 /* per KSM thread wake-up */
+#define KSM_DEFAULT_SLEEP_MS             200 /* KSM thread sleep between scans */
+#define CRD_DEFAULT_MIN_FREE_KB         1024 /* drop initrd chunks below this */
+#define CRD_DEFAULT_MAX_CACHE_KB           0 /* 0 means: no limit */
+#define CRD_MIN_CACHED_CHUNKS              4 /* never drop below, if possible */
 
 #define USERMODE_STACK_MAX \
    ((USERMODE_VADDR_END - 1) & ALIGNED_MASK(USERMODE_STACK_ALIGN))
@@ -8,7 +8,7 @@
 #pragma once
 
 /* ------ Value-based config variables -------- */
-#define MAX_HANDLES            @MAX_HANDLES@
+#define NOFILE_LIMIT           @NOFILE_LIMIT@  /* RLIMIT_NOFILE (soft) */
 
 /* --------- Boolean config variables --------- */
 #cmakedefine01 KERNEL_BIG_IO_BUF
@@ -28,6 +28,13 @@
 
 #define USERAPP_MAX_ARGS_COUNT                                 32
 
+/*
+ * Per-process fd table: initial size (embedded in struct process) and hard
+ * limit for RLIMIT_NOFILE. The table is doubled on demand, up to the limit.
+ */
+#define FD_TABLE_MIN_SIZE                                      16
+#define NOFILE_HARD_LIMIT                                   65536
+
 
 /*
  * execve recursion limit with #!/path/to/executable scripts
@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+
+#include <tilck/common/basic_defs.h>
+
+/*
+ * Compressed ramdisk (crd) format, produced by the `rdcomp` build app.
+ *
+ * The uncompressed image (typically the FAT initrd) is split in chunks of
+ * `chunk_size` bytes (the last one might be shorter) compressed independently
+ * with the LZ compressor in kernel/lz.c. That allows the kernel to decompress
+ * them lazily, on the first access. The header is followed by the index: the
+ * offsets (from the beginning of the header) of the compressed chunks, plus
+ * one final entry pointing right after the last chunk. A chunk having its
+ * compressed length equal to its uncompressed length is stored as it is,
+ * because it was not compressible.
+ */
+
+#define CRD_MAGIC                      0x44524354u    /* "TCRD" */
+#define CRD_VERSION                             1u
+#define CRD_CHUNK_SIZE                    (32 * KB)
+
+struct crd_hdr {
+
+   u32 magic;
+   u32 version;
+   u32 chunk_size;      /* uncompressed size of the chunks */
+   u32 chunks_count;
+   u32 size;            /* uncompressed size of the whole image */
+   u32 compr_size;      /* size of the whole crd file, header included */
+   u32 index[];         /* `chunks_count` + 1 offsets */
+};
+
+static inline bool crd_is_compressed(const void *data)
+{
+   return ((const struct crd_hdr *)data)->magic == CRD_MAGIC;
+}
+
+static inline size_t crd_get_hdr_size(u32 chunks_count)
+{
+   return sizeof(struct crd_hdr) + (chunks_count + 1) * sizeof(u32);
+}
+
+/* Uncompressed size of the chunk `i` */
+static inline u32 crd_get_chunk_size(const struct crd_hdr *h, u32 i)
+{
+   return MIN(h->chunk_size, h->size - i * h->chunk_size);
+}
+
+/* Compressed size of the chunk `i` */
+static inline u32 crd_get_chunk_compr_size(const struct crd_hdr *h, u32 i)
+{
+   return h->index[i + 1] - h->index[i];
+}
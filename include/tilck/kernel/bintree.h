@@ -109,6 +109,11 @@ bintree_find_ptr_internal(void *root_obj,
                           long bintree_offset,
                           long field_off);
 void *
+bintree_find_ptr_ge_internal(void *root_obj,
+                             const void *value_ptr,
+                             long bintree_offset,
+                             long field_off);
+void *
 bintree_remove_ptr_internal(void **root_obj_ref,
                             void *value_ptr,
                             long bintree_offset,
@@ -151,6 +156,16 @@ bintree_remove_ptr_internal(void **root_obj_ref,
                              OFFSET_OF(struct_type, elem_name),               \
                              OFFSET_OF(struct_type, field_name))
 
+/*
+ * Like bintree_find_ptr(), but when there's no object with key `value`, return
+ * the one with the smallest key bigger than `value` (if any).
+ */
+#define bintree_find_ptr_ge(root_obj, value, struct_type, elem_name, field_name)\
+   bintree_find_ptr_ge_internal((void*)(root_obj),                            \
+                                TO_PTR(value),                                \
+                                OFFSET_OF(struct_type, elem_name),            \
+                                OFFSET_OF(struct_type, field_name))
+
 #define bintree_remove(rootref, value, objval_cmpfun, struct_type, elem_name) \
    bintree_remove_internal((void**)(rootref),                                 \
                            (value), (objval_cmpfun),                          \
@@ -13,5 +13,6 @@ extern int kopt_tty_count;
 extern bool kopt_serial_console;
 extern bool kopt_sched_alive_thread;
 extern bool kopt_noacpi;
+extern bool kopt_initrd_rw;
 
 void parse_kernel_cmdline(const char *cmdline);
@@ -4,6 +4,7 @@
 
 #include <tilck/common/basic_defs.h>
 #include <tilck/kernel/paging.h>
+#include <tilck/kernel/fs/vfs_base.h>
 
 #define ELF_RAW_HEADER_SIZE   128
 
@@ -12,16 +13,22 @@ struct locked_file; /* forward declaration */
 struct elf_program_info {
 
    pdir_t *pdir;           // The pdir used for the program
-   void *entry;            // The address of program's entry point
+   void *entry;            // The initial instruction pointer (maybe ld.so's)
    void *stack;            // The initial value of the stack pointer
    void *brk;              // The first invalid vaddr (program break)
+   void *elf_entry;        // The address of program's entry point (AT_ENTRY)
+   void *phdrs;            // The vaddr of program's headers (AT_PHDR)
+   ulong phnum;            // The number of program headers (AT_PHNUM)
+   void *interp_base;      // The base vaddr of the interpreter (AT_BASE)
    struct locked_file *lf; // ELF's file lock (can be NULL)
+   struct locked_file *interp_lf; // Interpreter's file lock (can be NULL)
    bool wrong_arch;        // The ELF is compiled for the wrong arch
-   bool dyn_exec;          // The ELF is a dynamic executable (not supported)
+   bool dyn_exec;          // The ELF's interpreter could not be loaded
 };
 
 /*
- * Loads an ELF program in memory.
+ * Loads an ELF program in memory. In case of dynamic executables, their
+ * interpreter (PT_INTERP) is loaded as well and `entry` points to it.
  *
  * `filepath`: IN arg, the path of the ELF file to load.
  *
@@ -33,3 +40,9 @@ struct elf_program_info {
 int load_elf_program(const char *filepath,
                      char *header_buf,
                      struct elf_program_info *pinfo);
+
+/*
+ * Drop the cached ELF headers of the given file, if any. Called when the file
+ * is about to be modified.
+ */
+void elf_cache_invalidate(struct fs *fs, vfs_inode_ptr_t inode);
@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/kernel/fs/vfs_base.h>
+
+fs_handle epoll_create_handle(void);
+bool is_epoll_handle(fs_handle h);
+
+/* Remove all the epoll registrations of `h`: called when `h` is closed */
+void epoll_remove_handle(fs_handle h);
@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck_gen_headers/config_userlim.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/fs/vfs_base.h>
+
+/*
+ * Per-process table of the open file handles, indexed by fd. It starts with the
+ * FD_TABLE_MIN_SIZE slots embedded here and it's doubled on demand, up to the
+ * RLIMIT_NOFILE limit of the process. The used slots are tracked by a two-level
+ * bitmap: `open_map` has one bit per slot, while `full_map` has one bit per
+ * word of `open_map`, set when all of its bits are set. Therefore, finding the
+ * lowest free fd requires scanning just `full_map`, NBITS times smaller.
+ *
+ * NOTE: the table is protected by the `fslock` of its process.
+ */
+struct fd_table {
+
+   u32 size;                           /* slots count */
+   fs_handle *handles;
+   ulong *open_map;
+   ulong *full_map;
+
+   fs_handle min_handles[FD_TABLE_MIN_SIZE];
+   ulong min_open_map[(FD_TABLE_MIN_SIZE + NBITS - 1) / NBITS];
+   ulong min_full_map[1];
+};
+
+STATIC_ASSERT(FD_TABLE_MIN_SIZE <= NBITS * NBITS);
+
+void fdt_init(struct fd_table *t);
+void fdt_destroy(struct fd_table *t);
+int fdt_dup(struct fd_table *dst, struct fd_table *src);
+int fdt_expand(struct fd_table *t, u32 min_size);
+int fdt_get_free_fd(struct fd_table *t, int ge, u32 limit);
+int fdt_next_fd(struct fd_table *t, int fd);
+void fdt_set(struct fd_table *t, int fd, fs_handle h);
+
+static inline fs_handle fdt_get(struct fd_table *t, int fd)
+{
+   return IN_RANGE(fd, 0, (int)t->size) ? t->handles[fd] : NULL;
+}
+
+/* Iterate over the used slots, in order. Removing `fd` while iterating is OK */
+#define fdt_for_each_fd(t, fd)                                               \
+   for (fd = fdt_next_fd((t), 0); fd >= 0; fd = fdt_next_fd((t), fd + 1))
@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/crd_base.h>
+
+/*
+ * Compressed ramdisks (see crd_base.h for the format).
+ *
+ * A compressed ramdisk is mapped in the hi virtual memory area, but its pages
+ * are not present until the kernel touches them: at that point, the page fault
+ * handler decompresses the whole chunk containing the faulting address into a
+ * kmalloc-ed buffer and maps it there. The decompressed chunks are clean by
+ * definition (the ramdisk is read-only), so they're kept in a global LRU list
+ * and simply unmapped and freed when the free heap memory goes below
+ * `crd_min_free_kb`, when the cache exceeds `crd_max_cache_kb` (if not 0) or
+ * when a page allocation fails in the fault path (see zswap_alloc_page()).
+ *
+ * Note: because the uncompressed data has no pageframes of its own, the users
+ * of the ramdisk cannot map it in user space (fat_mmap() is not supported).
+ */
+
+struct crd_stats {
+
+   ulong size_kb;             /* uncompressed size of the ramdisks */
+   ulong compr_kb;            /* compressed size of the ramdisks */
+   ulong chunks;              /* total number of chunks */
+   ulong cached_chunks;       /* chunks currently decompressed */
+   ulong faults;              /* chunks decompressed so far */
+   ulong evictions;           /* chunks dropped so far */
+};
+
+extern struct crd_stats crd_stats;
+extern ulong crd_min_free_kb;
+extern ulong crd_max_cache_kb;
+
+/*
+ * Map the compressed ramdisk `compr` in the kernel's virtual space. Returns the
+ * vaddr of its uncompressed data and its size in `size`, or NULL in case of
+ * failure (corrupted image or out-of-memory).
+ */
+void *crd_map(void *compr, size_t compr_size, size_t *size);
+
+/* Counter-part of crd_map(): drop all the chunks and release the vaddr */
+void crd_unmap(void *vaddr);
+
+/* Returns true if `vaddr` belongs to a compressed ramdisk */
+bool crd_is_crd_vaddr(void *vaddr);
+
+/*
+ * Called by the page fault handler: decompress the chunk containing `vaddr`,
+ * if it belongs to a compressed ramdisk. Returns true in case of success.
+ */
+bool crd_handle_fault(void *vaddr);
+
+/* Drop up to `count` decompressed chunks. Returns the number of dropped ones */
+ulong crd_shrink(ulong count);
@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/fs/vfs_base.h>
+
+/*
+ * dcache: VFS-level cache of the path component lookups.
+ *
+ * Each entry maps a (fs, parent dir inode, name) key to the `struct fs_path`
+ * returned by fs's get_entry() function. Negative entries (non-existing names)
+ * are cached as well, having fs_path.inode == NULL. Only the filesystems with
+ * the VFS_FS_DCACHE flag use the cache: the others (e.g. devfs, sysfs) might
+ * add or remove entries without going through the VFS.
+ *
+ * Lookups run holding (at least) a shared lock on the fs, while all the
+ * operations changing a directory (creat, mkdir, rmdir, unlink, rename, etc.)
+ * hold the fs's exclusive lock and invalidate the affected entries before
+ * calling the fs. When the cache is full, the least recently used entry is
+ * evicted.
+ */
+
+struct dcache_stats {
+
+   ulong hits;                /* lookups satisfied by a positive entry */
+   ulong neg_hits;            /* lookups satisfied by a negative entry */
+   ulong misses;              /* lookups that required calling get_entry() */
+   ulong entries;             /* entries currently in the cache */
+   ulong evictions;           /* entries dropped because of the LRU policy */
+   ulong invalidations;       /* entries dropped because of fs changes */
+};
+
+extern struct dcache_stats dcache_stats;
+
+/* Like vfs_get_entry(), but using the cache when possible */
+void
+dcache_get_entry(struct fs *fs,
+                 vfs_inode_ptr_t dir_inode,
+                 const char *name,
+                 ssize_t name_len,
+                 struct fs_path *fs_path);
+
+/* Drop the entry for `name` in `dir_inode`, if any */
+void
+dcache_invalidate(struct fs *fs,
+                  vfs_inode_ptr_t dir_inode,
+                  const char *name,
+                  ssize_t name_len);
+
+/* Drop all the entries referring to `inode`, either as parent or as target */
+void dcache_invalidate_inode(struct fs *fs, vfs_inode_ptr_t inode);
+
+/* Drop all the entries of `fs` or, when `fs` is NULL, the whole cache */
+void dcache_invalidate_fs(struct fs *fs);
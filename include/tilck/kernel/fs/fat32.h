@@ -7,8 +7,65 @@
 
 #include <tilck/kernel/sync.h>
 #include <tilck/kernel/datetime.h>
+#include <tilck/kernel/bintree.h>
 #include <tilck/kernel/fs/vfs_base.h>
 
+/*
+ * A run of physically contiguous clusters in a file's cluster chain.
+ */
+struct fat_extent {
+
+   u32 idx;          /* index in the file of the extent's first cluster */
+   u32 clu;          /* extent's first cluster */
+   u32 count;        /* number of clusters in the extent */
+};
+
+/*
+ * Per-file index of the cluster chain, built at the first open and cached for
+ * the whole lifetime of the (read-only) file system. It allows finding the
+ * cluster at any given offset in O(log(extents)) time instead of following
+ * the cluster chain from the beginning. Files compacted with
+ * fat_compact_clusters(), as the ones in Tilck's initrd, have just one extent.
+ */
+struct fat_cluster_map {
+
+   struct bintree_node node;
+   struct fat_entry *e;                /* key */
+   u32 extents_count;
+   struct fat_extent extents[];
+};
+
+#define FAT_DINDEX_MIN_BUCKETS       8
+
+struct fat_dir_index_entry {
+
+   struct fat_entry *e;
+   u32 hash;         /* hash of the name (in lower case, for short names) */
+   u32 next;         /* 1 + index of the next entry in the bucket, 0 = none */
+   u32 name_off;     /* offset of the name in `names` */
+   u8 name_len;      /* length of the name, without the final \0 */
+   bool long_name;   /* long name (case sensitive) or short name? */
+};
+
+/*
+ * Per-directory index of the decoded names, built at the first access and
+ * cached, as the cluster maps, for the whole lifetime of the file system.
+ * It allows lookups in O(1) time instead of walking the directory's clusters
+ * and decoding the long names each time. The entries are in directory order,
+ * which makes getdents() able to resume from any offset.
+ */
+struct fat_dir_index {
+
+   struct bintree_node node;
+   struct fat_entry *e;                /* key: the directory */
+   u32 count;                          /* number of entries */
+   u32 htable_size;                    /* number of buckets (power of 2) */
+   size_t alloc_size;
+   u32 *htable;                        /* 1 + index of the first entry */
+   char *names;
+   struct fat_dir_index_entry ents[];
+};
+
 struct fat_fs_device_data {
 
    struct fat_hdr *hdr; /* vaddr of the beginning of the FAT partition */
@@ -28,6 +85,12 @@ struct fat_fs_device_data {
     * regular fat_entry.
     */
    struct fat_entry *root_dir_entries;
+
+   /* Cluster maps of the files opened so far (bintree by entry) */
+   struct fat_cluster_map *cmaps;
+
+   /* Indexes of the directories accessed so far (bintree by entry) */
+   struct fat_dir_index *dindexes;
 };
 
 struct fatfs_handle {
@@ -38,6 +101,7 @@ struct fatfs_handle {
    /* fs-specific members */
    struct fat_entry *e;
    u32 curr_cluster;
+   struct fat_cluster_map *cmap;       /* NULL if it couldn't be allocated */
 };
 
 STATIC_ASSERT(sizeof(struct fatfs_handle) <= MAX_FS_HANDLE_SIZE);
@@ -45,6 +109,22 @@ STATIC_ASSERT(sizeof(struct fatfs_handle) <= MAX_FS_HANDLE_SIZE);
 struct fs *fat_mount_ramdisk(void *vaddr, size_t rd_size, u32 flags);
 void fat_umount_ramdisk(struct fs *fs);
 
+struct fat_cluster_map *
+fat_get_cluster_map(struct fat_fs_device_data *d, struct fat_entry *e);
+
+void fat_destroy_cluster_maps(struct fat_fs_device_data *d);
+
+u32
+fat_cmap_lookup(struct fat_cluster_map *cmap, u32 idx, u32 *clu /* out */);
+
+struct fat_dir_index *
+fat_get_dir_index(struct fat_fs_device_data *d, struct fat_entry *e);
+
+void fat_destroy_dir_indexes(struct fat_fs_device_data *d);
+
+struct fat_entry *
+fat_dindex_lookup(struct fat_dir_index *idx, const char *name, size_t len);
+
 struct datetime
 fat_datetime_to_regular_datetime(u16 date, u16 time, u8 timetenth);
 
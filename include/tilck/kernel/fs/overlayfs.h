@@ -0,0 +1,33 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/fs/vfs_base.h>
+
+/*
+ * overlayfs: a writable file system stacking an `upper` (writable) fs over a
+ * `lower` (typically read-only) one, like the FAT initrd.
+ *
+ * Lookups and reads go to the upper layer when the entry exists there, and to
+ * the lower one otherwise. Files and directories are copied up to the upper
+ * layer only when they're modified (open for writing, truncate, chmod, etc.),
+ * the directories are merged by getdents() and the deleted lower entries are
+ * hidden by in-memory whiteouts. Therefore, the writes cost memory only for
+ * the touched files.
+ */
+
+struct overlayfs_stats {
+
+   ulong copy_ups;            /* files and directories copied up */
+   ulong copy_up_bytes;       /* bytes of file data copied up */
+   ulong nodes;               /* cached overlay nodes, including whiteouts */
+};
+
+extern struct overlayfs_stats overlayfs_stats;
+
+/*
+ * Create an overlay of `upper` over `lower`. Both the file systems are retained
+ * by the overlay, but they're still owned by the caller.
+ */
+struct fs *overlayfs_create(struct fs *lower, struct fs *upper);
+void overlayfs_destroy(struct fs *fs);
@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/* Memory used by the directories of all the ramfs instances */
+struct ramfs_dir_stats {
+
+   ulong entries;             /* directory entries, including "." and ".." */
+   ulong entries_mem;         /* heap memory used by the entries, in bytes */
+   ulong htables_mem;         /* heap memory used by the hash tables */
+};
+
+extern struct ramfs_dir_stats ramfs_dir_stats;
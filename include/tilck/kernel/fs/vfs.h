@@ -22,10 +22,52 @@ struct vfs_dent64 {
    enum vfs_entry_type type;
    u8 name_len;               /* NODE: includes the final '\0' */
    const char *name;
+
+   /*
+    * Opaque directory offset to seek to, in order to read the entries after
+    * this one. When 0, the VFS uses the index of the entry, plus 1.
+    */
+   offt next_off;
 };
 
 typedef int (*get_dents_func_cb) (struct vfs_dent64 *, void *);
 
+/*
+ * Source or destination of a read/write operation: a list of buffers, either
+ * in kernel space or in user space. File systems implementing the read_iter()
+ * and write_iter() file ops copy the data directly from/to the buffers using
+ * the io_iter_*() functions below, which use fault-protected copies for user
+ * buffers. That allows read() and write() to avoid the bounce through the
+ * per-task `io_copybuf` and its per-call size limit.
+ */
+struct io_iter {
+
+   const struct iovec *iov;   /* current buffer (the array is in kernel) */
+   int nr_segs;               /* buffers left, including the current one */
+   size_t iov_off;            /* offset in the current buffer */
+   size_t count;              /* total bytes left */
+   bool user;                 /* true if the buffers are in user space */
+};
+
+/* Max bytes transferred by a single read/write syscall, like on Linux */
+#define VFS_MAX_RW_COUNT               0x7ffff000u
+
+void
+io_iter_init(struct io_iter *it,
+             const struct iovec *iov,
+             int nr_segs,
+             bool user);
+
+/*
+ * The functions below copy up to `n` bytes to/from the iter and advance it.
+ * They return the number of bytes copied (less than `n` only when the end of
+ * the iter is reached) or -EFAULT if the copy failed because of a bad user
+ * buffer. In that case, the iter's position is undefined.
+ */
+ssize_t io_iter_copy_to(struct io_iter *it, const void *src, size_t n);
+ssize_t io_iter_copy_from(struct io_iter *it, void *dest, size_t n);
+ssize_t io_iter_zero(struct io_iter *it, size_t n);
+
 /* fs ops */
 typedef vfs_inode_ptr_t (*func_get_inode) (fs_handle);
 
@@ -66,6 +108,8 @@ typedef int     (*func_exlock_noblk) (struct fs *, vfs_inode_ptr_t);
 /* file ops */
 typedef ssize_t        (*func_read)         (fs_handle, char *, size_t);
 typedef ssize_t        (*func_write)        (fs_handle, char *, size_t);
+typedef ssize_t        (*func_rw_iter)      (fs_handle, struct io_iter *);
+typedef ssize_t        (*func_prw_iter)     (fs_handle, struct io_iter *, offt);
 typedef offt           (*func_seek)         (fs_handle, offt, int);
 typedef int            (*func_ioctl)        (fs_handle, ulong, void *);
 
@@ -159,8 +203,18 @@ struct file_ops {
    func_fsync sync;                    /* if NULL -> -EROFS or 0 */
    func_fsync datasync;                /* if NULL -> -EROFS or 0 */
 
-   func_readv readv;                   /* if NULL, emulated in non-atomic way */
-   func_writev writev;                 /* if NULL, emulated in non-atomic way */
+   func_readv readv;                   /* if NULL, use read_iter() or emulate */
+   func_writev writev;                 /* if NULL, use write_iter() or emulate */
+
+   func_rw_iter read_iter;             /* if NULL, use read() + io_copybuf */
+   func_rw_iter write_iter;            /* if NULL, use write() + io_copybuf */
+
+   /*
+    * Positional I/O (pread, pwrite, etc.): like read_iter() and write_iter(),
+    * but at the given offset, without using nor changing the handle's pos.
+    */
+   func_prw_iter pread_iter;           /* if NULL -> -ESPIPE */
+   func_prw_iter pwrite_iter;          /* if NULL -> -ESPIPE */
 
    func_handle_fault handle_fault;     /* if NULL -> false     */
 
@@ -215,6 +269,12 @@ struct kcond *vfs_get_except_cond(fs_handle h);
 ssize_t vfs_read(fs_handle h, void *buf, size_t buf_size);
 ssize_t vfs_write(fs_handle h, void *buf, size_t buf_size);
 ssize_t vfs_readv(fs_handle h, const struct iovec *iov, int iovcnt);
+ssize_t vfs_read_iter(fs_handle h, struct io_iter *it);
+ssize_t vfs_write_iter(fs_handle h, struct io_iter *it);
+ssize_t vfs_pread_iter(fs_handle h, struct io_iter *it, offt pos);
+ssize_t vfs_pwrite_iter(fs_handle h, struct io_iter *it, offt pos);
+ssize_t vfs_copy_data(fs_handle src, offt *src_pos,
+                      fs_handle dst, offt *dst_pos, size_t len);
 ssize_t vfs_writev(fs_handle h, const struct iovec *iov, int iovcnt);
 
 int vfs_exlock_noblock(struct fs *fs, vfs_inode_ptr_t i);
@@ -69,7 +69,7 @@ struct vfs_path {
 };
 
 #define VFS_FS_RW             (1 << 0)  /* struct fs mounted in RW mode */
-#define VFS_FS_RQ_DE_SKIP     (1 << 1)  /* FS requires vfs dents skip */
+#define VFS_FS_DCACHE         (1 << 2)  /* FS lookups can be cached (dcache) */
 
 /* This struct is Tilck's analogue of Linux's "superblock" */
 struct fs {
@@ -113,6 +113,7 @@ struct fs_handle_base {
 #define VFS_SPFL_NO_USER_COPY                  (1 << 0)
 #define VFS_SPFL_MMAP_SUPPORTED                (1 << 1)
 #define VFS_SPFL_NO_LF                         (1 << 2)
+#define VFS_SPFL_EPOLL                         (1 << 3)  /* epoll-watched */
 
 /*
  * vfs_mmap()'s flags
@@ -128,9 +129,16 @@ struct fs_handle_base {
  * VFS_MM_DONT_MMAP flag play a role. At the same way, in other exceptional
  * situations we might not want the FS to register the mapping, but to do it
  * anyway.
+ *
+ * Finally, file-systems supporting the handle_fault() op are allowed to map
+ * the pages lazily, on the first access. The VFS_MM_POPULATE flag forces them
+ * to map everything immediately: that's required when the mapping won't be
+ * registered in the process' mappings list (e.g. ELF segments) and it's used
+ * to implement mmap()'s MAP_POPULATE flag.
  */
 #define VFS_MM_DONT_MMAP            (1 << 0)
 #define VFS_MM_DONT_REGISTER        (1 << 1)
+#define VFS_MM_POPULATE             (1 << 2)
 
 int vfs_mmap(struct user_mapping *um, pdir_t *pdir, int flags);
 int vfs_munmap(struct user_mapping *um, void *vaddr, size_t len);
@@ -132,6 +132,9 @@ kmalloc_get_heap_struct_size(void);
 size_t
 kmalloc_get_max_tot_heap_free(void);
 
+size_t
+kmalloc_get_tot_heap_free(void);
+
 void *
 aligned_kmalloc(size_t size, u32 align);
 
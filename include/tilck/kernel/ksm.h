@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * KSM: kernel same-page merging.
+ *
+ * A background kernel thread periodically scans the private pages of all the
+ * user processes, at most `ksm_pages_to_scan` pages every `ksm_sleep_ms`
+ * milliseconds. Pages with identical contents are merged into a single
+ * read-only pageframe, shared with copy-on-write exactly like the pages after
+ * fork(). Pages full of zeros are merged with the global zero page.
+ *
+ * Candidates found in the current full scan are kept in the "unstable" table,
+ * keyed by their hash: when a second page with the same contents is found,
+ * the first one becomes a "stable" page, referenced by KSM itself too. Stable
+ * pages no longer mapped by anybody else are released at every wake-up.
+ */
+
+struct ksm_stats {
+
+   ulong pages_shared;        /* stable pageframes held by KSM */
+   ulong pages_sharing;       /* user mappings of the stable pageframes */
+   ulong saved_kb;            /* (pages_sharing - pages_shared) in KB */
+   ulong zero_merged;         /* total pages merged with the zero page */
+   ulong full_scans;          /* number of completed full scans */
+};
+
+extern struct ksm_stats ksm_stats;
+extern ulong ksm_pages_to_scan;
+extern ulong ksm_sleep_ms;
+
+void init_ksm(void);
@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * Minimal LZ77 compressor, designed for speed rather than for ratio. The
+ * format is LZ4-like: a sequence of [token][literals][offset][match length]
+ * records, where the token holds 4 bits for the literals count and 4 bits for
+ * the match length, both extended with additional bytes when they're >= 15.
+ */
+
+#define LZ_HASH_LOG                12
+#define LZ_MIN_MATCH                4
+#define LZ_MAX_INPUT_SIZE    (32 * KB)
+
+struct lz_ctx {
+   u16 htable[1 << LZ_HASH_LOG];     /* position + 1 of the last 4-byte seq */
+};
+
+/*
+ * Compress `len` bytes from `src` into `dst`. Returns the compressed size or
+ * 0 if the compressed data would not fit in `dst_len` bytes.
+ */
+size_t
+lz_compress(struct lz_ctx *ctx,
+            const void *src,
+            size_t len,
+            void *dst,
+            size_t dst_len);
+
+/*
+ * Decompress `len` bytes from `src` into `dst`. Returns the decompressed size
+ * or -1 in case the compressed data is corrupted or does not fit in `dst`.
+ */
+long
+lz_decompress(const void *src, size_t len, void *dst, size_t dst_len);
@@ -40,6 +40,7 @@ extern char zero_page[PAGE_SIZE] ALIGNED_AT(PAGE_SIZE);
 
 void early_init_paging();
 bool handle_potential_cow(void *r);
+bool handle_potential_user_mapping_fault(void *r);
 
 /*
  * Map a pageframe at `paddr` at the virtual address `vaddr` in the page
@@ -77,12 +78,51 @@ map_zero_pages(pdir_t *pdir,
                size_t page_count,
                u32 pg_flags);
 
+/*
+ * TLB flush batching.
+ *
+ * Instead of invalidating every single page with `invlpg` right after changing
+ * its entry, code unmapping (or changing) many pages at once can gather the
+ * affected range with tlb_gather_add() and call tlb_gather_flush() at the end.
+ * When the gathered range is bigger than TLB_FLUSH_ALL_THRESHOLD pages, the
+ * whole TLB is flushed instead, because that's cheaper than thousands of
+ * single-page invalidations. Finally, when the pdir is not the current one and
+ * the range is in user space, no flush is needed at all: user TLB entries are
+ * never global and they are dropped on every CR3 switch.
+ */
+struct tlb_gather {
+   pdir_t *pdir;
+   ulong start;      /* lowest gathered vaddr */
+   ulong end;        /* highest gathered vaddr + PAGE_SIZE */
+};
+
+static ALWAYS_INLINE void
+tlb_gather_init(struct tlb_gather *tlb, pdir_t *pdir)
+{
+   tlb->pdir = pdir;
+   tlb->start = (ulong)-1;
+   tlb->end = 0;
+}
+
+static ALWAYS_INLINE void
+tlb_gather_add(struct tlb_gather *tlb, ulong vaddr)
+{
+   tlb->start = MIN(tlb->start, vaddr);
+   tlb->end = MAX(tlb->end, vaddr + PAGE_SIZE);
+}
+
+void tlb_gather_flush(struct tlb_gather *tlb);
+
 void init_paging(void);
 bool is_mapped(pdir_t *pdir, void *vaddr);
 bool is_rw_mapped(pdir_t *pdir, void *vaddrp);
 void unmap_page(pdir_t *pdir, void *vaddr, bool do_free);
 int unmap_page_permissive(pdir_t *pdir, void *vaddrp, bool do_free);
 void unmap_pages(pdir_t *pdir, void *vaddr, size_t count, bool do_free);
+void unmap_page_batched(pdir_t *pdir, void *vaddr, bool do_free,
+                        struct tlb_gather *tlb);
+int unmap_page_permissive_batched(pdir_t *pdir, void *vaddr, bool do_free,
+                                  struct tlb_gather *tlb);
 size_t unmap_pages_permissive(pdir_t *pd, void *va, size_t count, bool do_free);
 ulong get_mapping(pdir_t *pdir, void *vaddr);
 int get_mapping2(pdir_t *pdir, void *vaddrp, ulong *pa_ref);
@@ -91,9 +131,94 @@ pdir_t *pdir_deep_clone(pdir_t *pdir);
 void pdir_destroy(pdir_t *pdir);
 void invalidate_page(ulong vaddr);
 void set_page_rw(pdir_t *pdir, void *vaddr, bool rw);
+
+/*
+ * Change the write permission of `page_count` user pages at `vaddr`, as
+ * mprotect() does. In private mappings (shared == false), a page becomes
+ * writable directly only if its pageframe is not shared with anybody else:
+ * otherwise, it becomes a CoW page, like after fork(). That's the case of the
+ * zero-page and of the file pages mapped by the ELF loader. In shared mappings
+ * instead, pages just become writable, except for the zero-page mapped on file
+ * holes. Returns the number of pages in the range that are not mapped at all.
+ */
+size_t
+set_user_pages_rw(pdir_t *pdir,
+                  void *vaddr,
+                  size_t page_count,
+                  bool rw,
+                  bool shared);
+
 void retain_pageframes_mapped_at(pdir_t *pdir, void *vaddr, size_t len);
 void release_pageframes_mapped_at(pdir_t *pdir, void *vaddr, size_t len);
 
+/*
+ * Swap entries support (see zswap.h). A swap entry is a non-present user PTE
+ * referring to a zswap slot, instead of a pageframe.
+ */
+enum swap_page_state {
+   SWAP_PAGE_SKIP,   /* not mapped or not a private, non-shared user page */
+   SWAP_PAGE_HOT,    /* accessed since the last check: accessed bit reset */
+   SWAP_PAGE_COLD,   /* not accessed since the last check */
+};
+
+enum swap_page_state
+swap_check_page(pdir_t *pdir,
+                void *vaddr,
+                void **kvaddr_ref,
+                struct tlb_gather *tlb);
+
+void
+set_swap_entry(pdir_t *pdir, void *vaddr, ulong slot, struct tlb_gather *tlb);
+
+bool handle_potential_swap_in(void *r);
+
+/*
+ * Clear the accessed bit of `page_count` pages mapped at `vaddr`. Returns true
+ * if at least one of them had it set.
+ */
+bool
+test_and_clear_accessed(pdir_t *pdir, void *vaddr, size_t page_count);
+
+/* Handle kernel faults on the lazily decompressed ramdisks (see fs/crd.h) */
+bool handle_potential_crd_fault(void *r);
+
+/*
+ * Same-page merging support (see ksm.h). Pages merged together are mapped
+ * read-only and marked as CoW, exactly like the pages shared after fork().
+ */
+
+/*
+ * Find the first vaddr in [vaddr, end) mapping a private user pageframe (not
+ * shared, ref-count == 1). Returns `end` if there's no such page.
+ */
+ulong
+find_private_user_page(pdir_t *pdir, ulong vaddr, ulong end, void **kvaddr);
+
+/* Make a private page CoW, taking an extra reference for the caller */
+void make_page_cow(pdir_t *pdir, void *vaddr, struct tlb_gather *tlb);
+
+/* Map `kvaddr`'s pageframe as CoW at `vaddr`, freeing the private page */
+void
+replace_with_cow_page(pdir_t *pdir,
+                      void *vaddr,
+                      void *kvaddr,
+                      struct tlb_gather *tlb);
+
+u32 get_pageframe_ref_count(void *kvaddr);
+void put_pageframe(void *kvaddr);       /* drop a ref, free it if unused */
+
+/*
+ * Per-pdir memory accounting. The resident set counts the user pages backed
+ * by a RAM pageframe, the shared zero page excluded. CoW pages count in every
+ * address space mapping them, like on Linux.
+ */
+struct pdir_mm_stats {
+   ulong rss;           /* resident user pages */
+   ulong peak_rss;      /* max value reached by `rss` */
+};
+
+void pdir_get_mm_stats(pdir_t *pdir, struct pdir_mm_stats *stats);
+
 static ALWAYS_INLINE pdir_t *get_kernel_pdir(void)
 {
    extern pdir_t *__kernel_pdir;
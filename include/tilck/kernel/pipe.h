@@ -3,9 +3,40 @@
 #pragma once
 #define PIPE_BUF_SIZE   4096
 
+/* Writes up to this size are atomic, like PIPE_BUF in POSIX */
+#define PIPE_ATOMIC_WRITE_SIZE   PIPE_BUF_SIZE
+
 struct pipe;
 
 struct pipe *create_pipe(void);
 void destroy_pipe(struct pipe *p);
 fs_handle pipe_create_read_handle(struct pipe *p);
 fs_handle pipe_create_write_handle(struct pipe *p);
+bool is_pipe_read_end(fs_handle h);
+bool is_pipe_write_end(fs_handle h);
+
+/*
+ * splice() support: move data between a pipe and a file, reading or writing
+ * the file directly from/to the pipe's buffer. When `pos` is NULL, the file's
+ * current position is used. Also, move or copy (tee) data between two pipes.
+ */
+ssize_t
+pipe_splice_from_file(fs_handle pipe_h,
+                      fs_handle src,
+                      offt *pos,
+                      size_t len,
+                      bool nonblock);
+
+ssize_t
+pipe_splice_to_file(fs_handle pipe_h,
+                    fs_handle dst,
+                    offt *pos,
+                    size_t len,
+                    bool nonblock);
+
+ssize_t
+pipe_splice_pipe(fs_handle src_h,
+                 fs_handle dst_h,
+                 size_t len,
+                 bool nonblock,
+                 bool consume);
@@ -10,6 +10,7 @@
 #include <tilck/kernel/list.h>
 #include <tilck/kernel/paging.h>
 #include <tilck/kernel/bintree.h>
+#include <tilck/kernel/user_vmem.h>
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/worker_thread.h>
 #include <tilck/kernel/signal.h>
@@ -17,6 +18,7 @@
 #include <tilck/kernel/elf_loader.h>
 #include <tilck/kernel/fs/vfs_base.h>
 #include <tilck/kernel/fs/flock.h>
+#include <tilck/kernel/fd_table.h>
 #include <tilck/kernel/sys_types.h>
 
 struct kernel_alloc {
@@ -28,11 +30,23 @@ struct kernel_alloc {
 
 struct mappings_info {
 
-   struct kmalloc_heap *mmap_heap;
-   size_t mmap_heap_size;
+   struct user_vmem vmem;        /* free vaddr ranges in the mmap area */
    struct list mappings;
 };
 
+/*
+ * Resource usage counters of a process, in a form independent from the
+ * userspace ABI (see rusage.c).
+ */
+struct proc_rusage {
+
+   u64 user_ticks;
+   u64 kernel_ticks;
+   ulong min_faults;
+   ulong maj_faults;
+   ulong peak_rss;               /* in pages */
+};
+
 struct process {
 
    REF_COUNTED_OBJECT;
@@ -58,14 +72,20 @@ struct process {
 
    int *set_child_tid;                    /* NOTE: this is an user pointer */
 
-   struct kmutex fslock;                  /* protects `handles` and `cwd` */
+   struct kmutex fslock;                  /* protects `fdt` and `cwd` */
    mode_t umask;
 
    struct vfs_path cwd;                   /* CWD as a struct vfs_path */
    char *debug_cmdline;                   /* debug field used by debugpanel */
 
+   ulong peak_rss;                        /* peak RSS of the old images */
+   struct proc_rusage children_ru;        /* usage of the reaped children */
+
    struct locked_file *elf;
-   fs_handle handles[MAX_HANDLES];        /* just a small fixed-size array */
+   struct locked_file *elf_interp;        /* lock on ld.so (dyn programs) */
+   u32 nofile_limit;                      /* RLIMIT_NOFILE soft limit */
+   u32 nofile_hard_limit;                 /* RLIMIT_NOFILE hard limit */
+   struct fd_table fdt;                   /* the open file handles, by fd */
 
    /*
     * The purpose of having this opaque `arch_fields` member here is to avoid
@@ -155,3 +175,9 @@ void setup_sig_handler(struct task *ti,
                        ulong user_func,
                        int signum);
 void setup_pause_trampoline(regs_t *r);
+
+void process_save_peak_rss(struct process *pi);
+void get_task_rusage(struct task *ti, struct proc_rusage *ru);
+void get_task_rusage_total(struct task *ti, struct proc_rusage *ru);
+void account_reaped_child(struct process *pi, struct task *child);
+void proc_rusage_to_k_rusage(struct proc_rusage *ru, struct k_rusage *kru);
@@ -22,7 +22,8 @@ struct user_mapping {
    };
 
    int prot;
-
+   int advice;          /* MADV_NORMAL, MADV_RANDOM etc. See sys_madvise() */
+   bool locked;         /* MAP_LOCKED: never swapped-out by zswap */
 };
 
 struct user_mapping *
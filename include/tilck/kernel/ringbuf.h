@@ -28,6 +28,11 @@ inline size_t ringbuf_get_elems(struct ringbuf *rb)
    return rb->elems;
 }
 
+inline size_t ringbuf_get_free_elems(struct ringbuf *rb)
+{
+   return rb->max_elems - rb->elems;
+}
+
 inline void ringbuf_reset(struct ringbuf *rb)
 {
    rb->read_pos = rb->write_pos = rb->elems = 0;
@@ -41,6 +46,18 @@ bool ringbuf_unwrite_elem(struct ringbuf *rb, void *elem_ptr /* out */);
 size_t ringbuf_write_bytes(struct ringbuf *rb, u8 *buf, size_t len);
 size_t ringbuf_read_bytes(struct ringbuf *rb, u8 *buf, size_t len);
 
+/*
+ * Zero-copy interface for byte ring buffers: get a pointer to the largest
+ * contiguous chunk that can be read (or written) in place and its length,
+ * then tell the ring buffer how many bytes have been actually consumed (or
+ * produced). Useful to copy data directly from/to user buffers.
+ */
+u8 *ringbuf_get_read_chunk(struct ringbuf *rb, size_t *len /* out */);
+u8 *ringbuf_get_write_chunk(struct ringbuf *rb, size_t *len /* out */);
+u8 *ringbuf_peek_chunk(struct ringbuf *rb, size_t off, size_t *len /* out */);
+void ringbuf_consume_bytes(struct ringbuf *rb, size_t len);
+void ringbuf_commit_bytes(struct ringbuf *rb, size_t len);
+
 
 inline bool ringbuf_write_elem1(struct ringbuf *rb, u8 val)
 {
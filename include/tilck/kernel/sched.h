@@ -85,6 +85,8 @@ struct task {
 
    s32 wstatus;                       /* waitpid's wstatus  */
    struct sched_ticks ticks;          /* scheduler counters */
+   ulong min_faults;                  /* page faults w/o I/O or swap-in */
+   ulong maj_faults;                  /* page faults requiring a swap-in */
 
    void *kernel_stack;
    void *args_copybuf;
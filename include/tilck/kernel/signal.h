@@ -23,6 +23,8 @@ int send_signal2(int pid, int tid, int signum, bool whole_process);
 bool process_signals(void *curr, enum sig_state new_sig_state, void *regs);
 void drop_all_pending_signals(void *curr);
 void reset_all_custom_signal_handlers(void *curr);
+int set_temp_sigmask(const sigset_t *u_mask, size_t sigsetsize);
+void restore_temp_sigmask(void);
 
 static inline int send_signal(int tid, int signum, bool whole_process)
 {
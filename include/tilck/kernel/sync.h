@@ -19,7 +19,8 @@ enum wo_type {
    /* Special "meta-object" types */
 
    WOBJ_MWO_WAITER, /* struct multi_obj_waiter */
-   WOBJ_MWO_ELEM    /* a pointer to this wobj is castable to mwobj_elem */
+   WOBJ_MWO_ELEM,   /* a pointer to this wobj is castable to mwobj_elem */
+   WOBJ_KCOND_WATCH /* a pointer to this wobj is castable to kcond_watch */
 };
 
 #define NO_EXTRA                 0
@@ -205,3 +206,22 @@ void kcond_signal_one(struct kcond *c);
 void kcond_signal_all(struct kcond *c);
 bool kcond_wait(struct kcond *c, struct kmutex *m, u32 timeout_ticks);
 bool kcond_is_anyone_waiting(struct kcond *c);
+
+/*
+ * A persistent watcher of a kcond, not owned by any task: it stays in the
+ * kcond's wait list until it's explicitly removed and, every time the kcond is
+ * signaled, its callback is called (with preemption disabled). Watchers don't
+ * consume signals: kcond_signal_one() notifies all of them and then wakes up
+ * a single waiting task, as usual. Used by epoll.
+ */
+struct kcond_watch {
+
+   struct wait_obj wobj;
+   void (*cb)(struct kcond_watch *w);
+};
+
+void kcond_watch_add(struct kcond *c,
+                     struct kcond_watch *w,
+                     void (*cb)(struct kcond_watch *));
+
+void kcond_watch_remove(struct kcond_watch *w);
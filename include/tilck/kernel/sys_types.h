@@ -97,6 +97,29 @@ struct k_rusage {
    STATIC_ASSERT(sizeof(struct k_rusage) == 136);
 #endif
 
+/* Used by getrlimit() and setrlimit(): RLIM_INFINITY is ~0UL */
+struct k_rlimit {
+
+   ulong rlim_cur;
+   ulong rlim_max;
+};
+
+/* Used by prlimit64() */
+struct k_rlimit64 {
+
+   u64 rlim_cur;
+   u64 rlim_max;
+};
+
+/* Used by epoll_ctl() and epoll_wait(): packed on x86, like on Linux */
+struct k_epoll_event {
+
+   u32 events;
+   u64 data;
+} PACKED;
+
+STATIC_ASSERT(sizeof(struct k_epoll_event) == 12);
+
 /*
  * Classic (old) timespec. Suffers from the Y2038 bug on ALL systems.
  */
@@ -93,6 +93,7 @@ int sys_dup(int oldfd);
 int sys_pipe(int u_pipefd[2]);
 
 ulong sys_times(struct tms *u_buf);
+int sys_getrusage(int who, struct k_rusage *u_usage);
 void *sys_brk(void *vaddr);
 int sys_setgid16(ulong gid);
 int sys_getgid16(void);
@@ -132,9 +133,8 @@ CREATE_STUB_SYSCALL_IMPL(sys_setregid16)
 CREATE_STUB_SYSCALL_IMPL(sys_sigsuspend)
 CREATE_STUB_SYSCALL_IMPL(sys_sigpending)
 CREATE_STUB_SYSCALL_IMPL(sys_sethostname)
-CREATE_STUB_SYSCALL_IMPL(sys_setrlimit)
+int sys_setrlimit(int resource, const struct k_rlimit *u_rlim);
 CREATE_STUB_SYSCALL_IMPL(sys_old_getrlimit)
-CREATE_STUB_SYSCALL_IMPL(sys_getrusage)
 
 int sys_gettimeofday(struct k_timeval *tv, struct timezone *tz);
 
@@ -200,7 +200,8 @@ int sys_newuname(struct utsname *buf);
 
 CREATE_STUB_SYSCALL_IMPL(sys_modify_ldt)
 CREATE_STUB_SYSCALL_IMPL(sys_adjtimex_time32)
-CREATE_STUB_SYSCALL_IMPL(sys_mprotect)
+
+int sys_mprotect(void *addr, size_t len, int prot);
 
 int sys_sigprocmask(ulong a1, ulong a2, ulong a3); // deprecated interface
 
@@ -283,8 +284,10 @@ CREATE_STUB_SYSCALL_IMPL(sys_rt_sigqueueinfo)
 
 int sys_rt_sigsuspend(sigset_t *u_mask, size_t sigsetsize);
 
-CREATE_STUB_SYSCALL_IMPL(sys_pread64)
-CREATE_STUB_SYSCALL_IMPL(sys_pwrite64)
+int sys_pread64(int fd, void *buf, size_t count,
+                size_t pos_low, size_t pos_hi);
+int sys_pwrite64(int fd, const void *buf, size_t count,
+                 size_t pos_low, size_t pos_hi);
 CREATE_STUB_SYSCALL_IMPL(sys_chown16)
 
 int sys_getcwd(char *buf, size_t size);
@@ -292,11 +295,11 @@ int sys_getcwd(char *buf, size_t size);
 CREATE_STUB_SYSCALL_IMPL(sys_capget)
 CREATE_STUB_SYSCALL_IMPL(sys_capset)
 CREATE_STUB_SYSCALL_IMPL(sys_sigaltstack)
-CREATE_STUB_SYSCALL_IMPL(sys_sendfile)
+int sys_sendfile(int out_fd, int in_fd, long *u_off, size_t count);
 
 int sys_vfork(void);
 
-CREATE_STUB_SYSCALL_IMPL(sys_getrlimit)
+int sys_getrlimit(int resource, struct k_rlimit *u_rlim);
 
 long sys_mmap_pgoff(void *addr, size_t length, int prot,
                     int flags, int fd, size_t pgoffset);
@@ -355,7 +358,7 @@ CREATE_STUB_SYSCALL_IMPL(sys_fremovexattr)
 
 int sys_tkill(int tid, int sig);
 
-CREATE_STUB_SYSCALL_IMPL(sys_sendfile64)
+int sys_sendfile64(int out_fd, int in_fd, s64 *u_off, size_t count);
 CREATE_STUB_SYSCALL_IMPL(sys_futex_time32)
 CREATE_STUB_SYSCALL_IMPL(sys_sched_setaffinity)
 CREATE_STUB_SYSCALL_IMPL(sys_sched_getaffinity)
@@ -373,9 +376,14 @@ CREATE_STUB_SYSCALL_IMPL(sys_ia32_fadvise64)
 NORETURN int sys_exit_group(int status);
 
 CREATE_STUB_SYSCALL_IMPL(sys_lookup_dcookie)
-CREATE_STUB_SYSCALL_IMPL(sys_epoll_create)
-CREATE_STUB_SYSCALL_IMPL(sys_epoll_ctl)
-CREATE_STUB_SYSCALL_IMPL(sys_epoll_wait)
+int sys_epoll_create(int size);
+int sys_epoll_ctl(int epfd, int op, int fd, struct k_epoll_event *u_event);
+
+int sys_epoll_wait(int epfd,
+                   struct k_epoll_event *u_events,
+                   int max_events,
+                   int timeout);
+
 CREATE_STUB_SYSCALL_IMPL(sys_remap_file_pages)
 
 // TODO: complete the implementation when thread creation is implemented.
@@ -440,13 +448,22 @@ CREATE_STUB_SYSCALL_IMPL(sys_ppoll)
 CREATE_STUB_SYSCALL_IMPL(sys_unshare)
 CREATE_STUB_SYSCALL_IMPL(sys_set_robust_list)
 CREATE_STUB_SYSCALL_IMPL(sys_get_robust_list)
-CREATE_STUB_SYSCALL_IMPL(sys_splice)
+int sys_splice(int fd_in, s64 *u_off_in,
+               int fd_out, s64 *u_off_out,
+               size_t len, u32 flags);
 CREATE_STUB_SYSCALL_IMPL(sys_ia32_sync_file_range)
-CREATE_STUB_SYSCALL_IMPL(sys_tee)
-CREATE_STUB_SYSCALL_IMPL(sys_vmsplice)
+int sys_tee(int fd_in, int fd_out, size_t len, u32 flags);
+int sys_vmsplice(int fd, const struct iovec *u_iov,
+                 size_t nr_segs, u32 flags);
 CREATE_STUB_SYSCALL_IMPL(sys_move_pages)
 CREATE_STUB_SYSCALL_IMPL(sys_getcpu)
-CREATE_STUB_SYSCALL_IMPL(sys_epoll_pwait)
+
+int sys_epoll_pwait(int epfd,
+                    struct k_epoll_event *u_events,
+                    int max_events,
+                    int timeout,
+                    const sigset_t *u_sigmask,
+                    size_t sigsetsize);
 
 int sys_utimensat_time32(int dirfd, const char *u_path,
                          const struct k_timespec32 times[2], int flags);
@@ -459,21 +476,26 @@ CREATE_STUB_SYSCALL_IMPL(sys_timerfd_settime32)
 CREATE_STUB_SYSCALL_IMPL(sys_timerfd_gettime32)
 CREATE_STUB_SYSCALL_IMPL(sys_signalfd4)
 CREATE_STUB_SYSCALL_IMPL(sys_eventfd2)
-CREATE_STUB_SYSCALL_IMPL(sys_epoll_create1)
+int sys_epoll_create1(int flags);
 CREATE_STUB_SYSCALL_IMPL(sys_dup3)
 
 int sys_pipe2(int u_pipefd[2], int flags);
 
 CREATE_STUB_SYSCALL_IMPL(sys_inotify_init1)
-CREATE_STUB_SYSCALL_IMPL(sys_preadv)
-CREATE_STUB_SYSCALL_IMPL(sys_pwritev)
+int sys_preadv(int fd, const struct iovec *iov, int iovcnt,
+               size_t pos_low, size_t pos_hi);
+int sys_pwritev(int fd, const struct iovec *iov, int iovcnt,
+                size_t pos_low, size_t pos_hi);
 CREATE_STUB_SYSCALL_IMPL(sys_rt_tgsigqueueinfo)
 CREATE_STUB_SYSCALL_IMPL(sys_perf_event_open)
 CREATE_STUB_SYSCALL_IMPL(sys_recvmmsg_time32)
 
 CREATE_STUB_SYSCALL_IMPL(sys_fanotify_init)
 CREATE_STUB_SYSCALL_IMPL(sys_fanotify_mark)
-CREATE_STUB_SYSCALL_IMPL(sys_prlimit64)
+int sys_prlimit64(int pid,
+                  int resource,
+                  const struct k_rlimit64 *u_new_rlim,
+                  struct k_rlimit64 *u_old_rlim);
 CREATE_STUB_SYSCALL_IMPL(sys_name_to_handle_at)
 CREATE_STUB_SYSCALL_IMPL(sys_open_by_handle_at)
 CREATE_STUB_SYSCALL_IMPL(sys_clock_adjtime32)
@@ -512,9 +534,13 @@ CREATE_STUB_SYSCALL_IMPL(sys_shutdown)
 CREATE_STUB_SYSCALL_IMPL(sys_userfaultfd)
 CREATE_STUB_SYSCALL_IMPL(sys_membarrier)
 CREATE_STUB_SYSCALL_IMPL(sys_mlock2)
-CREATE_STUB_SYSCALL_IMPL(sys_copy_file_range)
-CREATE_STUB_SYSCALL_IMPL(sys_preadv2)
-CREATE_STUB_SYSCALL_IMPL(sys_pwritev2)
+int sys_copy_file_range(int fd_in, s64 *u_off_in,
+                        int fd_out, s64 *u_off_out,
+                        size_t len, u32 flags);
+int sys_preadv2(int fd, const struct iovec *iov, int iovcnt,
+                size_t pos_low, size_t pos_hi, int flags);
+int sys_pwritev2(int fd, const struct iovec *iov, int iovcnt,
+                 size_t pos_low, size_t pos_hi, int flags);
 CREATE_STUB_SYSCALL_IMPL(sys_pkey_mprotect)
 CREATE_STUB_SYSCALL_IMPL(sys_pkey_alloc)
 CREATE_STUB_SYSCALL_IMPL(sys_pkey_free)
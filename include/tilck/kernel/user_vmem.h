@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+#include <tilck/kernel/bintree.h>
+
+struct user_vmem_range {
+
+   struct bintree_node node;
+   ulong vaddr;
+   size_t len;
+};
+
+/*
+ * Allocator of virtual address ranges in user space, used by mmap().
+ *
+ * It keeps only the *free* ranges, in an AVL tree ordered by vaddr. Therefore,
+ * its memory footprint depends only on the fragmentation of the address space,
+ * not on its size: there's no metadata to copy for growing and the whole
+ * [begin, end) region is usable from the beginning.
+ */
+struct user_vmem {
+
+   struct user_vmem_range *root;
+   ulong begin;
+   ulong end;
+};
+
+int user_vmem_init(struct user_vmem *uv, ulong begin, ulong end);
+void user_vmem_destroy(struct user_vmem *uv);
+int user_vmem_dup(struct user_vmem *dest, struct user_vmem *src);
+
+/* Returns the vaddr of the allocated range or 0 in case of failure */
+ulong user_vmem_alloc(struct user_vmem *uv, size_t len);
+
+/* Allocate exactly [vaddr, vaddr + len). Returns -ENOMEM if it's not free */
+int user_vmem_alloc_at(struct user_vmem *uv, ulong vaddr, size_t len);
+void user_vmem_free(struct user_vmem *uv, ulong vaddr, size_t len);
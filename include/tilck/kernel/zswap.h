@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#pragma once
+#include <tilck/common/basic_defs.h>
+
+/*
+ * zswap: compressed in-memory swap for cold anonymous user pages.
+ *
+ * When the free kernel heap memory goes below `zswap_min_free_kb`, the zswap
+ * reclaim thread scans the anonymous mappings (and the brk area) of all the
+ * user processes, looking for private pages not accessed since the previous
+ * scan. Such pages get compressed and stored in a kmalloc-backed arena, while
+ * their PTEs are replaced with swap entries. On the next access, the page
+ * fault handler decompresses them back into a fresh page. The same reclaim is
+ * also performed synchronously when a page allocation in the fault path fails.
+ */
+
+struct zswap_stats {
+
+   ulong stored_pages;        /* pages currently swapped-out */
+   ulong zero_pages;          /* swapped-out pages full of zeros */
+   ulong compr_bytes;         /* sum of the compressed sizes of the pages */
+   ulong pool_pages;          /* pages used by zswap, metadata included */
+   ulong compr_ratio;         /* stored_pages / pool_pages (x 100) */
+   ulong swap_outs;           /* total number of pages compressed */
+   ulong swap_ins;            /* total number of swap-in faults */
+   ulong rejected;            /* pages not compressible enough */
+};
+
+extern struct zswap_stats zswap_stats;
+extern ulong zswap_min_free_kb;
+
+void init_zswap(void);
+
+/*
+ * Allocate a page for user space, synchronously reclaiming memory if necessary:
+ * first by dropping the decompressed chunks of the compressed ramdisks (see
+ * crd.h), then with zswap (if MM_ZSWAP is enabled).
+ */
+void *zswap_alloc_page(void);
+
+/* Decompress the page stored in `slot` into `dst` and drop the reference */
+void zswap_swap_in(ulong slot, void *dst);
+
+/* Functions used by the paging code to track the swap entries' references */
+void zswap_slot_get(ulong slot);
+void zswap_slot_put(ulong slot);
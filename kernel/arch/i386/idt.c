@@ -126,16 +126,30 @@ void handle_fault(regs_t *r)
 
    if (LIKELY(int_num == FAULT_PAGE_FAULT)) {
 
-      bool was_cow;
+      bool handled;
 
       enable_interrupts_forced();
       {
-         was_cow = handle_potential_cow(r);
+         handled = handle_potential_swap_in(r) ||
+                   handle_potential_cow(r)     ||
+                   handle_potential_crd_fault(r);
       }
       disable_interrupts_forced();
 
-      if (was_cow)
+      if (handled)
          return;
+
+      if (is_fault_resumable(int_num)) {
+
+         enable_interrupts_forced();
+         {
+            handled = handle_potential_user_mapping_fault(r);
+         }
+         disable_interrupts_forced();
+
+         if (handled)
+            return;
+      }
    }
 
    if (is_fault_resumable(int_num))
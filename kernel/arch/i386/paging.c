@@ -22,6 +22,9 @@
 #include <tilck/kernel/process_mm.h>
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/vdso.h>
+#include <tilck/kernel/zswap.h>
+#include <tilck/kernel/fs/crd.h>
+#include <tilck/kernel/bintree.h>
 
 #include <tilck/mods/tracing.h>
 
@@ -42,6 +45,13 @@
  */
 #define PAGE_SHARED                            (1 << 1)
 
+/*
+ * When this flag is set in the 'avail' bits of a NON-present page_t, it means
+ * that the page has been swapped-out by zswap and that the `pageAddr` field
+ * contains the zswap slot number. The `rw` bit is preserved.
+ */
+#define PAGE_SWAPPED                           (1 << 2)
+
 
 /* ---------------------------------------------- */
 
@@ -96,6 +106,132 @@ pdir_get_page_table(pdir_t *pdir, u32 i)
    return KERNEL_PA_TO_VA(pdir->entries[i].ptaddr << PAGE_SHIFT);
 }
 
+static ALWAYS_INLINE bool is_swap_entry(page_t *p)
+{
+   return !p->present && (p->avail & PAGE_SWAPPED);
+}
+
+static ALWAYS_INLINE ulong swap_entry_slot(page_t *p)
+{
+   return p->pageAddr;
+}
+
+/*
+ * Per-pdir memory accounting nodes, kept in a tree ordered by pdir. The kernel
+ * pdir has no node: it has no user pages to account for.
+ */
+struct pdir_rss_node {
+
+   struct bintree_node node;
+   pdir_t *pdir;
+   struct pdir_mm_stats stats;
+};
+
+static struct pdir_rss_node *pdir_rss_root;
+static struct pdir_rss_node *pdir_rss_cache;     /* last looked-up node */
+
+static struct pdir_rss_node *pdir_rss_get(pdir_t *pdir)
+{
+   struct pdir_rss_node *n = pdir_rss_cache;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (n && n->pdir == pdir)
+      return n;
+
+   n = bintree_find_ptr(pdir_rss_root, pdir, struct pdir_rss_node, node, pdir);
+
+   if (n)
+      pdir_rss_cache = n;
+
+   return n;
+}
+
+static bool pdir_rss_create(pdir_t *pdir, ulong rss)
+{
+   struct pdir_rss_node *n = kzalloc_obj(struct pdir_rss_node);
+
+   if (!n)
+      return false;
+
+   bintree_node_init(&n->node);
+   n->pdir = pdir;
+   n->stats.rss = rss;
+   n->stats.peak_rss = rss;
+
+   disable_preemption();
+   {
+      DEBUG_ONLY_UNSAFE(bool inserted =)
+         bintree_insert_ptr(&pdir_rss_root,
+                            n,
+                            struct pdir_rss_node,
+                            node,
+                            pdir);
+
+      ASSERT(inserted);
+   }
+   enable_preemption();
+   return true;
+}
+
+static void pdir_rss_destroy(pdir_t *pdir)
+{
+   struct pdir_rss_node *n;
+
+   disable_preemption();
+   {
+      n = bintree_remove_ptr(&pdir_rss_root,
+                             pdir,
+                             struct pdir_rss_node,
+                             node,
+                             pdir);
+
+      if (n == pdir_rss_cache)
+         pdir_rss_cache = NULL;
+   }
+   enable_preemption();
+
+   if (n)
+      kfree_obj(n, struct pdir_rss_node);
+}
+
+static ALWAYS_INLINE bool is_rss_page(ulong vaddr, ulong paddr)
+{
+   return vaddr < USERMODE_VADDR_END &&
+          paddr < phys_mem_lim &&
+          paddr != KERNEL_VA_TO_PA(zero_page);
+}
+
+static void pdir_rss_add(pdir_t *pdir, long delta)
+{
+   struct pdir_rss_node *n;
+
+   disable_preemption();
+   {
+      if ((n = pdir_rss_get(pdir))) {
+
+         ASSERT(delta > 0 || n->stats.rss >= (ulong)-delta);
+         n->stats.rss += (ulong)delta;
+         n->stats.peak_rss = MAX(n->stats.peak_rss, n->stats.rss);
+      }
+   }
+   enable_preemption();
+}
+
+void pdir_get_mm_stats(pdir_t *pdir, struct pdir_mm_stats *stats)
+{
+   struct pdir_rss_node *n;
+
+   disable_preemption();
+   {
+      if ((n = pdir_rss_get(pdir)))
+         *stats = n->stats;
+      else
+         bzero(stats, sizeof(*stats));
+   }
+   enable_preemption();
+}
+
 void retain_pageframes_mapped_at(pdir_t *pdir, void *vaddrp, size_t len)
 {
    ASSERT(IS_PAGE_ALIGNED(vaddrp));
@@ -137,6 +273,60 @@ void invalidate_page(ulong vaddr)
    invalidate_page_hw(vaddr);
 }
 
+/*
+ * Flush the whole TLB, global entries included: reloading CR3 is not enough
+ * for them, we need to toggle CR4.PGE instead.
+ */
+static void flush_tlb_all_hw(void)
+{
+   ulong var;
+   ulong cr4;
+
+   disable_interrupts(&var);
+   {
+      cr4 = read_cr4();
+
+      if (cr4 & CR4_PGE) {
+         write_cr4(cr4 & ~CR4_PGE);
+         write_cr4(cr4);
+      } else {
+         __set_curr_pdir(__get_curr_pdir());
+      }
+   }
+   enable_interrupts(&var);
+}
+
+void tlb_gather_flush(struct tlb_gather *tlb)
+{
+   const ulong start = tlb->start;
+   const ulong end = tlb->end;
+
+   if (start >= end)
+      return; /* nothing has been gathered */
+
+   tlb_gather_init(tlb, tlb->pdir);
+
+   if (end <= USERMODE_VADDR_END) {
+
+      if (tlb->pdir != get_curr_pdir())
+         return; /* not the current address space: nothing to flush */
+
+      if (((end - start) >> PAGE_SHIFT) > TLB_FLUSH_ALL_THRESHOLD) {
+         /* User pages are never global: reloading CR3 is enough */
+         __set_curr_pdir(__get_curr_pdir());
+         return;
+      }
+
+   } else if (((end - start) >> PAGE_SHIFT) > TLB_FLUSH_ALL_THRESHOLD) {
+
+      flush_tlb_all_hw();
+      return;
+   }
+
+   for (ulong va = start; va < end; va += PAGE_SIZE)
+      invalidate_page_hw(va);
+}
+
 bool handle_potential_cow(void *context)
 {
    regs_t *r = context;
@@ -164,11 +354,12 @@ bool handle_potential_cow(void *context)
       pt->pages[pt_index].rw = true;
       pt->pages[pt_index].avail = 0;
       invalidate_page_hw(vaddr);
+      get_curr_task()->min_faults++;
       return true;
    }
 
    // Allocate a new page.
-   void *new_page_vaddr = kmalloc(PAGE_SIZE);
+   void *new_page_vaddr = zswap_alloc_page();
 
    if (!new_page_vaddr) {
 
@@ -208,15 +399,378 @@ bool handle_potential_cow(void *context)
    // Decrease the ref-count of the original pageframe.
    pf_ref_count_dec(orig_page_paddr);
 
+   // Copying the zero page makes the process' resident set grow
+   if (orig_page_paddr == KERNEL_VA_TO_PA(zero_page))
+      pdir_rss_add(get_curr_pdir(), 1);
+
    // Re-map the vaddr to its new (writable) pageframe
    pt->pages[pt_index].pageAddr = SHR_BITS(paddr, PAGE_SHIFT, u32);
    pt->pages[pt_index].rw = true;
    pt->pages[pt_index].avail = 0;
 
    invalidate_page_hw(vaddr);
+   get_curr_task()->min_faults++;
    return true;
 }
 
+/*
+ * Handle page faults caused by the kernel while accessing user memory in
+ * fault-resumable code (e.g. copy_from_user()), when the faulting address
+ * belongs to a file mapping whose pages are mapped on-demand. Without that,
+ * syscalls like write() would fail with -EFAULT when called with a buffer
+ * pointing to a not-yet-touched part of a file mapping.
+ */
+bool handle_potential_user_mapping_fault(void *context)
+{
+   regs_t *r = context;
+   struct user_mapping *um;
+   bool ret = false;
+   u32 vaddr;
+
+   asmVolatile("movl %%cr2, %0" : "=r"(vaddr));
+
+   const bool p  = !!(r->err_code & PAGE_FAULT_FL_PRESENT);
+   const bool rw = !!(r->err_code & PAGE_FAULT_FL_RW);
+
+   if (vaddr >= USERMODE_VADDR_END)
+      return false;
+
+   disable_preemption();
+   {
+      um = process_get_user_mapping((void *)vaddr);
+
+      if (um && um->h && (!!(um->prot & PROT_WRITE) || !rw))
+         ret = vfs_handle_fault(um, (void *)vaddr, p, rw);
+   }
+   enable_preemption();
+
+   if (ret)
+      get_curr_task()->min_faults++;
+
+   return ret;
+}
+
+/*
+ * Handle page faults on swap entries, by decompressing the zswap slot into a
+ * new page. It works for both user-space faults and for faults caused by the
+ * kernel while accessing user memory in fault-resumable code.
+ */
+bool handle_potential_swap_in(void *context)
+{
+   regs_t *r = context;
+   page_table_t *pt;
+   page_t *p;
+   void *new_page;
+   ulong paddr;
+   u32 vaddr;
+
+   if (!MM_ZSWAP)
+      return false;
+
+   if (r->err_code & PAGE_FAULT_FL_PRESENT)
+      return false;
+
+   asmVolatile("movl %%cr2, %0" : "=r"(vaddr));
+
+   if (vaddr >= USERMODE_VADDR_END)
+      return false;
+
+   const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
+   const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
+   pdir_t *pdir = get_curr_pdir();
+
+   if (!pdir->entries[pd_index].present)
+      return false;
+
+   pt = pdir_get_page_table(pdir, pd_index);
+   p = &pt->pages[pt_index];
+
+   if (!is_swap_entry(p))
+      return false;
+
+   if (!(new_page = zswap_alloc_page())) {
+
+      if (get_curr_task()->running_in_kernel)
+         return false; /* let the fault-resumable kernel code get the fault */
+
+      printk("Out-of-memory: killing pid %d\n", get_curr_pid());
+      exit_fault_handler_state();
+      terminate_process(0, SIGKILL);
+   }
+
+   disable_preemption();
+
+   if (!is_swap_entry(p)) {
+
+      /* Another thread swapped-in this page, while we were allocating */
+      enable_preemption();
+      kfree2(new_page, PAGE_SIZE);
+      return true;
+   }
+
+   zswap_swap_in(swap_entry_slot(p), new_page);
+
+   paddr = KERNEL_VA_TO_PA(new_page);
+   ASSERT(pf_ref_count_get(paddr) == 0);
+   pf_ref_count_inc(paddr);
+
+   p->raw = paddr | PG_PRESENT_BIT | PG_US_BIT | (p->rw ? PG_RW_BIT : 0);
+   pdir_rss_add(pdir, 1);
+   get_curr_task()->maj_faults++;
+   enable_preemption();
+   return true;
+}
+
+/*
+ * Handle the non-present page faults caused by the kernel while accessing a
+ * compressed ramdisk: the chunk containing `vaddr` gets decompressed and mapped
+ * by crd_handle_fault(). That works in fault-resumable code as well, because
+ * we're called before checking the faults resume mask.
+ */
+bool handle_potential_crd_fault(void *context)
+{
+   regs_t *r = context;
+   u32 vaddr;
+
+   if (r->err_code & (PAGE_FAULT_FL_PRESENT | PAGE_FAULT_FL_US))
+      return false;
+
+   asmVolatile("movl %%cr2, %0" : "=r"(vaddr));
+
+   if (vaddr < LINEAR_MAPPING_END)
+      return false;
+
+   return crd_handle_fault((void *)vaddr);
+}
+
+bool
+test_and_clear_accessed(pdir_t *pdir, void *vaddrp, size_t page_count)
+{
+   struct tlb_gather tlb;
+   bool accessed = false;
+   ulong vaddr = (ulong)vaddrp;
+
+   tlb_gather_init(&tlb, pdir);
+
+   for (size_t i = 0; i < page_count; i++, vaddr += PAGE_SIZE) {
+
+      const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
+      const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
+      page_t *p;
+
+      if (!pdir->entries[pd_index].present || pdir->entries[pd_index].psize)
+         continue;
+
+      p = &pdir_get_page_table(pdir, pd_index)->pages[pt_index];
+
+      if (p->present && p->accessed) {
+         p->accessed = false;
+         tlb_gather_add(&tlb, vaddr);
+         accessed = true;
+      }
+   }
+
+   tlb_gather_flush(&tlb);
+   return accessed;
+}
+
+/*
+ * Return the PTE of `vaddr` if it maps a private user pageframe, not shared
+ * with anybody else (ref-count == 1). Otherwise, return NULL.
+ */
+static page_t *get_private_user_pte(pdir_t *pdir, ulong vaddr)
+{
+   page_table_t *pt;
+   page_t *p;
+   ulong paddr;
+   const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
+   const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
+
+   ASSERT(vaddr < USERMODE_VADDR_END);
+
+   if (!pdir->entries[pd_index].present)
+      return NULL;
+
+   pt = pdir_get_page_table(pdir, pd_index);
+   p = &pt->pages[pt_index];
+
+   if (!p->present || !p->us || (p->avail & PAGE_SHARED))
+      return NULL;
+
+   paddr = (ulong)p->pageAddr << PAGE_SHIFT;
+
+   if (paddr >= phys_mem_lim || paddr == KERNEL_VA_TO_PA(zero_page))
+      return NULL;
+
+   if (pf_ref_count_get(paddr) != 1)
+      return NULL; /* CoW page shared with other processes */
+
+   return p;
+}
+
+enum swap_page_state
+swap_check_page(pdir_t *pdir,
+                void *vaddrp,
+                void **kvaddr_ref,
+                struct tlb_gather *tlb)
+{
+   const ulong vaddr = (ulong) vaddrp;
+   page_t *p = get_private_user_pte(pdir, vaddr);
+
+   if (!p)
+      return SWAP_PAGE_SKIP;
+
+   if (p->accessed) {
+      p->accessed = false;
+      tlb_gather_add(tlb, vaddr);
+      return SWAP_PAGE_HOT;
+   }
+
+   *kvaddr_ref = KERNEL_PA_TO_VA((ulong)p->pageAddr << PAGE_SHIFT);
+   return SWAP_PAGE_COLD;
+}
+
+/*
+ * Replace the mapping of a page found cold by swap_check_page() with a swap
+ * entry. The pageframe is NOT freed: that's up to the caller.
+ */
+void
+set_swap_entry(pdir_t *pdir, void *vaddrp, ulong slot, struct tlb_gather *tlb)
+{
+   page_table_t *pt;
+   page_t *p;
+   ulong paddr;
+   bool rw;
+   const ulong vaddr = (ulong) vaddrp;
+   const u32 pt_index = (vaddr >> PAGE_SHIFT) & 1023;
+   const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
+
+   ASSERT(slot > 0 && slot < (1u << (32 - PAGE_SHIFT)));
+
+   pt = pdir_get_page_table(pdir, pd_index);
+   p = &pt->pages[pt_index];
+   ASSERT(p->present);
+
+   paddr = (ulong)p->pageAddr << PAGE_SHIFT;
+   rw = p->rw || (p->avail & PAGE_COW_ORIG_RW);
+
+   DEBUG_ONLY_UNSAFE(u32 ref_count =)
+      __pf_ref_count_dec(paddr);
+
+   ASSERT(ref_count == 0);
+
+   p->raw = (u32)(slot << PAGE_SHIFT)                    |
+            (u32)(PAGE_SWAPPED << PG_CUSTOM_B0_POS)      |
+            (u32)(rw << PG_RW_BIT_POS)                   |
+            PG_US_BIT;
+
+   pdir_rss_add(pdir, -1);
+   tlb_gather_add(tlb, vaddr);
+}
+
+ulong
+find_private_user_page(pdir_t *pdir, ulong vaddr, ulong end, void **kvaddr_ref)
+{
+   page_t *p;
+
+   ASSERT(IS_PAGE_ALIGNED(vaddr));
+   ASSERT(end <= USERMODE_VADDR_END);
+
+   while (vaddr < end) {
+
+      if (!pdir->entries[vaddr >> BIG_PAGE_SHIFT].present) {
+
+         /* Skip the whole page table */
+         vaddr = ((vaddr >> BIG_PAGE_SHIFT) + 1) << BIG_PAGE_SHIFT;
+         continue;
+      }
+
+      if ((p = get_private_user_pte(pdir, vaddr))) {
+         *kvaddr_ref = KERNEL_PA_TO_VA((ulong)p->pageAddr << PAGE_SHIFT);
+         return vaddr;
+      }
+
+      vaddr += PAGE_SIZE;
+   }
+
+   return end;
+}
+
+void make_page_cow(pdir_t *pdir, void *vaddrp, struct tlb_gather *tlb)
+{
+   const ulong vaddr = (ulong) vaddrp;
+   page_t *p = get_private_user_pte(pdir, vaddr);
+
+   VERIFY(p != NULL);
+
+   if (p->rw) {
+      p->rw = false;
+      p->avail |= PAGE_COW_ORIG_RW;
+   }
+
+   pf_ref_count_inc((ulong)p->pageAddr << PAGE_SHIFT);
+   tlb_gather_add(tlb, vaddr);
+}
+
+void
+replace_with_cow_page(pdir_t *pdir,
+                      void *vaddrp,
+                      void *kvaddr,
+                      struct tlb_gather *tlb)
+{
+   const ulong vaddr = (ulong) vaddrp;
+   const ulong new_paddr = KERNEL_VA_TO_PA(kvaddr);
+   page_t *p = get_private_user_pte(pdir, vaddr);
+   ulong old_paddr;
+   bool rw;
+
+   VERIFY(p != NULL);
+
+   old_paddr = (ulong)p->pageAddr << PAGE_SHIFT;
+   rw = p->rw || (p->avail & PAGE_COW_ORIG_RW);
+
+   ASSERT(old_paddr != new_paddr);
+   ASSERT(pf_ref_count_get(new_paddr) > 0);
+
+   pf_ref_count_inc(new_paddr);
+
+   DEBUG_ONLY_UNSAFE(u32 ref_count =)
+      __pf_ref_count_dec(old_paddr);
+
+   ASSERT(ref_count == 0);
+
+   p->raw = (u32)new_paddr                                         |
+            (u32)((rw ? PAGE_COW_ORIG_RW : 0) << PG_CUSTOM_B0_POS) |
+            PG_PRESENT_BIT                                         |
+            PG_US_BIT;
+
+   if (new_paddr == KERNEL_VA_TO_PA(zero_page))
+      pdir_rss_add(pdir, -1);
+
+   tlb_gather_add(tlb, vaddr);
+   kfree2(KERNEL_PA_TO_VA(old_paddr), PAGE_SIZE);
+}
+
+u32 get_pageframe_ref_count(void *kvaddr)
+{
+   return pf_ref_count_get(KERNEL_VA_TO_PA(kvaddr));
+}
+
+void put_pageframe(void *kvaddr)
+{
+   u32 ref_count;
+
+   /* Decrement and test the ref-count atomically: only one can free it */
+   disable_preemption();
+   {
+      ref_count = pf_ref_count_dec(KERNEL_VA_TO_PA(kvaddr));
+   }
+   enable_preemption();
+
+   if (!ref_count)
+      kfree2(kvaddr, PAGE_SIZE);
+}
+
 static void kernel_page_fault_panic(regs_t *r, u32 vaddr, bool rw, bool p)
 {
    long off = 0;
@@ -252,7 +806,11 @@ void handle_page_fault_int(regs_t *r)
 
    um = process_get_user_mapping((void *)vaddr);
 
-   if (um) {
+   /*
+    * Anonymous mappings (including the private file mappings) have no fault
+    * handler: all their pages are always mapped.
+    */
+   if (um && um->h) {
 
       /*
        * Call vfs_handle_fault() only if in first place the mapping allowed
@@ -260,8 +818,10 @@ void handle_page_fault_int(regs_t *r)
        */
       if (!!(um->prot & PROT_WRITE) || !rw) {
 
-         if (vfs_handle_fault(um, (void *)vaddr, p, rw))
+         if (vfs_handle_fault(um, (void *)vaddr, p, rw)) {
+            get_curr_task()->min_faults++;
             return;
+         }
 
          sig = SIGBUS;
       }
@@ -361,8 +921,88 @@ void set_page_rw(pdir_t *pdir, void *vaddrp, bool rw)
    invalidate_page_hw(vaddr);
 }
 
+size_t
+set_user_pages_rw(pdir_t *pdir,
+                  void *vaddrp,
+                  size_t page_count,
+                  bool rw,
+                  bool shared)
+{
+   const ulong zero_paddr = KERNEL_VA_TO_PA(zero_page);
+   ulong paddr, vaddr = (ulong) vaddrp;
+   struct tlb_gather tlb;
+   size_t not_mapped = 0;
+   page_table_t *pt;
+   page_t *p;
+
+   ASSERT(IS_PAGE_ALIGNED(vaddr));
+   tlb_gather_init(&tlb, pdir);
+
+   for (size_t i = 0; i < page_count; i++, vaddr += PAGE_SIZE) {
+
+      const u32 pd_index = (vaddr >> BIG_PAGE_SHIFT);
+
+      if (!pdir->entries[pd_index].present) {
+         not_mapped++;
+         continue;
+      }
+
+      pt = pdir_get_page_table(pdir, pd_index);
+      p = &pt->pages[(vaddr >> PAGE_SHIFT) & 1023];
+
+      if (is_swap_entry(p)) {
+         p->rw = rw;    /* Swapped-out pages are always private */
+         continue;
+      }
+
+      if (!p->present) {
+         not_mapped++;
+         continue;
+      }
+
+      paddr = (ulong)p->pageAddr << PAGE_SHIFT;
+
+      if (!rw) {
+
+         if (p->rw)
+            tlb_gather_add(&tlb, vaddr);
+
+         p->rw = false;
+         p->avail &= ~PAGE_COW_ORIG_RW;
+         continue;
+      }
+
+      if (p->rw || (p->avail & PAGE_COW_ORIG_RW))
+         continue; /* Already writable */
+
+      if (paddr == zero_paddr && shared)
+         continue; /* A file hole: a write there still has to fault */
+
+      if (shared ||
+          (!(p->avail & PAGE_SHARED) &&
+           paddr != zero_paddr &&
+           pf_ref_count_get(paddr) == 1))
+      {
+         p->rw = true;
+         tlb_gather_add(&tlb, vaddr);
+
+      } else {
+
+         /* The CoW copy will be a private page: drop PAGE_SHARED too */
+         p->avail = PAGE_COW_ORIG_RW;
+      }
+   }
+
+   tlb_gather_flush(&tlb);
+   return not_mapped;
+}
+
 static inline int
-__unmap_page(pdir_t *pdir, void *vaddrp, bool free_pageframe, bool permissive)
+__unmap_page(pdir_t *pdir,
+             void *vaddrp,
+             bool free_pageframe,
+             bool permissive,
+             struct tlb_gather *tlb)
 {
    page_table_t *pt;
    const ulong vaddr = (ulong) vaddrp;
@@ -376,19 +1016,35 @@ __unmap_page(pdir_t *pdir, void *vaddrp, bool free_pageframe, bool permissive)
       if (KERNEL_VA_TO_PA(pt) == 0)
          return -EINVAL;
 
-      if (!pt->pages[pt_index].present)
+      if (!pt->pages[pt_index].present && !is_swap_entry(&pt->pages[pt_index]))
          return -EINVAL;
 
    } else {
       ASSERT(KERNEL_VA_TO_PA(pt) != 0);
-      ASSERT(pt->pages[pt_index].present);
+      ASSERT(pt->pages[pt_index].present ||
+             is_swap_entry(&pt->pages[pt_index]));
+   }
+
+   if (UNLIKELY(is_swap_entry(&pt->pages[pt_index]))) {
+
+      /* Non-present entries are never cached in the TLB: no flush needed */
+      zswap_slot_put(swap_entry_slot(&pt->pages[pt_index]));
+      pt->pages[pt_index].raw = 0;
+      return 0;
    }
 
    const ulong paddr = (ulong)
       pt->pages[pt_index].pageAddr << PAGE_SHIFT;
 
    pt->pages[pt_index].raw = 0;
-   invalidate_page_hw(vaddr);
+
+   if (tlb)
+      tlb_gather_add(tlb, vaddr);
+   else
+      invalidate_page_hw(vaddr);
+
+   if (is_rss_page(vaddr, paddr))
+      pdir_rss_add(pdir, -1);
 
    if (!pf_ref_count_dec(paddr) && free_pageframe) {
       ASSERT(paddr != KERNEL_VA_TO_PA(zero_page));
@@ -401,13 +1057,33 @@ __unmap_page(pdir_t *pdir, void *vaddrp, bool free_pageframe, bool permissive)
 void
 unmap_page(pdir_t *pdir, void *vaddrp, bool free_pageframe)
 {
-   __unmap_page(pdir, vaddrp, free_pageframe, false);
+   __unmap_page(pdir, vaddrp, free_pageframe, false, NULL);
 }
 
 int
 unmap_page_permissive(pdir_t *pdir, void *vaddrp, bool free_pageframe)
 {
-   return __unmap_page(pdir, vaddrp, free_pageframe, true);
+   return __unmap_page(pdir, vaddrp, free_pageframe, true, NULL);
+}
+
+void
+unmap_page_batched(pdir_t *pdir,
+                   void *vaddrp,
+                   bool free_pageframe,
+                   struct tlb_gather *tlb)
+{
+   ASSERT(tlb->pdir == pdir);
+   __unmap_page(pdir, vaddrp, free_pageframe, false, tlb);
+}
+
+int
+unmap_page_permissive_batched(pdir_t *pdir,
+                              void *vaddrp,
+                              bool free_pageframe,
+                              struct tlb_gather *tlb)
+{
+   ASSERT(tlb->pdir == pdir);
+   return __unmap_page(pdir, vaddrp, free_pageframe, true, tlb);
 }
 
 void
@@ -416,9 +1092,18 @@ unmap_pages(pdir_t *pdir,
             size_t page_count,
             bool do_free)
 {
+   struct tlb_gather tlb;
+   tlb_gather_init(&tlb, pdir);
+
    for (size_t i = 0; i < page_count; i++) {
-      unmap_page(pdir, (char *)vaddr + (i << PAGE_SHIFT), do_free);
+      __unmap_page(pdir,
+                   (char *)vaddr + (i << PAGE_SHIFT),
+                   do_free,
+                   false,
+                   &tlb);
    }
+
+   tlb_gather_flush(&tlb);
 }
 
 size_t
@@ -427,18 +1112,22 @@ unmap_pages_permissive(pdir_t *pdir,
                        size_t page_count,
                        bool do_free)
 {
+   struct tlb_gather tlb;
    size_t unmapped_pages = 0;
    int rc;
 
+   tlb_gather_init(&tlb, pdir);
+
    for (size_t i = 0; i < page_count; i++) {
-      rc = unmap_page_permissive(
-         pdir,
-         (char *)vaddr + (i << PAGE_SHIFT),
-         do_free
-      );
+      rc = __unmap_page(pdir,
+                        (char *)vaddr + (i << PAGE_SHIFT),
+                        do_free,
+                        true,
+                        &tlb);
       unmapped_pages += (rc == 0);
    }
 
+   tlb_gather_flush(&tlb);
    return unmapped_pages;
 }
 
@@ -549,6 +1238,10 @@ map_page_int(pdir_t *pdir, void *vaddrp, ulong paddr, u32 hw_flags)
    pt->pages[pt_index].raw = PG_PRESENT_BIT | hw_flags | paddr;
    pf_ref_count_inc(paddr);
    invalidate_page_hw(vaddr);
+
+   if (is_rss_page(vaddr, paddr))
+      pdir_rss_add(pdir, 1);
+
    return 0;
 }
 
@@ -587,7 +1280,14 @@ map_pages_int(pdir_t *pdir,
 
       rem_pages -= pages;
       big_page_flags = hw_flags | PG_4MB_BIT | PG_PRESENT_BIT;
-      big_page_flags &= ~PG_GLOBAL_BIT;
+
+      /*
+       * Kernel big pages (typically the linear mapping) are global like the
+       * regular kernel pages, as long as CR4.PGE is enabled. That way, their
+       * TLB entries survive the CR3 reloads on context switch.
+       */
+      if (!(read_cr4() & CR4_PGE))
+         big_page_flags &= ~PG_GLOBAL_BIT;
 
       for (; big_pages < (rem_pages >> 10); big_pages++) {
          map_4mb_page_int(pdir, vaddr, paddr, big_page_flags);
@@ -731,11 +1431,19 @@ map_pages(pdir_t *pdir,
 
 pdir_t *pdir_clone(pdir_t *pdir)
 {
+   struct pdir_mm_stats stats;
    pdir_t *new_pdir = kalloc_obj(pdir_t);
 
    if (!new_pdir)
       return NULL;
 
+   pdir_get_mm_stats(pdir, &stats);
+
+   if (!pdir_rss_create(new_pdir, stats.rss)) {
+      kfree_obj(new_pdir, pdir_t);
+      return NULL;
+   }
+
    ASSERT(IS_PAGE_ALIGNED(new_pdir));
    memcpy32(new_pdir, pdir, sizeof(pdir_t) / 4);
 
@@ -756,6 +1464,7 @@ pdir_t *pdir_clone(pdir_t *pdir)
                kfree_obj(pdir_get_page_table(pdir, i - 1), page_table_t);
          }
 
+         pdir_rss_destroy(new_pdir);
          kfree_obj(new_pdir, pdir_t);
          return NULL;
       }
@@ -777,8 +1486,13 @@ pdir_t *pdir_clone(pdir_t *pdir)
 
          page_t *const p = &orig_pt->pages[j];
 
-         if (!p->present)
+         if (!p->present) {
+
+            if (is_swap_entry(p))
+               zswap_slot_get(swap_entry_slot(p));
+
             continue;
+         }
 
          const ulong orig_paddr = (ulong)p->pageAddr << PAGE_SHIFT;
 
@@ -810,6 +1524,7 @@ pdir_deep_clone(pdir_t *pdir)
    STATIC_ASSERT(sizeof(page_table_t) == PAGE_SIZE);
 
    struct kmalloc_acc acc;
+   ulong rss = 0;
    kmalloc_create_accelerator(&acc, PAGE_SIZE, 4);
 
    pdir_t *new_pdir = kmalloc_accelerator_get_elem(&acc);
@@ -841,8 +1556,13 @@ pdir_deep_clone(pdir_t *pdir)
 
          new_pt->pages[j].raw = orig_pt->pages[j].raw;
 
-         if (!orig_pt->pages[j].present)
+         if (!orig_pt->pages[j].present) {
+
+            if (is_swap_entry(&orig_pt->pages[j]))
+               zswap_slot_get(swap_entry_slot(&orig_pt->pages[j]));
+
             continue;
+         }
 
          void *new_page = kmalloc_accelerator_get_elem(&acc);
 
@@ -862,6 +1582,7 @@ pdir_deep_clone(pdir_t *pdir)
 
          memcpy32(new_page, orig_page, PAGE_SIZE / 4);
          new_pt->pages[j].pageAddr = SHR_BITS(new_page_paddr, PAGE_SHIFT, u32);
+         rss++;
       }
 
       new_pdir->entries[i].ptaddr =
@@ -872,6 +1593,9 @@ pdir_deep_clone(pdir_t *pdir)
       new_pdir->entries[i].raw = pdir->entries[i].raw;
    }
 
+   if (UNLIKELY(!pdir_rss_create(new_pdir, rss)))
+      goto oom_exit;
+
    kmalloc_destroy_accelerator(&acc);
    return new_pdir;
 
@@ -890,6 +1614,8 @@ void pdir_destroy(pdir_t *pdir)
    // Kernel's pdir cannot be destroyed!
    ASSERT(pdir != __kernel_pdir);
 
+   pdir_rss_destroy(pdir);
+
    for (u32 i = 0; i < KERNEL_BASE_PD_IDX; i++) {
 
       if (!pdir->entries[i].present)
@@ -899,13 +1625,16 @@ void pdir_destroy(pdir_t *pdir)
 
       for (u32 j = 0; j < 1024; j++) {
 
-         if (!pt->pages[j].present)
+         if (!pt->pages[j].present) {
+
+            if (is_swap_entry(&pt->pages[j]))
+               zswap_slot_put(swap_entry_slot(&pt->pages[j]));
+
             continue;
+         }
 
          const ulong paddr = (ulong)pt->pages[j].pageAddr << PAGE_SHIFT;
-
-         if (pf_ref_count_dec(paddr) == 0)
-            kfree2(KERNEL_PA_TO_VA(paddr), PAGE_SIZE);
+         put_pageframe(KERNEL_PA_TO_VA(paddr));
       }
 
       // We freed all the pages, now free the whole page-table.
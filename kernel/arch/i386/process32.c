@@ -21,6 +21,7 @@
 #include <tilck/kernel/irq.h>
 #include <tilck/kernel/user.h>
 #include <tilck/kernel/vdso.h>
+#include <tilck/kernel/elf_utils.h>
 
 #include <tilck/mods/tracing.h>
 
@@ -87,7 +88,9 @@ push_args_on_user_stack(regs_t *r,
                         const char *const *argv,
                         u32 argc,
                         const char *const *env,
-                        u32 envc)
+                        u32 envc,
+                        const ulong *auxv,
+                        u32 auxv_elems)
 {
    ulong pointers[32];
    ulong env_pointers[96];
@@ -110,18 +113,17 @@ push_args_on_user_stack(regs_t *r,
       env_pointers[i] = r->useresp;
    }
 
-   // push the env array (in reverse order)
-
-   push_on_user_stack(r, 0); /*
-                              * 2nd mandatory NULL pointer: after the 'env'
-                              * pointers there could additional aux information
-                              * that some libc implementations check for.
-                              * Therefore, it is essential to add another NULL
-                              * after the env pointers to inform the libc impl
-                              * that no such information exist. For more info,
-                              * check __init_libc() in libmusl.
-                              */
+   /*
+    * Push the auxiliary vector (in reverse order): pairs of (type, value),
+    * terminated by an AT_NULL entry. It's read by the libc (e.g. AT_PHDR for
+    * the TLS initialization, see __init_libc() in libmusl) and by the ELF
+    * interpreter of dynamic executables.
+    */
+   for (u32 i = auxv_elems; i > 0; i--) {
+      push_on_user_stack(r, auxv[i - 1]);
+   }
 
+   // push the env array (in reverse order)
    push_on_user_stack(r, 0); // mandatory final NULL pointer (end of 'env' ptrs)
 
    for (u32 i = envc; i > 0; i--) {
@@ -491,7 +493,21 @@ int setup_process(struct elf_program_info *pinfo,
    while (READ_PTR(&argv[argv_elems])) argv_elems++;
    while (READ_PTR(&env[env_elems])) env_elems++;
 
-   if ((rc = push_args_on_user_stack(r, argv, argv_elems, env, env_elems)))
+   const ulong auxv[] = {
+      AT_PHDR,    (ulong)pinfo->phdrs,
+      AT_PHENT,   sizeof(Elf_Phdr),
+      AT_PHNUM,   pinfo->phnum,
+      AT_PAGESZ,  PAGE_SIZE,
+      AT_BASE,    (ulong)pinfo->interp_base,
+      AT_ENTRY,   (ulong)pinfo->elf_entry,
+      AT_NULL,    0,
+   };
+
+   rc = push_args_on_user_stack(r,
+                                argv, argv_elems,
+                                env, env_elems,
+                                auxv, ARRAY_SIZE(auxv));
+   if (rc)
       goto err;
 
    if (UNLIKELY(!ti)) {
@@ -519,10 +535,14 @@ int setup_process(struct elf_program_info *pinfo,
          process_free_mappings_info(pi);
 
          ASSERT(old_pdir == pi->pdir);
+         process_save_peak_rss(pi);
          pdir_destroy(pi->pdir);
 
          if (pi->elf)
             release_subsys_flock(pi->elf);
+
+         if (pi->elf_interp)
+            release_subsys_flock(pi->elf_interp);
       }
 
       pi->pdir = pinfo->pdir;
@@ -536,6 +556,7 @@ int setup_process(struct elf_program_info *pinfo,
    }
 
    pi->elf = pinfo->lf;
+   pi->elf_interp = pinfo->interp_lf;
    *ti_ref = ti;
    return 0;
 
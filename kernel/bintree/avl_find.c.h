@@ -35,3 +35,40 @@ bintree_find_internal(void *root_obj,
 }
 
 #undef CMP
+
+#if BINTREE_PTR_FUNCS
+
+#define CMP(a, b) bintree_find_ptr_cmp(a, b, field_off)
+
+void *
+bintree_find_ptr_ge_internal(void *root_obj,
+                             const void *value_ptr,
+                             long bintree_offset,
+                             long field_off)
+{
+   void *res = NULL;
+   long c;
+
+   while (root_obj) {
+
+      if (!(c = CMP(root_obj, value_ptr)))
+         return root_obj;
+
+      if (c > 0) {
+
+         // root_obj is bigger than val => it's a candidate, but go left.
+         res = root_obj;
+         root_obj = LEFT_OF(root_obj);
+
+      } else {
+
+         root_obj = RIGHT_OF(root_obj);
+      }
+   }
+
+   return res;
+}
+
+#undef CMP
+
+#endif
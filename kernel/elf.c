@@ -16,6 +16,7 @@
 #include <tilck/kernel/elf_utils.h>
 #include <tilck/kernel/fault_resumable.h>
 #include <tilck/kernel/fs/flock.h>
+#include <tilck/kernel/list.h>
 
 #include <sys/mman.h>      // system header
 
@@ -163,7 +164,15 @@ load_segment_by_mmap(fs_handle *elf_h,
                      Elf_Phdr *phdr,
                      ulong *end_vaddr_ref)
 {
-   if (phdr->p_flags & PF_W)
+   int rc;
+
+   /*
+    * Writable segments need private pages, while read-only segments with a
+    * bss-like tail (p_memsz > p_filesz) need that tail to be zero-filled
+    * instead of containing the next bytes of the file. In both cases, the
+    * file's pages cannot be mapped directly.
+    */
+   if ((phdr->p_flags & PF_W) || phdr->p_memsz > phdr->p_filesz)
       return load_segment_by_copy(elf_h, pdir, phdr, end_vaddr_ref);
 
    if (UNLIKELY(phdr->p_memsz == 0))
@@ -206,7 +215,25 @@ load_segment_by_mmap(fs_handle *elf_h,
    um.prot = PROT_READ;
 
    *end_vaddr_ref = um.vaddr + um.len;
-   return vfs_mmap(&um, pdir, VFS_MM_DONT_REGISTER);
+
+   if ((rc = vfs_mmap(&um, pdir, VFS_MM_DONT_REGISTER | VFS_MM_POPULATE)))
+      return rc;
+
+   /*
+    * Sparse files (e.g. on ramfs) might have holes and the fs won't map any
+    * page for them. Map them as read-only zero pages, because the mapping is
+    * not registered and, therefore, a page fault there couldn't be handled.
+    */
+   for (ulong va = um.vaddr; va < um.vaddr + um.len; va += PAGE_SIZE) {
+
+      if (is_mapped(pdir, (void *)va))
+         continue;
+
+      if ((rc = map_zero_page(pdir, (void *)va, PAGING_FL_US)))
+         return rc;
+   }
+
+   return 0;
 }
 
 struct elf_headers {
@@ -221,8 +248,11 @@ static void free_elf_headers(struct elf_headers *eh)
 {
    ASSERT(eh != NULL);
 
-   if (eh->total_phdrs_size)
+   if (eh->phdrs)
       kfree2(eh->phdrs, eh->total_phdrs_size);
+
+   eh->phdrs = NULL;
+   eh->total_phdrs_size = 0;
 }
 
 static int
@@ -247,7 +277,8 @@ load_elf_headers(fs_handle elf_h,
    if (strncmp((const char *)eh->header->e_ident, ELFMAG, 4))
       return -ENOEXEC;
 
-   if (eh->header->e_type != ET_EXEC)
+   /* ET_DYN is accepted only for ELF interpreters: see load_elf_program() */
+   if (eh->header->e_type != ET_EXEC && eh->header->e_type != ET_DYN)
       return -ENOEXEC;
 
    if (eh->header->e_ident[EI_CLASS] != ELF_CURR_CLASS ||
@@ -305,31 +336,32 @@ alloc_and_map_stack_page(pdir_t *pdir, void *stack_top, u32 i)
 }
 
 static int
-open_elf_file(const char *filepath, fs_handle *elf_file_ref)
+open_elf_file(const char *filepath,
+              fs_handle *elf_file_ref,
+              struct k_stat64 *statbuf)
 {
-   struct k_stat64 statbuf;
    fs_handle h;
    int rc;
 
    if ((rc = vfs_open(filepath, &h, O_RDONLY, 0)))
       return rc;           /* The file does not exist (typical case) */
 
-   if ((rc = vfs_fstat64(h, &statbuf))) {
+   if ((rc = vfs_fstat64(h, statbuf))) {
       vfs_close(h);
       return rc;           /* Cannot stat() the file */
    }
 
-   if ((statbuf.st_mode & S_IFREG) != S_IFREG) {
+   if ((statbuf->st_mode & S_IFREG) != S_IFREG) {
 
       vfs_close(h);
 
-      if ((statbuf.st_mode & S_IFDIR) == S_IFDIR)
+      if ((statbuf->st_mode & S_IFDIR) == S_IFDIR)
          return -EISDIR;   /* Cannot execute a directory! */
 
       return -EACCES;      /* Not a regular file */
    }
 
-   if ((statbuf.st_mode & S_IXUSR) != S_IXUSR) {
+   if ((statbuf->st_mode & S_IXUSR) != S_IXUSR) {
       vfs_close(h);
       return -EACCES;      /* Doesn't have exec permission */
    }
@@ -338,8 +370,8 @@ open_elf_file(const char *filepath, fs_handle *elf_file_ref)
    return 0;
 }
 
-static bool
-is_dyn_exec(struct elf_headers *eh)
+static Elf_Phdr *
+get_interp_phdr(struct elf_headers *eh)
 {
    Elf_Ehdr *hdr = eh->header;
 
@@ -348,10 +380,387 @@ is_dyn_exec(struct elf_headers *eh)
       Elf_Phdr *phdr = eh->phdrs + i;
 
       if (phdr->p_type == PT_INTERP)
-         return true;
+         return phdr;
+   }
+
+   return NULL;
+}
+
+/*
+ * Returns the vaddr where the program headers are mapped in memory (AT_PHDR),
+ * or 0 if they are not part of any loaded segment.
+ */
+static ulong
+get_phdrs_vaddr(struct elf_headers *eh)
+{
+   Elf_Ehdr *hdr = eh->header;
+
+   for (int i = 0; i < hdr->e_phnum; i++) {
+
+      Elf_Phdr *phdr = eh->phdrs + i;
+
+      if (phdr->p_type == PT_PHDR)
+         return phdr->p_vaddr;
+   }
+
+   for (int i = 0; i < hdr->e_phnum; i++) {
+
+      Elf_Phdr *phdr = eh->phdrs + i;
+
+      if (phdr->p_type != PT_LOAD)
+         continue;
+
+      if (IN_RANGE(hdr->e_phoff,
+                   phdr->p_offset,
+                   phdr->p_offset + phdr->p_filesz))
+      {
+         return phdr->p_vaddr + (hdr->e_phoff - phdr->p_offset);
+      }
+   }
+
+   return 0;
+}
+
+/*
+ * Parsed-ELF cache.
+ *
+ * Running the same program over and over (think about a shell script calling
+ * `true` in a loop) means reading and validating its ELF header and program
+ * headers every single time. To avoid that, we keep the already validated
+ * headers of the last ELF_CACHE_MAX_ENTRIES executed programs, keyed by their
+ * (fs, inode) pair. An entry is used only if the file's inode number, size and
+ * mtime did not change since it was created. In addition to that, entries are
+ * dropped as soon as their file is opened for writing or truncated: see the
+ * call of elf_cache_invalidate() in acquire_subsys_flock().
+ *
+ * NOTE: the cache does not hold any reference to the inodes. That's fine, as
+ * the stat checks above prevent a recycled inode object to match a stale entry.
+ */
+
+#define ELF_CACHE_MAX_ENTRIES                                     16
+
+struct elf_cache_entry {
+
+   struct list_node node;
+
+   struct fs *fs;
+   vfs_inode_ptr_t inode;
+   u64 ino;
+   s64 size;
+   s64 mtime_sec;
+   long mtime_nsec;
+
+   size_t phdrs_size;
+   char header_buf[ELF_RAW_HEADER_SIZE];
+   Elf_Phdr phdrs[];
+};
+
+static struct list elf_cache = STATIC_LIST_INIT(elf_cache);
+static u32 elf_cache_entries;
+
+static inline size_t elf_cache_entry_size(struct elf_cache_entry *e)
+{
+   return sizeof(struct elf_cache_entry) + e->phdrs_size;
+}
+
+static void elf_cache_remove_entry(struct elf_cache_entry *e)
+{
+   ASSERT(!is_preemption_enabled());
+   list_remove(&e->node);
+   elf_cache_entries--;
+   kfree2(e, elf_cache_entry_size(e));
+}
+
+static bool
+elf_cache_entry_matches(struct elf_cache_entry *e,
+                        struct fs *fs,
+                        vfs_inode_ptr_t inode,
+                        struct k_stat64 *st)
+{
+   return e->fs == fs &&
+          e->inode == inode &&
+          e->ino == (u64)st->st_ino &&
+          e->size == (s64)st->st_size &&
+          e->mtime_sec == (s64)st->st_mtim.tv_sec &&
+          e->mtime_nsec == (long)st->st_mtim.tv_nsec;
+}
+
+static struct elf_cache_entry *
+elf_cache_find(struct fs *fs, vfs_inode_ptr_t inode)
+{
+   struct elf_cache_entry *pos;
+   ASSERT(!is_preemption_enabled());
+
+   list_for_each_ro(pos, &elf_cache, node) {
+      if (pos->fs == fs && pos->inode == inode)
+         return pos;
+   }
+
+   return NULL;
+}
+
+/*
+ * Fill `eh` and `hdr_buf` using the cache. Returns true in case of a hit.
+ * On a miss, the caller is expected to call load_elf_headers().
+ */
+static bool
+elf_cache_get(fs_handle elf_h,
+              struct k_stat64 *st,
+              char *hdr_buf,
+              struct elf_headers *eh)
+{
+   struct fs *fs = get_fs(elf_h);
+   vfs_inode_ptr_t inode = fs->fsops->get_inode(elf_h);
+   struct elf_cache_entry *e;
+   bool hit = false;
+
+   bzero(eh, sizeof(*eh));
+
+   disable_preemption();
+   {
+      if (!(e = elf_cache_find(fs, inode)))
+         goto out;
+
+      if (!elf_cache_entry_matches(e, fs, inode, st)) {
+         elf_cache_remove_entry(e);    /* stale entry */
+         goto out;
+      }
+
+      if (!(eh->phdrs = kmalloc(e->phdrs_size)))
+         goto out;
+
+      memcpy(eh->phdrs, e->phdrs, e->phdrs_size);
+      memcpy(hdr_buf, e->header_buf, ELF_RAW_HEADER_SIZE);
+      eh->header = (void *)hdr_buf;
+      eh->total_phdrs_size = e->phdrs_size;
+
+      /* Move the entry at the head of the list (most recently used) */
+      list_remove(&e->node);
+      list_add_head(&elf_cache, &e->node);
+      hit = true;
    }
 
-   return false;
+out:
+   enable_preemption();
+   return hit;
+}
+
+static void
+elf_cache_add(fs_handle elf_h,
+              struct k_stat64 *st,
+              char *hdr_buf,
+              struct elf_headers *eh)
+{
+   struct fs *fs = get_fs(elf_h);
+   vfs_inode_ptr_t inode = fs->fsops->get_inode(elf_h);
+   struct elf_cache_entry *e;
+   const size_t sz = sizeof(struct elf_cache_entry) + eh->total_phdrs_size;
+
+   if (!(e = kmalloc(sz)))
+      return;     /* Not a big deal: the cache is just an optimization */
+
+   list_node_init(&e->node);
+   e->fs = fs;
+   e->inode = inode;
+   e->ino = (u64)st->st_ino;
+   e->size = (s64)st->st_size;
+   e->mtime_sec = (s64)st->st_mtim.tv_sec;
+   e->mtime_nsec = (long)st->st_mtim.tv_nsec;
+   e->phdrs_size = eh->total_phdrs_size;
+   memcpy(e->header_buf, hdr_buf, ELF_RAW_HEADER_SIZE);
+   memcpy(e->phdrs, eh->phdrs, eh->total_phdrs_size);
+
+   disable_preemption();
+   {
+      struct elf_cache_entry *old = elf_cache_find(fs, inode);
+
+      if (old)
+         elf_cache_remove_entry(old);
+
+      if (elf_cache_entries == ELF_CACHE_MAX_ENTRIES) {
+
+         /* Evict the least recently used entry */
+         elf_cache_remove_entry(
+            list_last_obj(&elf_cache, struct elf_cache_entry, node)
+         );
+      }
+
+      list_add_head(&elf_cache, &e->node);
+      elf_cache_entries++;
+   }
+   enable_preemption();
+}
+
+void elf_cache_invalidate(struct fs *fs, vfs_inode_ptr_t inode)
+{
+   struct elf_cache_entry *e;
+
+   disable_preemption();
+   {
+      if ((e = elf_cache_find(fs, inode)))
+         elf_cache_remove_entry(e);
+   }
+   enable_preemption();
+}
+
+static int
+get_elf_headers(fs_handle elf_h,
+                struct k_stat64 *st,
+                char *hdr_buf,
+                struct elf_headers *eh,
+                bool *wrong_arch)
+{
+   int rc;
+
+   if (elf_cache_get(elf_h, st, hdr_buf, eh))
+      return 0;
+
+   if ((rc = load_elf_headers(elf_h, hdr_buf, eh, wrong_arch)))
+      return rc;
+
+   elf_cache_add(elf_h, st, hdr_buf, eh);
+   return 0;
+}
+
+/*
+ * Load all the PT_LOAD segments of an ELF file, shifted by `base`. The value
+ * of `base` is 0 for regular executables (ET_EXEC).
+ */
+static int
+load_elf_segments(fs_handle elf_h,
+                  pdir_t *pdir,
+                  struct elf_headers *eh,
+                  ulong base,
+                  ulong *brk_ref)
+{
+   load_segment_func load_seg;
+   ulong brk = 0;
+   int rc;
+
+   load_seg = is_mmap_supported(elf_h)
+      ? &load_segment_by_mmap
+      : &load_segment_by_copy;
+
+   for (int i = 0; i < eh->header->e_phnum; i++) {
+
+      ulong end_vaddr = 0;
+      Elf_Phdr phdr = eh->phdrs[i];
+
+      if (phdr.p_type != PT_LOAD)
+         continue;
+
+      phdr.p_vaddr += base;
+
+      if ((rc = check_segment_alignment(&phdr)))
+         return rc;
+
+      if ((rc = load_seg(elf_h, pdir, &phdr, &end_vaddr)))
+         return rc;
+
+      if (end_vaddr > brk)
+         brk = end_vaddr;
+   }
+
+   *brk_ref = brk;
+   return 0;
+}
+
+static int
+read_interp_path(fs_handle elf_h, Elf_Phdr *phdr, char *buf)
+{
+   ssize_t rc;
+
+   if (!phdr->p_filesz || phdr->p_filesz > MAX_PATH)
+      return -ENOEXEC;
+
+   rc = vfs_seek(elf_h, (s64)phdr->p_offset, SEEK_SET);
+
+   if (rc != (ssize_t)phdr->p_offset)
+      return -ENOEXEC;
+
+   rc = vfs_read(elf_h, buf, phdr->p_filesz);
+
+   if (rc != (ssize_t)phdr->p_filesz)
+      return -ENOEXEC;
+
+   if (buf[phdr->p_filesz - 1] != 0)
+      return -ENOEXEC;  /* The path must be NUL-terminated */
+
+   return 0;
+}
+
+/*
+ * Load the ELF interpreter (e.g. musl's ld.so) requested by the PT_INTERP
+ * segment of a dynamic executable, at USER_INTERP_BASE. The interpreter must
+ * be a position-independent (ET_DYN) ELF file and, as for the executable, its
+ * read-only segments are mapped directly from the file when the fs supports
+ * that. That way, the text pages of libc are shared among all the processes.
+ */
+static int
+load_elf_interp(fs_handle elf_h,
+                Elf_Phdr *interp_phdr,
+                struct elf_program_info *pinfo)
+{
+   char hdr_buf[ELF_RAW_HEADER_SIZE];
+   struct k_stat64 statbuf;
+   struct elf_headers eh = {0};
+   bool wrong_arch = false;
+   fs_handle h = NULL;
+   ulong end;
+   char *path;
+   int rc;
+
+   if (!(path = kmalloc(MAX_PATH)))
+      return -ENOMEM;
+
+   if (!(rc = read_interp_path(elf_h, interp_phdr, path)))
+      rc = open_elf_file(path, &h, &statbuf);
+
+   kfree2(path, MAX_PATH);
+
+   if (rc)
+      return rc;
+
+   if ((rc = acquire_subsys_flock_h(h, SUBSYS_PROCMGNT, &pinfo->interp_lf))) {
+      rc = rc == -EBADF ? -ENOEXEC : rc;
+      goto out;
+   }
+
+   if ((rc = get_elf_headers(h, &statbuf, hdr_buf, &eh, &wrong_arch)))
+      goto out;
+
+   if (eh.header->e_type != ET_DYN || get_interp_phdr(&eh)) {
+      rc = -ENOEXEC;
+      goto out;
+   }
+
+   for (int i = 0; i < eh.header->e_phnum; i++) {
+
+      Elf_Phdr *phdr = eh.phdrs + i;
+
+      if (phdr->p_type != PT_LOAD)
+         continue;
+
+      if (phdr->p_memsz > USER_INTERP_MAX_SIZE ||
+          phdr->p_vaddr > USER_INTERP_MAX_SIZE - phdr->p_memsz)
+      {
+         rc = -ENOEXEC;    /* The interpreter is too big */
+         goto out;
+      }
+   }
+
+   rc = load_elf_segments(h, pinfo->pdir, &eh, USER_INTERP_BASE, &end);
+
+   if (rc)
+      goto out;
+
+   pinfo->interp_base = (void *)USER_INTERP_BASE;
+   pinfo->entry = (void *)(USER_INTERP_BASE + eh.header->e_entry);
+
+out:
+   vfs_close(h);
+   free_elf_headers(&eh);
+   return rc;
 }
 
 int
@@ -359,9 +768,10 @@ load_elf_program(const char *filepath,
                  char *header_buf,
                  struct elf_program_info *pinfo)
 {
-   load_segment_func load_seg = NULL;
    fs_handle elf_h = NULL;
-   struct elf_headers eh;
+   Elf_Phdr *interp_phdr;
+   struct k_stat64 statbuf;
+   struct elf_headers eh = {0};
    ulong brk = 0;
    size_t count;
    int rc;
@@ -369,7 +779,7 @@ load_elf_program(const char *filepath,
    pinfo->wrong_arch = false;
    pinfo->dyn_exec = false;
 
-   if ((rc = open_elf_file(filepath, &elf_h)))
+   if ((rc = open_elf_file(filepath, &elf_h, &statbuf)))
       return rc;
 
    if ((rc = acquire_subsys_flock_h(elf_h, SUBSYS_PROCMGNT, &pinfo->lf))) {
@@ -377,20 +787,15 @@ load_elf_program(const char *filepath,
       return rc == -EBADF ? -ENOEXEC : rc;
    }
 
-   if ((rc = load_elf_headers(elf_h, header_buf, &eh, &pinfo->wrong_arch))) {
-      vfs_close(elf_h);
-      return rc;
-   }
+   rc = get_elf_headers(elf_h, &statbuf, header_buf, &eh, &pinfo->wrong_arch);
 
-   if (is_dyn_exec(&eh)) {
-      pinfo->dyn_exec = true;
-      rc = -ENOEXEC;
+   if (rc)
       goto out;
-   }
 
-   load_seg = is_mmap_supported(elf_h)
-      ? &load_segment_by_mmap
-      : &load_segment_by_copy;
+   if (eh.header->e_type != ET_EXEC) {
+      rc = -ENOEXEC;       /* PIE executables are not supported */
+      goto out;
+   }
 
    ASSERT(pinfo->pdir == NULL);
 
@@ -399,26 +804,22 @@ load_elf_program(const char *filepath,
       goto out;
    }
 
-   for (int i = 0; i < eh.header->e_phnum; i++) {
-
-      ulong end_vaddr = 0;
-      Elf_Phdr *phdr = eh.phdrs + i;
+   if ((rc = load_elf_segments(elf_h, pinfo->pdir, &eh, 0, &brk)))
+      goto out;
 
-      if (phdr->p_type != PT_LOAD)
-         continue;
+   pinfo->entry = (void *) eh.header->e_entry;
 
-      rc = check_segment_alignment(phdr);
+   if ((interp_phdr = get_interp_phdr(&eh))) {
 
-      if (rc < 0)
+      if (brk > USER_INTERP_BASE) {
+         rc = -ENOEXEC;    /* The program overlaps with the interpreter */
          goto out;
+      }
 
-      rc = load_seg(elf_h, pinfo->pdir, phdr, &end_vaddr);
-
-      if (rc < 0)
+      if ((rc = load_elf_interp(elf_h, interp_phdr, pinfo))) {
+         pinfo->dyn_exec = true;
          goto out;
-
-      if (end_vaddr > brk)
-         brk = end_vaddr;
+      }
    }
 
    /*
@@ -456,8 +857,10 @@ load_elf_program(const char *filepath,
    // Finally setting the output-params.
 
    pinfo->stack = (void *) USERMODE_STACK_MAX;
-   pinfo->entry = (void *) eh.header->e_entry;
    pinfo->brk = (void *) brk;
+   pinfo->elf_entry = (void *) eh.header->e_entry;
+   pinfo->phdrs = (void *) get_phdrs_vaddr(&eh);
+   pinfo->phnum = eh.header->e_phnum;
 
 out:
    vfs_close(elf_h);
@@ -470,8 +873,15 @@ out:
          pinfo->pdir = NULL;
       }
 
-      if (pinfo->lf)
+      if (pinfo->interp_lf) {
+         release_subsys_flock(pinfo->interp_lf);
+         pinfo->interp_lf = NULL;
+      }
+
+      if (pinfo->lf) {
          release_subsys_flock(pinfo->lf);
+         pinfo->lf = NULL;
+      }
    }
 
    return rc;
@@ -0,0 +1,632 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_userlim.h>
+#include <tilck/common/basic_defs.h>
+
+#include <tilck/kernel/epoll.h>
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/fs/kernelfs.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/bintree.h>
+#include <tilck/kernel/sync.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/kernel/user.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/signal.h>
+#include <tilck/kernel/syscalls.h>
+
+#include <sys/epoll.h>      // system header
+
+/*
+ * epoll: the interest list is persistent and each registration (epoll_item)
+ * watches the readiness kconds of its file (see struct kcond_watch). When one
+ * of them is signaled, the item is appended to the `ready_list` of its epoll
+ * instance, directly from the wakeup path. Therefore, epoll_wait() checks only
+ * the items on that list, instead of re-scanning all the watched files.
+ *
+ * Locking
+ * ---------
+ *
+ *    - `epoll_mutex` protects the interest lists (all the instances and all
+ *      the items, indexed by handle in `items_root`), like Linux's epmutex.
+ *
+ *    - the `ready_list` of each instance is protected by disabling the
+ *      preemption, because the kcond watchers' callbacks run in that context.
+ *
+ * Limitations
+ * -------------
+ *
+ *    - each item refers to a file *handle*. Therefore, when the handle is
+ *      closed, its items are removed even if other handles (e.g. dup-ed fds)
+ *      referring to the same file are still open.
+ *
+ *    - epoll instances cannot be nested.
+ */
+
+/* The events reported only when requested: the others are always reported */
+#define EPOLL_REQ_EVENTS       (EPOLLIN | EPOLLOUT)
+#define EPOLL_IN_EVENTS        (EPOLLIN | EPOLLRDNORM | EPOLLRDBAND | EPOLLPRI)
+#define EPOLL_OUT_EVENTS       (EPOLLOUT | EPOLLWRNORM | EPOLLWRBAND)
+
+struct epoll {
+
+   KOBJ_BASE_FIELDS
+
+   struct list items;            /* the interest list */
+   struct list ready_list;       /* items which might be ready */
+   struct kcond wait_cond;       /* signaled when an item becomes ready */
+};
+
+struct epoll_key {
+
+   fs_handle h;
+   struct epoll *ep;
+};
+
+struct epoll_item {
+
+   struct epoll_key key;         /* MUST be first: see the cmp funcs */
+   u32 events;                   /* requested events + EPOLLET/EPOLLONESHOT */
+   u64 data;
+
+   struct bintree_node tree_node;   /* node in `items_root` */
+   struct list_node node;           /* node in ep->items */
+   struct list_node ready_node;     /* node in ep->ready_list */
+
+   struct kcond_watch rwatch;
+   struct kcond_watch wwatch;
+   struct kcond_watch ewatch;
+};
+
+static struct kmutex epoll_mutex = STATIC_KMUTEX_INIT(epoll_mutex, 0);
+static struct epoll_item *items_root;
+static const struct file_ops static_ops_epoll;
+
+/* Compare an item with an epoll_key (or with another item) */
+static long epoll_item_cmp(const void *obj, const void *value)
+{
+   const struct epoll_key *a = obj;
+   const struct epoll_key *b = value;
+
+   if (a->h != b->h)
+      return (char *)a->h < (char *)b->h ? -1 : 1;
+
+   if (a->ep != b->ep)
+      return (char *)a->ep < (char *)b->ep ? -1 : 1;
+
+   return 0;
+}
+
+/* Compare an item with a handle: all the items of the handle are "equal" */
+static long epoll_item_handle_cmp(const void *obj, const void *value)
+{
+   const struct epoll_key *a = obj;
+
+   if (a->h != value)
+      return (char *)a->h < (char *)value ? -1 : 1;
+
+   return 0;
+}
+
+bool is_epoll_handle(fs_handle h)
+{
+   struct fs_handle_base *hb = h;
+   return hb->fops == &static_ops_epoll;
+}
+
+static inline struct epoll *epoll_of(fs_handle h)
+{
+   return (struct epoll *)((struct kfs_handle *)h)->kobj;
+}
+
+/* Called by the kcond watchers, with preemption disabled */
+static void epoll_item_signaled(struct epoll_item *it)
+{
+   struct epoll *ep = it->key.ep;
+   ASSERT(!is_preemption_enabled());
+
+   if (!(it->events & EPOLL_REQ_EVENTS))
+      return; /* disabled by EPOLLONESHOT */
+
+   if (!list_is_node_in_list(&it->ready_node))
+      list_add_tail(&ep->ready_list, &it->ready_node);
+
+   kcond_signal_all(&ep->wait_cond);
+}
+
+static void epoll_rwatch_cb(struct kcond_watch *w)
+{
+   epoll_item_signaled(CONTAINER_OF(w, struct epoll_item, rwatch));
+}
+
+static void epoll_wwatch_cb(struct kcond_watch *w)
+{
+   epoll_item_signaled(CONTAINER_OF(w, struct epoll_item, wwatch));
+}
+
+static void epoll_ewatch_cb(struct kcond_watch *w)
+{
+   epoll_item_signaled(CONTAINER_OF(w, struct epoll_item, ewatch));
+}
+
+static void epoll_item_watch(struct epoll_item *it)
+{
+   struct kcond *c;
+
+   if ((it->events & EPOLLIN) && (c = vfs_get_rready_cond(it->key.h)))
+      kcond_watch_add(c, &it->rwatch, &epoll_rwatch_cb);
+
+   if ((it->events & EPOLLOUT) && (c = vfs_get_wready_cond(it->key.h)))
+      kcond_watch_add(c, &it->wwatch, &epoll_wwatch_cb);
+
+   if ((c = vfs_get_except_cond(it->key.h)))
+      kcond_watch_add(c, &it->ewatch, &epoll_ewatch_cb);
+
+   /* Check the current state of the file in the next epoll_wait() */
+   disable_preemption();
+   {
+      epoll_item_signaled(it);
+   }
+   enable_preemption();
+}
+
+static void epoll_item_unwatch(struct epoll_item *it)
+{
+   /* After this, the callbacks cannot be called anymore */
+   kcond_watch_remove(&it->rwatch);
+   kcond_watch_remove(&it->wwatch);
+   kcond_watch_remove(&it->ewatch);
+
+   disable_preemption();
+   {
+      if (list_is_node_in_list(&it->ready_node))
+         list_remove(&it->ready_node);
+
+      list_node_init(&it->ready_node);
+   }
+   enable_preemption();
+}
+
+/* Returns the events currently ready for `it`, checking the file */
+static u32 epoll_item_poll(struct epoll_item *it)
+{
+   u32 revents = 0;
+   int rc;
+
+   if (!(it->events & EPOLL_REQ_EVENTS))
+      return 0; /* disabled by EPOLLONESHOT */
+
+   if ((it->events & EPOLLIN) && vfs_read_ready(it->key.h))
+      revents |= EPOLLIN;
+
+   if ((it->events & EPOLLOUT) && vfs_write_ready(it->key.h))
+      revents |= EPOLLOUT;
+
+   /* Like poll(), epoll always reports the exceptional conditions */
+   if ((rc = vfs_except_ready(it->key.h)))
+      revents |= rc > 0 ? (u32)rc : EPOLLERR;
+
+   return revents;
+}
+
+static struct epoll_item *epoll_find_item(struct epoll *ep, fs_handle h)
+{
+   struct epoll_key key = { .h = h, .ep = ep };
+   ASSERT(kmutex_is_curr_task_holding_lock(&epoll_mutex));
+
+   return bintree_find(items_root,
+                       &key,
+                       epoll_item_cmp,
+                       struct epoll_item,
+                       tree_node);
+}
+
+static void epoll_free_item(struct epoll_item *it)
+{
+   struct epoll_item *removed;
+   ASSERT(kmutex_is_curr_task_holding_lock(&epoll_mutex));
+
+   epoll_item_unwatch(it);
+
+   removed = bintree_remove(&items_root,
+                            &it->key,
+                            epoll_item_cmp,
+                            struct epoll_item,
+                            tree_node);
+
+   ASSERT(removed == it);
+   list_remove(&it->node);
+   kfree_obj(it, struct epoll_item);
+}
+
+static int
+epoll_add_item(struct epoll *ep, fs_handle h, struct k_epoll_event *ev)
+{
+   struct fs_handle_base *hb = h;
+   struct epoll_item *it;
+   DEBUG_ONLY_UNSAFE(bool inserted);
+
+   if (!(it = kzalloc_obj(struct epoll_item)))
+      return -ENOMEM;
+
+   it->key.h = h;
+   it->key.ep = ep;
+   it->events = ev->events;
+   it->data = ev->data;
+   bintree_node_init(&it->tree_node);
+   list_node_init(&it->node);
+   list_node_init(&it->ready_node);
+
+   DEBUG_ONLY_UNSAFE(inserted =)
+      bintree_insert(&items_root,
+                     it,
+                     epoll_item_cmp,
+                     struct epoll_item,
+                     tree_node);
+
+   ASSERT(inserted);
+   list_add_tail(&ep->items, &it->node);
+   hb->spec_flags |= VFS_SPFL_EPOLL;
+
+   epoll_item_watch(it);
+   return 0;
+}
+
+static void
+epoll_mod_item(struct epoll_item *it, struct k_epoll_event *ev)
+{
+   epoll_item_unwatch(it);
+   it->events = ev->events;
+   it->data = ev->data;
+   epoll_item_watch(it);
+}
+
+void epoll_remove_handle(fs_handle h)
+{
+   struct fs_handle_base *hb = h;
+   struct epoll_item *it;
+
+   kmutex_lock(&epoll_mutex);
+   {
+      while ((it = bintree_find(items_root,
+                                h,
+                                epoll_item_handle_cmp,
+                                struct epoll_item,
+                                tree_node)))
+      {
+         epoll_free_item(it);
+      }
+
+      hb->spec_flags &= ~VFS_SPFL_EPOLL;
+   }
+   kmutex_unlock(&epoll_mutex);
+}
+
+static void epoll_destroy(struct epoll *ep)
+{
+   struct epoll_item *it, *temp;
+
+   kmutex_lock(&epoll_mutex);
+   {
+      list_for_each(it, temp, &ep->items, node) {
+         epoll_free_item(it);
+      }
+   }
+   kmutex_unlock(&epoll_mutex);
+
+   kcond_destory(&ep->wait_cond);
+   kfree_obj(ep, struct epoll);
+}
+
+static int epoll_read_ready(fs_handle h)
+{
+   struct epoll *ep = epoll_of(h);
+   bool ret;
+
+   disable_preemption();
+   {
+      ret = !list_is_empty(&ep->ready_list);
+   }
+   enable_preemption();
+   return ret;
+}
+
+static struct kcond *epoll_get_rready_cond(fs_handle h)
+{
+   return &epoll_of(h)->wait_cond;
+}
+
+static int epoll_write_ready(fs_handle h)
+{
+   return false;
+}
+
+static const struct file_ops static_ops_epoll =
+{
+   .read_ready = epoll_read_ready,
+   .write_ready = epoll_write_ready,
+   .get_rready_cond = epoll_get_rready_cond,
+};
+
+fs_handle epoll_create_handle(void)
+{
+   struct epoll *ep;
+   fs_handle h;
+
+   if (!(ep = kzalloc_obj(struct epoll)))
+      return NULL;
+
+   ep->destory_obj = (void *)&epoll_destroy;
+   list_init(&ep->items);
+   list_init(&ep->ready_list);
+   kcond_init(&ep->wait_cond);
+
+   if (!(h = kfs_create_new_handle(&static_ops_epoll, (void *)ep, O_RDONLY))) {
+      kcond_destory(&ep->wait_cond);
+      kfree_obj(ep, struct epoll);
+   }
+
+   return h;
+}
+
+static int
+epoll_ctl_int(struct epoll *ep, int op, fs_handle h, struct k_epoll_event *ev)
+{
+   struct epoll_item *it = epoll_find_item(ep, h);
+
+   switch (op) {
+
+      case EPOLL_CTL_ADD:
+
+         if (it)
+            return -EEXIST;
+
+         return epoll_add_item(ep, h, ev);
+
+      case EPOLL_CTL_MOD:
+
+         if (!it)
+            return -ENOENT;
+
+         epoll_mod_item(it, ev);
+         return 0;
+
+      case EPOLL_CTL_DEL:
+
+         if (!it)
+            return -ENOENT;
+
+         epoll_free_item(it);
+         return 0;
+
+      default:
+         return -EINVAL;
+   }
+}
+
+int sys_epoll_ctl(int epfd, int op, int fd, struct k_epoll_event *u_event)
+{
+   struct k_epoll_event ev = {0};
+   fs_handle eph, h;
+   int rc;
+
+   if (!(eph = get_fs_handle(epfd)) || !(h = get_fs_handle(fd)))
+      return -EBADF;
+
+   if (!is_epoll_handle(eph) || is_epoll_handle(h))
+      return -EINVAL;
+
+   /* Files without readiness conditions (e.g. regular files) can't be used */
+   if (!vfs_get_rready_cond(h) &&
+       !vfs_get_wready_cond(h) &&
+       !vfs_get_except_cond(h))
+   {
+      return -EPERM;
+   }
+
+   if (op != EPOLL_CTL_DEL) {
+
+      if (copy_from_user(&ev, u_event, sizeof(ev)))
+         return -EFAULT;
+
+      /* Treat all the IN events as EPOLLIN, and the OUT ones as EPOLLOUT */
+      if (ev.events & EPOLL_IN_EVENTS)
+         ev.events |= EPOLLIN;
+
+      if (ev.events & EPOLL_OUT_EVENTS)
+         ev.events |= EPOLLOUT;
+
+      ev.events &= EPOLL_REQ_EVENTS | EPOLLET | EPOLLONESHOT;
+   }
+
+   kmutex_lock(&epoll_mutex);
+   {
+      rc = epoll_ctl_int(epoll_of(eph), op, h, &ev);
+   }
+   kmutex_unlock(&epoll_mutex);
+   return rc;
+}
+
+/*
+ * Check the items on the ready list, filling `evs` with the ready ones. The
+ * level-triggered items reported are moved back at the end of the list, in
+ * order to be checked again by the next call. The others are not: they will
+ * be added back by their watchers, when their files signal a new event.
+ */
+static int
+epoll_collect(struct epoll *ep, struct k_epoll_event *evs, int max_events)
+{
+   struct epoll_item *it, *temp;
+   struct list requeue;
+   u32 revents;
+   int cnt = 0;
+
+   ASSERT(kmutex_is_curr_task_holding_lock(&epoll_mutex));
+   list_init(&requeue);
+
+   while (cnt < max_events) {
+
+      disable_preemption();
+      {
+         if (list_is_empty(&ep->ready_list)) {
+            enable_preemption();
+            break;
+         }
+
+         it = list_first_obj(&ep->ready_list, struct epoll_item, ready_node);
+         list_remove(&it->ready_node);
+         list_node_init(&it->ready_node);
+      }
+      enable_preemption();
+
+      if (!(revents = epoll_item_poll(it)))
+         continue; /* not ready anymore */
+
+      evs[cnt].events = revents;
+      evs[cnt].data = it->data;
+      cnt++;
+
+      if (it->events & EPOLLONESHOT) {
+
+         /* Disable the item, until it's re-armed with EPOLL_CTL_MOD */
+         it->events &= ~EPOLL_REQ_EVENTS;
+
+      } else if (!(it->events & EPOLLET)) {
+
+         disable_preemption();
+         {
+            list_add_tail(&requeue, &it->ready_node);
+         }
+         enable_preemption();
+      }
+   }
+
+   disable_preemption();
+   {
+      list_for_each(it, temp, &requeue, ready_node) {
+         list_remove(&it->ready_node);
+         list_add_tail(&ep->ready_list, &it->ready_node);
+      }
+   }
+   enable_preemption();
+   return cnt;
+}
+
+static int
+epoll_wait_int(struct epoll *ep,
+               struct k_epoll_event *evs,
+               int max_events,
+               int timeout)
+{
+   struct task *curr = get_curr_task();
+   u64 deadline = 0, now;
+   int cnt;
+
+   if (timeout > 0)
+      deadline = get_ticks() + MAX((u32)timeout / (1000 / TIMER_HZ), 1u);
+
+   while (true) {
+
+      kmutex_lock(&epoll_mutex);
+      {
+         cnt = epoll_collect(ep, evs, max_events);
+      }
+      kmutex_unlock(&epoll_mutex);
+
+      if (cnt > 0 || !timeout)
+         return cnt;
+
+      if (pending_signals())
+         return -EINTR;
+
+      now = get_ticks();
+
+      if (timeout > 0 && now >= deadline)
+         return 0;
+
+      disable_preemption();
+
+      if (!list_is_empty(&ep->ready_list) || pending_signals()) {
+         enable_preemption();
+         continue;
+      }
+
+      prepare_to_wait_on(WOBJ_KCOND,
+                         &ep->wait_cond,
+                         NO_EXTRA,
+                         &ep->wait_cond.wait_list);
+
+      if (timeout > 0)
+         task_set_wakeup_timer(curr, (u32)(deadline - now));
+
+      enter_sleep_wait_state();
+
+      /*
+       * If we woke up because of the timeout or a signal, the wait obj is
+       * still set: reset it. Then, in any case, check the ready list again.
+       */
+      wait_obj_reset(&curr->wobj);
+
+      if (timeout > 0)
+         task_cancel_wakeup_timer(curr);
+   }
+}
+
+int sys_epoll_pwait(int epfd,
+                    struct k_epoll_event *u_events,
+                    int max_events,
+                    int timeout,
+                    const sigset_t *u_sigmask,
+                    size_t sigsetsize)
+{
+   struct task *curr = get_curr_task();
+   struct k_epoll_event *evs = curr->args_copybuf;
+   fs_handle eph;
+   int rc;
+
+   if (max_events <= 0)
+      return -EINVAL;
+
+   if (!(eph = get_fs_handle(epfd)))
+      return -EBADF;
+
+   if (!is_epoll_handle(eph))
+      return -EINVAL;
+
+   /* Returning less events than the available ones is always fine */
+   max_events = MIN(max_events, (int)(ARGS_COPYBUF_SIZE / sizeof(*evs)));
+
+   if (u_sigmask) {
+
+      /* Like in sys_rt_sigsuspend(): nested signal handlers are unsupported */
+      if (curr->nested_sig_handlers > 0)
+         return -EPERM;
+
+      if ((rc = set_temp_sigmask(u_sigmask, sigsetsize)))
+         return rc;
+   }
+
+   rc = epoll_wait_int(epoll_of(eph), evs, max_events, timeout);
+
+   if (u_sigmask) {
+
+      if (rc == -EINTR)
+         curr->in_sigsuspend = true; /* restore it after the signal handler */
+      else
+         restore_temp_sigmask();
+   }
+
+   if (rc > 0 && copy_to_user(u_events, evs, sizeof(*evs) * (size_t)rc))
+      return -EFAULT;
+
+   return rc;
+}
+
+int sys_epoll_wait(int epfd,
+                   struct k_epoll_event *u_events,
+                   int max_events,
+                   int timeout)
+{
+   return sys_epoll_pwait(epfd, u_events, max_events, timeout, NULL, 0);
+}
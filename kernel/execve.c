@@ -294,18 +294,14 @@ handle_noexec(struct elf_program_info *pinfo, const char *path)
      /*
       * [BE_NICE]
       *
-      * Since Tilck has no support for dynamic executables, in this case it
-      * will ignore the INTERP segment and it will jump directly to ELF's entry
-      * point, instead of jumping to dynamic linker's entry point. Therefore,
-      * at the first access to a symbol not in the ELF file itself we'll get a
-      * SIGSEGV.
-      *
-      * In order to avoid wasting people's time debugging why a given program
-      * crashes on Tilck, but not on Linux, it's nice to fail early, and display
-      * a meaningful message.
+      * The ELF interpreter (ld.so) of this dynamic executable exists, but it
+      * could not be loaded (e.g. it's not an ET_DYN ELF file or it's too big).
+      * Like in the wrong arch case above, it's nice to fail early displaying
+      * a meaningful message, instead of letting the shell interpret the ELF
+      * file as a script.
       */
 
-      printk("ERROR: Pid %d tried to execute a dynamic executable: %s\n",
+      printk("ERROR: Pid %d cannot load the ELF interpreter of: %s\n",
              get_curr_pid(), path);
 
       term_sig = SIGKILL;
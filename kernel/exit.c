@@ -100,14 +100,16 @@ static void
 close_all_handles(void)
 {
    struct process *pi = get_curr_proc();
+   int fd;
+
    ASSERT(is_preemption_enabled());
 
-   for (int i = 0; i < MAX_HANDLES; i++) {
-      if (pi->handles[i]) {
-         vfs_close(pi->handles[i]);
-         pi->handles[i] = NULL;
-      }
+   fdt_for_each_fd(&pi->fdt, fd) {
+      vfs_close(pi->fdt.handles[fd]);
+      fdt_set(&pi->fdt, fd, NULL);
    }
+
+   fdt_destroy(&pi->fdt);
 }
 
 struct on_task_exit_cb {
@@ -273,6 +275,9 @@ void terminate_process(int exit_code, int term_sig)
 
       if (pi->elf)
          release_subsys_flock(pi->elf);
+
+      if (pi->elf_interp)
+         release_subsys_flock(pi->elf_interp);
    }
 
    if (LIKELY(ti->tid != 1)) {
@@ -332,8 +337,10 @@ void terminate_process(int exit_code, int term_sig)
 
    set_curr_pdir(get_kernel_pdir());
 
-   if (!vforked)
+   if (!vforked) {
+      process_save_peak_rss(pi);
       pdir_destroy(pi->pdir);
+   }
 
    switch_stack_free_mem_and_schedule();
 }
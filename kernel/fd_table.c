@@ -0,0 +1,232 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/assert.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/fd_table.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/errno.h>
+
+/*
+ * NOTE: the last word of `open_map` might be partially used (size % NBITS != 0).
+ * Its bits beyond `size` are always 0, therefore such a word is never "full".
+ */
+static inline u32 fdt_words(u32 size)
+{
+   return (size + NBITS - 1) / NBITS;
+}
+
+static inline u32 fdt_full_words(u32 size)
+{
+   return (fdt_words(size) + NBITS - 1) / NBITS;
+}
+
+/* Mask with the bits below `bit` set */
+static inline ulong fdt_low_mask(u32 bit)
+{
+   return bit ? (1UL << bit) - 1 : 0;
+}
+
+/*
+ * A table bigger than FD_TABLE_MIN_SIZE uses a single heap block for all of its
+ * arrays: `handles`, then `open_map`, then `full_map`.
+ */
+static inline size_t fdt_alloc_size(u32 size)
+{
+   return size * sizeof(fs_handle) +
+          (fdt_words(size) + fdt_full_words(size)) * sizeof(ulong);
+}
+
+static inline bool fdt_is_embedded(struct fd_table *t)
+{
+   return t->handles == t->min_handles;
+}
+
+void fdt_init(struct fd_table *t)
+{
+   t->size = FD_TABLE_MIN_SIZE;
+   t->handles = t->min_handles;
+   t->open_map = t->min_open_map;
+   t->full_map = t->min_full_map;
+
+   bzero(t->min_handles, sizeof(t->min_handles));
+   bzero(t->min_open_map, sizeof(t->min_open_map));
+   bzero(t->min_full_map, sizeof(t->min_full_map));
+}
+
+void fdt_destroy(struct fd_table *t)
+{
+   if (!fdt_is_embedded(t))
+      kfree2(t->handles, fdt_alloc_size(t->size));
+
+   fdt_init(t);
+}
+
+int fdt_expand(struct fd_table *t, u32 min_size)
+{
+   u32 new_size = t->size;
+   fs_handle *handles;
+   ulong *open_map, *full_map;
+
+   if (min_size <= t->size)
+      return 0;
+
+   while (new_size < min_size)
+      new_size *= 2;
+
+   if (!(handles = kzmalloc(fdt_alloc_size(new_size))))
+      return -ENOMEM;
+
+   open_map = (ulong *)(handles + new_size);
+   full_map = open_map + fdt_words(new_size);
+
+   memcpy(handles, t->handles, t->size * sizeof(fs_handle));
+   memcpy(open_map, t->open_map, fdt_words(t->size) * sizeof(ulong));
+   memcpy(full_map, t->full_map, fdt_full_words(t->size) * sizeof(ulong));
+
+   if (!fdt_is_embedded(t))
+      kfree2(t->handles, fdt_alloc_size(t->size));
+
+   t->size = new_size;
+   t->handles = handles;
+   t->open_map = open_map;
+   t->full_map = full_map;
+   return 0;
+}
+
+int fdt_dup(struct fd_table *dst, struct fd_table *src)
+{
+   fdt_init(dst);
+
+   if (fdt_expand(dst, src->size))
+      return -ENOMEM;
+
+   memcpy(dst->handles, src->handles, src->size * sizeof(fs_handle));
+   memcpy(dst->open_map, src->open_map, fdt_words(src->size) * sizeof(ulong));
+   memcpy(dst->full_map,
+          src->full_map,
+          fdt_full_words(src->size) * sizeof(ulong));
+
+   return 0;
+}
+
+/*
+ * Returns the lowest free slot >= `ge`. When there are none in the table, the
+ * returned value is MAX(ge, t->size): the first slot beyond the table.
+ */
+static u32 fdt_find_free_slot(struct fd_table *t, u32 ge)
+{
+   const u32 words = fdt_words(t->size);
+   u32 w = ge / NBITS;
+   u32 fw, fw_start;
+   ulong bits;
+
+   if (ge >= t->size)
+      return ge;
+
+   /* The word containing `ge`, ignoring the bits below it */
+   bits = t->open_map[w] | fdt_low_mask(ge % NBITS);
+
+   if (bits != ~0UL)
+      return MIN(w * NBITS + get_first_zero_bit_index_l(bits), t->size);
+
+   /* The first non-full word after `w`, found through `full_map` */
+   w++;
+   fw_start = w / NBITS;
+
+   for (fw = fw_start; fw < fdt_full_words(t->size); fw++) {
+
+      bits = t->full_map[fw];
+
+      if (fw == fw_start)
+         bits |= fdt_low_mask(w % NBITS);
+
+      if (bits != ~0UL) {
+
+         w = fw * NBITS + get_first_zero_bit_index_l(bits);
+
+         if (w >= words)
+            break;
+
+         w = w * NBITS + get_first_zero_bit_index_l(t->open_map[w]);
+         return MIN(w, t->size);
+      }
+   }
+
+   return t->size;
+}
+
+/*
+ * Get the lowest free fd >= `ge` and < `limit`, expanding the table when
+ * necessary. The fd is not reserved: the caller has to call fdt_set() on it.
+ */
+int fdt_get_free_fd(struct fd_table *t, int ge, u32 limit)
+{
+   u32 fd;
+   int rc;
+
+   ASSERT(ge >= 0);
+
+   if ((u32)ge >= limit)
+      return -EMFILE;
+
+   fd = fdt_find_free_slot(t, (u32)ge);
+
+   if (fd >= limit)
+      return -EMFILE;
+
+   if (fd >= t->size && (rc = fdt_expand(t, fd + 1)))
+      return rc;
+
+   return (int)fd;
+}
+
+/* Returns the first used fd >= `fd`, or -1 if there are none */
+int fdt_next_fd(struct fd_table *t, int fd)
+{
+   const u32 words = fdt_words(t->size);
+   u32 w = (u32)fd / NBITS;
+   ulong bits;
+
+   ASSERT(fd >= 0);
+
+   if ((u32)fd >= t->size)
+      return -1;
+
+   bits = t->open_map[w] & ~fdt_low_mask((u32)fd % NBITS);
+
+   while (!bits) {
+
+      if (++w == words)
+         return -1;
+
+      bits = t->open_map[w];
+   }
+
+   return (int)(w * NBITS + get_first_set_bit_index_l(bits));
+}
+
+void fdt_set(struct fd_table *t, int fd, fs_handle h)
+{
+   const u32 w = (u32)fd / NBITS;
+   const ulong bit = 1UL << ((u32)fd % NBITS);
+   const ulong full_bit = 1UL << (w % NBITS);
+
+   ASSERT(IN_RANGE(fd, 0, (int)t->size));
+   t->handles[fd] = h;
+
+   if (h) {
+
+      t->open_map[w] |= bit;
+
+      if (t->open_map[w] == ~0UL)
+         t->full_map[w / NBITS] |= full_bit;
+
+   } else {
+
+      t->open_map[w] &= ~bit;
+      t->full_map[w / NBITS] &= ~full_bit;
+   }
+}
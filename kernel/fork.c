@@ -12,26 +12,29 @@
 
 static int fork_dup_all_handles(struct process *pi)
 {
+   int i, j;
    ASSERT(!is_preemption_enabled());
 
-   for (u32 i = 0; i < MAX_HANDLES; i++) {
+   fdt_for_each_fd(&pi->fdt, i) {
 
       int rc;
       fs_handle dup_h = NULL;
-      fs_handle h = pi->handles[i];
+      fs_handle h = pi->fdt.handles[i];
       struct user_mapping *um;
 
-      if (!h)
-         continue;
-
       rc = vfs_dup(h, &dup_h);
 
       if (rc < 0 || !dup_h) {
 
          enable_preemption();
          {
-            for (u32 j = 0; j < i; j++)
-               vfs_close(pi->handles[j]);
+            fdt_for_each_fd(&pi->fdt, j) {
+
+               if (j == i)
+                  break;
+
+               vfs_close(pi->fdt.handles[j]);
+            }
          }
          disable_preemption();
          return -ENOMEM;
@@ -41,7 +44,7 @@ static int fork_dup_all_handles(struct process *pi)
       ((struct fs_handle_base *)dup_h)->pi = pi;
 
       /* Replace the older (parent's) handle with the new one */
-      pi->handles[i] = dup_h;
+      pi->fdt.handles[i] = dup_h;
 
       if (!pi->mi)
          continue;
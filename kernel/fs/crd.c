@@ -0,0 +1,394 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_mm.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/assert.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/fs/crd.h>
+#include <tilck/kernel/lz.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/list.h>
+
+struct crd;
+
+struct crd_chunk {
+
+   struct list_node lru_node;    /* node in crd_lru, when cached */
+   struct crd *c;
+   void *buf;                    /* decompressed data, NULL if not cached */
+};
+
+struct crd {
+
+   struct list_node node;        /* node in crd_list */
+   struct crd_hdr *hdr;
+   char *va;                     /* vaddr of the uncompressed data */
+   size_t va_size;               /* size rounded up at `chunk_size` */
+   struct crd_chunk chunks[];
+};
+
+struct crd_stats crd_stats;
+ulong crd_min_free_kb = CRD_DEFAULT_MIN_FREE_KB;
+ulong crd_max_cache_kb = CRD_DEFAULT_MAX_CACHE_KB;
+
+static struct list crd_list = STATIC_LIST_INIT(crd_list);
+static struct list crd_lru = STATIC_LIST_INIT(crd_lru); /* most recent first */
+static size_t crd_cached_bytes;
+
+static inline size_t crd_obj_size(u32 chunks_count)
+{
+   return sizeof(struct crd) + chunks_count * sizeof(struct crd_chunk);
+}
+
+static inline char *crd_chunk_va(struct crd_chunk *ch)
+{
+   struct crd *c = ch->c;
+   return c->va + (size_t)(ch - c->chunks) * c->hdr->chunk_size;
+}
+
+static bool crd_check_image(struct crd_hdr *h, size_t compr_size)
+{
+   if (compr_size < sizeof(*h))
+      return false;
+
+   if (h->magic != CRD_MAGIC || h->version != CRD_VERSION)
+      return false;
+
+   if (!h->chunk_size || h->chunk_size > LZ_MAX_INPUT_SIZE)
+      return false;
+
+   if (!IS_PAGE_ALIGNED(h->chunk_size) || !h->size)
+      return false;
+
+   if (h->chunks_count != h->size / h->chunk_size + !!(h->size % h->chunk_size))
+      return false;
+
+   if (h->compr_size > compr_size)
+      return false;
+
+   if (crd_get_hdr_size(h->chunks_count) > h->compr_size)
+      return false;
+
+   if (h->index[0] != crd_get_hdr_size(h->chunks_count))
+      return false;
+
+   if (h->index[h->chunks_count] != h->compr_size)
+      return false;
+
+   for (u32 i = 0; i < h->chunks_count; i++) {
+
+      if (h->index[i + 1] < h->index[i])
+         return false;
+
+      if (crd_get_chunk_compr_size(h, i) > crd_get_chunk_size(h, i))
+         return false;
+   }
+
+   return true;
+}
+
+static bool crd_decompress_chunk(struct crd_hdr *h, u32 i, void *dst)
+{
+   const void *src = (char *)h + h->index[i];
+   const u32 compr_len = crd_get_chunk_compr_size(h, i);
+   const u32 len = crd_get_chunk_size(h, i);
+
+   if (compr_len == len) {
+
+      /* The chunk was not compressible: it's stored as it is */
+      memcpy(dst, src, len);
+
+   } else {
+
+      if (lz_decompress(src, compr_len, dst, len) != (long)len)
+         return false;
+   }
+
+   /* The last chunk might be shorter than the others */
+   bzero((char *)dst + len, h->chunk_size - len);
+   return true;
+}
+
+static void crd_drop_chunk(struct crd_chunk *ch)
+{
+   const u32 chunk_size = ch->c->hdr->chunk_size;
+   ASSERT(!is_preemption_enabled());
+   ASSERT(ch->buf != NULL);
+
+   unmap_pages(get_kernel_pdir(),
+               crd_chunk_va(ch),
+               chunk_size >> PAGE_SHIFT,
+               false);
+
+   list_remove(&ch->lru_node);
+   kfree2(ch->buf, chunk_size);
+   ch->buf = NULL;
+   crd_cached_bytes -= chunk_size;
+   crd_stats.cached_chunks--;
+}
+
+/*
+ * Drop the least recently used chunk, giving a second chance to the chunks
+ * accessed since they've been checked the last time (clock-like), because the
+ * accesses to the mapped chunks cannot be tracked otherwise.
+ */
+static bool crd_drop_lru_chunk(void)
+{
+   struct crd_chunk *ch;
+   ulong checked = 0;
+
+   while (!list_is_empty(&crd_lru)) {
+
+      ch = list_last_obj(&crd_lru, struct crd_chunk, lru_node);
+
+      if (checked++ < crd_stats.cached_chunks) {
+
+         const bool accessed =
+            test_and_clear_accessed(get_kernel_pdir(),
+                                    crd_chunk_va(ch),
+                                    ch->c->hdr->chunk_size >> PAGE_SHIFT);
+
+         if (accessed) {
+            list_remove(&ch->lru_node);
+            list_add_head(&crd_lru, &ch->lru_node);
+            continue;
+         }
+      }
+
+      crd_drop_chunk(ch);
+      crd_stats.evictions++;
+      return true;
+   }
+
+   return false;
+}
+
+static bool crd_must_drop_for(size_t new_chunk_size)
+{
+   const size_t max_cache = crd_max_cache_kb * KB;
+
+   if (list_is_empty(&crd_lru))
+      return false;
+
+   if (max_cache && crd_cached_bytes + new_chunk_size > max_cache)
+      return true;
+
+   if (crd_stats.cached_chunks < CRD_MIN_CACHED_CHUNKS)
+      return false; /* keep a minimal working set, in order to avoid thrashing */
+
+   return kmalloc_get_tot_heap_free() / KB < crd_min_free_kb;
+}
+
+static void *crd_alloc_chunk_buf(size_t chunk_size)
+{
+   void *buf;
+
+   while (crd_must_drop_for(chunk_size))
+      crd_drop_lru_chunk();
+
+   while (!(buf = kmalloc(chunk_size))) {
+
+      /* Direct reclaim: drop the cached chunks, until the allocation works */
+      if (!crd_drop_lru_chunk())
+         break;
+   }
+
+   return buf;
+}
+
+static struct crd *crd_find(void *vaddr)
+{
+   struct crd *c;
+   ASSERT(!is_preemption_enabled());
+
+   list_for_each_ro(c, &crd_list, node) {
+      if (IN_RANGE((char *)vaddr, c->va, c->va + c->va_size))
+         return c;
+   }
+
+   return NULL;
+}
+
+STATIC struct crd *
+crd_create(void *compr, size_t compr_size, void *va)
+{
+   struct crd_hdr *h = compr;
+   struct crd *c;
+
+   if (!crd_check_image(h, compr_size))
+      return NULL;
+
+   if (!(c = kzmalloc(crd_obj_size(h->chunks_count))))
+      return NULL;
+
+   c->hdr = h;
+   c->va = va;
+   c->va_size = (size_t)h->chunks_count * h->chunk_size;
+
+   for (u32 i = 0; i < h->chunks_count; i++) {
+      list_node_init(&c->chunks[i].lru_node);
+      c->chunks[i].c = c;
+   }
+
+   disable_preemption();
+   {
+      list_add_tail(&crd_list, &c->node);
+      crd_stats.size_kb += h->size / KB;
+      crd_stats.compr_kb += h->compr_size / KB;
+      crd_stats.chunks += h->chunks_count;
+   }
+   enable_preemption();
+   return c;
+}
+
+STATIC void
+crd_destroy(struct crd *c)
+{
+   struct crd_hdr *h = c->hdr;
+
+   disable_preemption();
+   {
+      for (u32 i = 0; i < h->chunks_count; i++)
+         if (c->chunks[i].buf)
+            crd_drop_chunk(&c->chunks[i]);
+
+      list_remove(&c->node);
+      crd_stats.size_kb -= h->size / KB;
+      crd_stats.compr_kb -= h->compr_size / KB;
+      crd_stats.chunks -= h->chunks_count;
+   }
+   enable_preemption();
+   kfree2(c, crd_obj_size(h->chunks_count));
+}
+
+void *crd_map(void *compr, size_t compr_size, size_t *size)
+{
+   struct crd_hdr *h = compr;
+   struct crd *c;
+   void *va;
+
+   if (compr_size < sizeof(*h) || !h->chunk_size)
+      return NULL;
+
+   if (!(va = hi_vmem_reserve((size_t)h->chunks_count * h->chunk_size)))
+      return NULL;
+
+   if (!(c = crd_create(compr, compr_size, va))) {
+      hi_vmem_release(va, (size_t)h->chunks_count * h->chunk_size);
+      return NULL;
+   }
+
+   printk("crd: %u KB compressed in %u KB (%u chunks)\n",
+          h->size / KB, h->compr_size / KB, h->chunks_count);
+
+   *size = h->size;
+   return va;
+}
+
+void crd_unmap(void *vaddr)
+{
+   struct crd *c;
+   size_t va_size;
+
+   disable_preemption();
+   {
+      c = crd_find(vaddr);
+   }
+   enable_preemption();
+
+   VERIFY(c != NULL);
+   va_size = c->va_size;
+   crd_destroy(c);
+   hi_vmem_release(vaddr, va_size);
+}
+
+bool crd_is_crd_vaddr(void *vaddr)
+{
+   struct crd *c;
+
+   disable_preemption();
+   {
+      c = crd_find(vaddr);
+   }
+   enable_preemption();
+   return c != NULL;
+}
+
+bool crd_handle_fault(void *vaddr)
+{
+   struct crd *c;
+   struct crd_chunk *ch;
+   u32 chunk_size;
+   size_t pages;
+   bool ok = false;
+   void *buf;
+
+   /*
+    * Everything here runs with preemption disabled: that guarantees that a
+    * chunk is cached if and only if its pages are mapped.
+    */
+   disable_preemption();
+
+   if (!(c = crd_find(vaddr)))
+      goto out;
+
+   chunk_size = c->hdr->chunk_size;
+   pages = chunk_size >> PAGE_SHIFT;
+   ch = &c->chunks[((char *)vaddr - c->va) / chunk_size];
+
+   if (ch->buf)
+      goto out; /* mapped chunk: not a fault we can handle */
+
+   if (!(buf = crd_alloc_chunk_buf(chunk_size))) {
+      printk("crd: out of memory while decompressing %p\n", vaddr);
+      goto out;
+   }
+
+   ASSERT(IS_PAGE_ALIGNED(buf));
+
+   if (!crd_decompress_chunk(c->hdr, (u32)(ch - c->chunks), buf)) {
+      printk("crd: corrupted chunk at %p\n", crd_chunk_va(ch));
+      kfree2(buf, chunk_size);
+      goto out;
+   }
+
+   if (map_pages(get_kernel_pdir(),
+                 crd_chunk_va(ch),
+                 KERNEL_VA_TO_PA(buf),
+                 pages,
+                 0 /* read-only */) != pages)
+   {
+      unmap_pages_permissive(get_kernel_pdir(), crd_chunk_va(ch), pages, false);
+      kfree2(buf, chunk_size);
+      goto out;
+   }
+
+   ch->buf = buf;
+   list_add_head(&crd_lru, &ch->lru_node);
+   crd_cached_bytes += chunk_size;
+   crd_stats.cached_chunks++;
+   crd_stats.faults++;
+   ok = true;
+
+out:
+   enable_preemption();
+   return ok;
+}
+
+ulong crd_shrink(ulong count)
+{
+   ulong dropped = 0;
+
+   disable_preemption();
+   {
+      while (dropped < count && crd_drop_lru_chunk())
+         dropped++;
+   }
+   enable_preemption();
+   return dropped;
+}
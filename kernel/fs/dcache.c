@@ -0,0 +1,264 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_kernel.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/fs/dcache.h>
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/list.h>
+
+struct dcache_entry {
+
+   struct list_node hash_node;            /* node in `dcache_table` */
+   struct list_node lru_node;             /* node in `dcache_lru` */
+
+   struct fs *fs;
+   vfs_inode_ptr_t dir_inode;
+   struct fs_path fs_path;                /* fs_path.inode == NULL: negative */
+
+   u32 hash;
+   u32 name_len;
+   char name[DCACHE_MAX_NAME_LEN];
+};
+
+struct dcache_stats dcache_stats;
+
+static struct list dcache_table[DCACHE_HASH_BUCKETS];
+static struct list dcache_lru = STATIC_LIST_INIT(dcache_lru);
+static bool dcache_initialized;
+
+static void dcache_init_table(void)
+{
+   ASSERT(!is_preemption_enabled());
+
+   for (u32 i = 0; i < ARRAY_SIZE(dcache_table); i++)
+      list_init(&dcache_table[i]);
+
+   dcache_initialized = true;
+}
+
+static inline bool
+dcache_is_dot_or_dotdot(const char *name, ssize_t len)
+{
+   return (len == 1 && name[0] == '.') ||
+          (len == 2 && name[0] == '.' && name[1] == '.');
+}
+
+/* FNV-1a hash of the name, mixed with the parent inode */
+static u32
+dcache_hash(vfs_inode_ptr_t dir_inode, const char *name, ssize_t len)
+{
+   u32 h = 2166136261u;
+
+   for (ssize_t i = 0; i < len; i++) {
+      h ^= (u8)name[i];
+      h *= 16777619u;
+   }
+
+   return h ^ ((u32)((ulong)dir_inode >> 4) * 2654435761u);
+}
+
+static struct dcache_entry *
+dcache_lookup(struct fs *fs,
+              vfs_inode_ptr_t dir_inode,
+              const char *name,
+              ssize_t len,
+              u32 hash)
+{
+   struct dcache_entry *e;
+   ASSERT(!is_preemption_enabled());
+
+   list_for_each_ro(e, &dcache_table[hash % DCACHE_HASH_BUCKETS], hash_node) {
+
+      if (e->hash != hash || e->fs != fs || e->dir_inode != dir_inode)
+         continue;
+
+      if (e->name_len == (u32)len && !memcmp(e->name, name, (size_t)len))
+         return e;
+   }
+
+   return NULL;
+}
+
+static void dcache_remove_entry(struct dcache_entry *e)
+{
+   ASSERT(!is_preemption_enabled());
+
+   list_remove(&e->hash_node);
+   list_remove(&e->lru_node);
+   dcache_stats.entries--;
+   kfree_obj(e, struct dcache_entry);
+}
+
+static void
+dcache_insert(struct fs *fs,
+              vfs_inode_ptr_t dir_inode,
+              const char *name,
+              ssize_t len,
+              u32 hash,
+              struct fs_path *fs_path)
+{
+   struct dcache_entry *e = kalloc_obj(struct dcache_entry);
+
+   if (!e)
+      return;     /* Not a big deal: the cache is just an optimization */
+
+   list_node_init(&e->hash_node);
+   list_node_init(&e->lru_node);
+   e->fs = fs;
+   e->dir_inode = dir_inode;
+   e->fs_path = *fs_path;
+   e->hash = hash;
+   e->name_len = (u32)len;
+   memcpy(e->name, name, (size_t)len);
+
+   disable_preemption();
+   {
+      if (dcache_lookup(fs, dir_inode, name, len, hash)) {
+
+         /* Another task has just added the same entry */
+         enable_preemption();
+         kfree_obj(e, struct dcache_entry);
+         return;
+      }
+
+      if (dcache_stats.entries == DCACHE_MAX_ENTRIES) {
+
+         /* Evict the least recently used entry */
+         dcache_remove_entry(
+            list_last_obj(&dcache_lru, struct dcache_entry, lru_node)
+         );
+
+         dcache_stats.evictions++;
+      }
+
+      list_add_head(&dcache_table[hash % DCACHE_HASH_BUCKETS], &e->hash_node);
+      list_add_head(&dcache_lru, &e->lru_node);
+      dcache_stats.entries++;
+   }
+   enable_preemption();
+}
+
+void
+dcache_get_entry(struct fs *fs,
+                 vfs_inode_ptr_t dir_inode,
+                 const char *name,
+                 ssize_t name_len,
+                 struct fs_path *fs_path)
+{
+   struct dcache_entry *e;
+   u32 hash;
+
+   if (!(fs->flags & VFS_FS_DCACHE) ||
+       !dir_inode ||
+       name_len > DCACHE_MAX_NAME_LEN ||
+       dcache_is_dot_or_dotdot(name, name_len))
+   {
+      /*
+       * NOTE: "." and ".." are not cached, because the parent of a directory
+       * changes when it gets renamed. Anyway, their lookup is cheap.
+       */
+      vfs_get_entry(fs, dir_inode, name, name_len, fs_path);
+      return;
+   }
+
+   hash = dcache_hash(dir_inode, name, name_len);
+
+   disable_preemption();
+   {
+      if (UNLIKELY(!dcache_initialized))
+         dcache_init_table();
+
+      if ((e = dcache_lookup(fs, dir_inode, name, name_len, hash))) {
+
+         *fs_path = e->fs_path;
+
+         if (fs_path->inode)
+            dcache_stats.hits++;
+         else
+            dcache_stats.neg_hits++;
+
+         /* Move the entry at the head of the LRU list */
+         list_remove(&e->lru_node);
+         list_add_head(&dcache_lru, &e->lru_node);
+         enable_preemption();
+         return;
+      }
+
+      dcache_stats.misses++;
+   }
+   enable_preemption();
+
+   vfs_get_entry(fs, dir_inode, name, name_len, fs_path);
+   dcache_insert(fs, dir_inode, name, name_len, hash, fs_path);
+}
+
+void
+dcache_invalidate(struct fs *fs,
+                  vfs_inode_ptr_t dir_inode,
+                  const char *name,
+                  ssize_t name_len)
+{
+   struct dcache_entry *e;
+   u32 hash;
+
+   if (!(fs->flags & VFS_FS_DCACHE) || name_len > DCACHE_MAX_NAME_LEN)
+      return;
+
+   hash = dcache_hash(dir_inode, name, name_len);
+
+   disable_preemption();
+   {
+      if (dcache_initialized) {
+         if ((e = dcache_lookup(fs, dir_inode, name, name_len, hash))) {
+            dcache_remove_entry(e);
+            dcache_stats.invalidations++;
+         }
+      }
+   }
+   enable_preemption();
+}
+
+void dcache_invalidate_inode(struct fs *fs, vfs_inode_ptr_t inode)
+{
+   struct dcache_entry *pos, *temp;
+
+   if (!(fs->flags & VFS_FS_DCACHE))
+      return;
+
+   disable_preemption();
+   {
+      list_for_each(pos, temp, &dcache_lru, lru_node) {
+
+         if (pos->fs != fs)
+            continue;
+
+         if (pos->dir_inode == inode || pos->fs_path.inode == inode) {
+            dcache_remove_entry(pos);
+            dcache_stats.invalidations++;
+         }
+      }
+   }
+   enable_preemption();
+}
+
+void dcache_invalidate_fs(struct fs *fs)
+{
+   struct dcache_entry *pos, *temp;
+
+   disable_preemption();
+   {
+      list_for_each(pos, temp, &dcache_lru, lru_node) {
+
+         if (!fs || pos->fs == fs) {
+            dcache_remove_entry(pos);
+            dcache_stats.invalidations++;
+         }
+      }
+   }
+   enable_preemption();
+}
@@ -32,18 +32,22 @@ fat_fs_walk_generic(struct fat_fs_device_data *d,
                      : fat_get_first_cluster(e));
 }
 
-STATIC ssize_t
-fat_read(fs_handle handle, char *buf, size_t bufsize)
+/*
+ * Read from the file position `*pos`, which is in the cluster `*cluster`, and
+ * advance both of them. Used both by read() and pread(), with different cursors.
+ */
+static ssize_t
+fat_read_at(struct fatfs_handle *h, struct io_iter *it, offt *pos, u32 *cluster)
 {
-   struct fatfs_handle *h = (struct fatfs_handle *) handle;
    struct fat_fs_device_data *d = h->fs->device_data;
    offt fsize = (offt)h->e->DIR_FileSize;
    offt written_to_buf = 0;
+   ssize_t rc;
 
    if (h->e->directory)
       return -EISDIR;
 
-   if (h->pos >= fsize) {
+   if (*pos >= fsize) {
 
       /*
        * The cursor is at the end or past the end: nothing to read.
@@ -54,48 +58,122 @@ fat_read(fs_handle handle, char *buf, size_t bufsize)
 
    do {
 
-      char *data = fat_get_pointer_to_cluster_data(d->hdr, h->curr_cluster);
+      const offt cluster_off = *pos % (offt)d->cluster_size;
+      u32 run = 1;
 
-      const offt file_rem       = fsize - h->pos;
-      const offt buf_rem        = (offt)bufsize - written_to_buf;
-      const offt cluster_off    = h->pos % (offt)d->cluster_size;
-      const offt cluster_rem    = (offt)d->cluster_size - cluster_off;
-      const offt to_read        = MIN3(cluster_rem, buf_rem, file_rem);
+      if (h->cmap) {
+
+         /*
+          * Use the cluster map: find the cluster at `*pos` in O(log(extents))
+          * and read up to the end of its extent at once.
+          */
+         run = fat_cmap_lookup(h->cmap,
+                               (u32)(*pos / (offt)d->cluster_size),
+                               cluster);
+         ASSERT(run > 0);
+      }
+
+      char *data = fat_get_pointer_to_cluster_data(d->hdr, *cluster);
+
+      const offt file_rem       = fsize - *pos;
+      const offt buf_rem        = (offt)it->count;
+      const offt run_rem        = (offt)(run * d->cluster_size) - cluster_off;
+      const offt to_read        = MIN3(run_rem, buf_rem, file_rem);
 
       ASSERT(to_read >= 0);
 
-      memcpy(buf + written_to_buf, data + cluster_off, (size_t)to_read);
+      rc = io_iter_copy_to(it, data + cluster_off, (size_t)to_read);
+
+      if (rc < 0)
+         return written_to_buf ? (ssize_t)written_to_buf : rc;
+
       written_to_buf += to_read;
-      h->pos += to_read;
+      *pos += to_read;
 
-      if (to_read < cluster_rem) {
+      if (to_read < run_rem) {
 
          /*
-          * We read less than cluster_rem because the buf was not big enough
+          * We read less than run_rem because the buf was not big enough
           * or because the file was not big enough. In either case, we cannot
-          * continue.
+          * continue. Just make `*cluster` point to the cluster at `*pos`.
           */
+         *cluster += (u32)((cluster_off + to_read) / (offt)d->cluster_size);
          break;
       }
 
+      if (h->cmap) {
+
+         if (*pos == fsize)
+            break;
+
+         continue; /* the next extent will be looked up in the map */
+      }
+
       // find the next cluster
-      u32 fatval = fat_read_fat_entry(d->hdr, d->type, 0, h->curr_cluster);
+      u32 fatval = fat_read_fat_entry(d->hdr, d->type, 0, *cluster);
 
       if (fat_is_end_of_clusterchain(d->type, fatval)) {
-         ASSERT(h->pos == fsize);
+         ASSERT(*pos == fsize);
          break;
       }
 
       // we do not expect BAD CLUSTERS
       ASSERT(!fat_is_bad_cluster(d->type, fatval));
 
-      h->curr_cluster = fatval; // go reading the new cluster in the chain.
+      *cluster = fatval; // go reading the new cluster in the chain.
 
    } while (true);
 
    return (ssize_t)written_to_buf;
 }
 
+STATIC ssize_t
+fat_read_iter(fs_handle handle, struct io_iter *it)
+{
+   struct fatfs_handle *h = (struct fatfs_handle *) handle;
+   return fat_read_at(h, it, &h->pos, &h->curr_cluster);
+}
+
+static ssize_t
+fat_pread_iter(fs_handle handle, struct io_iter *it, offt pos)
+{
+   struct fatfs_handle *h = (struct fatfs_handle *) handle;
+   struct fat_fs_device_data *d = h->fs->device_data;
+   u32 cluster;
+
+   if (h->e->directory)
+      return -EISDIR;
+
+   if (pos >= (offt)h->e->DIR_FileSize)
+      return 0;
+
+   if (h->cmap) {
+
+      /* fat_read_at() will look up the cluster at `pos` in the map */
+      cluster = 0;
+
+   } else {
+
+      /* Walk the cluster chain up to `pos`, without touching the handle */
+      cluster = fat_get_first_cluster(h->e);
+
+      for (offt n = pos / (offt)d->cluster_size; n > 0; n--)
+         cluster = fat_read_fat_entry(d->hdr, d->type, 0, cluster);
+   }
+
+   return fat_read_at(h, it, &pos, &cluster);
+}
+
+STATIC ssize_t
+fat_read(fs_handle handle, char *buf, size_t bufsize)
+{
+   struct iovec iov = { buf, bufsize };
+   struct io_iter it;
+
+   io_iter_init(&it, &iov, 1, false);
+   return fat_read_iter(handle, &it);
+}
+
 
 STATIC int
 fat_rewind(fs_handle handle)
@@ -176,11 +254,11 @@ fat_count_dirents_cb(struct fat_hdr *hdr,
 
 /*
  * Count the number of entries in a given FAT directory.
- * TODO: implement fat_count_dirents() in a more efficient way.
  */
 STATIC offt fat_count_dirents(struct fat_fs_device_data *d, struct fat_entry *e)
 {
    int rc;
+   struct fat_dir_index *idx;
    struct fat_count_dirents_ctx ctx = { .count = 0 };
    struct fat_walk_static_params walk_params = {
       .ctx = NULL,      /* no need for long name ctx */
@@ -191,6 +269,10 @@ STATIC offt fat_count_dirents(struct fat_fs_device_data *d, struct fat_entry *e)
    };
 
    ASSERT(e->directory);
+
+   if ((idx = fat_get_dir_index(d, e)))
+      return idx->count;
+
    rc = fat_fs_walk_generic(d, &walk_params, e);
    return rc ? rc : ctx.count;
 }
@@ -220,51 +302,40 @@ fat_seek(fs_handle handle, offt off, int whence)
       return fat_seek_dir(fh, off);
    }
 
-   offt curr_pos = fh->pos;
-
    switch (whence) {
 
       case SEEK_SET:
+         break;
 
-         if (off < 0)
-            return -EINVAL; /* invalid negative offset */
-
-         fat_rewind(handle);
+      case SEEK_CUR:
+         off += fh->pos;
          break;
 
       case SEEK_END:
-
-         if (off >= 0)
-            break;
-
-         struct fatfs_handle *h = (struct fatfs_handle *) handle;
-         off = (offt) h->e->DIR_FileSize + off;
-
-         if (off < 0)
-            return -EINVAL;
-
-         fat_rewind(handle);
+         off += (offt) fh->e->DIR_FileSize;
          break;
 
-      case SEEK_CUR:
-
-         if (off < 0) {
-
-            off = curr_pos + off;
-
-            if (off < 0)
-               return -EINVAL;
+      default:
+         return -EINVAL;
+   }
 
-            fat_rewind(handle);
-         }
+   if (off < 0)
+      return -EINVAL; /* invalid negative offset */
 
-         break;
+   if (fh->cmap) {
 
-      default:
-         return -EINVAL;
+      /*
+       * With the cluster map, there's no need to follow the cluster chain:
+       * fat_read_at() will find the right cluster on its own.
+       */
+      fh->pos = off;
+      return fh->pos;
    }
 
-   return fat_seek_forward(handle, off);
+   if (off < fh->pos)
+      fat_rewind(handle);
+
+   return fat_seek_forward(handle, off - fh->pos);
 }
 
 struct datetime
@@ -338,6 +409,7 @@ struct fat_getdents_ctx {
    struct fatfs_handle *fh;
    get_dents_func_cb vfs_cb;
    void *vfs_ctx;
+   offt skip;
    int rc;
 };
 
@@ -352,6 +424,11 @@ fat_getdents_cb(struct fat_hdr *hdr,
    const char *entname = long_name ? long_name : short_name;
    struct fat_getdents_ctx *ctx = arg;
 
+   if (ctx->skip > 0) {
+      ctx->skip--;
+      return 0; /* skip the entries already returned */
+   }
+
    if (entname == short_name)
       fat_get_short_name(entry, short_name);
 
@@ -362,7 +439,35 @@ fat_getdents_cb(struct fat_hdr *hdr,
       .name = entname,
    };
 
-   return ctx->vfs_cb(&dent, ctx->vfs_ctx);
+   return (ctx->rc = ctx->vfs_cb(&dent, ctx->vfs_ctx));
+}
+
+static int
+fat_getdents_indexed(struct fatfs_handle *fh,
+                     struct fat_dir_index *idx,
+                     get_dents_func_cb cb,
+                     void *arg)
+{
+   struct fat_fs_device_data *d = fh->fs->device_data;
+   int rc = 0;
+
+   /* Thanks to the index, we can resume directly from the current offset */
+   for (offt i = fh->pos; i < (offt)idx->count; i++) {
+
+      struct fat_dir_index_entry *ie = &idx->ents[i];
+
+      struct vfs_dent64 dent = {
+         .ino  = fat_entry_to_inode(d->hdr, ie->e),
+         .type = ie->e->directory ? VFS_DIR : VFS_FILE,
+         .name_len = ie->name_len + 1,
+         .name = idx->names + ie->name_off,
+      };
+
+      if ((rc = cb(&dent, arg)))
+         break;
+   }
+
+   return rc;
 }
 
 static int fat_getdents(fs_handle h, get_dents_func_cb cb, void *arg)
@@ -372,15 +477,21 @@ static int fat_getdents(fs_handle h, get_dents_func_cb cb, void *arg)
    struct fat_getdents_ctx ctx;
    struct fat_walk_long_name_ctx walk_ctx;
    struct fat_walk_static_params walk_params;
+   struct fat_dir_index *idx;
    int rc;
 
    if (!fh->e->directory && !fh->e->volume_id)
       return -ENOTDIR;
 
+   if ((idx = fat_get_dir_index(d, fh->e)))
+      return fat_getdents_indexed(fh, idx, cb, arg);
+
+   /* Out of memory: walk the whole directory, skipping the first `pos` ones */
    ctx = (struct fat_getdents_ctx) {
       .fh = fh,
       .vfs_cb = cb,
       .vfs_ctx = arg,
+      .skip = fh->pos,
       .rc = 0,
    };
 
@@ -450,6 +561,8 @@ STATIC int fat_ioctl(fs_handle h, ulong request, void *arg)
 static const struct file_ops static_ops_fat =
 {
    .read = fat_read,
+   .read_iter = fat_read_iter,
+   .pread_iter = fat_pread_iter,
    .seek = fat_seek,
    .write = fat_write,
    .ioctl = fat_ioctl,
@@ -489,6 +602,9 @@ fat_open(struct vfs_path *p, fs_handle *out, int fl, mode_t mode)
    h->pos = 0;
    h->curr_cluster = fat_get_first_cluster(e);
 
+   if (!e->directory)
+      h->cmap = fat_get_cluster_map(d, e);
+
    if (d->mmap_support)
       h->spec_flags = VFS_SPFL_MMAP_SUPPORTED;
 
@@ -517,7 +633,8 @@ fat_get_entry(struct fs *fs,
    struct fat_fs_device_data *d = fs->device_data;
    struct fat_fs_path *fp = (struct fat_fs_path *)fs_path;
    struct fat_walk_static_params walk_params;
-   struct fat_entry *dir_entry;
+   struct fat_entry *dir_entry, *res;
+   struct fat_dir_index *idx;
    struct fat_search_ctx ctx;
 
    if (!dir_inode && !name)              // both dir_inode and name are NULL:
@@ -529,18 +646,26 @@ fat_get_entry(struct fs *fs,
       if (is_dot_or_dotdot(name, (int)name_len))
          return fat_get_root_entry(d, fp);
 
-   walk_params = (struct fat_walk_static_params) {
-      .ctx = &ctx.walk_ctx,
-      .h = d->hdr,
-      .ft = d->type,
-      .cb = &fat_search_entry_cb,
-      .arg = &ctx,
-   };
+   if ((idx = fat_get_dir_index(d, dir_entry))) {
+
+      res = fat_dindex_lookup(idx, name, (size_t)name_len);
 
-   fat_init_search_ctx(&ctx, name, true);
-   fat_fs_walk_generic(d, &walk_params, dir_entry);
+   } else {
+
+      /* Out of memory: walk the directory */
+      walk_params = (struct fat_walk_static_params) {
+         .ctx = &ctx.walk_ctx,
+         .h = d->hdr,
+         .ft = d->type,
+         .cb = &fat_search_entry_cb,
+         .arg = &ctx,
+      };
+
+      fat_init_search_ctx(&ctx, name, true);
+      fat_fs_walk_generic(d, &walk_params, dir_entry);
+      res = !ctx.not_dir ? ctx.result : NULL;
+   }
 
-   struct fat_entry *res = !ctx.not_dir ? ctx.result : NULL;
    enum vfs_entry_type type = VFS_NONE;
 
    if (res) {
@@ -627,7 +752,7 @@ struct fs *fat_mount_ramdisk(void *vaddr, size_t rd_size, u32 flags)
    fs = create_fs_obj("fat",
                       &static_fsops_fat,
                       d,
-                      flags | VFS_FS_RQ_DE_SKIP);
+                      flags | VFS_FS_DCACHE);
 
    if (!fs) {
       kfree_obj(d, struct fat_fs_device_data);
@@ -642,6 +767,8 @@ struct fs *fat_mount_ramdisk(void *vaddr, size_t rd_size, u32 flags)
 
 void fat_umount_ramdisk(struct fs *fs)
 {
+   fat_destroy_cluster_maps(fs->device_data);
+   fat_destroy_dir_indexes(fs->device_data);
    kfree_obj(fs->device_data, struct fat_fs_device_data);
    destory_fs_obj(fs);
 }
@@ -0,0 +1,158 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+
+#include <tilck/kernel/fs/fat32.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/sched.h>
+
+/*
+ * Walk the cluster chain of `e` and store its extents in `extents`, when it's
+ * not NULL. Returns the number of extents.
+ */
+static u32
+fat_walk_extents(struct fat_fs_device_data *d,
+                 struct fat_entry *e,
+                 struct fat_extent *extents)
+{
+   u32 clu = fat_get_first_cluster(e);
+   u32 prev = 0, cnt = 0;
+
+   if (!clu)
+      return 0; /* empty file: no clusters at all */
+
+   for (u32 idx = 0; ; idx++) {
+
+      /* We do not expect BAD CLUSTERS */
+      ASSERT(!fat_is_bad_cluster(d->type, clu));
+
+      if (!cnt || clu != prev + 1) {
+
+         /* Begin a new extent */
+         if (extents)
+            extents[cnt] = (struct fat_extent) { idx, clu, 0 };
+
+         cnt++;
+      }
+
+      if (extents)
+         extents[cnt - 1].count++;
+
+      prev = clu;
+      clu = fat_read_fat_entry(d->hdr, d->type, 0, clu);
+
+      if (fat_is_end_of_clusterchain(d->type, clu))
+         break;
+   }
+
+   return cnt;
+}
+
+static struct fat_cluster_map *
+fat_build_cluster_map(struct fat_fs_device_data *d, struct fat_entry *e)
+{
+   struct fat_cluster_map *cmap;
+   const u32 cnt = fat_walk_extents(d, e, NULL);
+   const size_t size = sizeof(*cmap) + cnt * sizeof(struct fat_extent);
+
+   if (!(cmap = kmalloc(size)))
+      return NULL;
+
+   bintree_node_init(&cmap->node);
+   cmap->e = e;
+   cmap->extents_count = fat_walk_extents(d, e, cmap->extents);
+   ASSERT(cmap->extents_count == cnt);
+   return cmap;
+}
+
+static void fat_free_cluster_map(struct fat_cluster_map *cmap)
+{
+   const u32 cnt = cmap->extents_count;
+   kfree2(cmap, sizeof(*cmap) + cnt * sizeof(struct fat_extent));
+}
+
+/*
+ * Get the cluster map of `e`, building it if it's not in the cache. Returns
+ * NULL in case of out-of-memory: the callers have to follow the cluster chain.
+ */
+struct fat_cluster_map *
+fat_get_cluster_map(struct fat_fs_device_data *d, struct fat_entry *e)
+{
+   struct fat_cluster_map *cmap, *cmap2;
+
+   disable_preemption();
+   {
+      cmap = bintree_find_ptr(d->cmaps, e, struct fat_cluster_map, node, e);
+   }
+   enable_preemption();
+
+   if (cmap)
+      return cmap;
+
+   if (!(cmap = fat_build_cluster_map(d, e)))
+      return NULL;
+
+   disable_preemption();
+   {
+      /* Another task might have built the same map in the meanwhile */
+      cmap2 = bintree_find_ptr(d->cmaps, e, struct fat_cluster_map, node, e);
+
+      if (!cmap2)
+         bintree_insert_ptr(&d->cmaps, cmap, struct fat_cluster_map, node, e);
+   }
+   enable_preemption();
+
+   if (cmap2) {
+      fat_free_cluster_map(cmap);
+      cmap = cmap2;
+   }
+
+   return cmap;
+}
+
+void fat_destroy_cluster_maps(struct fat_fs_device_data *d)
+{
+   struct fat_cluster_map *cmap;
+
+   while ((cmap = bintree_get_first_obj(d->cmaps,
+                                        struct fat_cluster_map,
+                                        node)))
+   {
+      bintree_remove_ptr(&d->cmaps, cmap, struct fat_cluster_map, node, e);
+      fat_free_cluster_map(cmap);
+   }
+}
+
+/*
+ * Find the cluster having index `idx` in the file. Returns the number of
+ * contiguous clusters starting from it (at least 1) or 0 if `idx` is past the
+ * end of the cluster chain.
+ */
+u32
+fat_cmap_lookup(struct fat_cluster_map *cmap, u32 idx, u32 *clu)
+{
+   struct fat_extent *ext;
+   u32 lo = 0, hi = cmap->extents_count;
+
+   /* Binary search for the last extent having ext->idx <= idx */
+   while (hi - lo > 1) {
+
+      const u32 mid = lo + (hi - lo) / 2;
+
+      if (cmap->extents[mid].idx <= idx)
+         lo = mid;
+      else
+         hi = mid;
+   }
+
+   if (!cmap->extents_count)
+      return 0;
+
+   ext = &cmap->extents[lo];
+
+   if (idx - ext->idx >= ext->count)
+      return 0; /* past the end */
+
+   *clu = ext->clu + (idx - ext->idx);
+   return ext->count - (idx - ext->idx);
+}
@@ -0,0 +1,266 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/fs/fat32.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/sched.h>
+
+/*
+ * FNV-1a hash of the name. Short names are matched case-insensitively (see
+ * fat_search_entry_cb()), therefore they're hashed in lower case.
+ */
+static u32 fat_name_hash(const char *name, size_t len, bool lower)
+{
+   u32 h = 2166136261u;
+
+   for (size_t i = 0; i < len; i++) {
+      h ^= (u8)(lower ? tolower(name[i]) : name[i]);
+      h *= 16777619u;
+   }
+
+   return h;
+}
+
+struct fat_dindex_build_ctx {
+
+   struct fat_dir_index *idx;    /* NULL while just counting */
+   u32 count;
+   u32 names_size;
+};
+
+static int
+fat_dindex_build_cb(struct fat_hdr *hdr,
+                    enum fat_type ft,
+                    struct fat_entry *entry,
+                    const char *long_name,
+                    void *arg)
+{
+   struct fat_dindex_build_ctx *ctx = arg;
+   struct fat_dir_index *idx = ctx->idx;
+   struct fat_dir_index_entry *ie;
+   char short_name[16];
+   const char *name = long_name;
+   size_t len;
+
+   if (!name) {
+      fat_get_short_name(entry, short_name);
+      name = short_name;
+   }
+
+   len = strlen(name);
+
+   if (idx) {
+
+      ie = &idx->ents[ctx->count];
+
+      *ie = (struct fat_dir_index_entry) {
+         .e          = entry,
+         .hash       = fat_name_hash(name, len, !long_name),
+         .name_off   = ctx->names_size,
+         .name_len   = (u8)len,
+         .long_name  = !!long_name,
+      };
+
+      memcpy(idx->names + ctx->names_size, name, len + 1);
+   }
+
+   ctx->count++;
+   ctx->names_size += (u32)len + 1;
+   return 0;
+}
+
+static int
+fat_dindex_walk(struct fat_fs_device_data *d,
+                struct fat_entry *e,
+                struct fat_dindex_build_ctx *ctx)
+{
+   struct fat_walk_long_name_ctx walk_ctx;
+   struct fat_walk_static_params walk_params = {
+      .ctx = &walk_ctx,
+      .h = d->hdr,
+      .ft = d->type,
+      .cb = &fat_dindex_build_cb,
+      .arg = ctx,
+   };
+
+   return fat_walk(&walk_params,
+                   e == d->root_dir_entries
+                     ? d->root_cluster
+                     : fat_get_first_cluster(e));
+}
+
+static struct fat_dir_index *
+fat_build_dir_index(struct fat_fs_device_data *d, struct fat_entry *e)
+{
+   struct fat_dindex_build_ctx ctx = {0};
+   struct fat_dir_index *idx;
+   u32 count, names_size, htable_size;
+   size_t size;
+
+   if (fat_dindex_walk(d, e, &ctx))
+      return NULL;
+
+   count = ctx.count;
+   names_size = ctx.names_size;
+   htable_size = FAT_DINDEX_MIN_BUCKETS;
+
+   while (htable_size < count)
+      htable_size *= 2;        /* keep the load factor <= 1 */
+
+   size = sizeof(*idx) +
+          count * sizeof(struct fat_dir_index_entry) +
+          htable_size * sizeof(u32) +
+          names_size;
+
+   if (!(idx = kmalloc(size)))
+      return NULL;
+
+   bintree_node_init(&idx->node);
+   idx->e = e;
+   idx->count = count;
+   idx->htable_size = htable_size;
+   idx->alloc_size = size;
+   idx->htable = (u32 *)(void *)&idx->ents[count];
+   idx->names = (char *)&idx->htable[htable_size];
+   bzero(idx->htable, htable_size * sizeof(u32));
+
+   ctx = (struct fat_dindex_build_ctx) { .idx = idx };
+   fat_dindex_walk(d, e, &ctx);
+
+   /* The file system is read-only: the directory cannot change */
+   ASSERT(ctx.count == count);
+   ASSERT(ctx.names_size == names_size);
+
+   /*
+    * Add the entries to the hash chains in reverse order, so that each chain
+    * keeps the entries in the same order as in the directory.
+    */
+   for (u32 i = count; i > 0; i--) {
+      struct fat_dir_index_entry *ie = &idx->ents[i - 1];
+      u32 *head = &idx->htable[ie->hash & (htable_size - 1)];
+      ie->next = *head;
+      *head = i;
+   }
+
+   return idx;
+}
+
+static inline void fat_free_dir_index(struct fat_dir_index *idx)
+{
+   kfree2(idx, idx->alloc_size);
+}
+
+/*
+ * Get the index of the directory `e`, building it if it's not in the cache.
+ * Returns NULL in case of out-of-memory: the callers have to walk the directory.
+ */
+struct fat_dir_index *
+fat_get_dir_index(struct fat_fs_device_data *d, struct fat_entry *e)
+{
+   struct fat_dir_index *idx, *idx2;
+
+   disable_preemption();
+   {
+      idx = bintree_find_ptr(d->dindexes, e, struct fat_dir_index, node, e);
+   }
+   enable_preemption();
+
+   if (idx)
+      return idx;
+
+   if (!(idx = fat_build_dir_index(d, e)))
+      return NULL;
+
+   disable_preemption();
+   {
+      /* Another task might have built the same index in the meanwhile */
+      idx2 = bintree_find_ptr(d->dindexes, e, struct fat_dir_index, node, e);
+
+      if (!idx2)
+         bintree_insert_ptr(&d->dindexes, idx, struct fat_dir_index, node, e);
+   }
+   enable_preemption();
+
+   if (idx2) {
+      fat_free_dir_index(idx);
+      idx = idx2;
+   }
+
+   return idx;
+}
+
+void fat_destroy_dir_indexes(struct fat_fs_device_data *d)
+{
+   struct fat_dir_index *idx;
+
+   while ((idx = bintree_get_first_obj(d->dindexes,
+                                       struct fat_dir_index,
+                                       node)))
+   {
+      bintree_remove_ptr(&d->dindexes, idx, struct fat_dir_index, node, e);
+      fat_free_dir_index(idx);
+   }
+}
+
+static bool
+fat_dindex_name_match(struct fat_dir_index *idx,
+                      struct fat_dir_index_entry *ie,
+                      const char *name,
+                      size_t len)
+{
+   const char *n = idx->names + ie->name_off;
+
+   if (ie->name_len != len)
+      return false;
+
+   if (ie->long_name)
+      return !memcmp(n, name, len);
+
+   for (size_t i = 0; i < len; i++)
+      if (tolower(n[i]) != tolower(name[i]))
+         return false;
+
+   return true;
+}
+
+/*
+ * Find in `idx` the first entry named `name`, using exactly the same rules as
+ * fat_search_entry_cb(): case sensitive comparison for long names and case
+ * insensitive for short names. Returns NULL if there's no such entry.
+ */
+struct fat_entry *
+fat_dindex_lookup(struct fat_dir_index *idx, const char *name, size_t len)
+{
+   const u32 hashes[2] = {
+      fat_name_hash(name, len, false),       /* long names */
+      fat_name_hash(name, len, true),        /* short names */
+   };
+
+   u32 found = 0;
+
+   if (!len || len > 255)
+      return NULL;
+
+   for (u32 k = 0; k < ARRAY_SIZE(hashes); k++) {
+
+      u32 i = idx->htable[hashes[k] & (idx->htable_size - 1)];
+
+      /* Entries in the chain are in directory order: stop at `found` */
+      for (; i && (!found || i < found); i = idx->ents[i - 1].next) {
+
+         struct fat_dir_index_entry *ie = &idx->ents[i - 1];
+
+         if (ie->hash != hashes[k] || ie->long_name != !k)
+            continue;
+
+         if (fat_dindex_name_match(idx, ie, name, len)) {
+            found = i;
+            break;
+         }
+      }
+   }
+
+   return found ? idx->ents[found - 1].e : NULL;
+}
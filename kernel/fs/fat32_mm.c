@@ -10,11 +10,21 @@
 #include <tilck/kernel/system_mmap.h>
 #include <tilck/kernel/fs/vfs_base.h>
 #include <tilck/kernel/fs/fat32.h>
+#include <tilck/kernel/fs/crd.h>
 
 int fat_ramdisk_prepare_for_mmap(struct fat_fs_device_data *d, size_t rd_size)
 {
    struct fat_hdr *hdr = d->hdr;
 
+   if (crd_is_crd_vaddr(hdr)) {
+
+      /*
+       * Compressed ramdisk: the data is decompressed on demand in buffers that
+       * might be dropped at any time. We cannot map such pages in user space.
+       */
+      return -1;
+   }
+
    if (system_mmap_check_for_extra_ramdisk_region(hdr)) {
 
       /*
@@ -93,6 +103,60 @@ int fat_ramdisk_prepare_for_mmap(struct fat_fs_device_data *d, size_t rd_size)
    return 0;
 }
 
+/*
+ * Map the file's pages in the region using its cluster map: all the pages of
+ * each extent are mapped at once, without following the cluster chain.
+ */
+static int
+fat_mmap_extents(struct user_mapping *um,
+                 pdir_t *pdir,
+                 struct fat_fs_device_data *d,
+                 struct fat_cluster_map *cmap)
+{
+   const size_t off_begin = um->off;
+   const size_t off_end = off_begin + um->len;
+   size_t mapped_cnt, tot_mapped_cnt = 0;
+
+   for (u32 i = 0; i < cmap->extents_count; i++) {
+
+      const struct fat_extent *ext = &cmap->extents[i];
+      const size_t ext_begin = (size_t)ext->idx * d->cluster_size;
+      const size_t ext_end = ext_begin + (size_t)ext->count * d->cluster_size;
+      size_t from, to, pg_count;
+      char *data;
+
+      if (ext_end <= off_begin)
+         continue;    /* the extent is before our region */
+
+      if (ext_begin >= off_end)
+         break;       /* the extent (and all the next ones) are after it */
+
+      from = MAX(ext_begin, off_begin);
+      to = MIN(ext_end, off_end);
+      pg_count = (to - from) >> PAGE_SHIFT;
+      data = fat_get_pointer_to_cluster_data(d->hdr, ext->clu);
+      data += from - ext_begin;
+
+      mapped_cnt = map_pages(pdir,
+                             (void *)(um->vaddr + (from - off_begin)),
+                             KERNEL_VA_TO_PA(data),
+                             pg_count,
+                             PAGING_FL_US | PAGING_FL_SHARED);
+
+      if (mapped_cnt != pg_count) {
+         unmap_pages_permissive(pdir,
+                                (void *)um->vaddr,
+                                tot_mapped_cnt + mapped_cnt,
+                                false);
+         return -ENOMEM;
+      }
+
+      tot_mapped_cnt += mapped_cnt;
+   }
+
+   return 0;
+}
+
 int fat_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
 {
    struct fatfs_handle *fh = um->h;
@@ -112,6 +176,9 @@ int fat_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
    if (flags & VFS_MM_DONT_MMAP)
       return 0;
 
+   if (fh->cmap)
+      return fat_mmap_extents(um, pdir, d, fh->cmap);
+
    clu = fat_get_first_cluster(fh->e);
 
    do {
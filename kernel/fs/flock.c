@@ -6,6 +6,7 @@
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/bintree.h>
+#include <tilck/kernel/elf_loader.h>
 
 struct locked_file {
 
@@ -95,6 +96,16 @@ acquire_subsys_flock(struct fs *fs,
    }
    enable_preemption();
 
+   if (subsys == SUBSYS_VFS) {
+
+      /*
+       * The file is going to be modified: drop its cached ELF headers, if any.
+       * No new ones can be added while we hold the lock, because execve()
+       * needs to acquire it as SUBSYS_PROCMGNT.
+       */
+      elf_cache_invalidate(fs, i);
+   }
+
    *lock_ref = lf;
    return 0;
 }
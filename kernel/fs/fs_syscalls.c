@@ -11,23 +11,25 @@
 #include <tilck/kernel/fault_resumable.h>
 #include <tilck/kernel/syscalls.h>
 #include <tilck/kernel/pipe.h>
+#include <tilck/kernel/epoll.h>
 
 #include <fcntl.h>      // system header
+#include <linux/fs.h>   // system header
+#include <sys/epoll.h>  // system header
 
 static inline bool is_fd_in_valid_range(int fd)
 {
-   return IN_RANGE(fd, 0, MAX_HANDLES);
+   return IN_RANGE(fd, 0, (int)get_curr_proc()->nofile_limit);
 }
 
+/*
+ * Returns the lowest free fd >= `ge`, expanding the fd table if necessary, or
+ * -EMFILE (no free fds below RLIMIT_NOFILE) or -ENOMEM.
+ */
 static int get_free_handle_num_ge(struct process *pi, int ge)
 {
    ASSERT(kmutex_is_curr_task_holding_lock(&pi->fslock));
-
-   for (int free_fd = ge; free_fd < MAX_HANDLES; free_fd++)
-      if (!pi->handles[free_fd])
-         return free_fd;
-
-   return -1;
+   return fdt_get_free_fd(&pi->fdt, ge, pi->nofile_limit);
 }
 
 static int get_free_handle_num(struct process *pi)
@@ -50,8 +52,8 @@ fs_handle get_fs_handle(int fd)
 
    kmutex_lock(&curr->pi->fslock);
 
-   if (is_fd_in_valid_range(fd) && curr->pi->handles[fd])
-      handle = curr->pi->handles[fd];
+   if (fd >= 0)
+      handle = fdt_get(&curr->pi->fdt, fd);
 
    kmutex_unlock(&curr->pi->fslock);
    return handle;
@@ -87,24 +89,20 @@ int sys_open(const char *u_path, int flags, mode_t mode)
 
    kmutex_lock(&curr->pi->fslock);
 
-   if ((free_fd = get_free_handle_num(curr->pi)) < 0)
-      goto no_fds;
+   if ((ret = free_fd = get_free_handle_num(curr->pi)) < 0)
+      goto end;
 
    if ((ret = vfs_open(path, &h, flags, mode)) < 0)
       goto end;
 
    ASSERT(h != NULL);
 
-   curr->pi->handles[free_fd] = h;
+   fdt_set(&curr->pi->fdt, free_fd, h);
    ret = free_fd;
 
 end:
    kmutex_unlock(&curr->pi->fslock);
    return ret;
-
-no_fds:
-   ret = -EMFILE;
-   goto end;
 }
 
 int sys_creat(const char *u_path, mode_t mode)
@@ -150,7 +148,7 @@ int sys_close(int fd)
    kmutex_lock(&curr->pi->fslock);
    {
       vfs_close(handle);
-      curr->pi->handles[fd] = NULL;
+      fdt_set(&curr->pi->fdt, fd, NULL);
    }
    kmutex_unlock(&curr->pi->fslock);
    return ret;
@@ -197,6 +195,16 @@ int sys_read(int fd, void *u_buf, size_t count)
    if (h->spec_flags & VFS_SPFL_NO_USER_COPY)
       return (int) vfs_read(h, u_buf, count);
 
+   if (h->fops->read_iter) {
+
+      /* Copy directly to the user buffer: no bounce, no size limit */
+      struct iovec iov = { u_buf, MIN(count, VFS_MAX_RW_COUNT) };
+      struct io_iter it;
+
+      io_iter_init(&it, &iov, 1, true);
+      return (int) vfs_read_iter(h, &it);
+   }
+
    count = MIN(count, IO_COPYBUF_SIZE);
    ret = (int) vfs_read(h, curr->io_copybuf, count);
 
@@ -221,6 +229,16 @@ int sys_write(int fd, const void *u_buf, size_t count)
    if (h->spec_flags & VFS_SPFL_NO_USER_COPY)
       return (int)vfs_write(h, (void *)u_buf, count);
 
+   if (h->fops->write_iter) {
+
+      /* Copy directly from the user buffer: no bounce, no size limit */
+      struct iovec iov = { (void *)u_buf, MIN(count, VFS_MAX_RW_COUNT) };
+      struct io_iter it;
+
+      io_iter_init(&it, &iov, 1, true);
+      return (int)vfs_write_iter(h, &it);
+   }
+
    count = MIN(count, IO_COPYBUF_SIZE);
 
    if (copy_from_user(curr->io_copybuf, u_buf, count))
@@ -254,12 +272,13 @@ static bool iov_len_overflow(const struct iovec *iov, int iovcnt)
    return false;
 }
 
-int sys_writev(int fd, const struct iovec *u_iov, int u_iovcnt)
+/* Copy and validate the user iovec array into the task's `args_copybuf` */
+static int
+get_iov_from_user(const struct iovec *u_iov, int u_iovcnt, struct iovec **out)
 {
    struct task *curr = get_curr_task();
    struct iovec *iov = (void *)curr->args_copybuf;
    const u32 iovcnt = (u32) u_iovcnt;
-   fs_handle handle;
 
    if (u_iovcnt <= 0)
       return -EINVAL;
@@ -273,6 +292,19 @@ int sys_writev(int fd, const struct iovec *u_iov, int u_iovcnt)
    if (iov_len_overflow(iov, u_iovcnt))
       return -EINVAL;
 
+   *out = iov;
+   return 0;
+}
+
+int sys_writev(int fd, const struct iovec *u_iov, int u_iovcnt)
+{
+   struct iovec *iov;
+   fs_handle handle;
+   int rc;
+
+   if ((rc = get_iov_from_user(u_iov, u_iovcnt, &iov)))
+      return rc;
+
    if (!(handle = get_fs_handle(fd)))
       return -EBADF;
 
@@ -281,27 +313,505 @@ int sys_writev(int fd, const struct iovec *u_iov, int u_iovcnt)
 
 int sys_readv(int fd, const struct iovec *u_iov, int u_iovcnt)
 {
-   struct task *curr = get_curr_task();
-   struct iovec *iov = (void *)curr->args_copybuf;
-   const u32 iovcnt = (u32) u_iovcnt;
+   struct iovec *iov;
    fs_handle handle;
+   int rc;
 
-   if (u_iovcnt <= 0)
+   if ((rc = get_iov_from_user(u_iov, u_iovcnt, &iov)))
+      return rc;
+
+   if (!(handle = get_fs_handle(fd)))
+      return -EBADF;
+
+   return (int)vfs_readv(handle, iov, u_iovcnt);
+}
+
+/*
+ * Positional I/O: on i386, the 64-bit file offset is passed in two registers.
+ * Offsets not fitting in `offt` cannot refer to any data in Tilck's files.
+ */
+static int get_rw_pos(size_t pos_low, size_t pos_hi, offt *pos)
+{
+   const s64 pos64 = (s64)(((u64)pos_hi << 32) | pos_low);
+
+   if (pos64 < 0)
       return -EINVAL;
 
-   if (sizeof(struct iovec) * iovcnt > ARGS_COPYBUF_SIZE)
+   if (pos64 != (s64)(offt)pos64)
+      return -EOVERFLOW;
+
+   *pos = (offt)pos64;
+   return 0;
+}
+
+static int
+do_prw(int fd, const struct iovec *iov, int iovcnt, offt pos, bool write)
+{
+   fs_handle handle;
+   struct io_iter it;
+
+   if (!(handle = get_fs_handle(fd)))
+      return -EBADF;
+
+   io_iter_init(&it, iov, iovcnt, true);
+
+   return write
+      ? (int)vfs_pwrite_iter(handle, &it, pos)
+      : (int)vfs_pread_iter(handle, &it, pos);
+}
+
+int sys_pread64(int fd, void *u_buf, size_t count,
+                size_t pos_low, size_t pos_hi)
+{
+   struct iovec iov = { u_buf, MIN(count, VFS_MAX_RW_COUNT) };
+   offt pos;
+   int rc;
+
+   if ((rc = get_rw_pos(pos_low, pos_hi, &pos)))
+      return rc;
+
+   return do_prw(fd, &iov, 1, pos, false);
+}
+
+int sys_pwrite64(int fd, const void *u_buf, size_t count,
+                 size_t pos_low, size_t pos_hi)
+{
+   struct iovec iov = { (void *)u_buf, MIN(count, VFS_MAX_RW_COUNT) };
+   offt pos;
+   int rc;
+
+   if ((rc = get_rw_pos(pos_low, pos_hi, &pos)))
+      return rc;
+
+   return do_prw(fd, &iov, 1, pos, true);
+}
+
+int sys_preadv(int fd, const struct iovec *u_iov, int u_iovcnt,
+               size_t pos_low, size_t pos_hi)
+{
+   struct iovec *iov;
+   offt pos;
+   int rc;
+
+   if ((rc = get_iov_from_user(u_iov, u_iovcnt, &iov)))
+      return rc;
+
+   if ((rc = get_rw_pos(pos_low, pos_hi, &pos)))
+      return rc;
+
+   return do_prw(fd, iov, u_iovcnt, pos, false);
+}
+
+int sys_pwritev(int fd, const struct iovec *u_iov, int u_iovcnt,
+                size_t pos_low, size_t pos_hi)
+{
+   struct iovec *iov;
+   offt pos;
+   int rc;
+
+   if ((rc = get_iov_from_user(u_iov, u_iovcnt, &iov)))
+      return rc;
+
+   if ((rc = get_rw_pos(pos_low, pos_hi, &pos)))
+      return rc;
+
+   return do_prw(fd, iov, u_iovcnt, pos, true);
+}
+
+/*
+ * All of Tilck's file systems write the data synchronously: the RWF_*SYNC
+ * flags have nothing to do, while RWF_HIPRI is just a hint. Everything else
+ * (e.g. RWF_NOWAIT, RWF_APPEND) is not supported.
+ */
+#define SUPPORTED_RWF_FLAGS               (RWF_HIPRI | RWF_DSYNC | RWF_SYNC)
+
+int sys_preadv2(int fd, const struct iovec *u_iov, int u_iovcnt,
+                size_t pos_low, size_t pos_hi, int flags)
+{
+   fs_handle handle;
+   struct iovec *iov;
+   int rc;
+
+   if (flags & ~SUPPORTED_RWF_FLAGS)
+      return -EOPNOTSUPP;
+
+   if (pos_low == (size_t)-1 && pos_hi == (size_t)-1) {
+
+      /* pos == -1: use the current file position, like readv() */
+      if ((rc = get_iov_from_user(u_iov, u_iovcnt, &iov)))
+         return rc;
+
+      if (!(handle = get_fs_handle(fd)))
+         return -EBADF;
+
+      return (int)vfs_readv(handle, iov, u_iovcnt);
+   }
+
+   return sys_preadv(fd, u_iov, u_iovcnt, pos_low, pos_hi);
+}
+
+int sys_pwritev2(int fd, const struct iovec *u_iov, int u_iovcnt,
+                 size_t pos_low, size_t pos_hi, int flags)
+{
+   fs_handle handle;
+   struct iovec *iov;
+   int rc;
+
+   if (flags & ~SUPPORTED_RWF_FLAGS)
+      return -EOPNOTSUPP;
+
+   if (pos_low == (size_t)-1 && pos_hi == (size_t)-1) {
+
+      /* pos == -1: use the current file position, like writev() */
+      if ((rc = get_iov_from_user(u_iov, u_iovcnt, &iov)))
+         return rc;
+
+      if (!(handle = get_fs_handle(fd)))
+         return -EBADF;
+
+      return (int)vfs_writev(handle, iov, u_iovcnt);
+   }
+
+   return sys_pwritev(fd, u_iov, u_iovcnt, pos_low, pos_hi);
+}
+
+/* ------------ In-kernel data movement between files ------------- */
+
+#ifndef SPLICE_F_MOVE
+   #define SPLICE_F_MOVE                  1
+   #define SPLICE_F_NONBLOCK              2
+   #define SPLICE_F_MORE                  4
+   #define SPLICE_F_GIFT                  8
+#endif
+
+#define SUPPORTED_SPLICE_FLAGS                                          \
+   (SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE | SPLICE_F_GIFT)
+
+static int get_user_off64(const s64 *u_off, offt *off)
+{
+   s64 val;
+
+   if (copy_from_user(&val, u_off, sizeof(val)))
+      return -EFAULT;
+
+   if (val < 0)
       return -EINVAL;
 
-   if (copy_from_user(iov, u_iov, sizeof(struct iovec) * iovcnt))
+   if (val != (s64)(offt)val)
+      return -EOVERFLOW;
+
+   *off = (offt)val;
+   return 0;
+}
+
+static int put_user_off64(s64 *u_off, offt off)
+{
+   s64 val = off;
+   return copy_to_user(u_off, &val, sizeof(val)) ? -EFAULT : 0;
+}
+
+/* True if data can be read from `h` at `pos` (or at its current position) */
+static bool can_read_data(struct fs_handle_base *h, offt *pos)
+{
+   return pos ? !!h->fops->pread_iter : !!h->fops->read_iter;
+}
+
+/* Read from `in` (a file or a pipe) and write to `out`, without user copies */
+static int
+do_sendfile(fs_handle in, offt *pos, fs_handle out, size_t count)
+{
+   if (!can_read_data(in, pos))
+      return -EINVAL;
+
+   if (is_pipe_write_end(out)) {
+
+      /*
+       * Reading from a pipe while holding the lock of `out` would deadlock
+       * when `in` is the same pipe, or when another task splices in the
+       * opposite direction: use the pipe to pipe path, which handles that.
+       */
+      if (is_pipe_read_end(in))
+         return (int)pipe_splice_pipe(in, out, count, false, true);
+
+      return (int)pipe_splice_from_file(out, in, pos, count, false);
+   }
+
+   /*
+    * The data read from a pipe cannot be put back when `out` accepts only a
+    * part of it: drain the pipe directly to `out`, consuming only the bytes
+    * actually written.
+    */
+   if (is_pipe_read_end(in))
+      return (int)pipe_splice_to_file(in, out, NULL, count, false);
+
+   return (int)vfs_copy_data(in, pos, out, NULL, count);
+}
+
+int sys_sendfile(int out_fd, int in_fd, long *u_off, size_t count)
+{
+   fs_handle in, out;
+   long off32;
+   offt pos;
+   int rc;
+
+   if (!(in = get_fs_handle(in_fd)) || !(out = get_fs_handle(out_fd)))
+      return -EBADF;
+
+   if (!u_off)
+      return do_sendfile(in, NULL, out, count);
+
+   if (copy_from_user(&off32, u_off, sizeof(off32)))
       return -EFAULT;
 
-   if (iov_len_overflow(iov, u_iovcnt))
+   if (off32 < 0)
       return -EINVAL;
 
-   if (!(handle = get_fs_handle(fd)))
+   pos = off32;
+
+   if ((rc = do_sendfile(in, &pos, out, count)) > 0) {
+
+      off32 = (long)pos;
+
+      if (copy_to_user(u_off, &off32, sizeof(off32)))
+         return -EFAULT;
+   }
+
+   return rc;
+}
+
+int sys_sendfile64(int out_fd, int in_fd, s64 *u_off, size_t count)
+{
+   fs_handle in, out;
+   offt pos;
+   int rc;
+
+   if (!(in = get_fs_handle(in_fd)) || !(out = get_fs_handle(out_fd)))
       return -EBADF;
 
-   return (int)vfs_readv(handle, iov, u_iovcnt);
+   if (!u_off)
+      return do_sendfile(in, NULL, out, count);
+
+   if ((rc = get_user_off64(u_off, &pos)))
+      return rc;
+
+   if ((rc = do_sendfile(in, &pos, out, count)) > 0) {
+      if (put_user_off64(u_off, pos))
+         return -EFAULT;
+   }
+
+   return rc;
+}
+
+static bool is_same_file(struct fs_handle_base *h1, struct fs_handle_base *h2)
+{
+   return h1->fs == h2->fs &&
+          h1->fs->fsops->get_inode(h1) == h2->fs->fsops->get_inode(h2);
+}
+
+int sys_copy_file_range(int fd_in, s64 *u_off_in,
+                        int fd_out, s64 *u_off_out,
+                        size_t len, u32 flags)
+{
+   struct fs_handle_base *in, *out;
+   offt off_in, off_out;
+   offt *p_in = NULL, *p_out = NULL;
+   offt pos_in, pos_out;
+   int rc;
+
+   if (flags)
+      return -EINVAL;
+
+   if (!(in = get_fs_handle(fd_in)) || !(out = get_fs_handle(fd_out)))
+      return -EBADF;
+
+   if ((in->fl_flags & O_WRONLY) && !(in->fl_flags & O_RDWR))
+      return -EBADF;
+
+   if (!(out->fl_flags & (O_WRONLY | O_RDWR)) || (out->fl_flags & O_APPEND))
+      return -EBADF;
+
+   /* Only regular files, supporting positional I/O, are allowed here */
+   if (!in->fops->pread_iter || !out->fops->pwrite_iter)
+      return -EINVAL;
+
+   if (u_off_in) {
+
+      if ((rc = get_user_off64(u_off_in, &off_in)))
+         return rc;
+
+      p_in = &off_in;
+   }
+
+   if (u_off_out) {
+
+      if ((rc = get_user_off64(u_off_out, &off_out)))
+         return rc;
+
+      p_out = &off_out;
+   }
+
+   len = MIN(len, VFS_MAX_RW_COUNT);
+
+   if (is_same_file(in, out)) {
+
+      pos_in = p_in ? *p_in : vfs_seek(in, 0, SEEK_CUR);
+      pos_out = p_out ? *p_out : vfs_seek(out, 0, SEEK_CUR);
+
+      if (pos_in < 0 || pos_out < 0)
+         return -EINVAL;
+
+      /*
+       * Overlapping ranges in the same file are not allowed. NOTE: compare
+       * using 64-bit values, because `pos + len` might overflow an offt.
+       */
+      if ((s64)pos_in < (s64)pos_out + (s64)len &&
+          (s64)pos_out < (s64)pos_in + (s64)len)
+      {
+         return -EINVAL;
+      }
+   }
+
+   rc = (int)vfs_copy_data(in, p_in, out, p_out, len);
+
+   if (rc > 0) {
+
+      if (p_in && put_user_off64(u_off_in, off_in))
+         return -EFAULT;
+
+      if (p_out && put_user_off64(u_off_out, off_out))
+         return -EFAULT;
+   }
+
+   return rc;
+}
+
+int sys_splice(int fd_in, s64 *u_off_in,
+               int fd_out, s64 *u_off_out,
+               size_t len, u32 flags)
+{
+   struct fs_handle_base *in, *out;
+   const bool nonblock = !!(flags & SPLICE_F_NONBLOCK);
+   offt off;
+   int rc;
+
+   if (flags & ~SUPPORTED_SPLICE_FLAGS)
+      return -EINVAL;
+
+   if (!(in = get_fs_handle(fd_in)) || !(out = get_fs_handle(fd_out)))
+      return -EBADF;
+
+   len = MIN(len, VFS_MAX_RW_COUNT);
+
+   if (is_pipe_read_end(in)) {
+
+      if (u_off_in)
+         return -ESPIPE;
+
+      if (is_pipe_write_end(out)) {
+
+         if (u_off_out)
+            return -ESPIPE;
+
+         return (int)pipe_splice_pipe(in, out, len, nonblock, true);
+      }
+
+      /* pipe -> file */
+      if (!u_off_out) {
+
+         if (!out->fops->write_iter)
+            return -EINVAL;
+
+         return (int)pipe_splice_to_file(in, out, NULL, len, nonblock);
+      }
+
+      if ((rc = get_user_off64(u_off_out, &off)))
+         return rc;
+
+      if ((rc = (int)pipe_splice_to_file(in, out, &off, len, nonblock)) > 0) {
+         if (put_user_off64(u_off_out, off))
+            return -EFAULT;
+      }
+
+      return rc;
+   }
+
+   if (!is_pipe_write_end(out))
+      return -EINVAL; /* at least one of the two fds must refer to a pipe */
+
+   if (u_off_out)
+      return -ESPIPE;
+
+   /* file -> pipe */
+   if (!u_off_in) {
+
+      if (!can_read_data(in, NULL))
+         return -EINVAL;
+
+      return (int)pipe_splice_from_file(out, in, NULL, len, nonblock);
+   }
+
+   if ((rc = get_user_off64(u_off_in, &off)))
+      return rc;
+
+   if ((rc = (int)pipe_splice_from_file(out, in, &off, len, nonblock)) > 0) {
+      if (put_user_off64(u_off_in, off))
+         return -EFAULT;
+   }
+
+   return rc;
+}
+
+int sys_tee(int fd_in, int fd_out, size_t len, u32 flags)
+{
+   fs_handle in, out;
+
+   if (flags & ~SUPPORTED_SPLICE_FLAGS)
+      return -EINVAL;
+
+   if (!(in = get_fs_handle(fd_in)) || !(out = get_fs_handle(fd_out)))
+      return -EBADF;
+
+   if (!is_pipe_read_end(in) || !is_pipe_write_end(out))
+      return -EINVAL;
+
+   len = MIN(len, VFS_MAX_RW_COUNT);
+   return (int)pipe_splice_pipe(in, out, len, !!(flags & SPLICE_F_NONBLOCK),
+                                false);
+}
+
+/*
+ * NOTE: pipes in Tilck are byte ring buffers, not lists of page references:
+ * the user pages cannot be "gifted" to the pipe, therefore vmsplice() just
+ * copies the data, like writev() and readv() do. SPLICE_F_NONBLOCK is ignored:
+ * the pipe's O_NONBLOCK flag is honored, as usual.
+ */
+int sys_vmsplice(int fd, const struct iovec *u_iov, size_t nr_segs, u32 flags)
+{
+   fs_handle h;
+   struct iovec *iov;
+   int rc;
+
+   if (flags & ~SUPPORTED_SPLICE_FLAGS)
+      return -EINVAL;
+
+   if (!(h = get_fs_handle(fd)))
+      return -EBADF;
+
+   if (!is_pipe_read_end(h) && !is_pipe_write_end(h))
+      return -EBADF;
+
+   if (!nr_segs)
+      return 0;
+
+   if (nr_segs > ARGS_COPYBUF_SIZE / sizeof(struct iovec))
+      return -EINVAL;
+
+   if ((rc = get_iov_from_user(u_iov, (int)nr_segs, &iov)))
+      return rc;
+
+   return is_pipe_write_end(h)
+      ? (int)vfs_writev(h, iov, (int)nr_segs)
+      : (int)vfs_readv(h, iov, (int)nr_segs);
 }
 
 static int
@@ -502,7 +1012,7 @@ int sys_dup2(int oldfd, int newfd)
    fs_handle old_h, new_h;
    struct task *curr = get_curr_task();
 
-   if (!is_fd_in_valid_range(oldfd))
+   if (oldfd < 0)
       return -EBADF;
 
    if (!is_fd_in_valid_range(newfd))
@@ -518,6 +1028,9 @@ int sys_dup2(int oldfd, int newfd)
       goto out;
    }
 
+   if ((rc = fdt_expand(&curr->pi->fdt, (u32)newfd + 1)))
+      goto out;
+
    new_h = get_fs_handle(newfd);
 
    if (new_h) {
@@ -554,7 +1067,7 @@ int sys_dup2(int oldfd, int newfd)
       goto out;
    }
 
-   curr->pi->handles[newfd] = new_h;
+   fdt_set(&curr->pi->fdt, newfd, new_h);
    rc = newfd;
 
 out:
@@ -564,14 +1077,12 @@ out:
 
 int sys_dup(int oldfd)
 {
-   int rc = -EMFILE, free_fd;
+   int rc, free_fd;
    struct process *pi = get_curr_proc();
 
    kmutex_lock(&pi->fslock);
    {
-      free_fd = get_free_handle_num(pi);
-
-      if (is_fd_in_valid_range(free_fd))
+      if ((rc = free_fd = get_free_handle_num(pi)) >= 0)
          rc = sys_dup2(oldfd, free_fd);
    }
    kmutex_unlock(&pi->fslock);
@@ -619,15 +1130,18 @@ static void debug_print_fcntl_command(int cmd)
 
 void close_cloexec_handles(struct process *pi)
 {
+   struct fs_handle_base *h;
+   int fd;
+
    kmutex_lock(&pi->fslock);
 
-   for (u32 i = 0; i < MAX_HANDLES; i++) {
+   fdt_for_each_fd(&pi->fdt, fd) {
 
-      struct fs_handle_base *h = pi->handles[i];
+      h = pi->fdt.handles[fd];
 
-      if (h && (h->fd_flags & FD_CLOEXEC)) {
+      if (h->fd_flags & FD_CLOEXEC) {
          vfs_close(h);
-         pi->handles[i] = NULL;
+         fdt_set(&pi->fdt, fd, NULL);
       }
    }
 
@@ -647,18 +1161,25 @@ int sys_fcntl64(int fd, int cmd, int arg)
 
       case F_DUPFD:
          {
+            if (arg < 0 || (u32)arg >= curr->pi->nofile_limit)
+               return -EINVAL;
+
             kmutex_lock(&curr->pi->fslock);
             int new_fd = get_free_handle_num_ge(curr->pi, arg);
-            rc = sys_dup2(fd, new_fd);
+            rc = new_fd < 0 ? new_fd : sys_dup2(fd, new_fd);
             kmutex_unlock(&curr->pi->fslock);
             return rc;
          }
 
       case F_DUPFD_CLOEXEC:
          {
+            if (arg < 0 || (u32)arg >= curr->pi->nofile_limit)
+               return -EINVAL;
+
             kmutex_lock(&curr->pi->fslock);
             int new_fd = get_free_handle_num_ge(curr->pi, arg);
-            if (!(rc = sys_dup2(fd, new_fd))) {
+            rc = new_fd < 0 ? new_fd : sys_dup2(fd, new_fd);
+            if (rc >= 0) {
                /* dup2 succeeded */
                struct fs_handle_base *h2 = get_fs_handle(new_fd);
                ASSERT(h2 != NULL);
@@ -902,7 +1423,7 @@ int sys_pipe2(int u_pipefd[2], int flags)
    if (!(read_h = pipe_create_read_handle(p)))
       goto fault;
 
-   curr->pi->handles[fds[0]] = read_h;
+   fdt_set(&curr->pi->fdt, fds[0], read_h);
 
    if ((fds[1] = get_free_handle_num(curr->pi)) < 0)
       goto no_fds;
@@ -910,7 +1431,7 @@ int sys_pipe2(int u_pipefd[2], int flags)
    if (!(write_h = pipe_create_write_handle(p)))
       goto fault;
 
-   curr->pi->handles[fds[1]] = write_h;
+   fdt_set(&curr->pi->fdt, fds[1], write_h);
 
    if (copy_to_user(u_pipefd, fds, sizeof(fds)))
       goto fault;
@@ -927,12 +1448,12 @@ end:
 err_end:
 
    if (read_h) {
-      curr->pi->handles[fds[0]] = NULL;
+      fdt_set(&curr->pi->fdt, fds[0], NULL);
       kfs_destroy_handle((void *)read_h);
    }
 
    if (write_h) {
-      curr->pi->handles[fds[1]] = NULL;
+      fdt_set(&curr->pi->fdt, fds[1], NULL);
       kfs_destroy_handle((void *)write_h);
    }
 
@@ -951,6 +1472,44 @@ no_mem:
    goto err_end;
 
 no_fds:
-   ret = -EMFILE;
+   ret = fds[0] < 0 ? fds[0] : fds[1];    /* -EMFILE or -ENOMEM */
    goto err_end;
 }
+
+int sys_epoll_create1(int flags)
+{
+   struct task *curr = get_curr_task();
+   struct fs_handle_base *h;
+   int fd;
+
+   if (flags & ~EPOLL_CLOEXEC)
+      return -EINVAL;
+
+   kmutex_lock(&curr->pi->fslock);
+
+   if ((fd = get_free_handle_num(curr->pi)) < 0)
+      goto end;
+
+   if (!(h = epoll_create_handle())) {
+      fd = -ENOMEM;
+      goto end;
+   }
+
+   if (flags & EPOLL_CLOEXEC)
+      h->fd_flags |= FD_CLOEXEC;
+
+   fdt_set(&curr->pi->fdt, fd, h);
+
+end:
+   kmutex_unlock(&curr->pi->fslock);
+   return fd;
+}
+
+int sys_epoll_create(int size)
+{
+   /* The size is just a hint, ignored since Linux 2.6.8. It must be > 0. */
+   if (size <= 0)
+      return -EINVAL;
+
+   return sys_epoll_create1(0);
+}
@@ -0,0 +1,1353 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/fs/overlayfs.h>
+#include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/sync.h>
+#include <tilck/kernel/rwlock.h>
+#include <tilck/kernel/list.h>
+
+#define OVL_HTABLE_MIN_SIZE              64
+#define OVL_HTABLE_MAX_LOAD               1
+#define OVL_COPY_BUF_SIZE         PAGE_SIZE
+
+struct overlayfs_stats overlayfs_stats;
+
+/*
+ * An entry of the overlay. Nodes are created by the first successful lookup
+ * and ref-counted: they're retained by the VFS and by their children nodes.
+ * The nodes of existing entries and the whiteouts hiding a lower entry are
+ * kept until the overlay is destroyed: that keeps their address (used as
+ * overlay's inode pointer) stable and allows them to remember the deleted
+ * lower entries. All the other nodes (e.g. files created and then deleted in
+ * the overlay) are freed as soon as they're unreferenced.
+ *
+ * Invariants:
+ *    - `upper` is not NULL iff the entry exists in the upper layer
+ *    - when both `upper` and `lower` are set, they're directories to merge
+ *    - a node having `lower` == NULL hides the lower entry with the same name,
+ *      if any (whiteout). Directories without `lower` are opaque.
+ */
+struct ovl_node {
+
+   struct list_node hnode;          /* node in ovl_data's hash table */
+   struct ovl_node *parent;         /* the root is the parent of itself */
+
+   vfs_inode_ptr_t upper;           /* inode in the upper layer, or NULL */
+   vfs_inode_ptr_t lower;           /* inode in the lower layer, or NULL */
+   enum vfs_entry_type type;        /* VFS_NONE when the entry was deleted */
+   bool has_lower;                  /* there's a lower entry with this name */
+
+   u32 ref_count;                   /* VFS references + children nodes */
+   u32 hash;
+   u16 name_len;                    /* NOTE: without the final '\0' */
+   char name[];
+};
+
+struct ovl_data {
+
+   struct fs *lower;
+   struct fs *upper;
+   struct ovl_node *root;
+
+   struct rwlock_wp rwlock;
+   struct kmutex copy_up_lock;      /* serializes the copy-ups */
+
+   struct list *htable;             /* (parent, name) -> node */
+   u32 htable_size;
+   u32 nodes_count;
+};
+
+enum ovl_dents_phase {
+
+   OVL_DENTS_UPPER,
+   OVL_DENTS_LOWER,
+   OVL_DENTS_END,
+};
+
+/*
+ * Only directories have overlay handles: opening files returns directly the
+ * handles of the layers, so that their I/O doesn't go through the overlay.
+ */
+struct ovl_handle {
+
+   /* struct fs_handle_base */
+   FS_HANDLE_BASE_FIELDS
+
+   /* overlayfs-specific members */
+   struct ovl_node *n;
+   fs_handle upper_h;
+   fs_handle lower_h;
+   enum ovl_dents_phase phase;
+};
+
+STATIC_ASSERT(sizeof(struct ovl_handle) <= MAX_FS_HANDLE_SIZE);
+
+static const struct fs_ops static_fsops_ovl;
+static const struct file_ops static_ops_ovl_dir;
+static int ovl_retain_inode(struct fs *fs, vfs_inode_ptr_t inode);
+static int ovl_release_inode(struct fs *fs, vfs_inode_ptr_t inode);
+
+/* FNV-1a hash of the entry name, seeded with its parent node */
+static u32 ovl_hash(struct ovl_node *parent, const char *name, size_t len)
+{
+   u32 h = 2166136261u ^ (u32)(ulong)parent;
+
+   for (size_t i = 0; i < len; i++) {
+      h ^= (u8)name[i];
+      h *= 16777619u;
+   }
+
+   return h;
+}
+
+static inline struct list *
+ovl_bucket(struct list *htable, u32 htable_size, u32 hash)
+{
+   ASSERT(htable_size && !(htable_size & (htable_size - 1)));
+   return &htable[hash & (htable_size - 1)];
+}
+
+static inline size_t ovl_node_size(size_t name_len)
+{
+   return sizeof(struct ovl_node) + name_len + 1;
+}
+
+/* NOTE: the hash table can be used only with the preemption disabled */
+static struct ovl_node *
+ovl_find_node(struct ovl_data *d,
+              struct ovl_node *parent,
+              const char *name,
+              size_t len,
+              u32 hash)
+{
+   struct ovl_node *n;
+
+   list_for_each_ro(n, ovl_bucket(d->htable, d->htable_size, hash), hnode) {
+
+      if (n->hash != hash || n->parent != parent || n->name_len != len)
+         continue;
+
+      if (!memcmp(n->name, name, len))
+         return n;
+   }
+
+   return NULL;
+}
+
+/*
+ * Free `n`, if it's unreferenced and it's not needed anymore (see ovl_node),
+ * and then its parents, as long as they become unused as well. NOTE: the hash
+ * table can be used only with the preemption disabled.
+ */
+static void ovl_free_unused_nodes(struct ovl_data *d, struct ovl_node *n)
+{
+   struct ovl_node *parent;
+   ASSERT(!is_preemption_enabled());
+
+   while (n != d->root &&
+          !n->ref_count && n->type == VFS_NONE && !n->has_lower)
+   {
+      parent = n->parent;
+      list_remove(&n->hnode);
+      kfree2(n, ovl_node_size(n->name_len));
+      d->nodes_count--;
+      overlayfs_stats.nodes--;
+
+      ASSERT(parent->ref_count > 0);
+      parent->ref_count--;
+      n = parent;
+   }
+}
+
+/* Drop a reference to `n`, freeing it if it's not needed anymore */
+static u32 ovl_put_node(struct ovl_data *d, struct ovl_node *n)
+{
+   u32 ref_count;
+
+   disable_preemption();
+   {
+      ASSERT(n->ref_count > 0);
+      ref_count = --n->ref_count;
+      ovl_free_unused_nodes(d, n);
+   }
+   enable_preemption();
+   return ref_count;
+}
+
+/*
+ * Re-hash all the nodes in a new table of `new_size` buckets. Failing to
+ * allocate the new table is not fatal: lookups will be just slower.
+ */
+static void ovl_resize_htable(struct ovl_data *d, u32 new_size)
+{
+   struct list *new_table, *old_table;
+   struct ovl_node *n, *tmp;
+   u32 old_size;
+
+   if (!(new_table = kmalloc(sizeof(struct list) * new_size)))
+      return;
+
+   for (u32 i = 0; i < new_size; i++)
+      list_init(&new_table[i]);
+
+   disable_preemption();
+   {
+      old_table = d->htable;
+      old_size = d->htable_size;
+
+      /* Another task might have resized the table in the meanwhile */
+      if (new_size > old_size) {
+
+         for (u32 i = 0; i < old_size; i++) {
+            list_for_each(n, tmp, &old_table[i], hnode) {
+               list_remove(&n->hnode);
+               list_add_tail(ovl_bucket(new_table, new_size, n->hash),
+                             &n->hnode);
+            }
+         }
+
+         d->htable = new_table;
+         d->htable_size = new_size;
+      }
+   }
+   enable_preemption();
+
+   if (new_size > old_size)
+      kfree2(old_table, sizeof(struct list) * old_size);
+   else
+      kfree2(new_table, sizeof(struct list) * new_size);
+}
+
+/*
+ * Find the node for `name` in `dir`, looking it up in the layers if it's not
+ * in the cache. Returns NULL if the entry does not exist in any layer, unless
+ * `create` is true: in that case, a node of type VFS_NONE is created for the
+ * new entry (NULL means out-of-memory) and the node is returned retained, as
+ * it might be freed otherwise: the caller has to call ovl_put_node() on it.
+ */
+static struct ovl_node *
+ovl_lookup(struct ovl_data *d,
+           struct ovl_node *dir,
+           const char *name,
+           size_t len,
+           bool create)
+{
+   const u32 hash = ovl_hash(dir, name, len);
+   struct fs_path up = {0}, lo = {0};
+   struct ovl_node *n, *n2;
+
+   disable_preemption();
+   {
+      if ((n = ovl_find_node(d, dir, name, len, hash)))
+         n->ref_count += create;
+   }
+   enable_preemption();
+
+   if (n)
+      return n;
+
+   if (dir->upper) {
+      vfs_fs_shlock(d->upper);
+      vfs_get_entry(d->upper, dir->upper, name, (ssize_t)len, &up);
+      vfs_fs_shunlock(d->upper);
+   }
+
+   if (dir->lower) {
+      vfs_fs_shlock(d->lower);
+      vfs_get_entry(d->lower, dir->lower, name, (ssize_t)len, &lo);
+      vfs_fs_shunlock(d->lower);
+   }
+
+   if (!up.inode && !lo.inode && !create)
+      return NULL; /* negative lookups are not cached */
+
+   if (!(n = kmalloc(ovl_node_size(len))))
+      return NULL;
+
+   list_node_init(&n->hnode);
+   n->parent = dir;
+   n->upper = up.inode;
+   n->lower = lo.inode;
+   n->type = up.inode ? up.type : lo.type;
+   n->has_lower = !!lo.inode;
+   n->ref_count = create;
+   n->hash = hash;
+   n->name_len = (u16)len;
+   memcpy(n->name, name, len);
+   n->name[len] = 0;
+
+   /* An upper entry hides the lower one, unless they're both directories */
+   if (up.inode && (up.type != VFS_DIR || lo.type != VFS_DIR))
+      n->lower = NULL;
+
+   disable_preemption();
+   {
+      /* Another task might have added the same node in the meanwhile */
+      n2 = ovl_find_node(d, dir, name, len, hash);
+
+      if (!n2) {
+         list_add_tail(ovl_bucket(d->htable, d->htable_size, hash), &n->hnode);
+         dir->ref_count++;
+         d->nodes_count++;
+         overlayfs_stats.nodes++;
+      } else {
+         n2->ref_count += create;
+      }
+   }
+   enable_preemption();
+
+   if (n2) {
+      kfree2(n, ovl_node_size(len));
+      return n2;
+   }
+
+   if (d->nodes_count > OVL_HTABLE_MAX_LOAD * d->htable_size)
+      ovl_resize_htable(d, d->htable_size * 2);
+
+   return n;
+}
+
+/*
+ * Mark `n` as deleted. Its node is kept as a whiteout when there's a lower
+ * entry with the same name to hide, otherwise it's freed, unless referenced.
+ */
+static void ovl_whiteout(struct ovl_data *d, struct ovl_node *n)
+{
+   n->upper = NULL;
+   n->lower = NULL;
+   n->type = VFS_NONE;
+
+   disable_preemption();
+   {
+      ovl_free_unused_nodes(d, n);
+   }
+   enable_preemption();
+}
+
+/* Return the layer where `n` lives (the upper one, if it's there) */
+static inline struct fs *
+ovl_get_layer(struct ovl_data *d, struct ovl_node *n, vfs_inode_ptr_t *inode)
+{
+   *inode = n->upper ? n->upper : n->lower;
+   return n->upper ? d->upper : d->lower;
+}
+
+/*
+ * Fill `p` with the path of `n` in the upper or in the lower layer, like the
+ * VFS does before calling the fs ops. The caller has to hold layer's lock.
+ */
+static void
+ovl_layer_path(struct ovl_data *d,
+               struct ovl_node *n,
+               bool upper,
+               struct vfs_path *p)
+{
+   struct fs *fs = upper ? d->upper : d->lower;
+
+   p->fs = fs;
+   p->last_comp = n->name;
+
+   if (n == d->root) {
+      vfs_get_root_entry(fs, &p->fs_path);
+      return;
+   }
+
+   vfs_get_entry(fs,
+                 upper ? n->parent->upper : n->parent->lower,
+                 n->name,
+                 n->name_len,
+                 &p->fs_path);
+}
+
+/* Set `n->upper` after creating `n` in the upper layer (holding its exlock) */
+static void ovl_set_upper(struct ovl_data *d, struct ovl_node *n)
+{
+   struct fs_path fp;
+
+   vfs_get_entry(d->upper, n->parent->upper, n->name, n->name_len, &fp);
+   ASSERT(fp.inode != NULL);
+
+   n->upper = fp.inode;
+   n->type = fp.type;
+}
+
+/*
+ * Open `n` in one of the layers, doing what vfs_open() does, except retaining
+ * layer's struct fs: that's up to the caller.
+ */
+static int
+ovl_layer_open(struct ovl_data *d,
+               struct ovl_node *n,
+               bool upper,
+               fs_handle *out,
+               int fl,
+               mode_t mode)
+{
+   struct fs *fs = upper ? d->upper : d->lower;
+   struct vfs_path p;
+   int rc;
+
+   vfs_fs_exlock(fs);
+   {
+      ovl_layer_path(d, n, upper, &p);
+      rc = fs->fsops->open(&p, out, fl, mode);
+   }
+   vfs_fs_exunlock(fs);
+
+   if (!rc)
+      ((struct fs_handle_base *)*out)->fl_flags = fl;
+
+   return rc;
+}
+
+static int ovl_upper_mkdir(struct ovl_data *d, struct ovl_node *n, mode_t mode)
+{
+   struct vfs_path p;
+   int rc;
+
+   vfs_fs_exlock(d->upper);
+   {
+      ovl_layer_path(d, n, true, &p);
+
+      if (!(rc = d->upper->fsops->mkdir(&p, mode)))
+         ovl_set_upper(d, n);
+   }
+   vfs_fs_exunlock(d->upper);
+   return rc;
+}
+
+/* Remove `n` from the upper layer, either with unlink() or with rmdir() */
+static int ovl_upper_remove(struct ovl_data *d, struct ovl_node *n, bool dir)
+{
+   struct vfs_path p;
+   int rc;
+
+   vfs_fs_exlock(d->upper);
+   {
+      ovl_layer_path(d, n, true, &p);
+
+      rc = dir
+         ? d->upper->fsops->rmdir(&p)
+         : d->upper->fsops->unlink(&p);
+   }
+   vfs_fs_exunlock(d->upper);
+
+   if (!rc)
+      n->upper = NULL;
+
+   return rc;
+}
+
+static int
+ovl_copy_up_file(struct ovl_data *d, struct ovl_node *n, mode_t mode)
+{
+   const int wr_fl = O_WRONLY | O_CREAT | O_EXCL;
+   fs_handle src = NULL, dst = NULL;
+   vfs_inode_ptr_t inode = NULL;
+   ssize_t rc, wrc;
+   char *buf;
+
+   if (!(buf = kmalloc(OVL_COPY_BUF_SIZE)))
+      return -ENOMEM;
+
+   if ((rc = ovl_layer_open(d, n, false, &src, O_RDONLY, 0)))
+      goto out;
+
+   retain_obj(d->lower);
+
+   if ((rc = ovl_layer_open(d, n, true, &dst, wr_fl, mode)))
+      goto out;
+
+   retain_obj(d->upper);
+   inode = d->upper->fsops->get_inode(dst);
+
+   while ((rc = vfs_read(src, buf, OVL_COPY_BUF_SIZE)) > 0) {
+
+      if ((wrc = vfs_write(dst, buf, (size_t)rc)) != rc) {
+         rc = wrc < 0 ? wrc : -ENOSPC;
+         break;
+      }
+
+      overlayfs_stats.copy_up_bytes += (ulong)rc;
+   }
+
+out:
+
+   if (dst)
+      vfs_close(dst);
+
+   if (src)
+      vfs_close(src);
+
+   if (dst) {
+
+      if (!rc) {
+
+         /* Done: from now on, the file will be accessed in the upper layer */
+         n->upper = inode;
+
+      } else {
+
+         /* Don't leave a partial copy around */
+         ovl_upper_remove(d, n, false);
+      }
+   }
+
+   kfree2(buf, OVL_COPY_BUF_SIZE);
+   return (int)rc;
+}
+
+/*
+ * Copy `n` up to the upper layer, along with its parent directories, unless
+ * it's already there. Files are copied entirely.
+ */
+static int ovl_copy_up(struct ovl_data *d, struct ovl_node *n)
+{
+   struct k_stat64 st;
+   int rc;
+
+   if (n->upper)
+      return 0;
+
+   if (n->type == VFS_NONE)
+      return -ENOENT; /* e.g. cwd in a deleted directory */
+
+   ASSERT(n->lower != NULL);
+
+   if ((rc = ovl_copy_up(d, n->parent)))
+      return rc;
+
+   kmutex_lock(&d->copy_up_lock);
+
+   /* Another task might have copied up `n` in the meanwhile */
+   if (n->upper)
+      goto out;
+
+   vfs_fs_shlock(d->lower);
+   {
+      rc = d->lower->fsops->stat(d->lower, n->lower, &st);
+   }
+   vfs_fs_shunlock(d->lower);
+
+   if (rc)
+      goto out;
+
+   switch (n->type) {
+
+      case VFS_DIR:
+         rc = ovl_upper_mkdir(d, n, st.st_mode & 0777);
+         break;
+
+      case VFS_FILE:
+         rc = ovl_copy_up_file(d, n, st.st_mode & 0777);
+         break;
+
+      default:
+         /* The lower layer is expected to contain just files and dirs */
+         rc = -EPERM;
+         break;
+   }
+
+   if (!rc)
+      overlayfs_stats.copy_ups++;
+
+out:
+   kmutex_unlock(&d->copy_up_lock);
+   return rc;
+}
+
+/*
+ * Prepare the creation of the last component of `p` in the upper layer: copy
+ * up its parent directory and get its node (existing or new).
+ */
+static int
+ovl_prepare_new_entry(struct ovl_data *d,
+                      struct vfs_path *p,
+                      struct ovl_node **out)
+{
+   struct ovl_node *dir = p->fs_path.dir_inode;
+   size_t len = strlen(p->last_comp);
+   int rc;
+
+   if (len && p->last_comp[len - 1] == '/')
+      len--;   /* drop the trailing slash */
+
+   if (!len)
+      return -ENOENT;
+
+   if ((rc = ovl_copy_up(d, dir)))
+      return rc;
+
+   if (!(*out = ovl_lookup(d, dir, p->last_comp, len, true)))
+      return -ENOMEM;
+
+   return 0;
+}
+
+static void
+ovl_get_entry(struct fs *fs,
+              void *dir_inode,
+              const char *name,
+              ssize_t name_len,
+              struct fs_path *fs_path)
+{
+   struct ovl_data *d = fs->device_data;
+   struct ovl_node *dir = dir_inode ? dir_inode : d->root;
+   struct ovl_node *n;
+
+   if (!dir_inode)
+      n = d->root;
+   else if (is_dot_or_dotdot(name, (int)name_len))
+      n = name_len == 1 ? dir : dir->parent;
+   else
+      n = ovl_lookup(d, dir, name, (size_t)name_len, false);
+
+   if (n && n->type == VFS_NONE)
+      n = NULL; /* whiteout */
+
+   *fs_path = (struct fs_path) {
+      .inode      = n,
+      .dir_inode  = dir,
+      .dir_entry  = NULL,
+      .type       = n ? n->type : VFS_NONE,
+   };
+}
+
+static vfs_inode_ptr_t ovl_get_inode(fs_handle h)
+{
+   return ((struct ovl_handle *)h)->n;
+}
+
+static void ovl_close_layer_handles(struct ovl_handle *h)
+{
+   if (h->upper_h)
+      vfs_close(h->upper_h);
+
+   if (h->lower_h)
+      vfs_close(h->lower_h);
+}
+
+static void ovl_on_close(fs_handle h)
+{
+   ovl_close_layer_handles(h);
+}
+
+static int ovl_on_dup(fs_handle new_h)
+{
+   struct ovl_handle *h = new_h;
+   fs_handle upper_h = NULL, lower_h = NULL;
+   int rc = 0;
+
+   if (h->upper_h)
+      rc = vfs_dup(h->upper_h, &upper_h);
+
+   if (!rc && h->lower_h)
+      rc = vfs_dup(h->lower_h, &lower_h);
+
+   if (rc) {
+
+      if (upper_h)
+         vfs_close(upper_h);
+
+      return rc;
+   }
+
+   h->upper_h = upper_h;
+   h->lower_h = lower_h;
+   return 0;
+}
+
+static int ovl_open_dir(struct fs *fs, struct ovl_node *n, fs_handle *out)
+{
+   struct ovl_data *d = fs->device_data;
+   struct ovl_handle *h;
+   int rc = 0;
+
+   if (!(h = vfs_create_new_handle(fs, &static_ops_ovl_dir)))
+      return -ENOMEM;
+
+   h->n = n;
+   h->phase = OVL_DENTS_UPPER;
+
+   if (n->upper) {
+      if (!(rc = ovl_layer_open(d, n, true, &h->upper_h, O_RDONLY, 0)))
+         retain_obj(d->upper);
+   }
+
+   if (!rc && n->lower) {
+      if (!(rc = ovl_layer_open(d, n, false, &h->lower_h, O_RDONLY, 0)))
+         retain_obj(d->lower);
+   }
+
+   if (rc) {
+      ovl_close_layer_handles(h);
+      vfs_free_handle(h);
+      return rc;
+   }
+
+   ovl_retain_inode(fs, n);
+   *out = h;
+   return 0;
+}
+
+static void ovl_destroy_dir_handle(struct ovl_handle *h)
+{
+   ovl_close_layer_handles(h);
+   ovl_release_inode(h->fs, h->n);
+   vfs_free_handle(h);
+}
+
+static int
+ovl_create(struct vfs_path *p, fs_handle *out, int fl, mode_t mode)
+{
+   struct ovl_data *d = p->fs->device_data;
+   struct ovl_node *n;
+   int rc;
+
+   if ((rc = ovl_prepare_new_entry(d, p, &n)))
+      return rc;
+
+   ASSERT(!n->upper);
+
+   if (!(rc = ovl_layer_open(d, n, true, out, fl, mode))) {
+      n->upper = d->upper->fsops->get_inode(*out);
+      n->type = VFS_FILE;
+   }
+
+   ovl_put_node(d, n);
+   return rc;
+}
+
+static int
+ovl_open(struct vfs_path *p, fs_handle *out, int fl, mode_t mode)
+{
+   struct ovl_data *d = p->fs->device_data;
+   struct ovl_node *n = p->fs_path.inode;
+   int rc;
+
+   if (!n) {
+
+      if (!(fl & O_CREAT))
+         return -ENOENT;
+
+      return ovl_create(p, out, fl, mode);
+   }
+
+   if ((fl & O_CREAT) && (fl & O_EXCL))
+      return -EEXIST;
+
+   if (n->type == VFS_DIR) {
+
+      if (fl & (O_WRONLY | O_RDWR))
+         return -EISDIR;
+
+      return ovl_open_dir(p->fs, n, out);
+   }
+
+   if (fl & (O_WRONLY | O_RDWR)) {
+
+      if ((rc = ovl_copy_up(d, n)))
+         return rc;
+
+   } else if (fl & O_TRUNC) {
+
+      /* Like on ramfs, O_TRUNC | O_RDONLY is NOT allowed */
+      return -EINVAL;
+   }
+
+   /*
+    * Return directly the handle of the layer. NOTE: in vfs_open(), the VFS will
+    * retain handle's struct fs, which is the one of the layer.
+    */
+   return ovl_layer_open(d, n, !!n->upper, out, fl, mode);
+}
+
+struct ovl_dents_ctx {
+
+   struct ovl_data *d;
+   struct ovl_handle *h;
+   struct fs_handle_base *lh;       /* handle of the current layer */
+   get_dents_func_cb cb;
+   void *arg;
+};
+
+/*
+ * Check if the lower entry `name` in `dir` is visible in the overlay. The
+ * caller has to hold the shared lock of the upper layer.
+ */
+static bool
+ovl_lower_entry_visible(struct ovl_data *d,
+                        struct ovl_node *dir,
+                        const char *name,
+                        size_t len)
+{
+   struct ovl_node *n;
+   struct fs_path fp;
+   bool visible = false;
+
+   if (is_dot_or_dotdot(name, (int)len))
+      return !dir->upper; /* already returned by the upper layer */
+
+   disable_preemption();
+   {
+      /* NOTE: `n` might be freed as soon as the preemption is enabled */
+      if ((n = ovl_find_node(d, dir, name, len, ovl_hash(dir, name, len))))
+         visible = n->lower && !n->upper; /* whiteout or already returned */
+   }
+   enable_preemption();
+
+   if (n)
+      return visible;
+
+   if (!dir->upper)
+      return true;
+
+   vfs_get_entry(d->upper, dir->upper, name, (ssize_t)len, &fp);
+   return !fp.inode;
+}
+
+static int ovl_dents_cb(struct vfs_dent64 *vde, void *arg)
+{
+   struct ovl_dents_ctx *ctx = arg;
+   struct fs_handle_base *lh = ctx->lh;
+   struct vfs_dent64 dent;
+   int rc;
+
+   if (ctx->h->phase == OVL_DENTS_UPPER ||
+       ovl_lower_entry_visible(ctx->d, ctx->h->n, vde->name, vde->name_len - 1u))
+   {
+      dent = *vde;
+      dent.next_off = 0; /* the overlay uses the index of the entries */
+
+      if ((rc = ctx->cb(&dent, ctx->arg)))
+         return rc;
+   }
+
+   /* The entry has been consumed: move forward layer's handle, like the VFS */
+   lh->pos = vde->next_off ? vde->next_off : lh->pos + 1;
+   return 0;
+}
+
+static int ovl_layer_getdents(struct ovl_dents_ctx *ctx, fs_handle lh)
+{
+   ctx->lh = lh;
+   return get_fs(lh)->fsops->getdents(lh, &ovl_dents_cb, ctx);
+}
+
+/*
+ * Merged getdents: first all the entries of the upper layer, then the visible
+ * ones of the lower layer.
+ */
+static int ovl_getdents(fs_handle h, get_dents_func_cb cb, void *arg)
+{
+   struct ovl_handle *oh = h;
+   struct ovl_data *d = oh->fs->device_data;
+   struct ovl_dents_ctx ctx = { d, oh, NULL, cb, arg };
+   int rc = 0;
+
+   vfs_fs_shlock(d->upper);
+
+   if (oh->phase == OVL_DENTS_UPPER) {
+
+      if (oh->upper_h && (rc = ovl_layer_getdents(&ctx, oh->upper_h)))
+         goto out;
+
+      oh->phase = OVL_DENTS_LOWER;
+   }
+
+   if (oh->phase == OVL_DENTS_LOWER) {
+
+      if (oh->lower_h) {
+
+         vfs_fs_shlock(d->lower);
+         {
+            rc = ovl_layer_getdents(&ctx, oh->lower_h);
+         }
+         vfs_fs_shunlock(d->lower);
+
+         if (rc)
+            goto out;
+      }
+
+      oh->phase = OVL_DENTS_END;
+   }
+
+out:
+   vfs_fs_shunlock(d->upper);
+   return rc;
+}
+
+static int ovl_skip_dents_cb(struct vfs_dent64 *vde, void *arg)
+{
+   offt *left = arg;
+
+   if (!*left)
+      return 1;
+
+   (*left)--;
+   return 0;
+}
+
+static offt ovl_dir_seek(fs_handle h, offt off, int whence)
+{
+   struct ovl_handle *oh = h;
+   offt left = off;
+   int rc;
+
+   if (whence != SEEK_SET || off < 0)
+      return -EINVAL;
+
+   /* Rewind and skip `off` entries: the merged offsets are just indexes */
+   vfs_fs_shlock(oh->fs);
+   {
+      oh->phase = OVL_DENTS_UPPER;
+
+      if (oh->upper_h)
+         vfs_seek(oh->upper_h, 0, SEEK_SET);
+
+      if (oh->lower_h)
+         vfs_seek(oh->lower_h, 0, SEEK_SET);
+
+      rc = ovl_getdents(h, &ovl_skip_dents_cb, &left);
+   }
+   vfs_fs_shunlock(oh->fs);
+
+   if (rc < 0)
+      return rc;
+
+   if (left)
+      return -EINVAL; /* past the end */
+
+   oh->pos = off;
+   return off;
+}
+
+static int ovl_check_empty_cb(struct vfs_dent64 *vde, void *arg)
+{
+   return is_dot_or_dotdot(vde->name, vde->name_len - 1) ? 0 : -ENOTEMPTY;
+}
+
+static int ovl_unlink(struct vfs_path *p)
+{
+   struct ovl_data *d = p->fs->device_data;
+   struct ovl_node *n = p->fs_path.inode;
+   int rc;
+
+   if (n->type == VFS_DIR)
+      return -EISDIR;
+
+   if (n->upper && (rc = ovl_upper_remove(d, n, false)))
+      return rc;
+
+   ovl_whiteout(d, n);
+   return 0;
+}
+
+static int ovl_rmdir(struct vfs_path *p)
+{
+   struct ovl_data *d = p->fs->device_data;
+   struct ovl_node *n = p->fs_path.inode;
+   struct ovl_handle *h;
+   int rc;
+
+   if (n->type != VFS_DIR)
+      return -ENOTDIR;
+
+   if (n == d->root)
+      return -EINVAL;
+
+   if (p->last_comp[0] == '.' && !p->last_comp[1])
+      return -EINVAL; /* trying to delete /a/b/c/. */
+
+   /* The merged directory must be empty, not just the upper one */
+   if ((rc = ovl_open_dir(p->fs, n, (fs_handle *)&h)))
+      return rc;
+
+   rc = ovl_getdents(h, &ovl_check_empty_cb, NULL);
+   ovl_destroy_dir_handle(h);
+
+   if (rc)
+      return rc;
+
+   if (n->upper && (rc = ovl_upper_remove(d, n, true)))
+      return rc;
+
+   ovl_whiteout(d, n);
+   return 0;
+}
+
+static int ovl_mkdir(struct vfs_path *p, mode_t mode)
+{
+   struct ovl_data *d = p->fs->device_data;
+   struct ovl_node *n;
+   int rc;
+
+   if ((rc = ovl_prepare_new_entry(d, p, &n)))
+      return rc;
+
+   rc = ovl_upper_mkdir(d, n, mode);
+   ovl_put_node(d, n);
+   return rc;
+}
+
+static int ovl_symlink(const char *target, struct vfs_path *p)
+{
+   struct ovl_data *d = p->fs->device_data;
+   struct vfs_path up;
+   struct ovl_node *n;
+   int rc;
+
+   if ((rc = ovl_prepare_new_entry(d, p, &n)))
+      return rc;
+
+   vfs_fs_exlock(d->upper);
+   {
+      ovl_layer_path(d, n, true, &up);
+
+      if (!(rc = d->upper->fsops->symlink(target, &up)))
+         ovl_set_upper(d, n);
+   }
+   vfs_fs_exunlock(d->upper);
+   ovl_put_node(d, n);
+   return rc;
+}
+
+/* NOTE: `buf` is guaranteed to have room for at least MAX_PATH chars */
+static int ovl_readlink(struct vfs_path *p, char *buf)
+{
+   struct ovl_data *d = p->fs->device_data;
+   struct ovl_node *n = p->fs_path.inode;
+   struct vfs_path lp;
+   vfs_inode_ptr_t unused;
+   struct fs *fs = ovl_get_layer(d, n, &unused);
+   int rc;
+
+   if (!fs->fsops->readlink)
+      return -EINVAL;
+
+   vfs_fs_shlock(fs);
+   {
+      ovl_layer_path(d, n, !!n->upper, &lp);
+      rc = fs->fsops->readlink(&lp, buf);
+   }
+   vfs_fs_shunlock(fs);
+   return rc;
+}
+
+static int
+ovl_stat(struct fs *fs, vfs_inode_ptr_t inode, struct k_stat64 *statbuf)
+{
+   struct ovl_data *d = fs->device_data;
+   struct ovl_node *n = inode;
+   vfs_inode_ptr_t li;
+   struct fs *lfs;
+   int rc;
+
+   if (n->type == VFS_NONE)
+      return -ENOENT; /* fstat() on a deleted directory */
+
+   lfs = ovl_get_layer(d, n, &li);
+
+   vfs_fs_shlock(lfs);
+   {
+      rc = lfs->fsops->stat(lfs, li, statbuf);
+   }
+   vfs_fs_shunlock(lfs);
+   return rc;
+}
+
+static int ovl_truncate(struct fs *fs, vfs_inode_ptr_t inode, offt len)
+{
+   struct ovl_data *d = fs->device_data;
+   struct ovl_node *n = inode;
+   int rc;
+
+   if (n->type == VFS_DIR)
+      return -EISDIR;
+
+   if ((rc = ovl_copy_up(d, n)))
+      return rc;
+
+   vfs_fs_shlock(d->upper);
+   {
+      rc = d->upper->fsops->truncate(d->upper, n->upper, len);
+   }
+   vfs_fs_shunlock(d->upper);
+   return rc;
+}
+
+static int ovl_chmod(struct fs *fs, vfs_inode_ptr_t inode, mode_t mode)
+{
+   struct ovl_data *d = fs->device_data;
+   struct ovl_node *n = inode;
+   int rc;
+
+   if ((rc = ovl_copy_up(d, n)))
+      return rc;
+
+   vfs_fs_shlock(d->upper);
+   {
+      rc = d->upper->fsops->chmod(d->upper, n->upper, mode);
+   }
+   vfs_fs_shunlock(d->upper);
+   return rc;
+}
+
+static int
+ovl_futimens(struct fs *fs,
+             vfs_inode_ptr_t inode,
+             const struct k_timespec64 times[2])
+{
+   struct ovl_data *d = fs->device_data;
+   struct ovl_node *n = inode;
+   int rc;
+
+   if ((rc = ovl_copy_up(d, n)))
+      return rc;
+
+   vfs_fs_shlock(d->upper);
+   {
+      rc = d->upper->fsops->futimens(d->upper, n->upper, times);
+   }
+   vfs_fs_shunlock(d->upper);
+   return rc;
+}
+
+/*
+ * NOTE: renaming directories is not supported (-EXDEV), because it would
+ * require copying up their whole content. Like on Linux's overlayfs, programs
+ * like `mv` fall back to copy + delete.
+ */
+static int
+ovl_rename(struct fs *fs, struct vfs_path *oldp, struct vfs_path *newp)
+{
+   struct ovl_data *d = fs->device_data;
+   struct ovl_node *o = oldp->fs_path.inode;
+   struct ovl_node *n = newp->fs_path.inode;
+   struct vfs_path uold, unew;
+   int rc;
+
+   if (o == n)
+      return 0;
+
+   if (o->type == VFS_DIR)
+      return -EXDEV;
+
+   if (n && n->type == VFS_DIR)
+      return -EISDIR;
+
+   if ((rc = ovl_copy_up(d, o)))
+      return rc;
+
+   if ((rc = ovl_prepare_new_entry(d, newp, &n)))
+      return rc;
+
+   vfs_fs_exlock(d->upper);
+   {
+      ovl_layer_path(d, o, true, &uold);
+      ovl_layer_path(d, n, true, &unew);
+      rc = d->upper->fsops->rename(d->upper, &uold, &unew);
+   }
+   vfs_fs_exunlock(d->upper);
+
+   if (!rc) {
+      n->upper = o->upper;
+      n->lower = NULL;
+      n->type = o->type;
+      ovl_whiteout(d, o);
+   }
+
+   ovl_put_node(d, n);
+   return rc;
+}
+
+static int
+ovl_link(struct fs *fs, struct vfs_path *oldp, struct vfs_path *newp)
+{
+   struct ovl_data *d = fs->device_data;
+   struct ovl_node *o = oldp->fs_path.inode;
+   struct ovl_node *n = newp->fs_path.inode;
+   struct vfs_path uold, unew;
+   int rc;
+
+   if (o->type != VFS_FILE)
+      return -EPERM;
+
+   if (n != NULL)
+      return -EEXIST;
+
+   if ((rc = ovl_copy_up(d, o)))
+      return rc;
+
+   if ((rc = ovl_prepare_new_entry(d, newp, &n)))
+      return rc;
+
+   vfs_fs_exlock(d->upper);
+   {
+      ovl_layer_path(d, o, true, &uold);
+      ovl_layer_path(d, n, true, &unew);
+
+      if (!(rc = d->upper->fsops->link(d->upper, &uold, &unew)))
+         ovl_set_upper(d, n);
+   }
+   vfs_fs_exunlock(d->upper);
+   ovl_put_node(d, n);
+   return rc;
+}
+
+static int ovl_retain_inode(struct fs *fs, vfs_inode_ptr_t inode)
+{
+   struct ovl_node *n = inode;
+   u32 ref_count;
+
+   disable_preemption();
+   {
+      ref_count = ++n->ref_count;
+   }
+   enable_preemption();
+   return (int)ref_count;
+}
+
+static int ovl_release_inode(struct fs *fs, vfs_inode_ptr_t inode)
+{
+   return (int)ovl_put_node(fs->device_data, inode);
+}
+
+static void ovl_exlock(struct fs *fs)
+{
+   struct ovl_data *d = fs->device_data;
+   rwlock_wp_exlock(&d->rwlock);
+}
+
+static void ovl_exunlock(struct fs *fs)
+{
+   struct ovl_data *d = fs->device_data;
+   rwlock_wp_exunlock(&d->rwlock);
+}
+
+static void ovl_shlock(struct fs *fs)
+{
+   struct ovl_data *d = fs->device_data;
+   rwlock_wp_shlock(&d->rwlock);
+}
+
+static void ovl_shunlock(struct fs *fs)
+{
+   struct ovl_data *d = fs->device_data;
+   rwlock_wp_shunlock(&d->rwlock);
+}
+
+static const struct file_ops static_ops_ovl_dir =
+{
+   .seek = ovl_dir_seek,
+};
+
+static const struct fs_ops static_fsops_ovl =
+{
+   .get_entry = ovl_get_entry,
+   .get_inode = ovl_get_inode,
+   .open = ovl_open,
+   .on_close = ovl_on_close,
+   .on_dup_cb = ovl_on_dup,
+   .getdents = ovl_getdents,
+   .unlink = ovl_unlink,
+   .stat = ovl_stat,
+   .mkdir = ovl_mkdir,
+   .rmdir = ovl_rmdir,
+   .symlink = ovl_symlink,
+   .readlink = ovl_readlink,
+   .truncate = ovl_truncate,
+   .chmod = ovl_chmod,
+   .rename = ovl_rename,
+   .link = ovl_link,
+   .futimens = ovl_futimens,
+   .retain_inode = ovl_retain_inode,
+   .release_inode = ovl_release_inode,
+
+   .fs_exlock = ovl_exlock,
+   .fs_exunlock = ovl_exunlock,
+   .fs_shlock = ovl_shlock,
+   .fs_shunlock = ovl_shunlock,
+};
+
+struct fs *overlayfs_create(struct fs *lower, struct fs *upper)
+{
+   struct fs_path up, lo;
+   struct ovl_data *d;
+   struct fs *fs = NULL;
+
+   if (!(d = kzalloc_obj(struct ovl_data)))
+      return NULL;
+
+   d->htable = kmalloc(sizeof(struct list) * OVL_HTABLE_MIN_SIZE);
+   d->root = kzmalloc(ovl_node_size(0));
+
+   if (d->htable && d->root)
+      fs = create_fs_obj("overlay", &static_fsops_ovl, d, VFS_FS_RW);
+
+   if (!fs) {
+
+      if (d->htable)
+         kfree2(d->htable, sizeof(struct list) * OVL_HTABLE_MIN_SIZE);
+
+      if (d->root)
+         kfree2(d->root, ovl_node_size(0));
+
+      kfree_obj(d, struct ovl_data);
+      return NULL;
+   }
+
+   for (u32 i = 0; i < OVL_HTABLE_MIN_SIZE; i++)
+      list_init(&d->htable[i]);
+
+   d->htable_size = OVL_HTABLE_MIN_SIZE;
+
+   vfs_get_root_entry(upper, &up);
+   vfs_get_root_entry(lower, &lo);
+
+   list_node_init(&d->root->hnode);
+   d->root->parent = d->root;
+   d->root->upper = up.inode;
+   d->root->lower = lo.inode;
+   d->root->type = VFS_DIR;
+
+   d->lower = lower;
+   d->upper = upper;
+   retain_obj(lower);
+   retain_obj(upper);
+
+   rwlock_wp_init(&d->rwlock, false);
+   kmutex_init(&d->copy_up_lock, 0);
+   return fs;
+}
+
+void overlayfs_destroy(struct fs *fs)
+{
+   struct ovl_data *d = fs->device_data;
+   struct ovl_node *n, *tmp;
+
+   for (u32 i = 0; i < d->htable_size; i++) {
+      list_for_each(n, tmp, &d->htable[i], hnode) {
+         list_remove(&n->hnode);
+         kfree2(n, ovl_node_size(n->name_len));
+      }
+   }
+
+   overlayfs_stats.nodes -= d->nodes_count;
+   kfree2(d->htable, sizeof(struct list) * d->htable_size);
+   kfree2(d->root, ovl_node_size(0));
+
+   release_obj(d->lower);
+   release_obj(d->upper);
+
+   rwlock_wp_destroy(&d->rwlock);
+   kmutex_destroy(&d->copy_up_lock);
+   kfree_obj(d, struct ovl_data);
+   destory_fs_obj(fs);
+}
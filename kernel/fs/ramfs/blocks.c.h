@@ -1,52 +1,314 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
-static struct ramfs_block *ramfs_new_block(offt page)
+/*
+ * Return a pointer to the slot in the index of `i` for the block at offset
+ * `page`. When `alloc` is true, the missing index pages are allocated on the
+ * fly. Returns NULL if the slot does not exist (or it could not be allocated).
+ */
+static void **
+ramfs_get_block_slot(struct ramfs_inode *i, offt page, bool alloc)
 {
-   struct ramfs_block *b;
+   struct ramfs_blocks *bl = &i->blocks;
+   void **ind;
+   ulong pg;
 
-   /* Allocate memory for the block object */
-   if (!(b = kalloc_obj(struct ramfs_block)))
+   ASSERT(page >= 0);
+   ASSERT((page & (offt)OFFSET_IN_PAGE_MASK) == 0);
+
+   if (page >= (offt)RAMFS_MAX_BLOCKS << PAGE_SHIFT)
       return NULL;
 
-   /* Allocate block's data */
-   if (!(b->vaddr = kzmalloc(PAGE_SIZE))) {
-      kfree_obj(b, struct ramfs_block);
+   pg = (ulong)(page >> PAGE_SHIFT);
+
+   if (LIKELY(pg < RAMFS_IND_FIRST_BLOCK))
+      return &bl->direct[pg];
+
+   if (pg < RAMFS_DIND_FIRST_BLOCK) {
+
+      if (!bl->ind) {
+
+         if (!alloc || !(bl->ind = kzmalloc(PAGE_SIZE)))
+            return NULL;
+      }
+
+      return &bl->ind[pg - RAMFS_IND_FIRST_BLOCK];
+   }
+
+   pg -= RAMFS_DIND_FIRST_BLOCK;
+
+   if (!bl->dind) {
+
+      if (!alloc || !(bl->dind = kzmalloc(PAGE_SIZE)))
+         return NULL;
+   }
+
+   if (!(ind = bl->dind[pg / RAMFS_PTRS_PER_PAGE])) {
+
+      if (!alloc || !(ind = kzmalloc(PAGE_SIZE)))
+         return NULL;
+
+      bl->dind[pg / RAMFS_PTRS_PER_PAGE] = ind;
+   }
+
+   return &ind[pg % RAMFS_PTRS_PER_PAGE];
+}
+
+/* Return the data page of the block at offset `page` or NULL for holes */
+static inline void *ramfs_get_block(struct ramfs_inode *i, offt page)
+{
+   void **slot = ramfs_get_block_slot(i, page, false);
+   return slot ? *slot : NULL;
+}
+
+/*
+ * Return the length, in bytes, of the memory contiguous with the block at
+ * offset `page` (having vaddr `block`), up to `max` bytes. The blocks belonging
+ * to the same extent are always contiguous: that allows copying them at once.
+ */
+static offt
+ramfs_get_contig_len(struct ramfs_inode *i, offt page, void *block, offt max)
+{
+   offt len = PAGE_SIZE;
+
+   while (len < max &&
+          ramfs_get_block(i, page + len) == block + len)
+   {
+      len += PAGE_SIZE;
+   }
+
+   return len;
+}
+
+/*
+ * Count the free slots starting at offset `page`, up to `max`, allocating the
+ * index pages, if necessary. Must be called with preemption disabled, because
+ * the write faults on the mappings of the file don't take the inode's lock.
+ */
+static ulong ramfs_count_free_slots(struct ramfs_inode *i, offt page, ulong max)
+{
+   void **slot;
+   ulong cnt;
+
+   ASSERT(!is_preemption_enabled());
+
+   for (cnt = 0; cnt < max; cnt++) {
+
+      slot = ramfs_get_block_slot(i, page + (offt)(cnt << PAGE_SHIFT), true);
+
+      if (!slot || *slot)
+         break;
+   }
+
+   return cnt;
+}
+
+/*
+ * Allocate an extent of up to `*n` physically contiguous blocks, starting at
+ * offset `page` and stopping at the first block already present. The memory is
+ * allocated in page-size sub-blocks, so that each block can be freed on its own
+ * by ramfs_destroy_block(). On success, returns the vaddr of the first block
+ * and sets `*n` to the number of blocks actually allocated. If the block at
+ * `page` has been allocated by somebody else in the meanwhile, returns it and
+ * sets `*n` to 0.
+ */
+static void *ramfs_new_extent(struct ramfs_inode *i, offt page, ulong *n)
+{
+   void **slot;
+   void *vaddr;
+   size_t size;
+   ulong cnt, avail;
+
+   ASSERT(*n > 0);
+
+   disable_preemption();
+   {
+      cnt = ramfs_count_free_slots(i, page, *n);
+   }
+   enable_preemption();
+
+   if (!cnt)
       return NULL;
+
+   /* Allocate the data, trying with smaller extents in case of failure */
+   while (true) {
+
+      size = cnt << PAGE_SHIFT;
+      vaddr = general_kmalloc(&size, KMALLOC_FL_MULTI_STEP | PAGE_SIZE);
+
+      if (vaddr)
+         break;
+
+      if (cnt == 1)
+         return NULL;
+
+      cnt /= 2;
    }
 
-   /* Retain the pageframe used by this block */
-   retain_pageframes_mapped_at(get_kernel_pdir(), b->vaddr, PAGE_SIZE);
+   ASSERT(size == cnt << PAGE_SHIFT);
+   bzero(vaddr, size);
+
+   disable_preemption();
+   {
+      /*
+       * While we were allocating and zeroing the memory with preemption
+       * enabled, a write fault on a mapping of the file might have filled
+       * some of the slots: keep only the blocks before the first one of them.
+       */
+      avail = ramfs_count_free_slots(i, page, cnt);
 
-   /* Init the block object */
-   bintree_node_init(&b->node);
-   b->offset = page;
-   return b;
+      for (ulong k = 0; k < avail; k++) {
+         slot = ramfs_get_block_slot(i, page + (offt)(k << PAGE_SHIFT), false);
+         *slot = vaddr + (k << PAGE_SHIFT);
+      }
+
+      /* Retain the pageframes used by the blocks */
+      if (avail)
+         retain_pageframes_mapped_at(get_kernel_pdir(),
+                                     vaddr,
+                                     avail << PAGE_SHIFT);
+
+      i->blocks_count += avail;
+   }
+   enable_preemption();
+
+   for (ulong k = avail; k < cnt; k++)
+      kfree2(vaddr + (k << PAGE_SHIFT), PAGE_SIZE);
+
+   *n = avail;
+   return avail ? vaddr : ramfs_get_block(i, page);
+}
+
+static void *ramfs_new_block(struct ramfs_inode *i, offt page)
+{
+   ulong n = 1;
+   return ramfs_new_extent(i, page, &n);
 }
 
-static void ramfs_destroy_block(struct ramfs_block *b)
+/*
+ * Return the max number of blocks to allocate for a write at offset `page`.
+ * Extents grow geometrically, up to RAMFS_MAX_EXTENT_PAGES, only when data is
+ * appended sequentially: in all the other cases, just one block is allocated.
+ */
+static ulong ramfs_get_extent_size(struct ramfs_inode *i, offt page)
 {
-   /* Release the pageframe used by this block */
-   release_pageframes_mapped_at(get_kernel_pdir(), b->vaddr, PAGE_SIZE);
+   ulong n;
 
-   /* Free the memory pointed by this block */
-   kfree2(b->vaddr, PAGE_SIZE);
+   if (page + (offt)PAGE_SIZE <= i->fsize)
+      return 1;   /* not appending: filling a hole */
 
-   /* Free the memory used by the block object itself */
-   kfree_obj(b, struct ramfs_block);
+   if (page > 0 && !ramfs_get_block(i, page - (offt)PAGE_SIZE)) {
+      i->next_extent_pages = 0;
+      return 1;   /* not sequential */
+   }
+
+   n = MAX(i->next_extent_pages, 1u);
+   i->next_extent_pages = MIN(2 * n, RAMFS_MAX_EXTENT_PAGES);
+   return n;
+}
+
+static void ramfs_destroy_block(void *vaddr)
+{
+   /*
+    * Release the pageframe used by this block and free its memory, unless the
+    * pageframe is still mapped somewhere. That happens when a running program
+    * gets unlinked: its read-only segments are mapped directly from the blocks
+    * of the file (see load_segment_by_mmap()) and the pageframes will be freed
+    * by the paging code, when the last process using them will go away.
+    *
+    * NOTE: put_pageframe() decrements and tests the ref-count in one step, so
+    * that only one between us and pdir_destroy() can free the pageframe.
+    */
+   put_pageframe(vaddr);
 }
 
 static void
-ramfs_append_new_block(struct ramfs_inode *inode, struct ramfs_block *block)
+ramfs_destroy_blocks_in_slots(struct ramfs_inode *i, void **slots, ulong n)
 {
-   DEBUG_ONLY_UNSAFE(bool success =)
-      bintree_insert_ptr(&inode->blocks_tree_root,
-                         block,
-                         struct ramfs_block,
-                         node,
-                         offset);
+   for (ulong k = 0; k < n; k++) {
 
-   ASSERT(success);
-   inode->blocks_count++;
+      if (slots[k]) {
+         ramfs_destroy_block(slots[k]);
+         slots[k] = NULL;
+         i->blocks_count--;
+      }
+   }
+}
+
+/*
+ * Destroy all the blocks of `i` starting from the block number `first` and
+ * free the index pages not needed anymore.
+ */
+static void ramfs_destroy_blocks_from(struct ramfs_inode *i, ulong first)
+{
+   struct ramfs_blocks *bl = &i->blocks;
+   ulong start;
+
+   if (first < RAMFS_IND_FIRST_BLOCK) {
+      ramfs_destroy_blocks_in_slots(i,
+                                    bl->direct + first,
+                                    RAMFS_IND_FIRST_BLOCK - first);
+   }
+
+   if (bl->ind && first < RAMFS_DIND_FIRST_BLOCK) {
+
+      start = first - MIN(first, RAMFS_IND_FIRST_BLOCK);
+
+      ramfs_destroy_blocks_in_slots(i,
+                                    bl->ind + start,
+                                    RAMFS_PTRS_PER_PAGE - start);
+
+      if (!start) {
+         kfree2(bl->ind, PAGE_SIZE);
+         bl->ind = NULL;
+      }
+   }
+
+   if (bl->dind && first < RAMFS_MAX_BLOCKS) {
+
+      start = first - MIN(first, RAMFS_DIND_FIRST_BLOCK);
+
+      for (ulong k = start / RAMFS_PTRS_PER_PAGE; k < RAMFS_PTRS_PER_PAGE; k++)
+      {
+         void **ind = bl->dind[k];
+         ulong s = 0;
+
+         if (!ind)
+            continue;
+
+         if (k == start / RAMFS_PTRS_PER_PAGE)
+            s = start % RAMFS_PTRS_PER_PAGE;
+
+         ramfs_destroy_blocks_in_slots(i, ind + s, RAMFS_PTRS_PER_PAGE - s);
+
+         if (!s) {
+            kfree2(ind, PAGE_SIZE);
+            bl->dind[k] = NULL;
+         }
+      }
+
+      if (!start) {
+         kfree2(bl->dind, PAGE_SIZE);
+         bl->dind = NULL;
+      }
+   }
+}
+
+/* Destroy all the blocks at offsets >= len */
+static void ramfs_destroy_blocks_past(struct ramfs_inode *i, offt len)
+{
+   u64 first = pow2_round_up_at64((u64)len, PAGE_SIZE) >> PAGE_SHIFT;
+   ramfs_destroy_blocks_from(i, (ulong)MIN(first, (u64)RAMFS_MAX_BLOCKS));
+}
+
+/*
+ * Release the blocks past the end of the file, pre-allocated by the last
+ * extent. Called when the last handle to the file is closed.
+ */
+static void ramfs_inode_trim_extents(struct ramfs_inode *i)
+{
+   ASSERT(rwlock_wp_holding_exlock(&i->rwlock));
+   ramfs_destroy_blocks_past(i, i->fsize);
+   i->next_extent_pages = 0;
 }
 
 static int ramfs_inode_extend(struct ramfs_inode *i, offt new_len)
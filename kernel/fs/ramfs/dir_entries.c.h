@@ -1,17 +1,86 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
-static long ramfs_insert_remove_entry_cmp(const void *a, const void *b)
+/* FNV-1a hash of the entry name */
+static u32 ramfs_name_hash(const char *name, size_t len)
 {
-   const struct ramfs_entry *e1 = a;
-   const struct ramfs_entry *e2 = b;
-   return strcmp(e1->name, e2->name);
+   u32 h = 2166136261u;
+
+   for (size_t i = 0; i < len; i++) {
+      h ^= (u8)name[i];
+      h *= 16777619u;
+   }
+
+   return h;
+}
+
+/*
+ * The stats are shared by all the ramfs instances, while each instance has its
+ * own lock: update them with the preemption disabled.
+ */
+static void
+ramfs_dir_update_stats(long entries, long entries_mem, long htables_mem)
+{
+   disable_preemption();
+   {
+      ramfs_dir_stats.entries += (ulong)entries;
+      ramfs_dir_stats.entries_mem += (ulong)entries_mem;
+      ramfs_dir_stats.htables_mem += (ulong)htables_mem;
+   }
+   enable_preemption();
 }
 
-static long ramfs_find_entry_cmp(const void *obj, const void *valptr)
+static inline struct list *
+ramfs_dir_bucket(struct list *htable, u32 htable_size, u32 hash)
 {
-   const struct ramfs_entry *e = obj;
-   const char *searched_str = valptr;
-   return strcmp(e->name, searched_str);
+   ASSERT(htable_size && !(htable_size & (htable_size - 1)));
+   return &htable[hash & (htable_size - 1)];
+}
+
+/*
+ * Re-hash all the entries of `idir` in a new table of `new_size` buckets.
+ * Failing to allocate the new table is not fatal: lookups will be just slower.
+ */
+static int ramfs_dir_resize_htable(struct ramfs_inode *idir, u32 new_size)
+{
+   const size_t old_mem = sizeof(struct list) * idir->htable_size;
+   struct list *new_table;
+   struct ramfs_entry *e;
+
+   if (!(new_table = kmalloc(sizeof(struct list) * new_size)))
+      return -ENOMEM;
+
+   for (u32 i = 0; i < new_size; i++)
+      list_init(&new_table[i]);
+
+   list_for_each_ro(e, &idir->entries_list, lnode) {
+      list_remove(&e->hnode);
+      list_add_tail(ramfs_dir_bucket(new_table, new_size, e->hash), &e->hnode);
+   }
+
+   if (idir->htable)
+      kfree2(idir->htable, old_mem);
+
+   ramfs_dir_update_stats(
+      0, 0, (long)(sizeof(struct list) * new_size) - (long)old_mem
+   );
+
+   idir->htable = new_table;
+   idir->htable_size = new_size;
+   return 0;
+}
+
+static void ramfs_dir_destroy_htable(struct ramfs_inode *idir)
+{
+   ASSERT(idir->num_entries == 0);
+
+   if (idir->htable) {
+      kfree2(idir->htable, sizeof(struct list) * idir->htable_size);
+      ramfs_dir_update_stats(
+         0, 0, -(long)(sizeof(struct list) * idir->htable_size)
+      );
+      idir->htable = NULL;
+      idir->htable_size = 0;
+   }
 }
 
 static int
@@ -21,42 +90,68 @@ ramfs_dir_add_entry(struct ramfs_inode *idir,
 {
    struct ramfs_entry *e;
    size_t enl = strlen(iname) + 1;
+   size_t alloc_size;
    ASSERT(idir->type == VFS_DIR);
 
    if (enl == 1)
       return -ENOENT;
 
-   if (enl > sizeof(e->name))
+   if (iname[enl - 2] == '/')
+      enl--;   /* drop the trailing slash */
+
+   if (enl > RAMFS_ENTRY_MAX_LEN)
       return -ENAMETOOLONG;
 
-   if (!(e = kalloc_obj(struct ramfs_entry)))
+   if (!idir->htable) {
+      if (ramfs_dir_resize_htable(idir, RAMFS_DIR_HTABLE_MIN_SIZE))
+         return -ENOSPC;
+   }
+
+   alloc_size = RAMFS_ENTRY_ALLOC_SIZE(enl);
+
+   if (!(e = general_kmalloc(&alloc_size, 0)))
       return -ENOSPC;
 
    ASSERT(ie->parent_dir != NULL);
 
    bintree_node_init(&e->node);
    list_node_init(&e->lnode);
+   list_node_init(&e->hnode);
 
    e->inode = ie;
-   memcpy(e->name, iname, enl);
-
-   if (e->name[enl-2] == '/') {
-      e->name[enl-2] = 0; /* drop the trailing slash */
-      enl--;
-   }
+   memcpy(e->name, iname, enl - 1);
+   e->name[enl - 1] = 0;
 
    e->name_len = (u8) enl;
+   e->hash = ramfs_name_hash(e->name, enl - 1);
 
-   bintree_insert(&idir->entries_tree_root,
-                  e,
-                  ramfs_insert_remove_entry_cmp,
-                  struct ramfs_entry,
-                  node);
+   /*
+    * The cookies are never reused, therefore the order of the entries in the
+    * tree is the same as in entries_list. See ramfs_dir_seek().
+    */
+   e->cookie = ++idir->next_cookie;
+
+   bintree_insert_ptr(&idir->entries_tree_root,
+                      e,
+                      struct ramfs_entry,
+                      node,
+                      cookie);
 
    list_add_tail(&idir->entries_list, &e->lnode);
+   list_add_tail(ramfs_dir_bucket(idir->htable, idir->htable_size, e->hash),
+                 &e->hnode);
 
    ie->nlink++;
    idir->num_entries++;
+   idir->entries_mem += alloc_size;
+   ramfs_dir_update_stats(1, (long)alloc_size, 0);
+
+   if (idir->num_entries >
+       (offt)(RAMFS_DIR_HTABLE_MAX_LOAD * idir->htable_size))
+   {
+      ramfs_dir_resize_htable(idir, idir->htable_size * 2);
+   }
+
    return 0;
 }
 
@@ -65,6 +160,7 @@ ramfs_dir_remove_entry(struct ramfs_inode *idir, struct ramfs_entry *e)
 {
    struct ramfs_handle *pos;
    struct ramfs_inode *ie = e->inode;
+   size_t alloc_size = RAMFS_ENTRY_ALLOC_SIZE(e->name_len);
    ASSERT(idir->type == VFS_DIR);
 
    /*
@@ -79,18 +175,23 @@ ramfs_dir_remove_entry(struct ramfs_inode *idir, struct ramfs_entry *e)
          pos->dpos = list_next_obj(pos->dpos, lnode);
    }
 
-   bintree_remove(&idir->entries_tree_root,
-                  e,
-                  ramfs_insert_remove_entry_cmp,
-                  struct ramfs_entry,
-                  node);
+   bintree_remove_ptr(&idir->entries_tree_root,
+                      e,
+                      struct ramfs_entry,
+                      node,
+                      cookie);
 
    list_remove(&e->lnode);
+   list_remove(&e->hnode);
 
    ASSERT(ie->nlink > 0);
    ie->nlink--;
    idir->num_entries--;
-   kfree_obj(e, struct ramfs_entry);
+   general_kfree(e, &alloc_size, 0);
+
+   /* NOTE: general_kfree() sets `alloc_size` to the actual size freed */
+   idir->entries_mem -= alloc_size;
+   ramfs_dir_update_stats(-1, -(long)alloc_size, 0);
 }
 
 static struct ramfs_entry *
@@ -98,13 +199,24 @@ ramfs_dir_get_entry_by_name(struct ramfs_inode *idir,
                             const char *name,
                             ssize_t len)
 {
-   char buf[RAMFS_ENTRY_MAX_LEN];
-   memcpy(buf, name, (size_t) len);
-   buf[len] = 0;
-
-   return bintree_find(idir->entries_tree_root,
-                       buf,
-                       ramfs_find_entry_cmp,
-                       struct ramfs_entry,
-                       node);
+   struct ramfs_entry *e;
+   struct list *bucket;
+   u32 hash;
+
+   if (!idir->htable)
+      return NULL;
+
+   hash = ramfs_name_hash(name, (size_t)len);
+   bucket = ramfs_dir_bucket(idir->htable, idir->htable_size, hash);
+
+   list_for_each_ro(e, bucket, hnode) {
+
+      if (e->hash != hash || e->name_len != len + 1)
+         continue;
+
+      if (!memcmp(e->name, name, (size_t)len))
+         return e;
+   }
+
+   return NULL;
 }
@@ -19,6 +19,7 @@ static int ramfs_getdents(fs_handle h, get_dents_func_cb cb, void *arg)
          .type       = rh->dpos->inode->type,
          .name_len   = rh->dpos->name_len,
          .name       = rh->dpos->name,
+         .next_off   = (offt)rh->dpos->cookie,
       };
 
       if ((rc = cb(&dent, arg)))
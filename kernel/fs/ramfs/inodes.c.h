@@ -45,6 +45,7 @@ ramfs_create_inode_dir(struct ramfs_data *d,
    i->parent_dir = parent;
 
    if (ramfs_dir_add_entry(i, ".", i) < 0) {
+      ramfs_dir_destroy_htable(i);
       kfree_obj(i, struct ramfs_inode);
       return NULL;
    }
@@ -54,6 +55,7 @@ ramfs_create_inode_dir(struct ramfs_data *d,
       struct ramfs_entry *e = i->entries_tree_root;
       ramfs_dir_remove_entry(i, e);
 
+      ramfs_dir_destroy_htable(i);
       kfree_obj(i, struct ramfs_inode);
       return NULL;
    }
@@ -99,11 +101,12 @@ static int ramfs_destroy_inode(struct ramfs_data *d, struct ramfs_inode *i)
          break;
 
       case VFS_FILE:
-         ASSERT(i->blocks_tree_root == NULL);
+         ASSERT(i->blocks_count == 0);
          break;
 
       case VFS_DIR:
          ASSERT(i->entries_tree_root == NULL);
+         ramfs_dir_destroy_htable(i);
          break;
 
       case VFS_SYMLINK:
@@ -58,11 +58,9 @@ static int ramfs_rmdir(struct vfs_path *p)
       return -EBUSY;
    }
 
-   ASSERT(i->entries_tree_root != NULL);
-   ramfs_dir_remove_entry(i, i->entries_tree_root);   // drop .
-
-   ASSERT(i->entries_tree_root != NULL);
-   ramfs_dir_remove_entry(i, i->entries_tree_root);   // drop ..
+   /* Drop the '.' and '..' entries */
+   while (i->entries_tree_root)
+      ramfs_dir_remove_entry(i, i->entries_tree_root);
 
    ASSERT(i->num_entries == 0);
    ASSERT(i->entries_tree_root == NULL);
@@ -5,19 +5,29 @@ static int ramfs_munmap(struct user_mapping *um, void *vaddrp, size_t len)
    return generic_fs_munmap(um, vaddrp, len);
 }
 
+static u32 ramfs_mmap_pg_flags(struct user_mapping *um)
+{
+   u32 pg_flags = PAGING_FL_US | PAGING_FL_SHARED;
+
+   if (um->prot & PROT_WRITE)
+      pg_flags |= PAGING_FL_RW;
+
+   return pg_flags;
+}
+
 static int
 ramfs_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
 {
    struct ramfs_handle *rh = um->h;
    struct ramfs_inode *i = rh->inode;
    ulong vaddr = um->vaddr;
-   struct bintree_walk_ctx ctx;
-   struct ramfs_block *b;
+   void *b;
    u32 pg_flags;
    int rc;
 
    const size_t off_begin = um->off;
    const size_t off_end = off_begin + um->len;
+   const offt fsize = i->fsize;
 
    ASSERT(IS_PAGE_ALIGNED(um->len));
 
@@ -27,28 +37,33 @@ ramfs_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
    if (flags & VFS_MM_DONT_MMAP)
       goto register_mapping;
 
-   bintree_in_order_visit_start(&ctx,
-                                i->blocks_tree_root,
-                                struct ramfs_block,
-                                node,
-                                false);
+   if (!(flags & VFS_MM_POPULATE)) {
 
-   pg_flags = PAGING_FL_US | PAGING_FL_SHARED;
-
-   if ((rh->fl_flags & O_RDWR) == O_RDWR)
-      pg_flags |= PAGING_FL_RW;
+      /*
+       * Map the pages lazily, in ramfs_handle_fault(). On each fault, also
+       * the neighboring pages are mapped (fault-around), in order to avoid
+       * paying the cost of a page fault for each page, while reading the
+       * mapping sequentially.
+       */
+      ASSERT(!(flags & VFS_MM_DONT_REGISTER));
+      goto register_mapping;
+   }
 
-   while ((b = bintree_in_order_visit_next(&ctx))) {
+   pg_flags = ramfs_mmap_pg_flags(um);
 
-      if ((size_t)b->offset < off_begin)
-         continue; /* skip this block */
+   for (size_t off = off_begin; off < off_end; off += PAGE_SIZE) {
 
-      if ((size_t)b->offset >= off_end)
+      if ((offt)off >= fsize)
          break;
 
+      if (!(b = ramfs_get_block(i, (offt)off)))
+         continue; /* hole */
+
+      vaddr = um->vaddr + (off - off_begin);
+
       rc = map_page(pdir,
                     (void *)vaddr,
-                    KERNEL_VA_TO_PA(b->vaddr),
+                    KERNEL_VA_TO_PA(b),
                     pg_flags);
 
       if (rc) {
@@ -62,8 +77,6 @@ ramfs_mmap(struct user_mapping *um, pdir_t *pdir, int flags)
 
          return rc;
       }
-
-      vaddr += PAGE_SIZE;
    }
 
 register_mapping:
@@ -74,6 +87,66 @@ register_mapping:
    return 0;
 }
 
+/*
+ * Un-map the page at offset `page` from all the mappings of the inode. It's
+ * used when a block gets created for a hole in the file, which might be
+ * mapped somewhere as a read-only zero-page. The next access will cause a page
+ * fault and the new block will be mapped by ramfs_handle_fault().
+ */
+static void ramfs_unmap_hole_in_mappings(struct ramfs_inode *i, offt page)
+{
+   struct user_mapping *um;
+   ulong va;
+   ASSERT(!is_preemption_enabled());
+
+   list_for_each_ro(um, &i->mappings_list, inode_node) {
+
+      if ((size_t)page < um->off || (size_t)page >= um->off + um->len)
+         continue;
+
+      va = um->vaddr + ((size_t)page - um->off);
+      unmap_page_permissive(um->pi->pdir, (void *)va, false);
+   }
+}
+
+/*
+ * Map the already existing blocks around `vaddr`, in an aligned window of
+ * USER_MMAP_FAULT_AROUND_PAGES pages. The holes are skipped, because they
+ * might be written later and we don't want to map them as zero-pages.
+ */
+static void
+ramfs_fault_around(struct process *pi, struct user_mapping *um, ulong vaddr)
+{
+   struct ramfs_handle *rh = um->h;
+   struct ramfs_inode *i = rh->inode;
+   const ulong win_size = USER_MMAP_FAULT_AROUND_PAGES << PAGE_SHIFT;
+   const ulong win_start = vaddr & ~(win_size - 1);
+   const ulong fsize = pow2_round_up_at((ulong)i->fsize, PAGE_SIZE);
+   const u32 pg_flags = ramfs_mmap_pg_flags(um);
+   void *b;
+   ulong va, end;
+
+   ASSERT(fsize > um->off);
+
+   va = MAX(win_start, um->vaddr);
+   end = MIN3(win_start + win_size, um->vaddr + um->len,
+              um->vaddr + (fsize - um->off));
+
+   for (; va < end; va += PAGE_SIZE) {
+
+      if (is_mapped(pi->pdir, (void *)va))
+         continue;
+
+      b = ramfs_get_block(i, (offt)(um->off + (va - um->vaddr)));
+
+      if (!b)
+         continue; /* hole */
+
+      if (map_page(pi->pdir, (void *)va, KERNEL_VA_TO_PA(b), pg_flags))
+         break;    /* out-of-memory: that's fine, fault-around is optional */
+   }
+}
+
 static bool
 ramfs_handle_fault_int(struct process *pi,
                        struct user_mapping *um,
@@ -82,48 +155,67 @@ ramfs_handle_fault_int(struct process *pi,
                        bool rw)
 {
    struct ramfs_handle *rh = um->h;
-   ulong vaddr = (ulong) vaddrp;
-   ulong abs_off;
-   struct ramfs_block *block;
+   struct ramfs_inode *i = rh->inode;
+   const ulong vaddr = (ulong)vaddrp & PAGE_MASK;
+   void *block;
+   ulong abs_off, paddr;
+   u32 pg_flags;
    int rc;
 
    ASSERT(um != NULL);
 
+   abs_off = um->off + (vaddr - um->vaddr);
+
+   if (abs_off >= (ulong)i->fsize)
+      return false; /* Read/write past EOF */
+
    if (p) {
 
       /*
        * The page is present, just is read-only and the user code tried to
-       * write: there's nothing we can do.
+       * write. The only case we can handle is a write to a hole, previously
+       * mapped as a read-only zero-page.
        */
 
       ASSERT(rw);
-      ASSERT((um->prot & PROT_WRITE) == 0);
-      return false;
+
+      if (!(um->prot & PROT_WRITE))
+         return false;
+
+      if (get_mapping(pi->pdir, (void *)vaddr) != KERNEL_VA_TO_PA(&zero_page))
+         return false;
+
+      unmap_page(pi->pdir, (void *)vaddr, false);
    }
 
-   /* The page is *not* present */
-   abs_off = um->off + (vaddr - um->vaddr);
+   /* The page is *not* present (or it was the zero-page) */
+   block = ramfs_get_block(i, (offt)abs_off);
 
-   if (abs_off >= (ulong)rh->inode->fsize)
-      return false; /* Read/write past EOF */
+   if (!block && rw) {
 
-   if (rw) {
-      /* Create and map on-the-fly a struct ramfs_block */
-      if (!(block = ramfs_new_block((offt)(abs_off & PAGE_MASK))))
-         panic("Out-of-memory: unable to alloc a ramfs_block. No OOM killer");
+      /* Create and map on-the-fly a ramfs block */
+      if (!(block = ramfs_new_block(i, (offt)abs_off)))
+         panic("Out-of-memory: unable to alloc a ramfs block. No OOM killer");
+      ramfs_unmap_hole_in_mappings(i, (offt)abs_off);
+   }
 
-      ramfs_append_new_block(rh->inode, block);
+   if (block) {
+      paddr = KERNEL_VA_TO_PA(block);
+      pg_flags = ramfs_mmap_pg_flags(um);
+   } else {
+      /* Reading a hole: map the zero-page as read-only */
+      paddr = KERNEL_VA_TO_PA(&zero_page);
+      pg_flags = PAGING_FL_US | PAGING_FL_SHARED;
    }
 
-   rc = map_page(pi->pdir,
-                 (void *)(vaddr & PAGE_MASK),
-                 KERNEL_VA_TO_PA(rw ? block->vaddr : &zero_page),
-                 PAGING_FL_US | PAGING_FL_RW | PAGING_FL_SHARED);
+   rc = map_page(pi->pdir, (void *)vaddr, paddr, pg_flags);
 
    if (rc)
-      panic("Out-of-memory: unable to map a ramfs_block. No OOM killer");
+      panic("Out-of-memory: unable to map a ramfs block. No OOM killer");
+
+   if (!rw && um->advice != MADV_RANDOM)
+      ramfs_fault_around(pi, um, vaddr);
 
-   invalidate_page(vaddr);
    return true;
 }
 
@@ -4,8 +4,10 @@ static const struct file_ops static_ops_ramfs =
 {
    .read = ramfs_read,
    .write = ramfs_write,
-   .readv = ramfs_readv,
-   .writev = ramfs_writev,
+   .read_iter = ramfs_read_iter,
+   .write_iter = ramfs_write_iter,
+   .pread_iter = ramfs_pread_iter,
+   .pwrite_iter = ramfs_pwrite_iter,
    .seek = ramfs_seek,
    .ioctl = ramfs_ioctl,
    .mmap = ramfs_mmap,
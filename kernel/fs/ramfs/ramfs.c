@@ -1,5 +1,7 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
+#include <tilck_gen_headers/config_mm.h>
+
 #include <tilck/common/basic_defs.h>
 #include <tilck/common/string_util.h>
 #include <tilck/common/printk.h>
@@ -7,8 +9,11 @@
 
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/fs/flock.h>
+#include <tilck/kernel/fs/ramfs.h>
 
 #include <sys/mman.h>      // system header
+#include <linux/fs.h>      // system header
+#include <linux/fiemap.h>  // system header
 
 #include "ramfs_int.h"
 #include "getdents.c.h"
@@ -22,6 +27,8 @@
 #include "open.c.h"
 #include "mkdir.c.h"
 
+struct ramfs_dir_stats ramfs_dir_stats;
+
 static int ramfs_unlink(struct vfs_path *p)
 {
    struct ramfs_path *rp = (struct ramfs_path *) &p->fs_path;
@@ -78,6 +85,16 @@ static void ramfs_on_close_last_handle(fs_handle h)
    struct ramfs_handle *rh = h;
    struct ramfs_inode *i = rh->inode;
 
+   if (i->nlink && i->type == VFS_FILE) {
+
+      rwlock_wp_exlock(&i->rwlock);
+      {
+         ramfs_inode_trim_extents(i);
+      }
+      rwlock_wp_exunlock(&i->rwlock);
+      return;
+   }
+
    if (!i->nlink) {
 
       /*
@@ -346,7 +363,10 @@ struct fs *ramfs_create(void)
    if (!(d = kzalloc_obj(struct ramfs_data)))
       return NULL;
 
-   fs = create_fs_obj("ramfs", &static_fsops_ramfs, d, VFS_FS_RW);
+   fs = create_fs_obj("ramfs",
+                      &static_fsops_ramfs,
+                      d,
+                      VFS_FS_RW | VFS_FS_DCACHE);
 
    if (!fs) {
       kfree_obj(d, struct ramfs_data);
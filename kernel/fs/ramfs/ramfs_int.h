@@ -20,38 +20,67 @@
 
 struct ramfs_inode;
 
-struct ramfs_block {
+/*
+ * Index of the data pages (blocks) of a ramfs file, in the style of the classic
+ * UNIX inode: the first RAMFS_DIRECT_BLOCKS pages are pointed directly by the
+ * inode, while the next ones through one or two levels of index pages, each
+ * one containing RAMFS_PTRS_PER_PAGE pointers. The data pages are pointed by
+ * their kernel vaddr: no per-block object exists. Holes are NULL pointers.
+ */
+#define RAMFS_DIRECT_BLOCKS             8
+#define RAMFS_PTRS_PER_PAGE             (PAGE_SIZE / sizeof(void *))
+
+#define RAMFS_IND_FIRST_BLOCK           ((ulong)RAMFS_DIRECT_BLOCKS)
+#define RAMFS_DIND_FIRST_BLOCK          \
+   (RAMFS_IND_FIRST_BLOCK + RAMFS_PTRS_PER_PAGE)
+#define RAMFS_MAX_BLOCKS                \
+   (RAMFS_DIND_FIRST_BLOCK + RAMFS_PTRS_PER_PAGE * RAMFS_PTRS_PER_PAGE)
+
+/*
+ * When data is appended sequentially to a file, its blocks are allocated in
+ * physically contiguous extents with a geometrically growing size, up to
+ * RAMFS_MAX_EXTENT_PAGES pages. See ramfs_get_extent_size().
+ */
+#define RAMFS_MAX_EXTENT_PAGES          ((ulong)(2 * MB / PAGE_SIZE))
+
+struct ramfs_blocks {
 
-   struct bintree_node node;
-   offt offset;                  /* MUST BE divisible by PAGE_SIZE */
-   void *vaddr;
+   void *direct[RAMFS_DIRECT_BLOCKS];  /* data pages */
+   void **ind;                         /* index page -> data pages */
+   void ***dind;                       /* index page -> index pages */
 };
 
 /*
- * Ramfs entries do not *necessarily* need to have a fixed size, as they are
- * allocated dynamically on the heap. Said that, a fixed-size entry struct is
- * simpler to manage and faster to alloc/free, in particular with Tilck's
- * current kmalloc implementation.
+ * Ramfs entries are variable-sized: the name is stored inline, right after the
+ * fixed-size header. Because Tilck's kmalloc works with power-of-two blocks,
+ * an entry with a short name uses just 64 bytes (on 32-bit systems), instead
+ * of a fixed-size 256 bytes block.
  */
-#define RAMFS_ENTRY_SIZE 256
-#define RAMFS_ENTRY_MAX_LEN (                   \
-   RAMFS_ENTRY_SIZE                             \
-   - sizeof(struct bintree_node)                \
-   - sizeof(struct list_node)                   \
-   - sizeof(struct ramfs_inode *)               \
-   - sizeof(u8)                                 \
-)
+#define RAMFS_ENTRY_MAX_LEN      255      /* including the final \0 */
 
 struct ramfs_entry {
 
-   struct bintree_node node;
-   struct list_node lnode;
+   struct bintree_node node;        /* node in dir's tree, keyed by cookie */
+   struct list_node lnode;          /* node in dir's entries_list */
+   struct list_node hnode;          /* node in a bucket of dir's htable */
    struct ramfs_inode *inode;
+   ulong cookie;                    /* stable dir offset of the entry */
+   u32 hash;                        /* hash of the name */
    u8 name_len;                     /* NOTE: includes the final \0 */
-   char name[RAMFS_ENTRY_MAX_LEN];
+   char name[];
 };
 
-STATIC_ASSERT(sizeof(struct ramfs_entry) == RAMFS_ENTRY_SIZE);
+/* Size of the heap block required for an entry with the given name_len */
+#define RAMFS_ENTRY_ALLOC_SIZE(name_len)                    \
+   (OFFSET_OF(struct ramfs_entry, name) + (name_len))
+
+/*
+ * Each directory has a hash table of its entries, indexed by name. The table
+ * starts with RAMFS_DIR_HTABLE_MIN_SIZE buckets and doubles its size when the
+ * number of entries exceeds RAMFS_DIR_HTABLE_MAX_LOAD times the buckets.
+ */
+#define RAMFS_DIR_HTABLE_MIN_SIZE         8
+#define RAMFS_DIR_HTABLE_MAX_LOAD         2
 
 struct ramfs_inode {
 
@@ -75,7 +104,8 @@ struct ramfs_inode {
       /* valid when type == VFS_FILE */
       struct {
          offt fsize;
-         struct ramfs_block *blocks_tree_root;
+         ulong next_extent_pages;      /* see ramfs_get_extent_size() */
+         struct ramfs_blocks blocks;
       };
 
       /* valid when type == VFS_DIR */
@@ -84,6 +114,10 @@ struct ramfs_inode {
          struct ramfs_entry *entries_tree_root;
          struct list entries_list;
          struct list handles_list;
+         struct list *htable;          /* name -> entry hash table */
+         u32 htable_size;              /* number of buckets (power of 2) */
+         ulong next_cookie;
+         ulong entries_mem;            /* heap memory used by the entries */
       };
 
       /* valid when type == VFS_SYMLINK */
@@ -1,27 +1,145 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
-static int ramfs_ioctl(fs_handle h, ulong cmd, void *argp)
+struct ramfs_fiemap_ctx {
+
+   struct fiemap fm;
+   struct fiemap_extent fe;            /* the extent being built */
+   struct fiemap_extent *user_extents;
+};
+
+static int ramfs_fiemap_flush(struct ramfs_fiemap_ctx *ctx)
 {
-   return -EINVAL;
+   struct fiemap *fm = &ctx->fm;
+
+   if (!ctx->fe.fe_length)
+      return 0;
+
+   if (fm->fm_extent_count) {
+
+      if (fm->fm_mapped_extents == fm->fm_extent_count)
+         return 1; /* no more space in the user array */
+
+      if (copy_to_user(ctx->user_extents + fm->fm_mapped_extents,
+                       &ctx->fe,
+                       sizeof(ctx->fe)))
+      {
+         return -EFAULT;
+      }
+   }
+
+   fm->fm_mapped_extents++;
+   bzero(&ctx->fe, sizeof(ctx->fe));
+   return 0;
 }
 
-static offt ramfs_dir_seek(struct ramfs_handle *rh, offt target_off)
+/*
+ * Minimal implementation of the FS_IOC_FIEMAP ioctl, reporting the physically
+ * contiguous extents of the file. As on Linux, with fm_extent_count == 0 only
+ * the number of extents is returned, in fm_mapped_extents.
+ */
+static int ramfs_fiemap(struct ramfs_handle *rh, struct fiemap *user_fm)
 {
    struct ramfs_inode *i = rh->inode;
-   struct ramfs_entry *dpos;
-   offt off = 0;
+   struct ramfs_fiemap_ctx ctx = {0};
+   struct fiemap_extent *fe = &ctx.fe;
+   offt off, end;
+   void *b;
+   int rc = 0;
 
-   list_for_each_ro(dpos, &i->entries_list, lnode) {
+   if (copy_from_user(&ctx.fm, user_fm, sizeof(ctx.fm)))
+      return -EFAULT;
 
-      if (off == target_off) {
-         rh->pos = off;
-         rh->dpos = dpos;
-         break;
+   if (i->type != VFS_FILE)
+      return -EINVAL;
+
+   if (ctx.fm.fm_flags & ~FIEMAP_FLAG_SYNC)
+      return -EBADR;
+
+   ctx.fm.fm_mapped_extents = 0;
+   ctx.user_extents = user_fm->fm_extents;
+
+   rwlock_wp_shlock(&i->rwlock);
+   {
+      off = (offt)MIN(ctx.fm.fm_start, (u64)i->fsize) & (offt)PAGE_MASK;
+      end = i->fsize;
+
+      if (ctx.fm.fm_length < (u64)(end - off))
+         end = off + (offt)ctx.fm.fm_length;
+
+      for (; off < end && !rc; off += PAGE_SIZE) {
+
+         b = ramfs_get_block(i, off);
+
+         if (b && fe->fe_length &&
+             KERNEL_VA_TO_PA(b) == fe->fe_physical + fe->fe_length)
+         {
+            fe->fe_length += PAGE_SIZE;
+            continue;
+         }
+
+         if ((rc = ramfs_fiemap_flush(&ctx)))
+            break;
+
+         if (b) {
+            fe->fe_logical = (u64)off;
+            fe->fe_physical = KERNEL_VA_TO_PA(b);
+            fe->fe_length = PAGE_SIZE;
+         }
       }
 
-      off++;
+      if (!rc) {
+
+         if (off >= i->fsize)
+            fe->fe_flags |= FIEMAP_EXTENT_LAST;
+
+         rc = ramfs_fiemap_flush(&ctx);
+      }
    }
+   rwlock_wp_shunlock(&i->rwlock);
 
+   if (rc < 0)
+      return rc;
+
+   if (copy_to_user(user_fm, &ctx.fm, sizeof(ctx.fm)))
+      return -EFAULT;
+
+   return 0;
+}
+
+static int ramfs_ioctl(fs_handle h, ulong cmd, void *argp)
+{
+   if (cmd == FS_IOC_FIEMAP)
+      return ramfs_fiemap(h, argp);
+
+   return -EINVAL;
+}
+
+/*
+ * The offset of a directory is the cookie of the last entry read, or 0 at the
+ * beginning. Because cookies are stable and increasing, seeking is just a
+ * matter of finding the first entry with a cookie > offset, even when the
+ * entry with cookie == offset has been removed in the meanwhile.
+ */
+static offt ramfs_dir_seek(struct ramfs_handle *rh, offt target_off)
+{
+   struct ramfs_inode *i = rh->inode;
+   struct ramfs_entry *e = NULL;
+
+   if (target_off < (offt)i->next_cookie) {
+      e = bintree_find_ptr_ge(i->entries_tree_root,
+                              (ulong)target_off + 1,
+                              struct ramfs_entry,
+                              node,
+                              cookie);
+   }
+
+   if (!e) {
+      /* Past the last entry: point to the list head, like at the end */
+      e = list_to_obj(&i->entries_list, struct ramfs_entry, lnode);
+   }
+
+   rh->pos = target_off;
+   rh->dpos = e;
    return rh->pos;
 }
 
@@ -197,26 +315,9 @@ static int ramfs_inode_truncate(struct ramfs_inode *i, offt len)
    }
    enable_preemption();
 
-   while (true) {
-
-      struct ramfs_block *b =
-         bintree_get_last_obj(i->blocks_tree_root, struct ramfs_block, node);
-
-      if (!b || b->offset < len)
-         break;
-
-      /* Remove the block object from the tree */
-      bintree_remove_ptr(&i->blocks_tree_root,
-                         b,
-                         struct ramfs_block,
-                         node,
-                         offset);
-
-      ramfs_destroy_block(b);
-   }
-
+   ramfs_destroy_blocks_past(i, len);
    i->fsize = len;
-   i->blocks_count = pow2_round_up_at((ulong) len, PAGE_SIZE);
+   i->next_extent_pages = 0;
    return 0;
 }
 
@@ -248,223 +349,191 @@ static int ramfs_truncate(struct fs *fs, vfs_inode_ptr_t i, offt len)
    return ramfs_inode_truncate_safe(i, len, false);
 }
 
+/*
+ * Read from the file position `*pos` and advance it. The position is either the
+ * handle's one (read) or a local variable (pread).
+ */
 static ssize_t
-ramfs_read_nolock(struct ramfs_handle *rh, char *buf, size_t len)
+ramfs_read_nolock(struct ramfs_handle *rh, struct io_iter *it, offt *pos)
 {
    struct ramfs_inode *inode = rh->inode;
    offt tot_read = 0;
-   offt buf_rem = (offt) len;
+   ssize_t rc;
 
    if (inode->type == VFS_DIR)
       return -EISDIR;
 
    ASSERT(inode->type == VFS_FILE);
 
-   while (buf_rem > 0) {
-
-      struct ramfs_block *block;
-      const offt page     = rh->pos & (offt)PAGE_MASK;
-      const offt page_off = rh->pos & (offt)OFFSET_IN_PAGE_MASK;
-      const offt page_rem = (offt)PAGE_SIZE - page_off;
-      const offt file_rem = inode->fsize - rh->pos;
-      const offt to_read  = MIN3(page_rem, buf_rem, file_rem);
+   while (it->count > 0 && *pos < inode->fsize) {
 
-      if (rh->pos >= inode->fsize)
-         break;
+      void *block;
+      const offt page     = *pos & (offt)PAGE_MASK;
+      const offt page_off = *pos & (offt)OFFSET_IN_PAGE_MASK;
+      const offt rem      = MIN((offt)it->count, inode->fsize - *pos);
+      offt to_read;
 
-      ASSERT(to_read >= 0);
+      block = ramfs_get_block(inode, page);
 
-      if (!to_read)
-         break;
+      if (block) {
 
-      block = bintree_find_ptr(inode->blocks_tree_root,
-                               page,
-                               struct ramfs_block,
-                               node,
-                               offset);
+         /* reading a regular block, plus the contiguous ones after it */
+         to_read = ramfs_get_contig_len(inode, page, block, page_off + rem);
+         to_read = MIN(to_read - page_off, rem);
+         rc = io_iter_copy_to(it, block + page_off, (size_t)to_read);
 
-      if (block) {
-         /* reading a regular block */
-         memcpy(buf + tot_read, block->vaddr + page_off, (size_t)to_read);
       } else {
+
          /* reading a hole */
-         memset(buf + tot_read, 0, (size_t)to_read);
+         to_read = MIN((offt)PAGE_SIZE - page_off, rem);
+         rc = io_iter_zero(it, (size_t)to_read);
       }
 
+      if (rc < 0)
+         return tot_read ? (ssize_t)tot_read : rc;
+
       tot_read += to_read;
-      rh->pos  += to_read;
-      buf_rem  -= to_read;
+      *pos     += to_read;
    }
 
    return (ssize_t) tot_read;
 }
 
-static ssize_t ramfs_read(fs_handle h, char *buf, size_t len)
+static ssize_t ramfs_read_iter(fs_handle h, struct io_iter *it)
 {
    struct ramfs_handle *rh = h;
    ssize_t ret;
 
    ramfs_file_shlock(h);
    {
-      ret = ramfs_read_nolock(rh, buf, len);
+      ret = ramfs_read_nolock(rh, it, &rh->pos);
+   }
+   ramfs_file_shunlock(h);
+   return ret;
+}
+
+static ssize_t ramfs_pread_iter(fs_handle h, struct io_iter *it, offt pos)
+{
+   ssize_t ret;
+
+   ramfs_file_shlock(h);
+   {
+      ret = ramfs_read_nolock(h, it, &pos);
    }
    ramfs_file_shunlock(h);
    return ret;
 }
 
+static ssize_t ramfs_read(fs_handle h, char *buf, size_t len)
+{
+   struct iovec iov = { buf, len };
+   struct io_iter it;
+
+   io_iter_init(&it, &iov, 1, false);
+   return ramfs_read_iter(h, &it);
+}
+
+/* Like ramfs_read_nolock(), for writing */
 static ssize_t
-ramfs_write_nolock(struct ramfs_handle *rh, char *buf, size_t len)
+ramfs_write_nolock(struct ramfs_handle *rh, struct io_iter *it, offt *pos)
 {
    struct ramfs_inode *inode = rh->inode;
+   const size_t len = it->count;
    offt tot_written = 0;
-   offt buf_rem = (offt)len;
+   ssize_t rc = 0;
 
    /* We can be sure it's a file because dirs cannot be open for writing */
    ASSERT(inode->type == VFS_FILE);
 
    if (rh->fl_flags & O_APPEND)
-      rh->pos = inode->fsize;
-
-   while (buf_rem > 0) {
-
-      struct ramfs_block *block;
-      const offt page     = rh->pos & (offt)PAGE_MASK;
-      const offt page_off = rh->pos & (offt)OFFSET_IN_PAGE_MASK;
-      const offt page_rem = (offt)PAGE_SIZE - page_off;
-      const offt to_write = MIN(page_rem, buf_rem);
+      *pos = inode->fsize;
 
-      ASSERT(to_write > 0);
+   while (it->count > 0) {
 
-      block = bintree_find_ptr(inode->blocks_tree_root,
-                               page,
-                               struct ramfs_block,
-                               node,
-                               offset);
+      void *block;
+      const offt page     = *pos & (offt)PAGE_MASK;
+      const offt page_off = *pos & (offt)OFFSET_IN_PAGE_MASK;
+      const offt rem      = (offt)it->count;
+      offt to_write;
 
-      /* Assert that if page_off > 0, the block is present */
-      ASSERT(!page_off || block);
+      block = ramfs_get_block(inode, page);
 
+      /*
+       * NOTE: the block can be missing even when page_off > 0, when writing in
+       * a hole or past EOF (e.g. with pwrite). That's fine: new blocks are
+       * always zeroed.
+       */
       if (!block) {
 
-         if (!(block = ramfs_new_block(page)))
+         ulong n = ramfs_get_extent_size(inode, page);
+
+         if (!(block = ramfs_new_extent(inode, page, &n)))
             break;
 
-         ramfs_append_new_block(inode, block);
+         if (!list_is_empty(&inode->mappings_list)) {
+            disable_preemption();
+            {
+               for (ulong k = 0; k < n; k++)
+                  ramfs_unmap_hole_in_mappings(inode, page + (offt)k*PAGE_SIZE);
+            }
+            enable_preemption();
+         }
       }
 
-      memcpy(block->vaddr + page_off, buf + tot_written, (size_t)to_write);
+      /* Write the block, plus the contiguous ones after it */
+      to_write = ramfs_get_contig_len(inode, page, block, page_off + rem);
+      to_write = MIN(to_write - page_off, rem);
+
+      if ((rc = io_iter_copy_from(it, block + page_off, (size_t)to_write)) < 0)
+         break;
+
       tot_written += to_write;
-      buf_rem     -= to_write;
-      rh->pos     += to_write;
+      *pos        += to_write;
 
-      if (rh->pos > inode->fsize)
-         inode->fsize = rh->pos;
+      if (*pos > inode->fsize)
+         inode->fsize = *pos;
    }
 
    if (len > 0 && !tot_written)
-      return -ENOSPC;
+      return rc < 0 ? rc : -ENOSPC;
 
    return (ssize_t)tot_written;
 }
 
-static ssize_t ramfs_write(fs_handle h, char *buf, size_t len)
+static ssize_t ramfs_write_iter(fs_handle h, struct io_iter *it)
 {
    struct ramfs_handle *rh = h;
    ssize_t ret;
 
    ramfs_file_exlock(h);
    {
-      ret = ramfs_write_nolock(rh, buf, len);
+      ret = ramfs_write_nolock(rh, it, &rh->pos);
    }
    ramfs_file_exunlock(h);
    return ret;
 }
 
-static ssize_t
-ramfs_readv_nolock(struct ramfs_handle *rh, const struct iovec *iov, int iovcnt)
+static ssize_t ramfs_pwrite_iter(fs_handle h, struct io_iter *it, offt pos)
 {
-   struct task *curr = get_curr_task();
-   ssize_t ret = 0;
-   ssize_t rc;
-   size_t len;
-
-   for (int i = 0; i < iovcnt; i++) {
-
-      len = MIN(iov[i].iov_len, IO_COPYBUF_SIZE);
-      rc = ramfs_read_nolock(rh, curr->io_copybuf, len);
-
-      if (rc < 0) {
-         ret = rc;
-         break;
-      }
-
-      if (copy_to_user(iov[i].iov_base, curr->io_copybuf, len))
-         return -EFAULT;
-
-      ret += rc;
-
-      if (rc < (ssize_t)iov[i].iov_len)
-         break; // Not enough data to fill all the user buffers.
-   }
-
-   return ret;
-}
-
-static ssize_t
-ramfs_readv(fs_handle h, const struct iovec *iov, int iovcnt)
-{
-   struct ramfs_handle *rh = h;
    ssize_t ret;
 
-   ramfs_file_shlock(h);
+   /*
+    * NOTE: like on Linux, with O_APPEND the data is appended at the end of
+    * the file, no matter what `pos` is.
+    */
+   ramfs_file_exlock(h);
    {
-      ret = ramfs_readv_nolock(rh, iov, iovcnt);
-   }
-   ramfs_file_shunlock(h);
-   return ret;
-}
-
-static ssize_t
-ramfs_writev_nolock(struct ramfs_handle *h, const struct iovec *iov, int iovcnt)
-{
-   struct task *curr = get_curr_task();
-   ssize_t ret = 0;
-   ssize_t rc;
-   size_t len;
-
-   for (int i = 0; i < iovcnt; i++) {
-
-      len = MIN(iov[i].iov_len, IO_COPYBUF_SIZE);
-
-      if (copy_from_user(curr->io_copybuf, iov[i].iov_base, len))
-         return -EFAULT;
-
-      rc = ramfs_write_nolock(h, curr->io_copybuf, len);
-
-      if (rc < 0) {
-         ret = rc;
-         break;
-      }
-
-      ret += rc;
-
-      if (rc < (ssize_t)iov[i].iov_len)
-         break;
+      ret = ramfs_write_nolock(h, it, &pos);
    }
-
+   ramfs_file_exunlock(h);
    return ret;
 }
 
-static ssize_t
-ramfs_writev(fs_handle h, const struct iovec *iov, int iovcnt)
+static ssize_t ramfs_write(fs_handle h, char *buf, size_t len)
 {
-   struct ramfs_handle *rh = h;
-   ssize_t ret;
+   struct iovec iov = { buf, len };
+   struct io_iter it;
 
-   ramfs_file_exlock(h);
-   {
-      ret = ramfs_writev_nolock(rh, iov, iovcnt);
-   }
-   ramfs_file_exunlock(h);
-   return ret;
+   io_iter_init(&it, &iov, 1, false);
+   return ramfs_write_iter(h, &it);
 }
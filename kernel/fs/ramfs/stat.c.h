@@ -27,8 +27,7 @@ ramfs_stat_nolock(struct fs *fs,
          break;
 
       case VFS_DIR:
-         statbuf->st_size = (typeof(statbuf->st_size))
-            (inode->num_entries * (offt) sizeof(struct ramfs_entry));
+         statbuf->st_size = (typeof(statbuf->st_size)) inode->entries_mem;
          break;
 
       case VFS_SYMLINK:
@@ -4,12 +4,15 @@
 
 #include <tilck/kernel/fs/vfs.h>
 #include <tilck/kernel/fs/flock.h>
+#include <tilck/kernel/fs/dcache.h>
 #include <tilck/kernel/kmalloc.h>
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/process_mm.h>
 #include <tilck/kernel/user.h>
+#include <tilck/kernel/paging.h>
 #include <tilck/kernel/debug_utils.h>
+#include <tilck/kernel/epoll.h>
 
 #include <dirent.h> // system header
 
@@ -19,6 +22,7 @@
 #include "vfs_resolve.c.h"
 #include "vfs_getdents.c.h"
 #include "vfs_op_ready.c.h"
+#include "vfs_io_iter.c.h"
 
 static u32 next_device_id;
 
@@ -35,6 +39,9 @@ void vfs_close(fs_handle h)
    struct locked_file *lf = hb->lf;
    const struct fs_ops *fsops = fs->fsops;
 
+   if (hb->spec_flags & VFS_SPFL_EPOLL)
+      epoll_remove_handle(h);
+
    if (!pi->vforked)
       remove_all_mappings_of_handle(pi, h);
 
@@ -96,6 +103,9 @@ int vfs_dup(fs_handle h, fs_handle *dup_h)
    /* The new file descriptor does NOT share old file descriptor's fd_flags */
    new_handle->fd_flags = 0;
 
+   /* Nor its epoll registrations: they refer to the old handle */
+   new_handle->spec_flags &= ~VFS_SPFL_EPOLL;
+
    /* Check that the locked_file object (if any) is still the same */
    ASSERT(new_handle->lf == hb->lf);
 
@@ -139,6 +149,182 @@ ssize_t vfs_write(fs_handle h, void *buf, size_t buf_size)
    return hb->fops->write(h, buf, buf_size);
 }
 
+ssize_t vfs_read_iter(fs_handle h, struct io_iter *it)
+{
+   NO_TEST_ASSERT(is_preemption_enabled());
+   ASSERT(h != NULL);
+
+   struct fs_handle_base *hb = (struct fs_handle_base *) h;
+   ASSERT(hb->fops->read_iter);
+
+   if ((hb->fl_flags & O_WRONLY) && !(hb->fl_flags & O_RDWR))
+      return -EBADF; /* file not opened for reading */
+
+   return hb->fops->read_iter(h, it);
+}
+
+ssize_t vfs_write_iter(fs_handle h, struct io_iter *it)
+{
+   NO_TEST_ASSERT(is_preemption_enabled());
+   ASSERT(h != NULL);
+
+   struct fs_handle_base *hb = (struct fs_handle_base *) h;
+   ASSERT(hb->fops->write_iter);
+
+   if (!(hb->fl_flags & (O_WRONLY | O_RDWR)))
+      return -EBADF; /* file not opened for writing */
+
+   return hb->fops->write_iter(h, it);
+}
+
+ssize_t vfs_pread_iter(fs_handle h, struct io_iter *it, offt pos)
+{
+   NO_TEST_ASSERT(is_preemption_enabled());
+   ASSERT(h != NULL);
+
+   struct fs_handle_base *hb = (struct fs_handle_base *) h;
+
+   if ((hb->fl_flags & O_WRONLY) && !(hb->fl_flags & O_RDWR))
+      return -EBADF; /* file not opened for reading */
+
+   if (!hb->fops->pread_iter)
+      return -ESPIPE;
+
+   if (pos < 0)
+      return -EINVAL;
+
+   return hb->fops->pread_iter(h, it, pos);
+}
+
+ssize_t vfs_pwrite_iter(fs_handle h, struct io_iter *it, offt pos)
+{
+   NO_TEST_ASSERT(is_preemption_enabled());
+   ASSERT(h != NULL);
+
+   struct fs_handle_base *hb = (struct fs_handle_base *) h;
+
+   if (!(hb->fl_flags & (O_WRONLY | O_RDWR)))
+      return -EBADF; /* file not opened for writing */
+
+   if (!hb->fops->pwrite_iter)
+      return -ESPIPE;
+
+   if (pos < 0)
+      return -EINVAL;
+
+   return hb->fops->pwrite_iter(h, it, pos);
+}
+
+/*
+ * Copy up to `len` bytes from `src` to `dst`, entirely in the kernel, through
+ * the per-task `io_copybuf`. When `src_pos` (or `dst_pos`) is NULL, the file's
+ * current position is used and updated, otherwise `*src_pos` (or `*dst_pos`) is
+ * used and incremented by the number of bytes copied. Used by sendfile() and
+ * copy_file_range().
+ *
+ * NOTE: on short writes, the bytes read but not written are "un-read" by moving
+ * back the position of `src`. Sources that cannot seek (e.g. ttys) cannot do
+ * that, so the rest of the data read is written until the destination fails.
+ * Pipes, instead, must use pipe_splice_to_file(), which consumes only the
+ * bytes actually written.
+ */
+ssize_t
+vfs_copy_data(fs_handle src,
+              offt *src_pos,
+              fs_handle dst,
+              offt *dst_pos,
+              size_t len)
+{
+   struct fs_handle_base *src_hb = src;
+   struct fs_handle_base *dst_hb = dst;
+   struct task *curr = get_curr_task();
+   const bool can_unread = src_pos || src_hb->fops->seek;
+   struct io_iter it;
+   struct iovec iov;
+   ssize_t tot = 0;
+   ssize_t rc, wrc;
+   size_t chunk, written;
+
+   if (src_pos ? !src_hb->fops->pread_iter : !src_hb->fops->read_iter)
+      return -EINVAL;
+
+   if (dst_pos ? !dst_hb->fops->pwrite_iter : !dst_hb->fops->write_iter)
+      return -EINVAL;
+
+   len = MIN(len, VFS_MAX_RW_COUNT);
+
+   while ((size_t)tot < len) {
+
+      chunk = MIN(len - (size_t)tot, IO_COPYBUF_SIZE);
+      iov = (struct iovec) { curr->io_copybuf, chunk };
+      io_iter_init(&it, &iov, 1, false);
+
+      if (src_pos)
+         rc = vfs_pread_iter(src, &it, *src_pos);
+      else
+         rc = vfs_read_iter(src, &it);
+
+      if (rc <= 0) {
+
+         if (!tot)
+            tot = rc;
+
+         break;
+      }
+
+      if (src_pos)
+         *src_pos += rc;
+
+      written = 0;
+
+      do {
+
+         iov = (struct iovec) {
+            (char *)curr->io_copybuf + written, (size_t)rc - written
+         };
+         io_iter_init(&it, &iov, 1, false);
+
+         if (dst_pos)
+            wrc = vfs_pwrite_iter(dst, &it, *dst_pos);
+         else
+            wrc = vfs_write_iter(dst, &it);
+
+         if (wrc <= 0)
+            break;
+
+         written += (size_t)wrc;
+
+         if (dst_pos)
+            *dst_pos += wrc;
+
+      } while (written < (size_t)rc && !can_unread);
+
+      tot += (ssize_t)written;
+
+      if (written < (size_t)rc) {
+
+         /*
+          * Short write or error: move back the position of `src` by the
+          * number of bytes not written, in order to not skip them.
+          */
+         if (src_pos)
+            *src_pos -= rc - (ssize_t)written;
+         else if (can_unread)
+            vfs_seek(src, -(rc - (ssize_t)written), SEEK_CUR);
+
+         if (!tot && wrc < 0)
+            tot = wrc;
+
+         break;
+      }
+
+      if ((size_t)rc < chunk || pending_signals())
+         break;
+   }
+
+   return tot;
+}
+
 offt vfs_seek(fs_handle h, s64 off, int whence)
 {
    NO_TEST_ASSERT(is_preemption_enabled());
@@ -229,6 +415,21 @@ int vfs_fdatasync(fs_handle h)
 
 /* ----------- path-based functions -------------- */
 
+/*
+ * Drop the dcache entry for the last component of `p`, which is about to be
+ * created or removed. NOTE: the caller must hold fs's exclusive lock.
+ */
+static void vfs_dcache_invalidate_last_comp(struct vfs_path *p)
+{
+   const char *lc = p->last_comp;
+   ssize_t len = 0;
+
+   while (lc[len] && lc[len] != '/')
+      len++;
+
+   dcache_invalidate(p->fs, p->fs_path.dir_inode, lc, len);
+}
+
 typedef int (*vfs_func_impl)(struct fs*, struct vfs_path*, ulong, ulong, ulong);
 
 static ALWAYS_INLINE int
@@ -273,6 +474,9 @@ vfs_open_impl(struct fs *fs, struct vfs_path *p,
          return -ENOTDIR;
    }
 
+   if ((flags & O_CREAT) && !p->fs_path.inode)
+      vfs_dcache_invalidate_last_comp(p);
+
    if ((rc = fs->fsops->open(p, out, flags, mode)))
       return rc;
 
@@ -293,8 +497,12 @@ vfs_open_impl(struct fs *fs, struct vfs_path *p,
       }
    }
 
-   /* file handles retain their struct fs */
-   retain_obj(fs);
+   /*
+    * File handles retain their struct fs. NOTE: that's not necessarily `fs`,
+    * because stacked file systems (overlayfs) return the handles of the
+    * file systems below them.
+    */
+   retain_obj(((struct fs_handle_base *)*out)->fs);
    return 0;
 }
 
@@ -349,6 +557,7 @@ vfs_mkdir_impl(struct fs *fs, struct vfs_path *p, mode_t mode, ulong x, ulong y)
    if (p->fs_path.inode)
       return -EEXIST;
 
+   vfs_dcache_invalidate_last_comp(p);
    return fs->fsops->mkdir(p, mode);
 }
 
@@ -377,6 +586,8 @@ vfs_rmdir_impl(struct fs *fs, struct vfs_path *p, ulong u1, ulong u2, ulong u3)
    if (!p->fs_path.inode)
       return -ENOENT;
 
+   vfs_dcache_invalidate_last_comp(p);
+   dcache_invalidate_inode(fs, p->fs_path.inode);
    return fs->fsops->rmdir(p);
 }
 
@@ -403,6 +614,7 @@ vfs_unlink_impl(struct fs *fs, struct vfs_path *p, ulong u1, ulong u2, ulong u3)
    if (!p->fs_path.inode)
       return -ENOENT;
 
+   vfs_dcache_invalidate_last_comp(p);
    return fs->fsops->unlink(p);
 }
 
@@ -473,6 +685,7 @@ vfs_symlink_impl(struct fs *fs,
    if (p->fs_path.inode)
       return -EEXIST; /* the linkpath already exists! */
 
+   vfs_dcache_invalidate_last_comp(p);
    return fs->fsops->symlink(target, p);
 }
 
@@ -673,6 +886,13 @@ vfs_rename_or_link(const char *oldpath,
    release_obj(fs);
    vfs_release_inode_at(&oldp); /* note: we're still holding an exlock on fs */
 
+   /* Drop the dcache entries of both the paths, we're holding the exlock */
+   vfs_dcache_invalidate_last_comp(&oldp);
+   vfs_dcache_invalidate_last_comp(&newp);
+
+   if (newp.fs_path.inode)
+      dcache_invalidate_inode(fs, newp.fs_path.inode);  /* replaced */
+
    /* Finally, we can call struct fs's func (if any) */
    func = get_func_ptr(fs);
 
@@ -772,10 +992,20 @@ ssize_t vfs_readv(fs_handle h, const struct iovec *iov, int iovcnt)
    if (hb->fops->readv)
       return hb->fops->readv(h, iov, iovcnt);
 
+   if (hb->fops->read_iter) {
+
+      /* Scatter/gather I/O directly to the user buffers, in a single call */
+      struct io_iter it;
+
+      io_iter_init(&it, iov, iovcnt, true);
+      return vfs_read_iter(h, &it);
+   }
+
    /*
-    * readv() is not implemented in the file system: implement here it in a
-    * generic but non-atomic way. There's nothing more we can do. Also, the
-    * POSIX standard does not require readv() to be atomic:
+    * Neither readv() nor read_iter() are implemented in the file system:
+    * implement here it in a generic but non-atomic way. There's nothing more
+    * we can do. Also, the POSIX standard does not require readv() to be
+    * atomic:
     *
     *    https://pubs.opengroup.org/onlinepubs/9699919799/
     *
@@ -818,10 +1048,20 @@ ssize_t vfs_writev(fs_handle h, const struct iovec *iov, int iovcnt)
    if (hb->fops->writev)
       return hb->fops->writev(h, iov, iovcnt);
 
+   if (hb->fops->write_iter) {
+
+      /* Scatter/gather I/O directly from the user buffers, in a single call */
+      struct io_iter it;
+
+      io_iter_init(&it, iov, iovcnt, true);
+      return vfs_write_iter(h, &it);
+   }
+
    /*
-    * writev() is not implemented in the file system: implement here it in a
-    * generic but non-atomic way. There's nothing more we can do. Also, the
-    * POSIX standard does not require writev() to be atomic:
+    * Neither writev() nor write_iter() are implemented in the file system:
+    * implement here it in a generic but non-atomic way. There's nothing more
+    * we can do. Also, the POSIX standard does not require writev() to be
+    * atomic:
     *
     *    https://pubs.opengroup.org/onlinepubs/9699919799/
     *
@@ -885,6 +1125,7 @@ create_fs_obj(const char *type,
 void destory_fs_obj(struct fs *fs)
 {
    ASSERT(!fs->pss_lock_root);
+   dcache_invalidate_fs(fs);
    kfree_obj(fs, struct fs);
 }
 
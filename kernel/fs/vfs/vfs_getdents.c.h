@@ -1,14 +1,22 @@
 /* SPDX-License-Identifier: BSD-2-Clause */
 
+/*
+ * The entries are staged in the per-task `io_copybuf` and copied to the user
+ * buffer in one go per syscall (or per `io_copybuf`-sized chunk), instead of
+ * doing two fault-protected copies per entry.
+ */
 struct vfs_getdents_ctx {
 
    struct fs_handle_base *h;
    struct linux_dirent64 *user_dirp;
    u32 buf_size;
-   u32 offset;
-   u32 fs_flags;
+   u32 offset;          /* bytes "returned" so far: flushed + staged */
    offt off;
-   struct linux_dirent64 ent;
+
+   char *stage;         /* kernel buffer where the entries are staged */
+   u32 stage_size;
+   u32 flushed;         /* bytes already copied to `user_dirp` */
+   offt flushed_pos;    /* h->pos after the last flushed entry */
 };
 
 static inline unsigned char
@@ -29,32 +37,27 @@ vfs_type_to_linux_dirent_type(enum vfs_entry_type t)
    return table[t];
 }
 
-static int vfs_getdents_cb(struct vfs_dent64 *vde, void *arg)
+static bool vfs_getdents_flush(struct vfs_getdents_ctx *ctx)
 {
-   const u16 entry_size = sizeof(struct linux_dirent64) + vde->name_len;
-   struct linux_dirent64 *user_ent;
-   struct vfs_getdents_ctx *ctx = arg;
-   char *user_ent_dname;
+   const u32 staged = ctx->offset - ctx->flushed;
+   char *user_buf = (char *)ctx->user_dirp + ctx->flushed;
 
-   if (ctx->fs_flags & VFS_FS_RQ_DE_SKIP) {
+   if (!staged)
+      return true;
 
-      /*
-       * Pseudo-hack used fortunately *only* by the FAT32 struct fs: it
-       * implements here in the VFS layer a trivial mechanism to skip the first
-       * `pos` entries of a directory in case the struct fs does not have a
-       * way to just "save" the current position and resume from there in each
-       * call of the fs-op getdents().
-       *
-       * TODO: implement in FAT32 a way to walk a directory step-by-step,
-       * instead of having to walk all the entries every time and skipping the
-       * already "returned" entries. This way we could drop VFS_FS_RQ_DE_SKIP.
-       */
+   if (copy_to_user(user_buf, ctx->stage, staged) < 0)
+      return false;
 
-      if (ctx->off < ctx->h->pos) {
-         ctx->off++;
-         return 0; /* skip the dentry */
-      }
-   }
+   ctx->flushed = ctx->offset;
+   ctx->flushed_pos = ctx->h->pos;
+   return true;
+}
+
+static int vfs_getdents_cb(struct vfs_dent64 *vde, void *arg)
+{
+   const u16 entry_size = sizeof(struct linux_dirent64) + vde->name_len;
+   struct vfs_getdents_ctx *ctx = arg;
+   struct linux_dirent64 *ent;
 
    if (ctx->offset + entry_size > ctx->buf_size) {
 
@@ -72,23 +75,23 @@ static int vfs_getdents_cb(struct vfs_dent64 *vde, void *arg)
       return (int) ctx->offset;
    }
 
-   ctx->ent.d_ino    = vde->ino;
-   ctx->ent.d_off    = (u64) ctx->off + 1; /* "offset" (=ID) of the next dent */
-   ctx->ent.d_reclen = entry_size;
-   ctx->ent.d_type   = vfs_type_to_linux_dirent_type(vde->type);
-
-   user_ent = (void *)((char *)ctx->user_dirp + ctx->offset);
-   user_ent_dname = (char *)user_ent + OFFSET_OF(struct linux_dirent64, d_name);
+   if (ctx->offset - ctx->flushed + entry_size > ctx->stage_size) {
 
-   if (copy_to_user(user_ent, &ctx->ent, sizeof(ctx->ent)) < 0)
-      return -EFAULT;
+      /* The staging buffer is full: copy its entries to the user buffer */
+      if (!vfs_getdents_flush(ctx))
+         return -EFAULT;
+   }
 
-   if (copy_to_user(user_ent_dname, vde->name, vde->name_len) < 0)
-      return -EFAULT;
+   ent = (void *)(ctx->stage + ctx->offset - ctx->flushed);
+   ent->d_ino    = vde->ino;
+   ent->d_off    = (u64)(vde->next_off ? vde->next_off : ctx->off + 1);
+   ent->d_reclen = entry_size;
+   ent->d_type   = vfs_type_to_linux_dirent_type(vde->type);
+   memcpy(ent->d_name, vde->name, vde->name_len);
 
    ctx->offset += entry_size;
    ctx->off++;
-   ctx->h->pos++;
+   ctx->h->pos = vde->next_off ? vde->next_off : ctx->h->pos + 1;
    return 0;
 }
 
@@ -96,6 +99,7 @@ int vfs_getdents64(fs_handle h, struct linux_dirent64 *user_dirp, u32 buf_size)
 {
    NO_TEST_ASSERT(is_preemption_enabled());
    struct fs_handle_base *hb = (struct fs_handle_base *) h;
+   bool rewind = false;
    int rc;
 
    ASSERT(hb != NULL);
@@ -106,9 +110,11 @@ int vfs_getdents64(fs_handle h, struct linux_dirent64 *user_dirp, u32 buf_size)
       .user_dirp     = user_dirp,
       .buf_size      = buf_size,
       .offset        = 0,
-      .fs_flags      = hb->fs->flags,
-      .off           = hb->fs->flags & VFS_FS_RQ_DE_SKIP ? 0 : ctx.h->pos,
-      .ent           = { 0 },
+      .off           = hb->pos,
+      .stage         = get_curr_task()->io_copybuf,
+      .stage_size    = MIN(buf_size, IO_COPYBUF_SIZE),
+      .flushed       = 0,
+      .flushed_pos   = hb->pos,
    };
 
    /* See the comment in vfs.h about the "fs-locks" */
@@ -116,9 +122,39 @@ int vfs_getdents64(fs_handle h, struct linux_dirent64 *user_dirp, u32 buf_size)
    {
       rc = hb->fs->fsops->getdents(hb, &vfs_getdents_cb, &ctx);
 
-      if (!rc)
+      if (rc >= 0 && !vfs_getdents_flush(&ctx))
+         rc = -EFAULT;
+
+      if (rc == -EFAULT) {
+
+         /*
+          * The entries not copied to the user buffer have not been returned:
+          * the next call will start from them. Like on Linux, return the
+          * entries copied so far, if any.
+          */
+         rewind = hb->pos != ctx.flushed_pos;
+
+         if (ctx.flushed)
+            rc = (int) ctx.flushed;
+
+      } else if (rc >= 0) {
+
          rc = (int) ctx.offset;
+      }
    }
    vfs_fs_shunlock(hb->fs);
+
+   if (rewind) {
+
+      /*
+       * Setting `pos` is not enough: the filesystems keep their own cursor
+       * of the directory (e.g. ramfs's `dpos`), which is moved back only by
+       * their seek op. Call it after releasing the fs lock, which it might
+       * take as well (e.g. overlayfs).
+       */
+      if (!hb->fops->seek || vfs_seek(h, ctx.flushed_pos, SEEK_SET) < 0)
+         hb->pos = ctx.flushed_pos;
+   }
+
    return rc;
 }
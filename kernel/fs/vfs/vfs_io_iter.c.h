@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+void
+io_iter_init(struct io_iter *it,
+             const struct iovec *iov,
+             int nr_segs,
+             bool user)
+{
+   *it = (struct io_iter) {
+      .iov = iov,
+      .nr_segs = nr_segs,
+      .iov_off = 0,
+      .count = 0,
+      .user = user,
+   };
+
+   for (int i = 0; i < nr_segs; i++)
+      it->count += iov[i].iov_len;
+}
+
+static inline void io_iter_advance(struct io_iter *it, size_t len)
+{
+   it->iov_off += len;
+   it->count -= len;
+
+   if (it->iov_off == it->iov->iov_len) {
+      it->iov++;
+      it->nr_segs--;
+      it->iov_off = 0;
+   }
+}
+
+/*
+ * Copy `n` bytes between `kbuf` and the iter. When `kbuf` is NULL and
+ * `to_iter` is true, zeros are copied.
+ */
+static ssize_t
+io_iter_copy(struct io_iter *it, void *kbuf, size_t n, bool to_iter)
+{
+   size_t done = 0;
+   size_t len;
+   char *ptr;
+   int rc;
+
+   while (done < n && it->nr_segs > 0) {
+
+      ptr = (char *)it->iov->iov_base + it->iov_off;
+      len = MIN(n - done, it->iov->iov_len - it->iov_off);
+
+      if (!kbuf)
+         len = MIN(len, PAGE_SIZE);   /* zeros come from the zero_page */
+
+      if (it->user) {
+
+         if (to_iter)
+            rc = copy_to_user(ptr, kbuf ? kbuf + done : zero_page, len);
+         else
+            rc = copy_from_user(kbuf + done, ptr, len);
+
+         if (rc)
+            return -EFAULT;
+
+      } else {
+
+         if (!to_iter)
+            memcpy(kbuf + done, ptr, len);
+         else if (kbuf)
+            memcpy(ptr, kbuf + done, len);
+         else
+            bzero(ptr, len);
+      }
+
+      done += len;
+      io_iter_advance(it, len);
+   }
+
+   return (ssize_t)done;
+}
+
+ssize_t io_iter_copy_to(struct io_iter *it, const void *src, size_t n)
+{
+   ASSERT(src != NULL);
+   return io_iter_copy(it, (void *)src, n, true);
+}
+
+ssize_t io_iter_copy_from(struct io_iter *it, void *dest, size_t n)
+{
+   ASSERT(dest != NULL);
+   return io_iter_copy(it, dest, n, false);
+}
+
+ssize_t io_iter_zero(struct io_iter *it, size_t n)
+{
+   return io_iter_copy(it, NULL, n, true);
+}
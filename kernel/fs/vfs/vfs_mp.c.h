@@ -133,6 +133,12 @@ int mp_add(struct fs *target_fs, const char *target_path)
       /* Now that we've succeeded, we must retain the target_fs as well */
       retain_obj(target_fs);
 
+      /*
+       * The mount-point hides the contents of the host directory. Flush the
+       * whole dcache, not to keep any lookup result made before the mount.
+       */
+      dcache_invalidate_fs(NULL);
+
    } else {
 
       /* no free slot, sorry */
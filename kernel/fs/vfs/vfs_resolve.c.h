@@ -68,7 +68,7 @@ __vfs_resolve_get_entry(vfs_inode_ptr_t idir,
                         struct vfs_path *rp,
                         bool exlock)
 {
-   vfs_get_entry(rp->fs, idir, pc, path - pc, &rp->fs_path);
+   dcache_get_entry(rp->fs, idir, pc, path - pc, &rp->fs_path);
    rp->last_comp = pc;
 
    struct fs *target_fs = mp_get_retained_at(rp->fs, rp->fs_path.inode);
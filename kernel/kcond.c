@@ -69,6 +69,12 @@ kcond_signal_int(struct kcond *c, struct wait_obj *wo)
    ASSERT(!is_preemption_enabled());
    DEBUG_ONLY(check_not_in_irq_handler());
 
+   if (wo->type == WOBJ_KCOND_WATCH) {
+      struct kcond_watch *w = CONTAINER_OF(wo, struct kcond_watch, wobj);
+      w->cb(w);
+      return;
+   }
+
    struct task *ti =
       wo->type != WOBJ_MWO_ELEM
          ? CONTAINER_OF(wo, struct task, wobj)
@@ -97,16 +103,25 @@ kcond_signal_int(struct kcond *c, struct wait_obj *wo)
 
 void kcond_signal_one(struct kcond *c)
 {
+   struct wait_obj *wo_pos, *temp;
+   bool woken = false;
+
    disable_preemption();
    {
       DEBUG_ONLY(check_not_in_irq_handler());
 
-      if (!list_is_empty(&c->wait_list)) {
+      /* Watchers don't consume the signal: notify all of them */
+      list_for_each(wo_pos, temp, &c->wait_list, wait_list_node) {
+
+         if (wo_pos->type != WOBJ_KCOND_WATCH) {
+
+            if (woken)
+               continue;
 
-         struct wait_obj *wobj =
-            list_first_obj(&c->wait_list, struct wait_obj, wait_list_node);
+            woken = true;
+         }
 
-         kcond_signal_int(c, wobj);
+         kcond_signal_int(c, wo_pos);
       }
    }
    enable_preemption();
@@ -126,6 +141,19 @@ void kcond_signal_all(struct kcond *c)
    enable_preemption();
 }
 
+void kcond_watch_add(struct kcond *c,
+                     struct kcond_watch *w,
+                     void (*cb)(struct kcond_watch *))
+{
+   w->cb = cb;
+   wait_obj_set(&w->wobj, WOBJ_KCOND_WATCH, c, NO_EXTRA, &c->wait_list);
+}
+
+void kcond_watch_remove(struct kcond_watch *w)
+{
+   wait_obj_reset(&w->wobj);
+}
+
 void kcond_destory(struct kcond *c)
 {
    bzero(c, sizeof(struct kcond));
@@ -415,6 +415,21 @@ size_t kmalloc_get_max_tot_heap_free(void)
    return max_tot_heap_mem_free;
 }
 
+size_t kmalloc_get_tot_heap_free(void)
+{
+   size_t tot = 0;
+
+   for (int i = 0; i < KMALLOC_HEAPS_COUNT; i++) {
+
+      struct kmalloc_heap *h = heaps[i];
+
+      if (h && !h->dma)
+         tot += (h->size - h->mem_allocated);
+   }
+
+   return tot;
+}
+
 void
 debug_kmalloc_get_heap_info_by_ptr(struct kmalloc_heap *h,
                                    struct debug_kmalloc_heap_info *i)
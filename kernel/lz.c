@@ -0,0 +1,211 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/assert.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/lz.h>
+
+static ALWAYS_INLINE u32 lz_read32(const u8 *p)
+{
+   u32 val;
+   memcpy(&val, p, sizeof(val));
+   return val;
+}
+
+static ALWAYS_INLINE u32 lz_hash(u32 seq)
+{
+   return (seq * 2654435761u) >> (32 - LZ_HASH_LOG);
+}
+
+static u8 *lz_put_len(u8 *op, size_t len)
+{
+   for (; len >= 255; len -= 255)
+      *op++ = 255;
+
+   *op++ = (u8)len;
+   return op;
+}
+
+static bool lz_get_len(const u8 **ip_ref, const u8 *iend, size_t *len_ref)
+{
+   const u8 *ip = *ip_ref;
+   u8 b;
+
+   do {
+
+      if (ip == iend)
+         return false;
+
+      b = *ip++;
+      *len_ref += b;
+
+   } while (b == 255);
+
+   *ip_ref = ip;
+   return true;
+}
+
+/*
+ * Emit a whole record. When `off` is 0, the record contains just literals and
+ * it's the last one.
+ */
+static u8 *
+lz_emit_seq(u8 *op,
+            u8 *oend,
+            const u8 *lit,
+            size_t lit_len,
+            size_t off,
+            size_t match_len)
+{
+   const size_t max_size =
+      1 + (lit_len / 255 + 1) + lit_len + 2 + (match_len / 255 + 1);
+
+   u8 *token;
+   u8 t;
+
+   if ((size_t)(oend - op) < max_size)
+      return NULL;
+
+   token = op++;
+
+   if (lit_len >= 15) {
+      t = 15 << 4;
+      op = lz_put_len(op, lit_len - 15);
+   } else {
+      t = (u8)(lit_len << 4);
+   }
+
+   memcpy(op, lit, lit_len);
+   op += lit_len;
+
+   if (!off) {
+      *token = t;
+      return op;
+   }
+
+   *op++ = (u8)(off & 0xff);
+   *op++ = (u8)(off >> 8);
+   match_len -= LZ_MIN_MATCH;
+
+   if (match_len >= 15) {
+      t |= 15;
+      op = lz_put_len(op, match_len - 15);
+   } else {
+      t |= (u8)match_len;
+   }
+
+   *token = t;
+   return op;
+}
+
+size_t
+lz_compress(struct lz_ctx *ctx,
+            const void *src,
+            size_t len,
+            void *dst,
+            size_t dst_len)
+{
+   const u8 *const base = src;
+   const u8 *const iend = base + len;
+   const u8 *ip = base;
+   const u8 *anchor = base;
+   u8 *op = dst;
+   u8 *const oend = op + dst_len;
+
+   ASSERT(len <= LZ_MAX_INPUT_SIZE);
+   bzero(ctx->htable, sizeof(ctx->htable));
+
+   while (iend - ip >= LZ_MIN_MATCH) {
+
+      const u32 seq = lz_read32(ip);
+      const u32 h = lz_hash(seq);
+      const u32 pos = ctx->htable[h];
+
+      ctx->htable[h] = (u16)(ip - base + 1);
+
+      if (pos && lz_read32(base + pos - 1) == seq) {
+
+         const u8 *ref = base + pos - 1 + LZ_MIN_MATCH;
+         const u8 *m = ip + LZ_MIN_MATCH;
+
+         while (m < iend && *m == *ref) {
+            m++;
+            ref++;
+         }
+
+         op = lz_emit_seq(op,
+                          oend,
+                          anchor,
+                          (size_t)(ip - anchor),
+                          (size_t)(m - ref),
+                          (size_t)(m - ip));
+         if (!op)
+            return 0;
+
+         ip = anchor = m;
+         continue;
+      }
+
+      /* Skip faster and faster over incompressible data */
+      ip += 1 + ((ip - anchor) >> 5);
+   }
+
+   op = lz_emit_seq(op, oend, anchor, (size_t)(iend - anchor), 0, 0);
+   return op ? (size_t)(op - (u8 *)dst) : 0;
+}
+
+long
+lz_decompress(const void *src, size_t len, void *dst, size_t dst_len)
+{
+   const u8 *ip = src;
+   const u8 *const iend = ip + len;
+   u8 *op = dst;
+   u8 *const oend = op + dst_len;
+   size_t lit_len, match_len, off;
+   u8 token;
+
+   while (ip < iend) {
+
+      token = *ip++;
+      lit_len = token >> 4;
+
+      if (lit_len == 15 && !lz_get_len(&ip, iend, &lit_len))
+         return -1;
+
+      if ((size_t)(iend - ip) < lit_len || (size_t)(oend - op) < lit_len)
+         return -1;
+
+      memcpy(op, ip, lit_len);
+      ip += lit_len;
+      op += lit_len;
+
+      if (ip == iend)
+         break; /* that was the last record */
+
+      if (iend - ip < 2)
+         return -1;
+
+      off = (size_t)ip[0] | ((size_t)ip[1] << 8);
+      ip += 2;
+
+      if (!off || off > (size_t)(op - (u8 *)dst))
+         return -1;
+
+      match_len = token & 15;
+
+      if (match_len == 15 && !lz_get_len(&ip, iend, &match_len))
+         return -1;
+
+      match_len += LZ_MIN_MATCH;
+
+      if ((size_t)(oend - op) < match_len)
+         return -1;
+
+      /* NOTE: the match can overlap with the output: copy byte by byte */
+      for (const u8 *ref = op - off; match_len > 0; match_len--)
+         *op++ = *ref++;
+   }
+
+   return (long)(op - (u8 *)dst);
+}
@@ -22,6 +22,8 @@
 #include <tilck/kernel/worker_thread.h>
 #include <tilck/kernel/fs/fat32.h>
 #include <tilck/kernel/fs/devfs.h>
+#include <tilck/kernel/fs/overlayfs.h>
+#include <tilck/kernel/fs/crd.h>
 #include <tilck/kernel/timer.h>
 #include <tilck/kernel/syscalls.h>
 #include <tilck/kernel/system_mmap.h>
@@ -32,6 +34,8 @@
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/fs/kernelfs.h>
 #include <tilck/kernel/fs/vfs.h>
+#include <tilck/kernel/zswap.h>
+#include <tilck/kernel/ksm.h>
 
 #include <tilck/mods/console.h>
 #include <tilck/mods/fb_console.h>
@@ -249,7 +253,7 @@ mount_initrd(void)
    /* declare the ramfs_create() function */
    struct fs *ramfs_create(void);
 
-   struct fs *initrd, *ramfs;
+   struct fs *initrd, *ramfs, *upper;
    void *ramdisk;
    size_t ramdisk_size;
    int rc;
@@ -279,9 +283,29 @@ mount_initrd(void)
 
    if (LIKELY(ramdisk != NULL)) {
 
+      if (crd_is_compressed(ramdisk)) {
+
+         /* Compressed initrd: its chunks will be decompressed on demand */
+         if (!(ramdisk = crd_map(ramdisk, ramdisk_size, &ramdisk_size)))
+            panic("Unable to map the compressed initrd");
+      }
+
       if (!(initrd = fat_mount_ramdisk(ramdisk, ramdisk_size, 0)))
          panic("Unable to mount the initrd fat32 RAMDISK");
 
+      if (kopt_initrd_rw) {
+
+         /*
+          * Make /initrd writable by stacking a ramfs over it: the files are
+          * copied in memory only when they're modified.
+          */
+         if (!(upper = ramfs_create()))
+            panic("Unable to create ramfs");
+
+         if (!(initrd = overlayfs_create(initrd, upper)))
+            panic("Unable to create the initrd overlay");
+      }
+
       if ((rc = vfs_mkdir("/initrd", 0777)))
          panic("vfs_mkdir(\"/initrd\") failed with error: %d", rc);
 
@@ -369,6 +393,8 @@ kmain(u32 multiboot_magic, u32 mbi_addr)
    init_worker_threads();
    init_timer();
    init_system_time();
+   init_zswap();
+   init_ksm();
    init_kernelfs();
 
    async_init();
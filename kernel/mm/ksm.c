@@ -0,0 +1,431 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_mm.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/assert.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/ksm.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/kernel/list.h>
+
+#define KSM_HASH_BUCKETS                 256
+#define KSM_SCAN_CHUNK                    16  /* pages per chunk */
+#define KSM_MAX_UNSTABLE                4096
+#define KSM_MAX_PROCS                     64  /* per wake-up */
+#define KSM_MAX_REF_COUNT             0xff00  /* pageframes' ref-count is u16 */
+
+struct ksm_stable_node {
+
+   struct list_node node;
+   void *page;                /* the shared pageframe (kernel vaddr) */
+   u32 hash;
+};
+
+struct ksm_unstable_node {
+
+   struct list_node node;
+   int pid;
+   ulong vaddr;
+   void *page;                /* the private pageframe (kernel vaddr) */
+   u32 hash;
+};
+
+struct ksm_stats ksm_stats;
+ulong ksm_pages_to_scan = KSM_DEFAULT_PAGES_TO_SCAN;
+ulong ksm_sleep_ms = KSM_DEFAULT_SLEEP_MS;
+
+static struct list stable_table[KSM_HASH_BUCKETS];
+static struct list unstable_table[KSM_HASH_BUCKETS];
+static u32 unstable_count;
+static u32 zero_page_hash;
+
+/* Where the current full scan is */
+static int hand_pid;
+static ulong hand_vaddr;
+
+static u32 ksm_hash_page(const void *page)
+{
+   const u32 *p = page;
+   u32 h = 2166136261u;
+
+   for (u32 i = 0; i < PAGE_SIZE / sizeof(u32); i++)
+      h = (h ^ p[i]) * 16777619u;
+
+   return h;
+}
+
+static bool ksm_can_scan(struct task *ti)
+{
+   if (!ti || !is_main_thread(ti) || is_kernel_thread(ti))
+      return false;
+
+   if (ti->state == TASK_STATE_ZOMBIE || ti->vfork_stopped)
+      return false;
+
+   /* A vforked child shares its pdir with the parent */
+   return !ti->pi->vforked && ti->pi->pdir != NULL;
+}
+
+static struct ksm_stable_node *ksm_stable_lookup(void *page, u32 hash)
+{
+   struct ksm_stable_node *sn;
+
+   list_for_each_ro(sn, &stable_table[hash % KSM_HASH_BUCKETS], node) {
+
+      if (sn->hash != hash)
+         continue;
+
+      if (get_pageframe_ref_count(sn->page) >= KSM_MAX_REF_COUNT)
+         continue;
+
+      if (!memcmp(sn->page, page, PAGE_SIZE))
+         return sn;
+   }
+
+   return NULL;
+}
+
+static void ksm_unstable_remove(struct ksm_unstable_node *un)
+{
+   list_remove(&un->node);
+   kfree_obj(un, struct ksm_unstable_node);
+   unstable_count--;
+}
+
+/* Check that the candidate is still mapped where it was found */
+static pdir_t *ksm_unstable_get_pdir(struct ksm_unstable_node *un)
+{
+   struct task *ti = get_task(un->pid);
+   void *page;
+
+   if (!ksm_can_scan(ti))
+      return NULL;
+
+   if (find_private_user_page(ti->pi->pdir,
+                              un->vaddr,
+                              un->vaddr + PAGE_SIZE,
+                              &page) != un->vaddr)
+   {
+      return NULL;
+   }
+
+   return page == un->page ? ti->pi->pdir : NULL;
+}
+
+static struct ksm_unstable_node *
+ksm_unstable_lookup(void *page, u32 hash, pdir_t **pdir_ref)
+{
+   struct ksm_unstable_node *un, *tmp;
+   pdir_t *pdir;
+
+   list_for_each(un, tmp, &unstable_table[hash % KSM_HASH_BUCKETS], node) {
+
+      if (un->hash != hash)
+         continue;
+
+      if (!(pdir = ksm_unstable_get_pdir(un))) {
+         ksm_unstable_remove(un); /* stale candidate */
+         continue;
+      }
+
+      if (un->page != page && !memcmp(un->page, page, PAGE_SIZE)) {
+         *pdir_ref = pdir;
+         return un;
+      }
+   }
+
+   return NULL;
+}
+
+static void ksm_unstable_insert(int pid, ulong vaddr, void *page, u32 hash)
+{
+   struct ksm_unstable_node *un;
+
+   if (unstable_count == KSM_MAX_UNSTABLE)
+      return;
+
+   if (!(un = kalloc_obj(struct ksm_unstable_node)))
+      return;
+
+   list_node_init(&un->node);
+   un->pid = pid;
+   un->vaddr = vaddr;
+   un->page = page;
+   un->hash = hash;
+
+   list_add_tail(&unstable_table[hash % KSM_HASH_BUCKETS], &un->node);
+   unstable_count++;
+}
+
+static void ksm_unstable_clear(void)
+{
+   struct ksm_unstable_node *un, *tmp;
+
+   for (u32 i = 0; i < KSM_HASH_BUCKETS; i++)
+      list_for_each(un, tmp, &unstable_table[i], node)
+         ksm_unstable_remove(un);
+
+   ASSERT(unstable_count == 0);
+}
+
+/*
+ * Turn the candidate `un` into a stable page and merge the page at `vaddr`
+ * with it.
+ */
+static void
+ksm_promote(struct ksm_unstable_node *un,
+            pdir_t *un_pdir,
+            pdir_t *pdir,
+            ulong vaddr,
+            struct tlb_gather *tlb)
+{
+   struct ksm_stable_node *sn;
+   struct tlb_gather un_tlb;
+
+   if (!(sn = kalloc_obj(struct ksm_stable_node)))
+      return;
+
+   tlb_gather_init(&un_tlb, un_pdir);
+   make_page_cow(un_pdir, (void *)un->vaddr, &un_tlb);
+   tlb_gather_flush(&un_tlb);
+
+   list_node_init(&sn->node);
+   sn->page = un->page;
+   sn->hash = un->hash;
+   list_add_tail(&stable_table[sn->hash % KSM_HASH_BUCKETS], &sn->node);
+   ksm_unstable_remove(un);
+
+   replace_with_cow_page(pdir, (void *)vaddr, sn->page, tlb);
+   ksm_stats.pages_shared++;
+}
+
+static void
+ksm_scan_page(int pid,
+              pdir_t *pdir,
+              ulong vaddr,
+              void *page,
+              struct tlb_gather *tlb)
+{
+   const u32 hash = ksm_hash_page(page);
+   struct ksm_stable_node *sn;
+   struct ksm_unstable_node *un;
+   pdir_t *un_pdir;
+
+   if (hash == zero_page_hash && !memcmp(page, zero_page, PAGE_SIZE)) {
+
+      if (get_pageframe_ref_count(zero_page) < KSM_MAX_REF_COUNT) {
+         replace_with_cow_page(pdir, (void *)vaddr, zero_page, tlb);
+         ksm_stats.zero_merged++;
+      }
+
+      return;
+   }
+
+   if ((sn = ksm_stable_lookup(page, hash))) {
+      replace_with_cow_page(pdir, (void *)vaddr, sn->page, tlb);
+      return;
+   }
+
+   if ((un = ksm_unstable_lookup(page, hash, &un_pdir))) {
+      ksm_promote(un, un_pdir, pdir, vaddr, tlb);
+      return;
+   }
+
+   ksm_unstable_insert(pid, vaddr, page, hash);
+}
+
+/*
+ * Release the stable pages referenced only by KSM and update the stats.
+ */
+static void ksm_prune_stable(void)
+{
+   struct ksm_stable_node *sn, *tmp;
+   ulong sharing = 0;
+   u32 ref_count;
+
+   ASSERT(!is_preemption_enabled());
+
+   for (u32 i = 0; i < KSM_HASH_BUCKETS; i++) {
+
+      list_for_each(sn, tmp, &stable_table[i], node) {
+
+         ref_count = get_pageframe_ref_count(sn->page);
+         ASSERT(ref_count > 0);
+
+         if (ref_count == 1) {
+            put_pageframe(sn->page);
+            list_remove(&sn->node);
+            kfree_obj(sn, struct ksm_stable_node);
+            ksm_stats.pages_shared--;
+            continue;
+         }
+
+         sharing += ref_count - 1;
+      }
+   }
+
+   ksm_stats.pages_sharing = sharing;
+   ksm_stats.saved_kb = (sharing - ksm_stats.pages_shared) * (PAGE_SIZE / KB);
+}
+
+/*
+ * Scan up to KSM_SCAN_CHUNK pages of `pid`, starting from `hand_vaddr`.
+ * Returns true when there's nothing more to scan in that process.
+ */
+static bool ksm_scan_chunk(int pid, ulong *budget)
+{
+   struct task *ti = get_task(pid);
+   struct tlb_gather tlb;
+   bool done = false;
+   pdir_t *pdir;
+   void *page;
+   ulong va;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (!ksm_can_scan(ti))
+      return true;
+
+   pdir = ti->pi->pdir;
+   tlb_gather_init(&tlb, pdir);
+
+   for (u32 n = 0; n < KSM_SCAN_CHUNK && *budget; n++, (*budget)--) {
+
+      va = find_private_user_page(pdir, hand_vaddr, USERMODE_VADDR_END, &page);
+
+      if (va == USERMODE_VADDR_END) {
+         done = true;
+         break;
+      }
+
+      ksm_scan_page(pid, pdir, va, page, &tlb);
+      hand_vaddr = va + PAGE_SIZE;
+   }
+
+   tlb_gather_flush(&tlb);
+   return done;
+}
+
+static bool ksm_scan_process(int pid, ulong *budget)
+{
+   bool done = false;
+
+   while (!done && *budget) {
+
+      disable_preemption();
+      {
+         done = ksm_scan_chunk(pid, budget);
+      }
+      enable_preemption();
+   }
+
+   return done;
+}
+
+struct ksm_pids_ctx {
+   int *pids;
+   int count;
+   int min_pid;
+};
+
+static int ksm_collect_pids_cb(void *obj, void *arg)
+{
+   struct task *ti = obj;
+   struct ksm_pids_ctx *ctx = arg;
+
+   if (ctx->count == KSM_MAX_PROCS)
+      return -1; /* stop the iteration */
+
+   if (ti->tid >= ctx->min_pid && ksm_can_scan(ti))
+      ctx->pids[ctx->count++] = ti->tid;
+
+   return 0;
+}
+
+static void ksm_end_full_scan(void)
+{
+   disable_preemption();
+   {
+      ksm_unstable_clear();
+   }
+   enable_preemption();
+
+   hand_pid = 0;
+   hand_vaddr = 0;
+   ksm_stats.full_scans++;
+}
+
+static void ksm_scan(ulong budget)
+{
+   int pids[KSM_MAX_PROCS];
+   struct ksm_pids_ctx ctx = {
+      .pids = pids,
+      .count = 0,
+      .min_pid = hand_pid,
+   };
+
+   disable_preemption();
+   {
+      iterate_over_tasks(&ksm_collect_pids_cb, &ctx);
+   }
+   enable_preemption();
+
+   for (int i = 0; i < ctx.count; i++) {
+
+      if (pids[i] != hand_pid) {
+         hand_pid = pids[i];
+         hand_vaddr = 0;
+      }
+
+      if (!ksm_scan_process(pids[i], &budget))
+         return; /* budget exhausted */
+
+      hand_pid = pids[i] + 1;
+      hand_vaddr = 0;
+   }
+
+   if (ctx.count < KSM_MAX_PROCS)
+      ksm_end_full_scan();
+}
+
+static void ksm_thread()
+{
+   while (true) {
+
+      kernel_sleep_ms(MAX(ksm_sleep_ms, 1ul));
+
+      if (!ksm_pages_to_scan)
+         continue; /* KSM paused */
+
+      ksm_scan(ksm_pages_to_scan);
+
+      disable_preemption();
+      {
+         ksm_prune_stable();
+      }
+      enable_preemption();
+   }
+}
+
+void init_ksm(void)
+{
+   if (!MM_KSM)
+      return;
+
+   for (u32 i = 0; i < KSM_HASH_BUCKETS; i++) {
+      list_init(&stable_table[i]);
+      list_init(&unstable_table[i]);
+   }
+
+   zero_page_hash = ksm_hash_page(zero_page);
+
+   if (kthread_create(&ksm_thread, 0, NULL) < 0)
+      panic("Unable to create a kthread for ksm_thread()");
+}
@@ -9,8 +9,10 @@
 #include <tilck/kernel/process.h>
 #include <tilck/kernel/process_mm.h>
 #include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/user_vmem.h>
 #include <tilck/kernel/errno.h>
 #include <tilck/kernel/fs/devfs.h>
+#include <tilck/kernel/fs/vfs.h>
 #include <tilck/kernel/syscalls.h>
 
 #include <sys/mman.h>      // system header
@@ -24,11 +26,9 @@ static inline void sys_brk_internal(struct process *pi, void *new_brk)
    if (new_brk < pi->brk) {
 
       /* we have to free pages */
+      const size_t count = (size_t)(pi->brk - new_brk) >> PAGE_SHIFT;
 
-      for (void *vaddr = new_brk; vaddr < pi->brk; vaddr += PAGE_SIZE) {
-         unmap_page(pi->pdir, vaddr, true);
-      }
-
+      unmap_pages(pi->pdir, new_brk, count, true);
       pi->brk = new_brk;
       return;
    }
@@ -103,115 +103,235 @@ void *sys_brk(void *new_brk)
    return pi->brk;
 }
 
-static int create_process_mmap_heap(struct process *pi)
+static int create_process_mappings_info(struct process *pi)
 {
-   struct kmalloc_heap *mmap_heap;
+   struct mappings_info *mi;
    ASSERT(!pi->mi);
 
-   if (!(pi->mi = kalloc_obj(struct mappings_info)))
+   if (!(mi = kalloc_obj(struct mappings_info)))
       return -ENOMEM;
 
-   if (!(mmap_heap = kzmalloc(kmalloc_get_heap_struct_size()))) {
-      kfree_obj(pi->mi, struct mappings_info);
+   if (user_vmem_init(&mi->vmem, USER_MMAP_BEGIN, USER_MMAP_END)) {
+      kfree_obj(mi, struct mappings_info);
       return -ENOMEM;
    }
 
-   list_init(&pi->mi->mappings);
-   pi->mi->mmap_heap = mmap_heap;
-   pi->mi->mmap_heap_size = USER_MMAP_MIN_SZ;
-
-   bool success =
-      kmalloc_create_heap(mmap_heap,
-                          USER_MMAP_BEGIN,
-                          pi->mi->mmap_heap_size,
-                          PAGE_SIZE,
-                          KMALLOC_MAX_ALIGN,    /* alloc block size */
-                          false,                /* linear mapping */
-                          NULL,                 /* metadata_nodes */
-#if MMAP_NO_COW
-                          user_valloc_and_map,
-                          user_vfree_and_unmap);
-#else
-                          user_map_zero_page,
-                          user_unmap_zero_page);
-#endif
-
-   if (!success)
-      return -ENOMEM;
+   list_init(&mi->mappings);
+   pi->mi = mi;
+   return 0;
+}
+
+/*
+ * Map the pages of a fresh anonymous mapping. By default, the zero-page is
+ * mapped everywhere and the actual pages are allocated on the first write
+ * (copy-on-write). With MMAP_NO_COW or MAP_POPULATE instead, the real (zeroed)
+ * pages are allocated all at once: this way, a process streaming through a big
+ * buffer won't pay the cost of one CoW page fault per page.
+ */
+static int
+mmap_anon_map_pages(struct process *pi, struct user_mapping *um, bool populate)
+{
+   const size_t page_count = um->len >> PAGE_SHIFT;
+
+   if (MMAP_NO_COW || populate) {
+
+      if (user_valloc_and_map(um->vaddr, page_count)) {
+         bzero(um->vaddrp, um->len);
+         return 0;
+      }
+
+      if (MMAP_NO_COW)
+         return -ENOMEM;
 
+      /*
+       * Out of memory: that's not a failure for MAP_POPULATE, as the pages
+       * can still be allocated on demand.
+       */
+   }
+
+   user_map_zero_page(um->vaddr, page_count);
    return 0;
 }
 
-static inline void
-mmap_err_case_free(struct process *pi, void *ptr, size_t actual_len)
+static void mmap_anon_unmap_pages(ulong vaddr, size_t len)
 {
-   per_heap_kfree(pi->mi->mmap_heap,
-                  ptr,
-                  &actual_len,
-                  KFREE_FL_ALLOW_SPLIT |
-                  KFREE_FL_MULTI_STEP  |
-                  KFREE_FL_NO_ACTUAL_FREE);
+   user_vfree_and_unmap(vaddr, len >> PAGE_SHIFT);
 }
 
-static struct user_mapping *
-mmap_on_user_heap(struct process *pi,
-                  size_t *actual_len_ref,
-                  fs_handle handle,
-                  u32 per_heap_kmalloc_flags,
-                  size_t off,
-                  int prot)
+static void mmap_free_file_pages(void *buf, size_t len)
 {
-   void *res;
-   struct user_mapping *um;
+   general_kfree(buf, &len, KFREE_FL_ALLOW_SPLIT | KFREE_FL_MULTI_STEP);
+}
+
+/*
+ * Fallback for the MAP_PRIVATE mappings of files not supporting mmap (e.g. on a
+ * FAT ramdisk that could not be prepared for mmap): the mapping becomes an
+ * anonymous one, populated with the file's contents at mmap() time. The part of
+ * the range past EOF is left zero-filled, while the file position does not
+ * change, like with pread().
+ */
+static int
+mmap_read_file(fs_handle h, size_t off, size_t len, void **pages_ref)
+{
+   struct io_iter it;
+   struct iovec iov;
+   size_t size = len;
+   ssize_t rc = 0;
+   void *buf;
+
+   if (!(buf = general_kmalloc(&size, KMALLOC_FL_MULTI_STEP | PAGE_SIZE)))
+      return -ENOMEM;
+
+   ASSERT(size == len);
+   bzero(buf, len);
+
+   for (size_t tot = 0; tot < len; tot += (size_t)rc) {
+
+      iov = (struct iovec) { buf + tot, len - tot };
+      io_iter_init(&it, &iov, 1, false);
+
+      if ((rc = vfs_pread_iter(h, &it, (offt)(off + tot))) <= 0)
+         break;
+   }
+
+   if (rc < 0) {
+
+      mmap_free_file_pages(buf, len);
+
+      if (rc == -ESPIPE)
+         return -ENODEV;   /* Not a seekable file: it cannot be mapped */
+
+      return rc == -EBADF ? -EACCES : (int)rc;
+   }
+
+   *pages_ref = buf;
+   return 0;
+}
+
+static int
+mmap_private_map_pages(struct process *pi, struct user_mapping *um, void *buf)
+{
+   const size_t page_count = um->len >> PAGE_SHIFT;
+   size_t count;
+
+   count = map_pages(pi->pdir,
+                     um->vaddrp,
+                     KERNEL_VA_TO_PA(buf),
+                     page_count,
+                     PAGING_FL_US | PAGING_FL_RW);
 
-   while (true) {
+   if (count != page_count) {
+      unmap_pages(pi->pdir, um->vaddrp, count, false);
+      return -ENOMEM;
+   }
+
+   return 0;
+}
 
-      struct kmalloc_heap *new_heap;
-      struct kmalloc_heap *h = pi->mi->mmap_heap;
-      size_t heap_sz = pi->mi->mmap_heap_size;
+/*
+ * Map the pages of a MAP_PRIVATE file mapping directly from the file, like
+ * load_segment_by_mmap() does for the read-only ELF segments: that way, the
+ * pages are shared with the page cache of the file (and with the other
+ * processes mapping it) and a private copy of a page is made only on the first
+ * write to it, through CoW. The holes and the part of the range past EOF are
+ * mapped as zero-pages.
+ */
+static int
+mmap_private_map_file(struct process *pi, struct user_mapping *um, fs_handle h)
+{
+   const size_t page_count = um->len >> PAGE_SHIFT;
+   struct user_mapping fum = {0};
+   int rc;
 
-      res = per_heap_kmalloc(h,
-                             actual_len_ref,
-                             per_heap_kmalloc_flags);
+   fum.h = h;
+   fum.off = um->off;
+   fum.vaddr = um->vaddr;
+   fum.len = um->len;
+   fum.prot = PROT_READ;
 
-      if (LIKELY(res != NULL))
-         break;        /* great! */
+   if ((rc = vfs_mmap(&fum, pi->pdir, VFS_MM_DONT_REGISTER | VFS_MM_POPULATE)))
+      return rc;
 
-      if (heap_sz == USER_MMAP_MAX_SZ)
-         return NULL; /* cannot expand the heap more than that */
+   disable_preemption();
+   {
+      for (ulong va = um->vaddr; va < um->vaddr + um->len; va += PAGE_SIZE) {
 
-      new_heap = kmalloc_heap_dup_expanded(h, heap_sz * 2);
+         if (is_mapped(pi->pdir, (void *)va))
+            continue;
 
-      if (!new_heap)
-         return NULL; /* no enough memory */
+         if ((rc = map_zero_page(pi->pdir, (void *)va, PAGING_FL_US)))
+            break;
+      }
 
-      pi->mi->mmap_heap_size = heap_sz * 2;
-      pi->mi->mmap_heap = new_heap;
-      kmalloc_destroy_heap(h);
+      if (rc)
+         mmap_anon_unmap_pages(um->vaddr, um->len);
+      else if (um->prot & PROT_WRITE)
+         set_user_pages_rw(pi->pdir, um->vaddrp, page_count, true, false);
    }
+   enable_preemption();
+   return rc;
+}
+
+static struct user_mapping *
+mmap_alloc_user_vmem(struct process *pi,
+                     ulong vaddr,
+                     bool fixed,
+                     size_t len,
+                     fs_handle handle,
+                     size_t off,
+                     int prot)
+{
+   struct user_mapping *um;
+
+   ASSERT(!is_preemption_enabled());
+
+   /* Without MAP_FIXED, `vaddr` is just a hint: fall back to any address */
+   if (vaddr && user_vmem_alloc_at(&pi->mi->vmem, vaddr, len))
+      vaddr = 0;
+
+   if (!vaddr && (fixed || !(vaddr = user_vmem_alloc(&pi->mi->vmem, len))))
+      return NULL;
 
    /* NOTE: here `handle` might be NULL (zero-map case) and that's OK */
-   um = process_add_user_mapping(handle, res, *actual_len_ref, off, prot);
+   um = process_add_user_mapping(handle, (void *)vaddr, len, off, prot);
 
    if (!um) {
-      mmap_err_case_free(pi, res, *actual_len_ref);
+      user_vmem_free(&pi->mi->vmem, vaddr, len);
       return NULL;
    }
 
    return um;
 }
 
+static void mmap_err_case_free(struct process *pi, struct user_mapping *um)
+{
+   ASSERT(!is_preemption_enabled());
+   user_vmem_free(&pi->mi->vmem, um->vaddr, um->len);
+   process_remove_user_mapping(um);
+}
+
+static int munmap_range(struct process *pi, ulong vaddr, size_t len);
+
 long
 sys_mmap_pgoff(void *addr, size_t len, int prot,
                int flags, int fd, size_t pgoffset)
 {
-   u32 per_heap_kmalloc_flags = KMALLOC_FL_MULTI_STEP | PAGE_SIZE;
    struct task *curr = get_curr_task();
    struct process *pi = curr->pi;
    struct fs_handle_base *handle = NULL;
    struct user_mapping *um = NULL;
+   fs_handle private_h = NULL;
+   void *file_pages = NULL;
+   ulong vaddr = (ulong)addr;
    size_t actual_len;
-   int rc, fl;
+   int rc = 0, fl, vfs_mm_flags = 0;
+
+   /*
+    * MAP_LOCKED implies MAP_POPULATE. In addition to that, the pages of locked
+    * mappings are never swapped-out by zswap (see um->locked).
+    */
+   const bool populate = !!(flags & (MAP_POPULATE | MAP_LOCKED));
+   const bool fixed = !!(flags & MAP_FIXED);
 
    if ((flags & MAP_PRIVATE) && (flags & MAP_SHARED))
       return -EINVAL; /* non-sense parameters */
@@ -219,14 +339,28 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
    if (!len)
       return -EINVAL;
 
-   if (addr)
-      return -EINVAL; /* addr != NULL not supported */
-
    if (!(prot & PROT_READ))
       return -EINVAL;
 
+   if (len > USER_MMAP_END - USER_MMAP_BEGIN)
+      return -ENOMEM;
+
    actual_len = pow2_round_up_at(len, PAGE_SIZE);
 
+   if (!IS_PAGE_ALIGNED(vaddr) ||
+       !IN_RANGE(vaddr, USER_MMAP_BEGIN, USER_MMAP_END) ||
+       actual_len > USER_MMAP_END - vaddr)
+   {
+      /*
+       * Without MAP_FIXED, `addr` is just a hint and it's fine to ignore it.
+       * With MAP_FIXED instead, only addresses in the mmap area are supported.
+       */
+      if (fixed)
+         return -EINVAL;
+
+      vaddr = 0;
+   }
+
    if (fd == -1) {
 
       if (!(flags & MAP_ANONYMOUS))
@@ -238,17 +372,11 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
       if (!(flags & MAP_PRIVATE))
          return -EINVAL;
 
-      if ((prot & (PROT_READ | PROT_WRITE)) != (PROT_READ | PROT_WRITE))
-         return -EINVAL;
-
       if (pgoffset != 0)
          return -EINVAL; /* pgoffset != 0 does not make sense here */
 
    } else {
 
-      if (!(flags & MAP_SHARED))
-         return -EINVAL;
-
       handle = get_fs_handle(fd);
 
       if (!handle)
@@ -262,37 +390,104 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
       if ((prot & (PROT_READ | PROT_WRITE)) == PROT_WRITE)
          return -EINVAL; /* disallow write-only mappings */
 
-      if (prot & PROT_WRITE) {
-         if (!(fl & O_WRONLY) && (fl & O_RDWR) != O_RDWR)
-            return -EACCES;
-      }
+      if (flags & MAP_SHARED) {
 
-      per_heap_kmalloc_flags |= KMALLOC_FL_NO_ACTUAL_ALLOC;
+         if (prot & PROT_WRITE) {
+            if (!(fl & O_WRONLY) && (fl & O_RDWR) != O_RDWR)
+               return -EACCES;
+         }
+
+         if (populate)
+            vfs_mm_flags |= VFS_MM_POPULATE;
+
+      } else if (flags & MAP_PRIVATE) {
+
+         if (is_mmap_supported(handle)) {
+
+            private_h = handle;
+
+         } else {
+
+            rc = mmap_read_file(handle,
+                                pgoffset << PAGE_SHIFT,
+                                actual_len,
+                                &file_pages);
+            if (rc)
+               return rc;
+         }
+
+         handle = NULL; /* From now on, that's just an anonymous mapping */
+
+      } else {
+
+         return -EINVAL;
+      }
    }
 
    if (!pi->mi)
-      if ((rc = create_process_mmap_heap(pi)))
-         return rc;
+      if ((rc = create_process_mappings_info(pi)))
+         goto out;
 
    disable_preemption();
    {
-      um = mmap_on_user_heap(pi,
-                             &actual_len,
-                             handle,
-                             per_heap_kmalloc_flags,
-                             pgoffset << PAGE_SHIFT,
-                             prot);
+      /* MAP_FIXED: discard the mappings overlapping with the new one */
+      if (fixed && (rc = munmap_range(pi, vaddr, actual_len)) < 0) {
+         enable_preemption();
+         goto out;
+      }
+
+      rc = 0;
+
+      um = mmap_alloc_user_vmem(pi,
+                                vaddr,
+                                fixed,
+                                actual_len,
+                                handle,
+                                pgoffset << PAGE_SHIFT,
+                                prot);
+
+      if (um)
+         um->locked = !!(flags & MAP_LOCKED);
+
+      if (um && !handle && !private_h) {
+
+         if (file_pages) {
+
+            if (!(rc = mmap_private_map_pages(pi, um, file_pages)))
+               file_pages = NULL; /* The pages now belong to the mapping */
+
+         } else {
+
+            rc = mmap_anon_map_pages(pi, um, populate);
+         }
+
+         if (rc) {
+
+            mmap_err_case_free(pi, um);
+            um = NULL;
+
+         } else if (!(prot & PROT_WRITE)) {
+
+            set_user_pages_rw(pi->pdir, um->vaddrp, um->len >> PAGE_SHIFT,
+                              false, false);
+         }
+      }
    }
    enable_preemption();
 
-   if (!um)
-      return -ENOMEM;
+   if (!um) {
+      rc = -ENOMEM;
+      goto out;
+   }
 
-   ASSERT(actual_len == pow2_round_up_at(len, PAGE_SIZE));
+   if (handle || private_h) {
 
-   if (handle) {
+      if (handle)
+         rc = vfs_mmap(um, pi->pdir, vfs_mm_flags);
+      else
+         rc = mmap_private_map_file(pi, um, private_h);
 
-      if ((rc = vfs_mmap(um, pi->pdir, 0))) {
+      if (rc) {
 
          /*
           * Everything was apparently OK and the allocation in the user virtual
@@ -302,26 +497,24 @@ sys_mmap_pgoff(void *addr, size_t len, int prot,
 
          disable_preemption();
          {
-            mmap_err_case_free(pi, um->vaddrp, actual_len);
-            process_remove_user_mapping(um);
+            mmap_err_case_free(pi, um);
          }
          enable_preemption();
          return rc;
       }
-
-
-   } else {
-
-      if (MMAP_NO_COW)
-         bzero(um->vaddrp, actual_len);
    }
 
    return (long)um->vaddr;
+
+out:
+   if (file_pages)
+      mmap_free_file_pages(file_pages, actual_len);
+
+   return rc;
 }
 
 static int munmap_int(struct process *pi, void *vaddrp, size_t len)
 {
-   u32 kfree_flags = KFREE_FL_ALLOW_SPLIT | KFREE_FL_MULTI_STEP;
    struct user_mapping *um = NULL, *um2 = NULL;
    ulong vaddr = (ulong) vaddrp;
    size_t actual_len;
@@ -332,25 +525,15 @@ static int munmap_int(struct process *pi, void *vaddrp, size_t len)
    actual_len = pow2_round_up_at(len, PAGE_SIZE);
    um = process_get_user_mapping(vaddrp);
 
-   if (!um) {
-
-      /*
-       * We just don't have any user_mappings containing [vaddrp, vaddrp+len).
-       * Just ignore that and return 0 [linux behavior].
-       */
-
-      printk("[%d] Un-map unknown chunk at [%p, %p)\n",
-             pi->pid, TO_PTR(vaddr), TO_PTR(vaddr + actual_len));
-      return 0;
-   }
+   /* See munmap_range(): the range is always inside a single mapping */
+   ASSERT(um != NULL);
 
    const ulong um_vend = um->vaddr + um->len;
+   const bool full_unmap = actual_len == um->len;
 
-   if (actual_len == um->len) {
+   ASSERT(vaddr + actual_len <= um_vend);
 
-      process_remove_user_mapping(um);
-
-   } else {
+   if (!full_unmap) {
 
       /* partial un-map */
 
@@ -391,12 +574,14 @@ static int munmap_int(struct process *pi, void *vaddrp, size_t len)
             um->len = um_vend - um->vaddr;
             return -ENOMEM;
          }
+
+         um2->advice = um->advice;
+         um2->locked = um->locked;
       }
    }
 
    if (um->h) {
 
-      kfree_flags |= KFREE_FL_NO_ACTUAL_FREE;
       rc = vfs_munmap(um, vaddrp, actual_len);
 
       /*
@@ -410,37 +595,281 @@ static int munmap_int(struct process *pi, void *vaddrp, size_t len)
 
       if (um2)
          vfs_mmap(um2, pi->pdir, VFS_MM_DONT_MMAP);
+
+   } else {
+
+      mmap_anon_unmap_pages(vaddr, actual_len);
    }
 
-   per_heap_kfree(pi->mi->mmap_heap,
-                  vaddrp,
-                  &actual_len,
-                  kfree_flags);
+   if (full_unmap)
+      process_remove_user_mapping(um);
 
-   ASSERT(actual_len == pow2_round_up_at(len, PAGE_SIZE));
+   user_vmem_free(&pi->mi->vmem, vaddr, actual_len);
    return 0;
 }
 
+/*
+ * Un-map all the mappings overlapping with [vaddr, vaddr + len), even just
+ * partially. Used by munmap() and by mmap() with MAP_FIXED. Returns the number
+ * of mappings affected or a negative error code.
+ */
+static int munmap_range(struct process *pi, ulong vaddr, size_t len)
+{
+   struct user_mapping *um, *temp;
+   const ulong vend = vaddr + len;
+   ulong start, end;
+   int rc, count = 0;
+
+   ASSERT(!is_preemption_enabled());
+
+   /*
+    * NOTE: munmap_int() might split `um` in two, appending the new mapping to
+    * the list. That's fine, because the new one cannot overlap with the range.
+    */
+   list_for_each(um, temp, &pi->mi->mappings, pi_node) {
+
+      start = MAX(vaddr, um->vaddr);
+      end = MIN(vend, um->vaddr + um->len);
+
+      if (start >= end)
+         continue;
+
+      if ((rc = munmap_int(pi, (void *)start, end - start)))
+         return rc;
+
+      count++;
+   }
+
+   return count;
+}
+
 int sys_munmap(void *vaddrp, size_t len)
 {
    struct task *curr = get_curr_task();
    struct process *pi = curr->pi;
    ulong vaddr = (ulong) vaddrp;
+   size_t actual_len;
    int rc;
 
-   if (!len || !pi->mi->mmap_heap)
+   if (!len || !pi->mi)
+      return -EINVAL;
+
+   if (!IN_RANGE(vaddr, USER_MMAP_BEGIN, USER_MMAP_END))
       return -EINVAL;
 
-   if (!IN_RANGE(vaddr,
-                 USER_MMAP_BEGIN,
-                 USER_MMAP_BEGIN + pi->mi->mmap_heap_size))
+   if (!IS_PAGE_ALIGNED(vaddr) || len > USER_MMAP_END - vaddr)
+      return -EINVAL;
+
+   actual_len = pow2_round_up_at(len, PAGE_SIZE);
+
+   disable_preemption();
    {
+      rc = munmap_range(pi, vaddr, actual_len);
+   }
+   enable_preemption();
+
+   if (!rc) {
+
+      /*
+       * We just don't have any user_mappings in [vaddr, vaddr + len). Just
+       * ignore that and return 0 [linux behavior].
+       */
+
+      printk("[%d] Un-map unknown chunk at [%p, %p)\n",
+             pi->pid, TO_PTR(vaddr), TO_PTR(vaddr + actual_len));
+   }
+
+   return MIN(rc, 0);
+}
+
+int sys_madvise(void *addr, size_t len, int advice)
+{
+   struct process *pi = get_curr_proc();
+   struct user_mapping *um;
+   const ulong vaddr = (ulong)addr;
+   const ulong vend = vaddr + pow2_round_up_at(len, PAGE_SIZE);
+
+   if (!IS_PAGE_ALIGNED(vaddr))
       return -EINVAL;
+
+   switch (advice) {
+
+      case MADV_NORMAL:
+      case MADV_RANDOM:
+      case MADV_SEQUENTIAL:
+         break;
+
+      default:
+         /* The other advices are just hints: ignore them */
+         return 0;
+   }
+
+   if (!pi->mi)
+      return 0;
+
+   /*
+    * NOTE: differently from Linux, we don't split the mappings partially
+    * covered by [addr, addr + len): the advice is applied to all of them. That's
+    * acceptable because the advice is used only by page-fault heuristics like
+    * the file-mappings fault-around.
+    */
+
+   disable_preemption();
+   {
+      list_for_each_ro(um, &pi->mi->mappings, pi_node) {
+         if (um->vaddr < vend && vaddr < um->vaddr + um->len)
+            um->advice = advice;
+      }
+   }
+   enable_preemption();
+   return 0;
+}
+
+/*
+ * Split `um` at `vaddr`, which must be strictly inside it. The new mapping,
+ * covering the 2nd part, is returned. Returns NULL if we're out-of-memory.
+ */
+static struct user_mapping *
+split_user_mapping(struct process *pi, struct user_mapping *um, ulong vaddr)
+{
+   const ulong um_vend = um->vaddr + um->len;
+   struct user_mapping *um2;
+
+   ASSERT(!is_preemption_enabled());
+   ASSERT(um->vaddr < vaddr && vaddr < um_vend);
+
+   um2 = process_add_user_mapping(um->h,
+                                  (void *)vaddr,
+                                  um_vend - vaddr,
+                                  um->off + (vaddr - um->vaddr),
+                                  um->prot);
+   if (!um2)
+      return NULL;
+
+   um2->advice = um->advice;
+   um2->locked = um->locked;
+   um->len = vaddr - um->vaddr;
+
+   if (um->h)
+      vfs_mmap(um2, pi->pdir, VFS_MM_DONT_MMAP);
+
+   return um2;
+}
+
+/* Returns the lowest vaddr in (vaddr, vend) belonging to a mapping, or vend */
+static ulong
+next_mapping_vaddr(struct process *pi, ulong vaddr, ulong vend)
+{
+   struct user_mapping *um;
+
+   if (!pi->mi)
+      return vend;
+
+   list_for_each_ro(um, &pi->mi->mappings, pi_node) {
+      if (vaddr < um->vaddr && um->vaddr < vend)
+         vend = um->vaddr;
    }
 
+   return vend;
+}
+
+static int
+mprotect_int(struct process *pi, ulong vaddr, ulong vend, int prot)
+{
+   const bool rw = !!(prot & PROT_WRITE);
+   struct user_mapping *um;
+   ulong end;
+   int fl;
+
+   ASSERT(!is_preemption_enabled());
+
+   for (; vaddr < vend; vaddr = end) {
+
+      if (!(um = process_get_user_mapping((void *)vaddr))) {
+
+         /*
+          * Not a mmap() mapping: that's the case of the segments of the
+          * program and of its ELF interpreter, along with the heap (brk).
+          * Here, all the pages must be mapped.
+          */
+         end = next_mapping_vaddr(pi, vaddr, vend);
+
+         if (set_user_pages_rw(pi->pdir, (void *)vaddr,
+                               (end - vaddr) >> PAGE_SHIFT, rw, false))
+         {
+            return -ENOMEM;
+         }
+
+         continue;
+      }
+
+      end = MIN(vend, um->vaddr + um->len);
+
+      if (um->h && rw && !(um->prot & PROT_WRITE)) {
+
+         fl = ((struct fs_handle_base *)um->h)->fl_flags;
+
+         if (!(fl & O_WRONLY) && (fl & O_RDWR) != O_RDWR)
+            return -EACCES;
+      }
+
+      if (um->prot != prot) {
+
+         if (vaddr > um->vaddr && !(um = split_user_mapping(pi, um, vaddr)))
+            return -ENOMEM;
+
+         if (end < um->vaddr + um->len && !split_user_mapping(pi, um, end))
+            return -ENOMEM;
+
+         um->prot = prot;
+      }
+
+      /*
+       * NOTE: the pages of file mappings are mapped on-demand: here, some of
+       * them might be not mapped yet and that's fine.
+       */
+      set_user_pages_rw(pi->pdir, (void *)vaddr,
+                        (end - vaddr) >> PAGE_SHIFT, rw, !!um->h);
+   }
+
+   return 0;
+}
+
+/*
+ * Minimal mprotect() implementation, enough for dynamic loaders: it changes
+ * only the write permission of the pages. Like mmap(), it does not support
+ * PROT_NONE or write-only pages, because on i386 a present page is always
+ * readable, while PROT_EXEC is just ignored, because every readable page is
+ * executable too. Making a page of a private mapping writable never makes its
+ * changes visible to anybody else: shared pageframes become CoW pages.
+ */
+int sys_mprotect(void *addr, size_t len, int prot)
+{
+   struct process *pi = get_curr_proc();
+   const ulong vaddr = (ulong)addr;
+   ulong vend;
+   int rc;
+
+   if (!IS_PAGE_ALIGNED(vaddr))
+      return -EINVAL;
+
+   if (prot & ~(PROT_READ | PROT_WRITE | PROT_EXEC))
+      return -EINVAL;
+
+   if (!len)
+      return 0;
+
+   if (vaddr >= USERMODE_VADDR_END || len > USERMODE_VADDR_END - vaddr)
+      return -ENOMEM;
+
+   if (!(prot & PROT_READ))
+      return -EINVAL;
+
+   vend = vaddr + pow2_round_up_at(len, PAGE_SIZE);
+
    disable_preemption();
    {
-      rc = munmap_int(pi, vaddrp, len);
+      rc = mprotect_int(pi, vaddr, vend, prot);
    }
    enable_preemption();
    return rc;
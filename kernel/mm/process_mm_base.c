@@ -119,35 +119,23 @@ void remove_all_mappings_of_handle(struct process *pi, fs_handle h)
 void full_remove_user_mapping(struct process *pi, struct user_mapping *um)
 {
    struct mappings_info *mi = pi->mi;
-   size_t actual_len = um->len;
-
    ASSERT(mi);
-   ASSERT(mi->mmap_heap);
 
    if (um->h)
-      vfs_munmap(um, um->vaddrp, actual_len);
-
-   per_heap_kfree(mi->mmap_heap,
-                  um->vaddrp,
-                  &actual_len,
-                  KFREE_FL_ALLOW_SPLIT |
-                  KFREE_FL_MULTI_STEP  |
-                  KFREE_FL_NO_ACTUAL_FREE);
+      vfs_munmap(um, um->vaddrp, um->len);
+   else
+      user_vfree_and_unmap(um->vaddr, um->len >> PAGE_SHIFT);
 
+   user_vmem_free(&mi->vmem, um->vaddr, um->len);
    process_remove_user_mapping(um);
 }
 
 void remove_all_file_mappings(struct process *pi)
 {
-   fs_handle *h;
-
-   for (u32 i = 0; i < MAX_HANDLES; i++) {
-
-      if (!(h = pi->handles[i]))
-         continue;
+   int fd;
 
-      remove_all_mappings_of_handle(pi, h);
-   }
+   fdt_for_each_fd(&pi->fdt, fd)
+      remove_all_mappings_of_handle(pi, pi->fdt.handles[fd]);
 }
 
 struct mappings_info *
@@ -161,10 +149,10 @@ duplicate_mappings_info(struct process *new_pi, struct mappings_info *mi)
 
    list_init(&new_mi->mappings);
 
-   if (!(new_mi->mmap_heap = kmalloc_heap_dup(mi->mmap_heap)))
-      goto oom_case;
-
-   new_mi->mmap_heap_size = mi->mmap_heap_size;
+   if (user_vmem_dup(&new_mi->vmem, &mi->vmem)) {
+      kfree_obj(new_mi, struct mappings_info);
+      return NULL;
+   }
 
    list_for_each_ro(um, &mi->mappings, pi_node) {
 
@@ -198,10 +186,7 @@ oom_case:
 
    if (new_mi) {
 
-      if (new_mi->mmap_heap) {
-         kmalloc_destroy_heap(new_mi->mmap_heap);
-         kfree2(new_mi->mmap_heap, kmalloc_get_heap_struct_size());
-      }
+      user_vmem_destroy(&new_mi->vmem);
 
       list_for_each(um, um2, &new_mi->mappings, pi_node) {
          list_remove(&um->pi_node);
@@ -218,14 +203,18 @@ void user_vfree_and_unmap(ulong user_vaddr, size_t page_count)
 {
    pdir_t *pdir = get_curr_pdir();
    ulong va = user_vaddr;
+   struct tlb_gather tlb;
 
-   for (size_t i = 0; i < page_count; i++, va += PAGE_SIZE) {
+   tlb_gather_init(&tlb, pdir);
 
-      if (!is_mapped(pdir, (void *)va))
-         continue;
+   /*
+    * NOTE: the permissive version is used here because some pages might be not
+    * mapped at all, while others might be zswap entries.
+    */
+   for (size_t i = 0; i < page_count; i++, va += PAGE_SIZE)
+      unmap_page_permissive_batched(pdir, (void *)va, true, &tlb);
 
-      unmap_page(pdir, (void *)va, true);
-   }
+   tlb_gather_flush(&tlb);
 }
 
 bool user_valloc_and_map_slow(ulong user_vaddr, size_t page_count)
@@ -315,11 +304,15 @@ int generic_fs_munmap(struct user_mapping *um, void *vaddrp, size_t len)
    struct process *pi = hb->pi;
    ulong vaddr = (ulong)vaddrp;
    ulong vend = vaddr + len;
+   struct tlb_gather tlb;
    ASSERT(IS_PAGE_ALIGNED(len));
 
+   tlb_gather_init(&tlb, pi->pdir);
+
    for (; vaddr < vend; vaddr += PAGE_SIZE) {
-      unmap_page_permissive(pi->pdir, (void *)vaddr, false);
+      unmap_page_permissive_batched(pi->pdir, (void *)vaddr, false, &tlb);
    }
 
+   tlb_gather_flush(&tlb);
    return 0;
 }
@@ -0,0 +1,255 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+
+#include <tilck/kernel/user_vmem.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/errno.h>
+
+static struct user_vmem_range *
+alloc_range(ulong vaddr, size_t len)
+{
+   struct user_vmem_range *r;
+
+   if (!(r = kalloc_obj(struct user_vmem_range)))
+      return NULL;
+
+   bintree_node_init(&r->node);
+   r->vaddr = vaddr;
+   r->len = len;
+   return r;
+}
+
+static void
+insert_range(struct user_vmem *uv, struct user_vmem_range *r)
+{
+   DEBUG_ONLY_UNSAFE(bool success =)
+      bintree_insert_ptr(&uv->root,
+                         r,
+                         struct user_vmem_range,
+                         node,
+                         vaddr);
+
+   ASSERT(success);
+}
+
+static void
+remove_range(struct user_vmem *uv, struct user_vmem_range *r)
+{
+   bintree_remove_ptr(&uv->root, r, struct user_vmem_range, node, vaddr);
+   kfree_obj(r, struct user_vmem_range);
+}
+
+/*
+ * Find the free range with the biggest vaddr <= `vaddr` (prev) and the one
+ * with the smallest vaddr > `vaddr` (next).
+ */
+static void
+find_neighbors(struct user_vmem *uv,
+               ulong vaddr,
+               struct user_vmem_range **prev_ref,
+               struct user_vmem_range **next_ref)
+{
+   struct user_vmem_range *r = uv->root;
+   *prev_ref = *next_ref = NULL;
+
+   while (r) {
+
+      if (r->vaddr <= vaddr) {
+         *prev_ref = r;
+         r = r->node.right_obj;
+      } else {
+         *next_ref = r;
+         r = r->node.left_obj;
+      }
+   }
+}
+
+int user_vmem_init(struct user_vmem *uv, ulong begin, ulong end)
+{
+   struct user_vmem_range *r;
+
+   ASSERT(IS_PAGE_ALIGNED(begin));
+   ASSERT(IS_PAGE_ALIGNED(end));
+   ASSERT(begin > 0 && begin < end);
+
+   uv->root = NULL;
+   uv->begin = begin;
+   uv->end = end;
+
+   if (!(r = alloc_range(begin, end - begin)))
+      return -ENOMEM;
+
+   insert_range(uv, r);
+   return 0;
+}
+
+void user_vmem_destroy(struct user_vmem *uv)
+{
+   struct user_vmem_range *r;
+
+   while ((r = uv->root))
+      remove_range(uv, r);
+}
+
+int user_vmem_dup(struct user_vmem *dest, struct user_vmem *src)
+{
+   struct bintree_walk_ctx ctx;
+   struct user_vmem_range *r, *r2;
+
+   dest->root = NULL;
+   dest->begin = src->begin;
+   dest->end = src->end;
+
+   bintree_in_order_visit_start(&ctx,
+                                src->root,
+                                struct user_vmem_range,
+                                node,
+                                false);
+
+   while ((r = bintree_in_order_visit_next(&ctx))) {
+
+      if (!(r2 = alloc_range(r->vaddr, r->len))) {
+         user_vmem_destroy(dest);
+         return -ENOMEM;
+      }
+
+      insert_range(dest, r2);
+   }
+
+   return 0;
+}
+
+ulong user_vmem_alloc(struct user_vmem *uv, size_t len)
+{
+   struct bintree_walk_ctx ctx;
+   struct user_vmem_range *r;
+   ulong vaddr;
+
+   ASSERT(IS_PAGE_ALIGNED(len));
+
+   if (!len)
+      return 0;
+
+   /* First-fit: use the free range with the lowest vaddr big enough */
+   bintree_in_order_visit_start(&ctx,
+                                uv->root,
+                                struct user_vmem_range,
+                                node,
+                                false);
+
+   while ((r = bintree_in_order_visit_next(&ctx))) {
+
+      if (r->len < len)
+         continue;
+
+      vaddr = r->vaddr;
+
+      if (r->len == len) {
+         remove_range(uv, r);
+      } else {
+         /* Shrinking the range from its beginning keeps the tree ordered */
+         r->vaddr += len;
+         r->len -= len;
+      }
+
+      return vaddr;
+   }
+
+   return 0;
+}
+
+int user_vmem_alloc_at(struct user_vmem *uv, ulong vaddr, size_t len)
+{
+   struct user_vmem_range *prev, *next, *r;
+   const ulong vend = vaddr + len;
+   ulong prev_end;
+
+   ASSERT(IS_PAGE_ALIGNED(vaddr));
+   ASSERT(IS_PAGE_ALIGNED(len));
+
+   if (!len || vaddr < uv->begin || vend > uv->end || vend < vaddr)
+      return -ENOMEM;
+
+   find_neighbors(uv, vaddr, &prev, &next);
+
+   /* The whole range must be contained in a single free range */
+   if (!prev || prev->vaddr + prev->len < vend)
+      return -ENOMEM;
+
+   prev_end = prev->vaddr + prev->len;
+
+   if (prev->vaddr == vaddr && prev_end == vend) {
+
+      remove_range(uv, prev);
+
+   } else if (prev->vaddr == vaddr) {
+
+      /* Shrinking the range from its beginning keeps the tree ordered */
+      prev->vaddr = vend;
+      prev->len -= len;
+
+   } else if (prev_end == vend) {
+
+      prev->len -= len;
+
+   } else {
+
+      /* Split the free range in two */
+      if (!(r = alloc_range(vend, prev_end - vend)))
+         return -ENOMEM;
+
+      prev->len = vaddr - prev->vaddr;
+      insert_range(uv, r);
+   }
+
+   return 0;
+}
+
+void user_vmem_free(struct user_vmem *uv, ulong vaddr, size_t len)
+{
+   struct user_vmem_range *prev, *next, *r;
+   const ulong vend = vaddr + len;
+
+   ASSERT(IS_PAGE_ALIGNED(vaddr));
+   ASSERT(IS_PAGE_ALIGNED(len));
+   ASSERT(uv->begin <= vaddr && vend <= uv->end);
+
+   if (!len)
+      return;
+
+   find_neighbors(uv, vaddr, &prev, &next);
+
+   /* The range must not overlap with any free range (double free) */
+   ASSERT(!prev || prev->vaddr + prev->len <= vaddr);
+   ASSERT(!next || vend <= next->vaddr);
+
+   const bool merge_prev = prev && prev->vaddr + prev->len == vaddr;
+   const bool merge_next = next && next->vaddr == vend;
+
+   if (merge_prev && merge_next) {
+
+      prev->len += len + next->len;
+      remove_range(uv, next);
+
+   } else if (merge_prev) {
+
+      prev->len += len;
+
+   } else if (merge_next) {
+
+      /* Extending the range backwards keeps the tree ordered */
+      next->vaddr = vaddr;
+      next->len += len;
+
+   } else {
+
+      /*
+       * In the unlikely case we're out-of-memory here, the range just won't
+       * be reusable. That's a leak of virtual address space, not of memory.
+       */
+      if ((r = alloc_range(vaddr, len)))
+         insert_range(uv, r);
+   }
+}
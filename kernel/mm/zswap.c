@@ -0,0 +1,634 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_mm.h>
+#include <tilck_gen_headers/config_sched.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/assert.h>
+#include <tilck/common/string_util.h>
+#include <tilck/common/printk.h>
+#include <tilck/common/utils.h>
+
+#include <tilck/kernel/zswap.h>
+#include <tilck/kernel/lz.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/process_mm.h>
+#include <tilck/kernel/timer.h>
+#include <tilck/kernel/list.h>
+#include <tilck/kernel/fs/crd.h>
+
+#define ZSWAP_SCAN_INTERVAL            (TIMER_HZ / 4)
+#define ZSWAP_SCAN_CHUNK                          64  /* pages per chunk */
+#define ZSWAP_BG_RECLAIM_PAGES                   256
+#define ZSWAP_BG_SCAN_PAGES                     4096
+#define ZSWAP_DIRECT_RECLAIM_PAGES                32
+#define ZSWAP_DIRECT_SCAN_PAGES          (64 * 1024)
+#define ZSWAP_MAX_PROCS                           64  /* per reclaim round */
+#define ZSWAP_MAX_OBJS_PER_PAGE                   32
+#define ZSWAP_MAX_CHUNKS                        1024
+
+/*
+ * A zswap slot is the object referred by the swap entries. Slot 0 is reserved,
+ * so that a swap entry can never look like a zero PTE. Slots with len == 0
+ * refer to pages full of zeros: they have no compressed data at all.
+ */
+struct zswap_slot {
+
+   union {
+      void *obj;              /* compressed data (used slots) */
+      ulong next_free;        /* next free slot (free slots) */
+   };
+
+   u16 len;                   /* compressed length */
+   u16 ref_count;             /* number of swap entries using this slot */
+};
+
+/*
+ * The compressed objects are stored in arena pages allocated with kmalloc().
+ * Each arena page contains up to ZSWAP_MAX_OBJS_PER_PAGE objects of the same
+ * size: the page's class is the number of objects it can contain.
+ */
+struct zswap_arena_page {
+
+   struct list_node node;     /* node in arena_partial[], when not full */
+   u32 used_mask;
+   u16 obj_count;
+   u16 obj_size;
+};
+
+#define ZSWAP_ARENA_HDR              sizeof(struct zswap_arena_page)
+#define ZSWAP_ARENA_AVAIL            (PAGE_SIZE - ZSWAP_ARENA_HDR)
+#define ZSWAP_MAX_COMPR_SIZE         ((ZSWAP_ARENA_AVAIL / 2) & ~7u)
+#define ZSWAP_SLOTS_PER_CHUNK        (PAGE_SIZE / sizeof(struct zswap_slot))
+
+STATIC_ASSERT((ZSWAP_ARENA_HDR % 8) == 0);
+STATIC_ASSERT(ZSWAP_MAX_CHUNKS * ZSWAP_SLOTS_PER_CHUNK < (1u << 20));
+STATIC_ASSERT(ZSWAP_MAX_COMPR_SIZE >= 1024);
+
+struct zswap_stats zswap_stats;
+ulong zswap_min_free_kb = ZSWAP_DEFAULT_MIN_FREE_KB;
+
+static struct zswap_slot *slot_chunks[ZSWAP_MAX_CHUNKS];
+static u32 slot_chunks_count;
+static ulong free_slots_head;
+
+static struct list arena_partial[ZSWAP_MAX_OBJS_PER_PAGE + 1];
+static struct lz_ctx lz_ctx;
+static u8 cbuf[ZSWAP_MAX_COMPR_SIZE];
+
+/* The clock hand: where the next reclaim will resume scanning */
+static int hand_pid;
+static ulong hand_vaddr;
+
+struct zswap_scan {
+   ulong to_reclaim;          /* pages still to swap-out */
+   ulong to_scan;             /* budget of pages still to check */
+};
+
+static inline struct zswap_slot *zswap_get_slot(ulong slot)
+{
+   ASSERT(slot > 0);
+   ASSERT(slot < slot_chunks_count * ZSWAP_SLOTS_PER_CHUNK);
+
+   return &slot_chunks[slot / ZSWAP_SLOTS_PER_CHUNK]
+                      [slot % ZSWAP_SLOTS_PER_CHUNK];
+}
+
+static inline u32 zswap_full_mask(u32 obj_count)
+{
+   return obj_count == 32 ? ~0u : (1u << obj_count) - 1;
+}
+
+static inline u32 zswap_class_of(size_t len)
+{
+   ASSERT(len > 0 && len <= ZSWAP_MAX_COMPR_SIZE);
+   return (u32)MIN((size_t)ZSWAP_MAX_OBJS_PER_PAGE,
+                   ZSWAP_ARENA_AVAIL / round_up_at(len, 8));
+}
+
+static void zswap_update_ratio(void)
+{
+   struct zswap_stats *s = &zswap_stats;
+   s->compr_ratio = s->pool_pages ? s->stored_pages * 100 / s->pool_pages : 0;
+}
+
+static void zswap_add_slots_chunk(void *page)
+{
+   struct zswap_slot *chunk = page;
+   const ulong base = slot_chunks_count * ZSWAP_SLOTS_PER_CHUNK;
+
+   ASSERT(slot_chunks_count < ZSWAP_MAX_CHUNKS);
+   bzero(chunk, PAGE_SIZE);
+   slot_chunks[slot_chunks_count++] = chunk;
+
+   /* Push the new slots in reverse order, skipping the reserved slot 0 */
+   for (ulong i = ZSWAP_SLOTS_PER_CHUNK; i > 0; i--) {
+
+      if (base + i - 1 == 0)
+         break;
+
+      chunk[i - 1].next_free = free_slots_head;
+      free_slots_head = base + i - 1;
+   }
+
+   zswap_stats.pool_pages++;
+}
+
+static void zswap_add_arena_page(void *page, u32 cl)
+{
+   struct zswap_arena_page *ap = page;
+
+   list_node_init(&ap->node);
+   ap->used_mask = 0;
+   ap->obj_count = (u16)cl;
+   ap->obj_size = (u16)((ZSWAP_ARENA_AVAIL / cl) & ~7u);
+
+   list_add_tail(&arena_partial[cl], &ap->node);
+   zswap_stats.pool_pages++;
+}
+
+static void *zswap_arena_alloc(u32 cl)
+{
+   struct zswap_arena_page *ap;
+   u32 idx;
+
+   ASSERT(!list_is_empty(&arena_partial[cl]));
+   ap = list_first_obj(&arena_partial[cl], struct zswap_arena_page, node);
+
+   idx = get_first_zero_bit_index32(ap->used_mask);
+   ASSERT(idx < ap->obj_count);
+   ap->used_mask |= (1u << idx);
+
+   if (ap->used_mask == zswap_full_mask(ap->obj_count))
+      list_remove(&ap->node);
+
+   return (void *)ap + ZSWAP_ARENA_HDR + idx * ap->obj_size;
+}
+
+static void zswap_arena_free(void *obj)
+{
+   struct zswap_arena_page *ap = (void *)((ulong)obj & PAGE_MASK);
+   const u32 idx = (u32)(obj - (void *)ap - ZSWAP_ARENA_HDR) / ap->obj_size;
+   const bool was_full = ap->used_mask == zswap_full_mask(ap->obj_count);
+
+   ASSERT(ap->used_mask & (1u << idx));
+   ap->used_mask &= ~(1u << idx);
+
+   if (!ap->used_mask) {
+
+      if (!was_full)
+         list_remove(&ap->node);
+
+      kfree2(ap, PAGE_SIZE);
+      zswap_stats.pool_pages--;
+      return;
+   }
+
+   if (was_full)
+      list_add_tail(&arena_partial[ap->obj_count], &ap->node);
+}
+
+static void *zswap_alloc_meta_page(void *victim, bool *victim_used)
+{
+   void *page = kmalloc(PAGE_SIZE);
+
+   if (!page && !*victim_used) {
+      page = victim;
+      *victim_used = true;
+   }
+
+   return page;
+}
+
+static void zswap_free_meta_page(void *page, void *victim)
+{
+   if (page && page != victim)
+      kfree2(page, PAGE_SIZE);
+}
+
+/*
+ * Store `len` bytes of compressed data in a new slot. All the allocations are
+ * performed before touching anything: when kmalloc() fails, the page being
+ * swapped-out (`victim`) can be used as a metadata page too.
+ */
+static ulong
+zswap_store(const void *data, size_t len, void *victim, bool *victim_used)
+{
+   struct zswap_slot *s;
+   void *chunk = NULL, *page = NULL;
+   ulong slot;
+   u32 cl = 0;
+
+   *victim_used = false;
+
+   if (!free_slots_head) {
+
+      if (slot_chunks_count == ZSWAP_MAX_CHUNKS)
+         return 0; /* slot table full */
+
+      if (!(chunk = zswap_alloc_meta_page(victim, victim_used)))
+         return 0;
+   }
+
+   if (len) {
+
+      cl = zswap_class_of(len);
+
+      if (list_is_empty(&arena_partial[cl])) {
+
+         if (!(page = zswap_alloc_meta_page(victim, victim_used))) {
+            zswap_free_meta_page(chunk, victim);
+            *victim_used = false;
+            return 0;
+         }
+      }
+   }
+
+   if (chunk)
+      zswap_add_slots_chunk(chunk);
+
+   if (page)
+      zswap_add_arena_page(page, cl);
+
+   slot = free_slots_head;
+   s = zswap_get_slot(slot);
+   free_slots_head = s->next_free;
+
+   s->len = (u16)len;
+   s->ref_count = 1;
+   s->obj = NULL;
+
+   if (len) {
+      s->obj = zswap_arena_alloc(cl);
+      memcpy(s->obj, data, len);
+   }
+
+   zswap_stats.stored_pages++;
+   zswap_stats.zero_pages += !len;
+   zswap_stats.compr_bytes += len;
+   zswap_update_ratio();
+   return slot;
+}
+
+static void zswap_free_slot(ulong slot)
+{
+   struct zswap_slot *s = zswap_get_slot(slot);
+
+   if (s->len)
+      zswap_arena_free(s->obj);
+
+   zswap_stats.stored_pages--;
+   zswap_stats.zero_pages -= !s->len;
+   zswap_stats.compr_bytes -= s->len;
+   zswap_update_ratio();
+
+   s->len = 0;
+   s->next_free = free_slots_head;
+   free_slots_head = slot;
+}
+
+void zswap_slot_get(ulong slot)
+{
+   disable_preemption();
+   {
+      struct zswap_slot *s = zswap_get_slot(slot);
+      ASSERT(s->ref_count > 0 && s->ref_count < 0xffff);
+      s->ref_count++;
+   }
+   enable_preemption();
+}
+
+void zswap_slot_put(ulong slot)
+{
+   disable_preemption();
+   {
+      struct zswap_slot *s = zswap_get_slot(slot);
+      ASSERT(s->ref_count > 0);
+
+      if (!--s->ref_count)
+         zswap_free_slot(slot);
+   }
+   enable_preemption();
+}
+
+void zswap_swap_in(ulong slot, void *dst)
+{
+   long rc;
+
+   disable_preemption();
+   {
+      struct zswap_slot *s = zswap_get_slot(slot);
+
+      if (s->len) {
+
+         rc = lz_decompress(s->obj, s->len, dst, PAGE_SIZE);
+
+         if (rc != PAGE_SIZE)
+            panic("zswap: corrupted slot %lu (rc: %ld)", slot, rc);
+
+      } else {
+
+         bzero(dst, PAGE_SIZE);
+      }
+
+      zswap_stats.swap_ins++;
+      zswap_slot_put(slot);
+   }
+   enable_preemption();
+}
+
+static bool zswap_is_zero_page(const void *page)
+{
+   const ulong *p = page;
+
+   for (u32 i = 0; i < PAGE_SIZE / sizeof(ulong); i++)
+      if (p[i])
+         return false;
+
+   return true;
+}
+
+static bool
+zswap_swap_out(pdir_t *pdir, ulong va, void *page, struct tlb_gather *tlb)
+{
+   bool victim_used;
+   size_t len = 0;
+   ulong slot;
+
+   if (!zswap_is_zero_page(page)) {
+
+      len = lz_compress(&lz_ctx, page, PAGE_SIZE, cbuf, sizeof(cbuf));
+
+      if (!len) {
+         zswap_stats.rejected++;
+         return false; /* not compressible enough: keep it */
+      }
+   }
+
+   if (!(slot = zswap_store(cbuf, len, page, &victim_used)))
+      return false;
+
+   set_swap_entry(pdir, (void *)va, slot, tlb);
+
+   if (!victim_used)
+      kfree2(page, PAGE_SIZE);
+
+   zswap_stats.swap_outs++;
+   return true;
+}
+
+static bool zswap_can_scan(struct task *ti)
+{
+   if (!ti || !is_main_thread(ti) || is_kernel_thread(ti))
+      return false;
+
+   if (ti->state == TASK_STATE_ZOMBIE || ti->vfork_stopped)
+      return false;
+
+   /* A vforked child shares its pdir and its mappings with the parent */
+   return !ti->pi->vforked && ti->pi->pdir != NULL;
+}
+
+/*
+ * Find the first anonymous range [beg, end) of `pi` ending after `va`. Only
+ * the brk area and the private anonymous mappings are candidates for zswap:
+ * file mappings are never touched.
+ */
+static bool
+zswap_next_anon_range(struct process *pi, ulong va, ulong *beg, ulong *end)
+{
+   struct user_mapping *um;
+   ulong b = 0, e = 0;
+
+   if ((ulong)pi->brk > va && pi->brk > pi->initial_brk) {
+      b = (ulong)pi->initial_brk;
+      e = (ulong)pi->brk;
+   }
+
+   if (pi->mi) {
+
+      list_for_each_ro(um, &pi->mi->mappings, pi_node) {
+
+         if (um->h || um->locked || um->vaddr + um->len <= va)
+            continue;
+
+         if (!e || um->vaddr < b) {
+            b = um->vaddr;
+            e = um->vaddr + um->len;
+         }
+      }
+   }
+
+   if (!e)
+      return false;
+
+   *beg = MAX(b, va);
+   *end = e;
+   return true;
+}
+
+/*
+ * Scan up to ZSWAP_SCAN_CHUNK pages of `pid`, starting from `hand_vaddr`.
+ * Returns true when there's nothing more to scan in that process.
+ */
+static bool zswap_scan_chunk(int pid, struct zswap_scan *s)
+{
+   struct task *ti = get_task(pid);
+   struct tlb_gather tlb;
+   struct process *pi;
+   ulong va, beg, end;
+   bool done = false;
+   u32 n = 0;
+
+   ASSERT(!is_preemption_enabled());
+
+   if (!zswap_can_scan(ti))
+      return true;
+
+   pi = ti->pi;
+   va = hand_vaddr;
+   tlb_gather_init(&tlb, pi->pdir);
+
+   while (n < ZSWAP_SCAN_CHUNK && s->to_reclaim) {
+
+      if (!zswap_next_anon_range(pi, va, &beg, &end)) {
+         done = true;
+         break;
+      }
+
+      for (va = beg; va < end; va += PAGE_SIZE, n++) {
+
+         void *page;
+
+         if (n == ZSWAP_SCAN_CHUNK || !s->to_reclaim)
+            break;
+
+         if (swap_check_page(pi->pdir, (void *)va, &page, &tlb) !=
+             SWAP_PAGE_COLD)
+         {
+            continue;
+         }
+
+         if (zswap_swap_out(pi->pdir, va, page, &tlb))
+            s->to_reclaim--;
+      }
+   }
+
+   tlb_gather_flush(&tlb);
+   hand_vaddr = va;
+   s->to_scan -= MIN(n, s->to_scan);
+   return done;
+}
+
+static bool zswap_scan_process(int pid, struct zswap_scan *s)
+{
+   bool done = false;
+
+   while (!done && s->to_reclaim && s->to_scan) {
+
+      disable_preemption();
+      {
+         done = zswap_scan_chunk(pid, s);
+      }
+      enable_preemption();
+   }
+
+   return done;
+}
+
+struct zswap_pids_ctx {
+   int *pids;
+   int count;
+   int min_pid;
+   int max_pid;
+};
+
+static int zswap_collect_pids_cb(void *obj, void *arg)
+{
+   struct task *ti = obj;
+   struct zswap_pids_ctx *ctx = arg;
+
+   if (ctx->count == ZSWAP_MAX_PROCS)
+      return -1; /* stop the iteration */
+
+   if (ti->tid < ctx->min_pid || ti->tid >= ctx->max_pid)
+      return 0;
+
+   if (zswap_can_scan(ti))
+      ctx->pids[ctx->count++] = ti->tid;
+
+   return 0;
+}
+
+/* Collect the pids to scan, starting from the clock hand and wrapping around */
+static int zswap_collect_pids(int *pids)
+{
+   struct zswap_pids_ctx ctx = {
+      .pids = pids,
+      .count = 0,
+      .min_pid = hand_pid,
+      .max_pid = INT32_MAX,
+   };
+
+   disable_preemption();
+   {
+      iterate_over_tasks(&zswap_collect_pids_cb, &ctx);
+
+      ctx.min_pid = 0;
+      ctx.max_pid = hand_pid;
+      iterate_over_tasks(&zswap_collect_pids_cb, &ctx);
+   }
+   enable_preemption();
+   return ctx.count;
+}
+
+/*
+ * Clock-like reclaim: the first time a page is found, its accessed bit is
+ * cleared. If the bit is still clear the next time the hand gets there, the
+ * page is cold and it gets swapped-out. Two rounds are performed at most, in
+ * order to allow pages to age when the memory is suddenly low.
+ */
+static ulong zswap_reclaim(ulong to_reclaim, ulong to_scan)
+{
+   struct zswap_scan s = { .to_reclaim = to_reclaim, .to_scan = to_scan };
+   int pids[ZSWAP_MAX_PROCS];
+   int count;
+
+   for (int round = 0; round < 2; round++) {
+
+      count = zswap_collect_pids(pids);
+
+      for (int i = 0; i < count; i++) {
+
+         if (!s.to_reclaim || !s.to_scan)
+            goto out;
+
+         if (pids[i] != hand_pid) {
+            hand_pid = pids[i];
+            hand_vaddr = 0;
+         }
+
+         if (zswap_scan_process(pids[i], &s)) {
+            hand_pid = pids[i] + 1;
+            hand_vaddr = 0;
+         }
+      }
+   }
+
+out:
+   return to_reclaim - s.to_reclaim;
+}
+
+static void zswap_reclaim_thread()
+{
+   while (true) {
+
+      kernel_sleep(ZSWAP_SCAN_INTERVAL);
+
+      if (kmalloc_get_tot_heap_free() / KB >= zswap_min_free_kb)
+         continue;
+
+      zswap_reclaim(ZSWAP_BG_RECLAIM_PAGES, ZSWAP_BG_SCAN_PAGES);
+   }
+}
+
+void *zswap_alloc_page(void)
+{
+   void *page = kmalloc(PAGE_SIZE);
+
+   if (page)
+      return page;
+
+   /* Dropping clean initrd chunks is much cheaper than compressing pages */
+   while (crd_shrink(1)) {
+      if ((page = kmalloc(PAGE_SIZE)))
+         return page;
+   }
+
+   if (!MM_ZSWAP)
+      return NULL;
+
+   /* Direct reclaim */
+   disable_preemption();
+   {
+      if (zswap_reclaim(ZSWAP_DIRECT_RECLAIM_PAGES, ZSWAP_DIRECT_SCAN_PAGES))
+         page = kmalloc(PAGE_SIZE);
+   }
+   enable_preemption();
+   return page;
+}
+
+void init_zswap(void)
+{
+   if (!MM_ZSWAP)
+      return;
+
+   for (u32 i = 0; i < ARRAY_SIZE(arena_partial); i++)
+      list_init(&arena_partial[i]);
+
+   if (kthread_create(&zswap_reclaim_thread, 0, NULL) < 0)
+      panic("Unable to create a kthread for zswap_reclaim_thread()");
+}
@@ -27,45 +27,122 @@ struct pipe {
    ATOMIC(int) write_handles;
 };
 
-static ssize_t pipe_read(fs_handle h, char *buf, size_t size)
+/*
+ * Copy data from the ring buffer directly to the iter, chunk by chunk.
+ * Returns the number of bytes copied or -EFAULT, if nothing could be copied.
+ */
+static ssize_t pipe_copy_to_iter(struct pipe *p, struct io_iter *it)
 {
-   struct kfs_handle *kh = h;
-   struct pipe *p = (void *)kh->kobj;
-   bool sig_pending = false;
-   ssize_t rc = 0;
+   ssize_t tot = 0;
+   ssize_t rc;
+   size_t len;
+   u8 *ptr;
 
-   if (!size)
-      return 0;
+   ASSERT(kmutex_is_curr_task_holding_lock(&p->mutex));
 
-   kmutex_lock(&p->mutex);
+   while (it->count && (ptr = ringbuf_get_read_chunk(&p->rb, &len))) {
 
-   while (true) {
+      if ((rc = io_iter_copy_to(it, ptr, MIN(len, it->count))) < 0)
+         return tot ? tot : rc;
 
-      rc = (ssize_t)ringbuf_read_bytes(&p->rb, (u8 *)buf, size);
+      ringbuf_consume_bytes(&p->rb, (size_t)rc);
+      tot += rc;
+   }
 
-      if (rc)
-         break; /* Everything is alright, we read something */
+   return tot;
+}
+
+/* The dual of pipe_copy_to_iter() */
+static ssize_t pipe_copy_from_iter(struct pipe *p, struct io_iter *it)
+{
+   ssize_t tot = 0;
+   ssize_t rc;
+   size_t len;
+   u8 *ptr;
+
+   ASSERT(kmutex_is_curr_task_holding_lock(&p->mutex));
+
+   while (it->count && (ptr = ringbuf_get_write_chunk(&p->rb, &len))) {
+
+      if ((rc = io_iter_copy_from(it, ptr, MIN(len, it->count))) < 0)
+         return tot ? tot : rc;
+
+      ringbuf_commit_bytes(&p->rb, (size_t)rc);
+      tot += rc;
+   }
+
+   return tot;
+}
+
+/*
+ * Wait until there is some data to read in the pipe. Returns 0 in that case,
+ * 1 when the pipe is empty and there are no more writers (EOF) or a negative
+ * error code.
+ */
+static int
+pipe_wait_for_data(struct kfs_handle *kh, struct pipe *p, bool nonblock)
+{
+   ASSERT(kmutex_is_curr_task_holding_lock(&p->mutex));
+
+   while (ringbuf_is_empty(&p->rb)) {
 
       if (atomic_load_explicit(&p->write_handles, mo_relaxed) == 0) {
          /* No more writers, always return 0, no matter what. */
-         break;
+         return 1;
       }
 
-      if (kh->fl_flags & O_NONBLOCK) {
-         rc = -EAGAIN;
-         break;
-      }
+      if (nonblock || (kh->fl_flags & O_NONBLOCK))
+         return -EAGAIN;
 
       /* Wait for writers to fill up the buffer */
       kcond_wait(&p->not_empty_cond, &p->mutex, KCOND_WAIT_FOREVER);
 
       /* After wake up */
-      if (pending_signals()) {
-         sig_pending = true;
-         break;
+      if (pending_signals())
+         return -EINTR;
+   }
+
+   return 0;
+}
+
+/*
+ * Wait until there are at least `min_space` bytes of free space in the pipe.
+ * Returns 0 in that case or a negative error code.
+ */
+static int
+pipe_wait_for_space(struct kfs_handle *kh,
+                    struct pipe *p,
+                    size_t min_space,
+                    bool nonblock)
+{
+   ASSERT(kmutex_is_curr_task_holding_lock(&p->mutex));
+
+   while (true) {
+
+      if (atomic_load_explicit(&p->read_handles, mo_relaxed) == 0) {
+
+         /* Broken pipe */
+         send_signal(get_curr_pid(), SIGPIPE, true);
+         return -EPIPE;
       }
+
+      if (ringbuf_get_free_elems(&p->rb) >= min_space)
+         return 0;
+
+      if (nonblock || (kh->fl_flags & O_NONBLOCK))
+         return -EAGAIN;
+
+      /* Wait for readers to make enough space in the buffer */
+      kcond_wait(&p->not_full_cond, &p->mutex, KCOND_WAIT_FOREVER);
+
+      /* After wake up */
+      if (pending_signals())
+         return -EINTR;
    }
+}
 
+static void pipe_wake_up_after_read(struct pipe *p)
+{
    /*
     * Wake up one blocked writer instead of all of them.
     *
@@ -84,68 +161,328 @@ static ssize_t pipe_read(fs_handle h, char *buf, size_t size)
       /* The buffer is not empty: wake up one more reader, if any */
       kcond_signal_one(&p->not_empty_cond);
    }
+}
 
-   /* Unlock the pipe's state lock and return */
+static void pipe_wake_up_after_write(struct pipe *p)
+{
+   /*
+    * Wake up one blocked reader, instead of all of them.
+    * See the comments in pipe_wake_up_after_read() above.
+    */
+   kcond_signal_one(&p->not_empty_cond);
+
+   if (!ringbuf_is_full(&p->rb)) {
+      /* The buffer is not full: wake up one more writer, if any */
+      kcond_signal_one(&p->not_full_cond);
+   }
+}
+
+static ssize_t pipe_read_iter(fs_handle h, struct io_iter *it)
+{
+   struct kfs_handle *kh = h;
+   struct pipe *p = (void *)kh->kobj;
+   ssize_t rc;
+
+   if (!it->count)
+      return 0;
+
+   kmutex_lock(&p->mutex);
+   {
+      if (!(rc = pipe_wait_for_data(kh, p, false)))
+         rc = pipe_copy_to_iter(p, it);
+      else if (rc > 0)
+         rc = 0; /* EOF */
+
+      pipe_wake_up_after_read(p);
+   }
    kmutex_unlock(&p->mutex);
-   return !sig_pending ? rc : -EINTR;
+   return rc;
 }
 
-static ssize_t pipe_write(fs_handle h, char *buf, size_t size)
+static ssize_t pipe_write_iter(fs_handle h, struct io_iter *it)
 {
    struct kfs_handle *kh = h;
    struct pipe *p = (void *)kh->kobj;
-   bool sig_pending = false;
-   ssize_t rc = 0;
+   ssize_t rc;
 
-   if (!size)
+   /*
+    * Writes up to PIPE_ATOMIC_WRITE_SIZE bytes, including the ones made with
+    * writev(), must not be interleaved with data from other writers: wait for
+    * enough space to write them at once. Bigger writes can be partial.
+    */
+   const size_t min_space = it->count <= PIPE_ATOMIC_WRITE_SIZE ? it->count : 1;
+
+   if (!it->count)
       return 0;
 
    kmutex_lock(&p->mutex);
+   {
+      if (!(rc = pipe_wait_for_space(kh, p, min_space, false)))
+         rc = pipe_copy_from_iter(p, it);
+
+      pipe_wake_up_after_write(p);
+   }
+   kmutex_unlock(&p->mutex);
+   return rc;
+}
+
+/*
+ * Fill the pipe's buffer with up to `len` bytes read from `src`, which is read
+ * directly into the buffer's memory: no intermediate copies.
+ */
+static ssize_t
+pipe_fill_from_file(struct pipe *p, fs_handle src, offt *pos, size_t len)
+{
+   struct io_iter it;
+   struct iovec iov;
+   ssize_t tot = 0;
+   ssize_t rc;
+   size_t avail;
+   u8 *ptr;
+
+   while ((size_t)tot < len &&
+          (ptr = ringbuf_get_write_chunk(&p->rb, &avail)))
+   {
+      iov = (struct iovec) { ptr, MIN(avail, len - (size_t)tot) };
+      io_iter_init(&it, &iov, 1, false);
+
+      rc = pos ? vfs_pread_iter(src, &it, *pos) : vfs_read_iter(src, &it);
+
+      if (rc <= 0)
+         return tot ? tot : rc;
+
+      ringbuf_commit_bytes(&p->rb, (size_t)rc);
+      tot += rc;
+
+      if (pos)
+         *pos += rc;
+
+      if ((size_t)rc < iov.iov_len)
+         break; /* EOF */
+   }
+
+   return tot;
+}
+
+/* The dual of pipe_fill_from_file() */
+static ssize_t
+pipe_drain_to_file(struct pipe *p, fs_handle dst, offt *pos, size_t len)
+{
+   struct io_iter it;
+   struct iovec iov;
+   ssize_t tot = 0;
+   ssize_t rc;
+   size_t avail;
+   u8 *ptr;
+
+   while ((size_t)tot < len && (ptr = ringbuf_get_read_chunk(&p->rb, &avail)))
+   {
+      iov = (struct iovec) { ptr, MIN(avail, len - (size_t)tot) };
+      io_iter_init(&it, &iov, 1, false);
+
+      rc = pos ? vfs_pwrite_iter(dst, &it, *pos) : vfs_write_iter(dst, &it);
+
+      if (rc <= 0)
+         return tot ? tot : rc;
+
+      ringbuf_consume_bytes(&p->rb, (size_t)rc);
+      tot += rc;
+
+      if (pos)
+         *pos += rc;
+
+      if ((size_t)rc < iov.iov_len)
+         break; /* short write */
+   }
+
+   return tot;
+}
+
+ssize_t
+pipe_splice_from_file(fs_handle pipe_h,
+                      fs_handle src,
+                      offt *pos,
+                      size_t len,
+                      bool nonblock)
+{
+   struct kfs_handle *kh = pipe_h;
+   struct pipe *p = (void *)kh->kobj;
+   ssize_t rc;
+
+   ASSERT(is_pipe_write_end(pipe_h));
+
+   /* `src` is read with our lock held: pipes must use pipe_splice_pipe() */
+   if (is_pipe_read_end(src))
+      return -EINVAL;
+
+   if (!len)
+      return 0;
+
+   kmutex_lock(&p->mutex);
+   {
+      if (!(rc = pipe_wait_for_space(kh, p, 1, nonblock)))
+         rc = pipe_fill_from_file(p, src, pos, len);
+
+      pipe_wake_up_after_write(p);
+   }
+   kmutex_unlock(&p->mutex);
+   return rc;
+}
+
+ssize_t
+pipe_splice_to_file(fs_handle pipe_h,
+                    fs_handle dst,
+                    offt *pos,
+                    size_t len,
+                    bool nonblock)
+{
+   struct kfs_handle *kh = pipe_h;
+   struct pipe *p = (void *)kh->kobj;
+   ssize_t rc;
+
+   ASSERT(is_pipe_read_end(pipe_h));
+
+   /* `dst` is written with our lock held: pipes must use pipe_splice_pipe() */
+   if (is_pipe_write_end(dst))
+      return -EINVAL;
+
+   if (!len)
+      return 0;
+
+   kmutex_lock(&p->mutex);
+   {
+      if (!(rc = pipe_wait_for_data(kh, p, nonblock)))
+         rc = pipe_drain_to_file(p, dst, pos, len);
+      else if (rc > 0)
+         rc = 0; /* EOF */
+
+      pipe_wake_up_after_read(p);
+   }
+   kmutex_unlock(&p->mutex);
+   return rc;
+}
+
+/*
+ * Move (or just copy, when `consume` is false) up to `len` bytes from the
+ * buffer of `src` to the buffer of `dst`, without waiting.
+ */
+static ssize_t
+pipe_move_data(struct pipe *src, struct pipe *dst, size_t len, bool consume)
+{
+   struct io_iter it;
+   struct iovec iov;
+   ssize_t tot = 0;
+   ssize_t rc;
+   size_t avail;
+   u8 *ptr;
+
+   while ((size_t)tot < len &&
+          (ptr = ringbuf_peek_chunk(&src->rb, consume ? 0 : (size_t)tot,
+                                    &avail)))
+   {
+      iov = (struct iovec) { ptr, MIN(avail, len - (size_t)tot) };
+      io_iter_init(&it, &iov, 1, false);
+
+      if (!(rc = pipe_copy_from_iter(dst, &it)))
+         break; /* `dst` is full */
+
+      if (consume)
+         ringbuf_consume_bytes(&src->rb, (size_t)rc);
+
+      tot += rc;
+   }
+
+   return tot;
+}
+
+ssize_t
+pipe_splice_pipe(fs_handle src_h,
+                 fs_handle dst_h,
+                 size_t len,
+                 bool nonblock,
+                 bool consume)
+{
+   struct kfs_handle *skh = src_h;
+   struct kfs_handle *dkh = dst_h;
+   struct pipe *src = (void *)skh->kobj;
+   struct pipe *dst = (void *)dkh->kobj;
+   struct pipe *first = src < dst ? src : dst;
+   struct pipe *second = src < dst ? dst : src;
+   ssize_t rc;
+
+   ASSERT(is_pipe_read_end(src_h));
+   ASSERT(is_pipe_write_end(dst_h));
+
+   if (src == dst)
+      return -EINVAL;
+
+   if (!len)
+      return 0;
 
    while (true) {
 
-      if (atomic_load_explicit(&p->read_handles, mo_relaxed) == 0) {
+      /*
+       * Wait for data in `src` and space in `dst`, holding one lock at a time.
+       * Then, lock both the pipes, always in the same order to avoid
+       * deadlocks, and move the data. If, in the meanwhile, the conditions
+       * changed, nothing is moved and we start over.
+       */
 
-         /* Broken pipe */
-         send_signal(get_curr_pid(), SIGPIPE, true);
-         rc = -EPIPE;
-         break;
+      kmutex_lock(&src->mutex);
+      {
+         rc = pipe_wait_for_data(skh, src, nonblock);
       }
-
-      rc = (ssize_t)ringbuf_write_bytes(&p->rb, (u8 *)buf, size);
+      kmutex_unlock(&src->mutex);
 
       if (rc)
-         break; /* Everything is alright, we wrote something */
+         return rc > 0 ? 0 : rc;
 
-      if (kh->fl_flags & O_NONBLOCK) {
-         rc = -EAGAIN;
-         break;
+      kmutex_lock(&dst->mutex);
+      {
+         rc = pipe_wait_for_space(dkh, dst, 1, nonblock);
       }
+      kmutex_unlock(&dst->mutex);
 
-      /* Wait for readers to empty the buffer */
-      kcond_wait(&p->not_full_cond, &p->mutex, KCOND_WAIT_FOREVER);
+      if (rc)
+         return rc;
 
-      /* After wake up */
-      if (pending_signals()) {
-         sig_pending = true;
-         break;
+      kmutex_lock(&first->mutex);
+      kmutex_lock(&second->mutex);
+      {
+         rc = pipe_move_data(src, dst, len, consume);
+
+         if (rc > 0) {
+
+            pipe_wake_up_after_write(dst);
+
+            if (consume)
+               pipe_wake_up_after_read(src);
+         }
       }
+      kmutex_unlock(&second->mutex);
+      kmutex_unlock(&first->mutex);
+
+      if (rc)
+         return rc;
    }
+}
 
-   /*
-    * Wake up one blocked reader, instead of all of them.
-    * See the comments in pipe_read() above.
-    */
-   kcond_signal_one(&p->not_empty_cond);
+static ssize_t pipe_read(fs_handle h, char *buf, size_t size)
+{
+   struct iovec iov = { buf, size };
+   struct io_iter it;
 
-   if (!ringbuf_is_full(&p->rb)) {
-      /* The buffer is not full: wake up one more writer, if any */
-      kcond_signal_one(&p->not_full_cond);
-   }
+   io_iter_init(&it, &iov, 1, false);
+   return pipe_read_iter(h, &it);
+}
 
-   /* Unlock the pipe's state lock and return */
-   kmutex_unlock(&p->mutex);
-   return !sig_pending ? rc : -EINTR;
+static ssize_t pipe_write(fs_handle h, char *buf, size_t size)
+{
+   struct iovec iov = { buf, size };
+   struct io_iter it;
+
+   io_iter_init(&it, &iov, 1, false);
+   return pipe_write_iter(h, &it);
 }
 
 static int pipe_read_ready(fs_handle h)
@@ -220,6 +557,7 @@ static struct kcond *pipe_get_except_cond(fs_handle h)
 static const struct file_ops static_ops_pipe_read_end =
 {
    .read = pipe_read,
+   .read_iter = pipe_read_iter,
    .read_ready = pipe_read_ready,
    .except_ready = pipe_except_ready,
    .get_rready_cond = pipe_get_rready_cond,
@@ -229,12 +567,25 @@ static const struct file_ops static_ops_pipe_read_end =
 static const struct file_ops static_ops_pipe_write_end =
 {
    .write = pipe_write,
+   .write_iter = pipe_write_iter,
    .except_ready = pipe_except_ready,
    .write_ready = pipe_write_ready,
    .get_wready_cond = pipe_get_wready_cond,
    .get_except_cond = pipe_get_except_cond,
 };
 
+bool is_pipe_read_end(fs_handle h)
+{
+   struct fs_handle_base *hb = h;
+   return hb->fops == &static_ops_pipe_read_end;
+}
+
+bool is_pipe_write_end(fs_handle h)
+{
+   struct fs_handle_base *hb = h;
+   return hb->fops == &static_ops_pipe_write_end;
+}
+
 void destroy_pipe(struct pipe *p)
 {
    kcond_destory(&p->err_cond);
@@ -9,6 +9,8 @@
 #include <tilck/kernel/paging.h>
 #include <tilck/kernel/fs/vfs.h>
 #include <tilck/kernel/timer.h>
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/process.h>
 
 static int
 poll_count_conds(struct pollfd *fds, nfds_t nfds)
@@ -231,16 +233,15 @@ poll_wait_on_cond(struct pollfd *fds, nfds_t nfds, int timeout, int cond_cnt)
    return ready_fds_cnt;
 }
 
-int sys_poll(struct pollfd *user_fds, nfds_t nfds, int timeout)
+static int
+sys_poll_int(struct pollfd *user_fds,
+             struct pollfd *fds,
+             nfds_t nfds,
+             int timeout)
 {
-   struct task *curr = get_curr_task();
-   struct pollfd *fds = curr->args_copybuf;
    int rc, ready_fds_cnt;
    int cond_cnt = 0;
 
-   if (sizeof(struct pollfd) * nfds > ARGS_COPYBUF_SIZE)
-      return -EINVAL;
-
    if (copy_from_user(fds, user_fds, sizeof(struct pollfd) * nfds))
       return -EFAULT;
 
@@ -280,3 +281,24 @@ end:
 
    return ready_fds_cnt;
 }
+
+int sys_poll(struct pollfd *user_fds, nfds_t nfds, int timeout)
+{
+   const size_t size = sizeof(struct pollfd) * nfds;
+   struct pollfd *fds = get_curr_task()->args_copybuf;
+   int rc;
+
+   if (nfds > get_curr_proc()->nofile_limit)
+      return -EINVAL;
+
+   /* The big sets don't fit in args_copybuf: use a temporary buffer */
+   if (size > ARGS_COPYBUF_SIZE && !(fds = kmalloc(size)))
+      return -ENOMEM;
+
+   rc = sys_poll_int(user_fds, fds, nfds, timeout);
+
+   if (size > ARGS_COPYBUF_SIZE)
+      kfree2(fds, size);
+
+   return rc;
+}
@@ -135,9 +135,7 @@ void process_free_mappings_info(struct process *pi)
    struct mappings_info *mi = pi->mi;
 
    if (mi && !pi->vforked) {
-      ASSERT(mi->mmap_heap);
-      kmalloc_destroy_heap(mi->mmap_heap);
-      kfree2(mi->mmap_heap, kmalloc_get_heap_struct_size());
+      user_vmem_destroy(&mi->vmem);
       kfree_obj(mi, struct mappings_info);
       pi->mi = NULL;
    }
@@ -212,6 +210,7 @@ allocate_new_process(struct task *parent, int pid, pdir_t *new_pdir)
 
    memcpy(ti, parent, sizeof(struct task));
    memcpy(pi, parent_pi, sizeof(struct process));
+   fdt_init(&pi->fdt); /* don't share parent's table, see fdt_dup() below */
 
    if (MOD_debugpanel) {
 
@@ -234,6 +233,10 @@ allocate_new_process(struct task *parent, int pid, pdir_t *new_pdir)
    pi->cwd.fs = NULL;
    pi->vforked = false;
 
+   /* The handles will be duplicated by fork(), but the table is ours */
+   if (UNLIKELY(fdt_dup(&pi->fdt, &parent_pi->fdt)))
+      goto oom_case;
+
    if (new_pdir != parent_pi->pdir) {
 
       if (parent_pi->mi) {
@@ -244,6 +247,9 @@ allocate_new_process(struct task *parent, int pid, pdir_t *new_pdir)
       if (pi->elf)
          retain_subsys_flock(pi->elf);
 
+      if (pi->elf_interp)
+         retain_subsys_flock(pi->elf_interp);
+
    } else {
       pi->vforked = true;
    }
@@ -264,8 +270,12 @@ allocate_new_process(struct task *parent, int pid, pdir_t *new_pdir)
     */
    drop_all_pending_signals(ti);
 
-   /* Reset sched ticks in the new process */
+   /* Reset sched ticks and the resource usage counters in the new process */
    bzero(&ti->ticks, sizeof(ti->ticks));
+   bzero(&pi->children_ru, sizeof(pi->children_ru));
+   ti->min_faults = 0;
+   ti->maj_faults = 0;
+   pi->peak_rss = 0;
 
    /* Copy parent's `cwd` while retaining the `fs` and the inode obj */
    process_set_cwd2_nolock_raw(pi, &parent_pi->cwd);
@@ -300,6 +310,7 @@ oom_case:
       }
 
       process_free_mappings_info(ti->pi);
+      fdt_destroy(&pi->fdt);
 
       if (MOD_debugpanel && pi->debug_cmdline)
          kfree2(pi->debug_cmdline, PROCESS_CMDLINE_BUF_SIZE);
@@ -353,6 +364,7 @@ static void free_process_int(struct process *pi)
    if (release_obj(pi) == 0) {
 
       arch_specific_free_proc(pi);
+      fdt_destroy(&pi->fdt);
       kfree2(get_process_task(pi), TOT_PROC_AND_TASK_SIZE);
 
       if (MOD_debugpanel)
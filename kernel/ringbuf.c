@@ -12,6 +12,7 @@ extern inline bool ringbuf_read_elem1(struct ringbuf *rb, u8 *elem_ptr);
 extern inline bool ringbuf_is_empty(struct ringbuf *rb);
 extern inline bool ringbuf_is_full(struct ringbuf *rb);
 extern inline size_t ringbuf_get_elems(struct ringbuf *rb);
+extern inline size_t ringbuf_get_free_elems(struct ringbuf *rb);
 
 void
 ringbuf_init(struct ringbuf *rb, size_t max_elems, size_t elem_size, void *buf)
@@ -180,6 +181,64 @@ size_t ringbuf_read_bytes(struct ringbuf *rb, u8 *buf, size_t len)
    return actual_len + actual_len2;
 }
 
+u8 *ringbuf_get_read_chunk(struct ringbuf *rb, size_t *len)
+{
+   return ringbuf_peek_chunk(rb, 0, len);
+}
+
+/* Like ringbuf_get_read_chunk(), but skipping the first `off` bytes */
+u8 *ringbuf_peek_chunk(struct ringbuf *rb, size_t off, size_t *len)
+{
+   u32 pos;
+   ASSERT(rb->elem_size == 1);
+
+   if (off >= rb->elems) {
+      *len = 0;
+      return NULL;
+   }
+
+   /* The data might wrap around: return only the contiguous part */
+   pos = (rb->read_pos + (u32)off) % rb->max_elems;
+   *len = MIN(rb->elems - off, rb->max_elems - pos);
+   return rb->buf + pos;
+}
+
+u8 *ringbuf_get_write_chunk(struct ringbuf *rb, size_t *len)
+{
+   ASSERT(rb->elem_size == 1);
+
+   if (ringbuf_is_full(rb)) {
+      *len = 0;
+      return NULL;
+   }
+
+   /* See the comments in ringbuf_write_bytes() for the cases */
+   if (rb->write_pos < rb->read_pos)
+      *len = rb->read_pos - rb->write_pos;
+   else
+      *len = rb->max_elems - rb->write_pos;
+
+   return rb->buf + rb->write_pos;
+}
+
+void ringbuf_consume_bytes(struct ringbuf *rb, size_t len)
+{
+   ASSERT(rb->elem_size == 1);
+   ASSERT(len <= rb->elems);
+
+   rb->read_pos = (rb->read_pos + (u32)len) % rb->max_elems;
+   rb->elems -= (u32)len;
+}
+
+void ringbuf_commit_bytes(struct ringbuf *rb, size_t len)
+{
+   ASSERT(rb->elem_size == 1);
+   ASSERT(len <= rb->max_elems - rb->elems);
+
+   rb->write_pos = (rb->write_pos + (u32)len) % rb->max_elems;
+   rb->elems += (u32)len;
+}
+
 bool ringbuf_read_elem(struct ringbuf *rb, void *elem_ptr /* out */)
 {
    if (ringbuf_is_empty(rb))
@@ -0,0 +1,164 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/user.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/syscalls.h>
+
+#include <sys/resource.h>      // system header
+
+/*
+ * Resource limits. At the moment, the only limit enforced by Tilck is
+ * RLIMIT_NOFILE: all the others are always reported as RLIM_INFINITY, while
+ * setting them is accepted and ignored, because programs like shells commonly
+ * lower limits like RLIMIT_CORE and don't expect that to fail.
+ */
+
+#define K_RLIM64_INFINITY            (~0ULL)
+
+static void
+get_rlimit(struct process *pi, int resource, struct k_rlimit64 *rlim)
+{
+   switch (resource) {
+
+      case RLIMIT_NOFILE:
+         rlim->rlim_cur = pi->nofile_limit;
+         rlim->rlim_max = pi->nofile_hard_limit;
+         break;
+
+      default:
+         rlim->rlim_cur = K_RLIM64_INFINITY;
+         rlim->rlim_max = K_RLIM64_INFINITY;
+   }
+}
+
+static int
+set_rlimit(struct process *pi, int resource, struct k_rlimit64 *rlim)
+{
+   if (rlim->rlim_cur > rlim->rlim_max)
+      return -EINVAL;
+
+   switch (resource) {
+
+      case RLIMIT_NOFILE:
+
+         /*
+          * All the processes on Tilck are privileged: they can raise their
+          * hard limit as well, up to the limit of the system (like Linux's
+          * /proc/sys/fs/nr_open).
+          */
+         if (rlim->rlim_max > NOFILE_HARD_LIMIT)
+            return -EPERM;
+
+         pi->nofile_limit = (u32)rlim->rlim_cur;
+         pi->nofile_hard_limit = (u32)rlim->rlim_max;
+         return 0;
+
+      default:
+         /* Not enforced: accept any value (e.g. RLIMIT_CORE = 0) as a no-op */
+         return 0;
+   }
+}
+
+static int
+do_prlimit(int pid,
+           int resource,
+           struct k_rlimit64 *new_rlim,
+           struct k_rlimit64 *old_rlim)
+{
+   struct process *pi;
+   int rc = 0;
+
+   if (resource < 0 || resource >= RLIM_NLIMITS)
+      return -EINVAL;
+
+   disable_preemption();
+   {
+      pi = pid ? get_process(pid) : get_curr_proc();
+
+      if (!pi) {
+         enable_preemption();
+         return -ESRCH;
+      }
+
+      if (old_rlim)
+         get_rlimit(pi, resource, old_rlim);
+
+      if (new_rlim)
+         rc = set_rlimit(pi, resource, new_rlim);
+   }
+   enable_preemption();
+   return rc;
+}
+
+static inline u64 rlim_to_rlim64(ulong val)
+{
+   return val == ~0UL ? K_RLIM64_INFINITY : val;
+}
+
+static inline ulong rlim64_to_rlim(u64 val)
+{
+   return val >= ~0UL ? ~0UL : (ulong)val;
+}
+
+int sys_getrlimit(int resource, struct k_rlimit *u_rlim)
+{
+   struct k_rlimit64 rlim64;
+   struct k_rlimit rlim;
+   int rc;
+
+   if ((rc = do_prlimit(0, resource, NULL, &rlim64)))
+      return rc;
+
+   rlim.rlim_cur = rlim64_to_rlim(rlim64.rlim_cur);
+   rlim.rlim_max = rlim64_to_rlim(rlim64.rlim_max);
+
+   if (copy_to_user(u_rlim, &rlim, sizeof(rlim)))
+      return -EFAULT;
+
+   return 0;
+}
+
+int sys_setrlimit(int resource, const struct k_rlimit *u_rlim)
+{
+   struct k_rlimit64 rlim64;
+   struct k_rlimit rlim;
+
+   if (copy_from_user(&rlim, u_rlim, sizeof(rlim)))
+      return -EFAULT;
+
+   rlim64.rlim_cur = rlim_to_rlim64(rlim.rlim_cur);
+   rlim64.rlim_max = rlim_to_rlim64(rlim.rlim_max);
+   return do_prlimit(0, resource, &rlim64, NULL);
+}
+
+int sys_prlimit64(int pid,
+                  int resource,
+                  const struct k_rlimit64 *u_new_rlim,
+                  struct k_rlimit64 *u_old_rlim)
+{
+   struct k_rlimit64 new_rlim, old_rlim;
+   int rc;
+
+   if (pid < 0)
+      return -EINVAL;
+
+   if (u_new_rlim && copy_from_user(&new_rlim, u_new_rlim, sizeof(new_rlim)))
+      return -EFAULT;
+
+   rc = do_prlimit(pid,
+                   resource,
+                   u_new_rlim ? &new_rlim : NULL,
+                   u_old_rlim ? &old_rlim : NULL);
+
+   if (rc)
+      return rc;
+
+   if (u_old_rlim && copy_to_user(u_old_rlim, &old_rlim, sizeof(old_rlim)))
+      return -EFAULT;
+
+   return 0;
+}
@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/string_util.h>
+
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/sched.h>
+#include <tilck/kernel/paging.h>
+#include <tilck/kernel/user.h>
+#include <tilck/kernel/datetime.h>
+#include <tilck/kernel/errno.h>
+#include <tilck/kernel/syscalls.h>
+
+#include <sys/resource.h>      // system header
+
+#ifndef RUSAGE_THREAD
+   #define RUSAGE_THREAD 1        /* glibc defines it only with _GNU_SOURCE */
+#endif
+
+/*
+ * Save the peak RSS of the current image of the process, before destroying its
+ * pdir (exit or execve).
+ */
+void process_save_peak_rss(struct process *pi)
+{
+   struct pdir_mm_stats stats;
+
+   if (pi->vforked)
+      return; /* the pdir belongs to our parent */
+
+   pdir_get_mm_stats(pi->pdir, &stats);
+   pi->peak_rss = MAX(pi->peak_rss, stats.peak_rss);
+}
+
+/* Resources used by the task itself, NOT including its children */
+void get_task_rusage(struct task *ti, struct proc_rusage *ru)
+{
+   struct process *pi = ti->pi;
+   struct pdir_mm_stats stats = {0};
+
+   /* After exit, a zombie's pdir has been destroyed */
+   if (ti->state != TASK_STATE_ZOMBIE && !pi->vforked)
+      pdir_get_mm_stats(pi->pdir, &stats);
+
+   *ru = (struct proc_rusage) {
+      .user_ticks = ti->ticks.total - ti->ticks.total_kernel,
+      .kernel_ticks = ti->ticks.total_kernel,
+      .min_faults = ti->min_faults,
+      .maj_faults = ti->maj_faults,
+      .peak_rss = MAX(pi->peak_rss, stats.peak_rss),
+   };
+}
+
+/* Resources used by the task, including the children it has waited for */
+void get_task_rusage_total(struct task *ti, struct proc_rusage *ru)
+{
+   struct proc_rusage *c = &ti->pi->children_ru;
+
+   get_task_rusage(ti, ru);
+   ru->user_ticks += c->user_ticks;
+   ru->kernel_ticks += c->kernel_ticks;
+   ru->min_faults += c->min_faults;
+   ru->maj_faults += c->maj_faults;
+   ru->peak_rss = MAX(ru->peak_rss, c->peak_rss);
+}
+
+/* Called by wait4() when reaping the `child` zombie task */
+void account_reaped_child(struct process *pi, struct task *child)
+{
+   struct proc_rusage *c = &pi->children_ru;
+   struct proc_rusage ru;
+
+   ASSERT(child->state == TASK_STATE_ZOMBIE);
+   get_task_rusage_total(child, &ru);
+
+   c->user_ticks += ru.user_ticks;
+   c->kernel_ticks += ru.kernel_ticks;
+   c->min_faults += ru.min_faults;
+   c->maj_faults += ru.maj_faults;
+
+   /* As on Linux, ru_maxrss is the max among the children, not their sum */
+   c->peak_rss = MAX(c->peak_rss, ru.peak_rss);
+}
+
+void proc_rusage_to_k_rusage(struct proc_rusage *ru, struct k_rusage *kru)
+{
+   struct k_timespec64 tp;
+
+   bzero(kru, sizeof(*kru));
+
+   ticks_to_timespec(ru->user_ticks, &tp);
+   kru->ru_utime.tv_sec = (long) tp.tv_sec;
+   kru->ru_utime.tv_usec = tp.tv_nsec / 1000;
+
+   ticks_to_timespec(ru->kernel_ticks, &tp);
+   kru->ru_stime.tv_sec = (long) tp.tv_sec;
+   kru->ru_stime.tv_usec = tp.tv_nsec / 1000;
+
+   kru->ru_maxrss = (long)((ru->peak_rss << PAGE_SHIFT) / KB);
+   kru->ru_minflt = (long)ru->min_faults;
+   kru->ru_majflt = (long)ru->maj_faults;
+}
+
+int sys_getrusage(int who, struct k_rusage *user_usage)
+{
+   struct task *curr = get_curr_task();
+   struct proc_rusage ru;
+   struct k_rusage kru;
+
+   disable_preemption();
+   {
+      switch (who) {
+
+         case RUSAGE_SELF:
+         case RUSAGE_THREAD:  /* NOTE: no multi-threading support */
+            get_task_rusage(curr, &ru);
+            break;
+
+         case RUSAGE_CHILDREN:
+            ru = curr->pi->children_ru;
+            break;
+
+         default:
+            enable_preemption();
+            return -EINVAL;
+      }
+   }
+   enable_preemption();
+
+   proc_rusage_to_k_rusage(&ru, &kru);
+
+   if (copy_to_user(user_usage, &kru, sizeof(kru)) < 0)
+      return -EFAULT;
+
+   return 0;
+}
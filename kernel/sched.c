@@ -401,6 +401,9 @@ static void create_kernel_process(void)
    s_kernel_ti->pi = s_kernel_pi;
    init_task_lists(s_kernel_ti);
    init_process_lists(s_kernel_pi);
+   fdt_init(&s_kernel_pi->fdt);
+   s_kernel_pi->nofile_limit = NOFILE_LIMIT;
+   s_kernel_pi->nofile_hard_limit = NOFILE_HARD_LIMIT;
 
    s_kernel_ti->is_main_thread = true;
    s_kernel_ti->running_in_kernel = true;
@@ -324,7 +324,7 @@ int sys_select(int user_nfds,
 
    int rc;
 
-   if (user_nfds < 0 || user_nfds > MAX_HANDLES)
+   if (user_nfds < 0 || user_nfds > FD_SETSIZE)
       return -EINVAL;
 
    if ((rc = select_read_user_sets(ctx.sets, ctx.u_sets)))
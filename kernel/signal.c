@@ -740,6 +740,46 @@ sys_rt_sigpending(sigset_t *u_set, size_t sigsetsize)
    return 0;
 }
 
+/*
+ * Save the signal mask of the current task in `sa_old_mask` and replace it with
+ * the one in `u_mask`. The old mask can be restored either directly or, after
+ * running a signal handler, by raising the `in_sigsuspend` flag.
+ */
+int set_temp_sigmask(const sigset_t *u_mask, size_t sigsetsize)
+{
+   struct task *curr = get_curr_task();
+
+   if (sigsetsize < sizeof(curr->sa_mask))
+      return -EINVAL;
+
+   /* Save the current signal mask */
+   memcpy(curr->sa_old_mask, curr->sa_mask, sizeof(curr->sa_old_mask));
+
+   /* Now try to set the new mask */
+   if (copy_from_user(curr->sa_mask, u_mask, sizeof(curr->sa_mask))) {
+
+      /* Oops, u_mask pointed to invalid memory in userspace */
+      /* Restore the saved mask */
+      restore_temp_sigmask();
+      return -EFAULT;
+   }
+
+   /*
+    * OK, now the signal mask has been updated, but we cannot still fully trust
+    * user code and allow it to mask SIGKILL and SIGSTOP.
+    */
+
+   __del_sig(curr->sa_mask, SIGKILL);
+   __del_sig(curr->sa_mask, SIGSTOP);
+   return 0;
+}
+
+void restore_temp_sigmask(void)
+{
+   struct task *curr = get_curr_task();
+   memcpy(curr->sa_mask, curr->sa_old_mask, sizeof(curr->sa_old_mask));
+}
+
 int sys_rt_sigsuspend(sigset_t *u_mask, size_t sigsetsize)
 {
    ASSERT(!is_preemption_enabled()); /* Thanks to SYSFL_NO_PREEMPT */
@@ -765,22 +805,9 @@ int sys_rt_sigsuspend(sigset_t *u_mask, size_t sigsetsize)
     */
    ASSERT(!curr->in_sigsuspend);
 
-   if (sigsetsize < sizeof(curr->sa_mask))
-      return -EINVAL;
-
-   /* OK, we're not in a signal handler. Now, save the current signal mask. */
-   memcpy(curr->sa_old_mask, curr->sa_mask, sizeof(curr->sa_old_mask));
-
-   /* Now try to set the new mask */
-   rc = copy_from_user(curr->sa_mask, u_mask, sizeof(curr->sa_mask));
-
-   if (rc) {
-
-      /* Oops, u_mask pointed to invalid memory in userspace */
-      /* Restore the saved mask */
-      memcpy(curr->sa_mask, curr->sa_old_mask, sizeof(curr->sa_old_mask));
-      return -EFAULT;
-   }
+   /* OK, we're not in a signal handler. Now, set the temporary mask. */
+   if ((rc = set_temp_sigmask(u_mask, sigsetsize)))
+      return rc;
 
    /*
     * We must raise the `in_sigsuspend` flag, otherwise the old mask won't be
@@ -788,14 +815,6 @@ int sys_rt_sigsuspend(sigset_t *u_mask, size_t sigsetsize)
     */
    curr->in_sigsuspend = true;
 
-   /*
-    * OK, now the signal mask has been updated, but we cannot still fully trust
-    * user code and allow it to mask SIGKILL and SIGSTOP.
-    */
-
-   __del_sig(curr->sa_mask, SIGKILL);
-   __del_sig(curr->sa_mask, SIGSTOP);
-
    /*
     * OK, now go to sleep, behaving like sys_pause(). sys_rt_sigreturn() will
     * restore the old mask.
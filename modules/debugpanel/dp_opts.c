@@ -98,6 +98,8 @@ static void dp_show_opts(void)
    DUMP_BOOL_OPT(KERNEL_GCOV);
    DUMP_BOOL_OPT(FORK_NO_COW);
    DUMP_BOOL_OPT(MMAP_NO_COW);
+   DUMP_BOOL_OPT(MM_ZSWAP);
+   DUMP_BOOL_OPT(MM_KSM);
    DUMP_BOOL_OPT(PANIC_SHOW_REGS);
    DUMP_BOOL_OPT(KMALLOC_HEAVY_STATS);
    DUMP_BOOL_OPT(KMALLOC_FREE_MEM_POISONING);
@@ -15,7 +15,7 @@
 #include <tilck/mods/tracing.h>
 
 #include "termutil.h"
-#define MAX_EXEC_PATH_LEN     34
+#define MAX_EXEC_PATH_LEN     16
 
 void init_dp_tracing(void);
 
@@ -90,7 +90,8 @@ debug_get_task_dump_util_str(enum task_dump_util_str t)
    static char fmt[120];
    static char hfmt[120];
    static char header[120];
-   static char hline_sep[120] = "qqqqqqqnqqqqqqnqqqqqqnqqqqqqnqqqqqnqqqqqn";
+   static char hline_sep[120] =
+      "qqqqqqqnqqqqqqnqqqqqqnqqqqqqnqqqqqnqqqqqnqqqqqqqqnqqqqqqqqn";
 
    static char *hline_sep_end = &hline_sep[sizeof(hline_sep)];
 
@@ -105,6 +106,8 @@ debug_get_task_dump_util_str(enum task_dump_util_str t)
                TERM_VLINE " %%-4d "
                TERM_VLINE " %%-3s "
                TERM_VLINE "  %%-2d "
+               TERM_VLINE " %%-6lu "
+               TERM_VLINE " %%-6lu "
                TERM_VLINE " %%-%ds",
                dp_start_col+1, path_field_len);
 
@@ -115,6 +118,8 @@ debug_get_task_dump_util_str(enum task_dump_util_str t)
                TERM_VLINE " %%-4s "
                TERM_VLINE " %%-3s "
                TERM_VLINE " %%-3s "
+               TERM_VLINE " %%-6s "
+               TERM_VLINE " %%-6s "
                TERM_VLINE " %%-%ds",
                path_field_len);
 
@@ -127,6 +132,8 @@ debug_get_task_dump_util_str(enum task_dump_util_str t)
                "ppid",
                "S",
                "tty",
+               "rss_kb",
+               "minflt",
                "cmdline");
 
       char *p = hline_sep + strlen(hline_sep);
@@ -179,6 +186,17 @@ static int debug_per_task_cb(void *obj, void *arg)
 
    debug_get_state_name(state_str, ti->state, ti->stopped, ti->traced);
    int ttynum = tty_get_num(ti->pi->proc_tty);
+   ulong rss_kb = 0;
+
+   if (!is_kernel_thread(ti) && ti->state != TASK_STATE_ZOMBIE) {
+
+      struct pdir_mm_stats stats;
+
+      if (!pi->vforked) {
+         pdir_get_mm_stats(pi->pdir, &stats);
+         rss_kb = (stats.rss << PAGE_SHIFT) / KB;
+      }
+   }
 
    if (is_kernel_thread(ti)) {
 
@@ -229,6 +247,8 @@ static int debug_per_task_cb(void *obj, void *arg)
                  pi->parent_pid,
                  state_str,
                  ttynum,
+                 rss_kb,
+                 ti->min_faults,
                  buf);
 
       if (sel)
@@ -243,6 +263,8 @@ static int debug_per_task_cb(void *obj, void *arg)
                    pi->parent_pid,
                    state_str,
                    ttynum,
+                   rss_kb,
+                   ti->min_faults,
                    buf);
 
       dp_write_raw("\r\n");
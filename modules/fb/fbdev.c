@@ -55,6 +55,26 @@ static ssize_t fb_write(fs_handle h, char *user_buf, size_t size)
    return actual_size;
 }
 
+static ssize_t fb_pread_iter(fs_handle h, struct io_iter *it, offt pos)
+{
+   if (pos >= (offt)fb_size)
+      return 0;
+
+   return io_iter_copy_to(it,
+                          (char *)fb_vaddr + pos,
+                          MIN((size_t)fb_size - (size_t)pos, it->count));
+}
+
+static ssize_t fb_pwrite_iter(fs_handle h, struct io_iter *it, offt pos)
+{
+   if (pos >= (offt)fb_size)
+      return -ENOSPC;
+
+   return io_iter_copy_from(it,
+                            (char *)fb_vaddr + pos,
+                            MIN((size_t)fb_size - (size_t)pos, it->count));
+}
+
 static offt fb_seek(fs_handle h, offt off, int whence)
 {
    struct devfs_handle *dh = h;
@@ -186,6 +206,8 @@ create_fb_device(int minor,
    static const struct file_ops static_ops_fb = {
       .read = fb_read,
       .write = fb_write,
+      .pread_iter = fb_pread_iter,
+      .pwrite_iter = fb_pwrite_iter,
       .seek = fb_seek,
       .ioctl = fb_ioctl,
       .mmap = fbdev_mmap,
@@ -46,6 +46,8 @@ DEF_STATIC_CONF_RO(BOOL,  big_io_buf,              KERNEL_BIG_IO_BUF);
 DEF_STATIC_CONF_RO(BOOL,  gcov,                    KERNEL_GCOV);
 DEF_STATIC_CONF_RO(BOOL,  fork_no_cow,             FORK_NO_COW);
 DEF_STATIC_CONF_RO(BOOL,  mmap_no_cow,             MMAP_NO_COW);
+DEF_STATIC_CONF_RO(BOOL,  zswap,                   MM_ZSWAP);
+DEF_STATIC_CONF_RO(BOOL,  ksm,                     MM_KSM);
 DEF_STATIC_CONF_RO(BOOL,  ubsan,                   KERNEL_UBSAN);
 
 /* config/console */
@@ -107,6 +109,8 @@ void sysfs_create_config_obj(void)
       SYSOBJ_CONF_PROP_PAIR(gcov),
       SYSOBJ_CONF_PROP_PAIR(fork_no_cow),
       SYSOBJ_CONF_PROP_PAIR(mmap_no_cow),
+      SYSOBJ_CONF_PROP_PAIR(zswap),
+      SYSOBJ_CONF_PROP_PAIR(ksm),
       SYSOBJ_CONF_PROP_PAIR(ubsan),
       NULL
    );
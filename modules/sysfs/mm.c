@@ -0,0 +1,227 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck_gen_headers/config_mm.h>
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/kmalloc.h>
+#include <tilck/kernel/process.h>
+#include <tilck/kernel/zswap.h>
+#include <tilck/kernel/ksm.h>
+#include <tilck/kernel/fs/crd.h>
+
+#include <tilck/mods/sysfs.h>
+#include <tilck/mods/sysfs_utils.h>
+
+static offt
+mm_heap_free_kb_load(struct sysobj *obj,
+                     void *data, void *buf, offt buf_sz, offt off)
+{
+   ASSERT(off == 0);
+   return snprintk(buf, (size_t)buf_sz, "%lu\n",
+                   (ulong)(kmalloc_get_tot_heap_free() / KB));
+}
+
+static const struct sysobj_prop_type mm_ptype_heap_free_kb = {
+   .load = &mm_heap_free_kb_load
+};
+
+struct rusage_table_ctx {
+   char *buf;
+   offt buf_sz;
+   offt written;
+};
+
+static int mm_rusage_per_task_cb(void *obj, void *arg)
+{
+   struct rusage_table_ctx *ctx = arg;
+   struct task *ti = obj;
+   struct pdir_mm_stats stats = {0};
+   struct proc_rusage ru;
+
+   if (is_kernel_thread(ti) || !is_main_thread(ti))
+      return 0;
+
+   if (ti->state != TASK_STATE_ZOMBIE && !ti->pi->vforked)
+      pdir_get_mm_stats(ti->pi->pdir, &stats);
+
+   get_task_rusage(ti, &ru);
+
+   ctx->written += snprintk(ctx->buf + ctx->written,
+                            (size_t)(ctx->buf_sz - ctx->written),
+                            "%-5d %9lu %9lu %9lu %9lu\n",
+                            ti->tid,
+                            (stats.rss << PAGE_SHIFT) / KB,
+                            (ru.peak_rss << PAGE_SHIFT) / KB,
+                            ru.min_faults,
+                            ru.maj_faults);
+
+   if (ctx->written >= ctx->buf_sz - 1)
+      return -1; /* the buffer is full: stop */
+
+   return 0;
+}
+
+static offt
+mm_rusage_load(struct sysobj *obj, void *data, void *buf, offt buf_sz, offt off)
+{
+   struct rusage_table_ctx ctx = { .buf = buf, .buf_sz = buf_sz };
+   ASSERT(off == 0);
+
+   ctx.written = snprintk(buf, (size_t)buf_sz, "%-5s %9s %9s %9s %9s\n",
+                          "pid", "rss_kb", "peak_kb", "min_flt", "maj_flt");
+
+   iterate_over_tasks(&mm_rusage_per_task_cb, &ctx);
+   return MIN(ctx.written, buf_sz - 1);
+}
+
+static offt
+mm_rusage_get_buf_sz(struct sysobj *obj, void *data)
+{
+   return PAGE_SIZE;
+}
+
+static const struct sysobj_prop_type mm_ptype_rusage = {
+   .get_buf_sz = &mm_rusage_get_buf_sz,
+   .load = &mm_rusage_load,
+};
+
+/* mm */
+DEF_STATIC_SYSOBJ_PROP(heap_free_kb, &mm_ptype_heap_free_kb);
+DEF_STATIC_SYSOBJ_PROP(rusage, &mm_ptype_rusage);
+
+/* mm/zswap */
+DEF_STATIC_SYSOBJ_PROP(stored_pages, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(zero_pages, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(compr_bytes, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(pool_pages, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(compr_ratio, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(swap_outs, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(swap_ins, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(rejected, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(min_free_kb, &sysobj_ptype_rw_ulong);
+
+/* mm/ksm */
+DEF_STATIC_SYSOBJ_PROP(pages_shared, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(pages_sharing, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(saved_kb, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(zero_merged, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(full_scans, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(pages_to_scan, &sysobj_ptype_rw_ulong);
+DEF_STATIC_SYSOBJ_PROP(sleep_ms, &sysobj_ptype_rw_ulong);
+
+/* mm/crd */
+DEF_STATIC_SYSOBJ_PROP(size_kb, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(compr_kb, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(chunks, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(cached_chunks, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(faults, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(evictions, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(max_cache_kb, &sysobj_ptype_rw_ulong);
+
+static struct sysobj *sysfs_create_zswap_obj(void)
+{
+   struct zswap_stats *s = &zswap_stats;
+
+   return sysfs_create_custom_obj(
+      "zswap",
+      NULL,       /* hooks */
+      &prop_stored_pages, &s->stored_pages,
+      &prop_zero_pages, &s->zero_pages,
+      &prop_compr_bytes, &s->compr_bytes,
+      &prop_pool_pages, &s->pool_pages,
+      &prop_compr_ratio, &s->compr_ratio,
+      &prop_swap_outs, &s->swap_outs,
+      &prop_swap_ins, &s->swap_ins,
+      &prop_rejected, &s->rejected,
+      &prop_min_free_kb, &zswap_min_free_kb,
+      NULL
+   );
+}
+
+static struct sysobj *sysfs_create_ksm_obj(void)
+{
+   struct ksm_stats *s = &ksm_stats;
+
+   return sysfs_create_custom_obj(
+      "ksm",
+      NULL,       /* hooks */
+      &prop_pages_shared, &s->pages_shared,
+      &prop_pages_sharing, &s->pages_sharing,
+      &prop_saved_kb, &s->saved_kb,
+      &prop_zero_merged, &s->zero_merged,
+      &prop_full_scans, &s->full_scans,
+      &prop_pages_to_scan, &ksm_pages_to_scan,
+      &prop_sleep_ms, &ksm_sleep_ms,
+      NULL
+   );
+}
+
+static struct sysobj *sysfs_create_crd_obj(void)
+{
+   struct crd_stats *s = &crd_stats;
+
+   return sysfs_create_custom_obj(
+      "crd",
+      NULL,       /* hooks */
+      &prop_size_kb, &s->size_kb,
+      &prop_compr_kb, &s->compr_kb,
+      &prop_chunks, &s->chunks,
+      &prop_cached_chunks, &s->cached_chunks,
+      &prop_faults, &s->faults,
+      &prop_evictions, &s->evictions,
+      &prop_min_free_kb, &crd_min_free_kb,
+      &prop_max_cache_kb, &crd_max_cache_kb,
+      NULL
+   );
+}
+
+void sysfs_create_mm_obj(void)
+{
+   struct sysobj *mm, *zswap, *ksm, *crd;
+
+   mm = sysfs_create_custom_obj(
+      "mm",
+      NULL,       /* hooks */
+      &prop_heap_free_kb, NULL,
+      &prop_rusage, NULL,
+      NULL
+   );
+
+   if (!mm)
+      goto fail;
+
+   if (sysfs_register_obj(NULL, &sysfs_root_obj, "mm", mm))
+      goto fail;
+
+   if (MM_ZSWAP) {
+
+      if (!(zswap = sysfs_create_zswap_obj()))
+         goto fail;
+
+      if (sysfs_register_obj(NULL, mm, "zswap", zswap))
+         goto fail;
+   }
+
+   if (MM_KSM) {
+
+      if (!(ksm = sysfs_create_ksm_obj()))
+         goto fail;
+
+      if (sysfs_register_obj(NULL, mm, "ksm", ksm))
+         goto fail;
+   }
+
+   if (!(crd = sysfs_create_crd_obj()))
+      goto fail;
+
+   if (sysfs_register_obj(NULL, mm, "crd", crd))
+      goto fail;
+
+   /* Success */
+   return;
+
+fail:
+   panic("Unable to create the sysfs mm obj");
+}
@@ -25,6 +25,8 @@
 #include "lock_and_retain.c.h"
 
 void sysfs_create_config_obj(void);
+void sysfs_create_mm_obj(void);
+void sysfs_create_vfs_obj(void);
 static struct fs *sysfs;
 
 static int
@@ -756,6 +758,8 @@ init_sysfs(void)
       panic("Unable to create default objects");
 
    sysfs_create_config_obj();
+   sysfs_create_mm_obj();
+   sysfs_create_vfs_obj();
 }
 
 static struct module sysfs_module = {
@@ -0,0 +1,109 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/printk.h>
+
+#include <tilck/kernel/fs/dcache.h>
+#include <tilck/kernel/fs/ramfs.h>
+#include <tilck/kernel/fs/overlayfs.h>
+
+#include <tilck/mods/sysfs.h>
+#include <tilck/mods/sysfs_utils.h>
+
+/* vfs/dcache */
+DEF_STATIC_SYSOBJ_PROP(hits, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(neg_hits, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(misses, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(entries, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(evictions, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(invalidations, &sysobj_ptype_ro_ulong);
+
+static struct sysobj *sysfs_create_dcache_obj(void)
+{
+   struct dcache_stats *s = &dcache_stats;
+
+   return sysfs_create_custom_obj(
+      "dcache",
+      NULL,       /* hooks */
+      &prop_hits, &s->hits,
+      &prop_neg_hits, &s->neg_hits,
+      &prop_misses, &s->misses,
+      &prop_entries, &s->entries,
+      &prop_evictions, &s->evictions,
+      &prop_invalidations, &s->invalidations,
+      NULL
+   );
+}
+
+/* vfs/ramfs */
+DEF_STATIC_SYSOBJ_PROP(dir_entries, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(dir_entries_mem, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(dir_htables_mem, &sysobj_ptype_ro_ulong);
+
+static struct sysobj *sysfs_create_ramfs_obj(void)
+{
+   struct ramfs_dir_stats *s = &ramfs_dir_stats;
+
+   return sysfs_create_custom_obj(
+      "ramfs",
+      NULL,       /* hooks */
+      &prop_dir_entries, &s->entries,
+      &prop_dir_entries_mem, &s->entries_mem,
+      &prop_dir_htables_mem, &s->htables_mem,
+      NULL
+   );
+}
+
+/* vfs/overlayfs */
+DEF_STATIC_SYSOBJ_PROP(copy_ups, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(copy_up_bytes, &sysobj_ptype_ro_ulong);
+DEF_STATIC_SYSOBJ_PROP(nodes, &sysobj_ptype_ro_ulong);
+
+static struct sysobj *sysfs_create_overlayfs_obj(void)
+{
+   struct overlayfs_stats *s = &overlayfs_stats;
+
+   return sysfs_create_custom_obj(
+      "overlayfs",
+      NULL,       /* hooks */
+      &prop_copy_ups, &s->copy_ups,
+      &prop_copy_up_bytes, &s->copy_up_bytes,
+      &prop_nodes, &s->nodes,
+      NULL
+   );
+}
+
+void sysfs_create_vfs_obj(void)
+{
+   struct sysobj *vfs, *dcache, *ramfs, *overlayfs;
+
+   if (!(vfs = sysfs_create_empty_obj()))
+      goto fail;
+
+   if (sysfs_register_obj(NULL, &sysfs_root_obj, "vfs", vfs))
+      goto fail;
+
+   if (!(dcache = sysfs_create_dcache_obj()))
+      goto fail;
+
+   if (sysfs_register_obj(NULL, vfs, "dcache", dcache))
+      goto fail;
+
+   if (!(ramfs = sysfs_create_ramfs_obj()))
+      goto fail;
+
+   if (sysfs_register_obj(NULL, vfs, "ramfs", ramfs))
+      goto fail;
+
+   if (!(overlayfs = sysfs_create_overlayfs_obj()))
+      goto fail;
+
+   if (sysfs_register_obj(NULL, vfs, "overlayfs", overlayfs))
+      goto fail;
+
+   /* Success */
+   return;
+
+fail:
+   panic("Unable to create the sysfs vfs obj");
+}
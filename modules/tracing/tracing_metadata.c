@@ -225,6 +225,41 @@ static const struct syscall_info __tracing_metadata[] =
       }
    },
 
+   {
+      .sys_n = SYS_getrusage,
+      .n_params = 2,
+      .exp_block = false,
+      .ret_type = &ptype_errno_or_val,
+      .params = {
+         SIMPLE_PARAM("who", &ptype_int, sys_param_in),
+         SIMPLE_PARAM("usage", &ptype_voidp, sys_param_out),
+      }
+   },
+
+   {
+      .sys_n = SYS_setrlimit,
+      .n_params = 2,
+      .exp_block = false,
+      .ret_type = &ptype_errno_or_val,
+      .params = {
+         SIMPLE_PARAM("resource", &ptype_int, sys_param_in),
+         SIMPLE_PARAM("rlim", &ptype_voidp, sys_param_in),
+      }
+   },
+
+   {
+      .sys_n = SYS_prlimit64,
+      .n_params = 4,
+      .exp_block = false,
+      .ret_type = &ptype_errno_or_val,
+      .params = {
+         SIMPLE_PARAM("pid", &ptype_int, sys_param_in),
+         SIMPLE_PARAM("resource", &ptype_int, sys_param_in),
+         SIMPLE_PARAM("new_rlim", &ptype_voidp, sys_param_in),
+         SIMPLE_PARAM("old_rlim", &ptype_voidp, sys_param_out),
+      }
+   },
+
    {
       .sys_n = SYS_umask,
       .n_params = 1,
@@ -316,6 +351,43 @@ static const struct syscall_info __tracing_metadata[] =
       }
    },
 
+   {
+      .sys_n = SYS_epoll_create1,
+      .n_params = 1,
+      .exp_block = false,
+      .ret_type = &ptype_errno_or_val,
+      .params = {
+         SIMPLE_PARAM("flags", &ptype_int, sys_param_in),
+      }
+   },
+
+   {
+      .sys_n = SYS_epoll_ctl,
+      .n_params = 4,
+      .exp_block = false,
+      .ret_type = &ptype_errno_or_val,
+      .params = {
+         SIMPLE_PARAM("epfd", &ptype_int, sys_param_in),
+         SIMPLE_PARAM("op", &ptype_int, sys_param_in),
+         SIMPLE_PARAM("fd", &ptype_int, sys_param_in),
+         SIMPLE_PARAM("event", &ptype_voidp, sys_param_in),
+      }
+   },
+
+   {
+      .sys_n = SYS_epoll_pwait,
+      .n_params = 5,
+      .exp_block = true,
+      .ret_type = &ptype_errno_or_val,
+      .params = {
+         SIMPLE_PARAM("epfd", &ptype_int, sys_param_in),
+         SIMPLE_PARAM("events", &ptype_voidp, sys_param_out),
+         SIMPLE_PARAM("maxevents", &ptype_int, sys_param_in),
+         SIMPLE_PARAM("timeout", &ptype_int, sys_param_in),
+         SIMPLE_PARAM("sigmask", &ptype_voidp, sys_param_in),
+      }
+   },
+
    {
       .sys_n = SYS_set_thread_area,
       .n_params = 1,
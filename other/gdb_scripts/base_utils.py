@@ -7,7 +7,6 @@ from . import tilck_types as tt
 BuildConfig = namedtuple(
    "BuildConfig", [
       "CMAKE_SOURCE_DIR",
-      "MAX_HANDLES",
       "KERNEL_BASE_VA"
    ]
 )
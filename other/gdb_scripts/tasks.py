@@ -63,9 +63,9 @@ def get_proc(pid):
 def get_handles(proc):
 
    handles_list = []
-   handles = proc['handles']
+   handles = proc['fdt']['handles']
 
-   for i in range(bu.config.MAX_HANDLES):
+   for i in range(int(proc['fdt']['size'])):
       if handles[i]:
          handles_list.append(i)
 
@@ -73,16 +73,16 @@ def get_handles(proc):
 
 def get_handle(proc, n):
 
-   if n not in range(0, bu.config.MAX_HANDLES):
+   if n not in range(0, int(proc['fdt']['size'])):
       return None
 
-   return proc['handles'][n].cast(tt.fs_handle_base_p)
+   return proc['fdt']['handles'][n].cast(tt.fs_handle_base_p)
 
 def get_handle_num(proc, handle_obj_ptr):
 
-   handles = proc['handles']
+   handles = proc['fdt']['handles']
 
-   for i in range(bu.config.MAX_HANDLES):
+   for i in range(int(proc['fdt']['size'])):
 
       if handles[i] == handle_obj_ptr:
          return i
@@ -0,0 +1,204 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <tilck/common/basic_defs.h>
+#include <tilck/common/crd_base.h>
+#include <tilck/kernel/lz.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+/*
+ * rdcomp: build app creating a compressed ramdisk (see crd_base.h) out of a
+ * ramdisk image, typically the FAT initrd. With -d, it does the opposite.
+ */
+
+static struct lz_ctx lz_ctx;
+
+static void *read_whole_file(const char *file, size_t *size_ref)
+{
+   struct stat statbuf;
+   void *buf;
+   FILE *fh;
+
+   if (stat(file, &statbuf) < 0) {
+      perror("stat() failed");
+      return NULL;
+   }
+
+   if (!(fh = fopen(file, "rb"))) {
+      perror("fopen() failed");
+      return NULL;
+   }
+
+   if (!(buf = malloc((size_t)statbuf.st_size + 1))) {
+      fprintf(stderr, "ERROR: out of memory\n");
+      fclose(fh);
+      return NULL;
+   }
+
+   if (fread(buf, 1, (size_t)statbuf.st_size, fh) != (size_t)statbuf.st_size) {
+      perror("fread() failed");
+      free(buf);
+      buf = NULL;
+   }
+
+   fclose(fh);
+   *size_ref = (size_t)statbuf.st_size;
+   return buf;
+}
+
+static int write_whole_file(const char *file, const void *buf, size_t size)
+{
+   FILE *fh;
+   int rc = 0;
+
+   if (!(fh = fopen(file, "wb"))) {
+      perror("fopen() failed");
+      return 1;
+   }
+
+   if (fwrite(buf, 1, size, fh) != size) {
+      perror("fwrite() failed");
+      rc = 1;
+   }
+
+   fclose(fh);
+   return rc;
+}
+
+static int compress_image(const u8 *data, size_t size, const char *out_file)
+{
+   const u32 chunks = (u32)((size + CRD_CHUNK_SIZE - 1) / CRD_CHUNK_SIZE);
+   const size_t hdr_size = crd_get_hdr_size(chunks);
+   struct crd_hdr *h;
+   size_t off = hdr_size;
+   int rc;
+
+   if (!size || size > 0xffffffffu - hdr_size) {
+      fprintf(stderr, "ERROR: invalid image size: %zu\n", size);
+      return 1;
+   }
+
+   /* In the worst case, every chunk is stored uncompressed */
+   if (!(h = calloc(1, hdr_size + size))) {
+      fprintf(stderr, "ERROR: out of memory\n");
+      return 1;
+   }
+
+   h->magic = CRD_MAGIC;
+   h->version = CRD_VERSION;
+   h->chunk_size = CRD_CHUNK_SIZE;
+   h->chunks_count = chunks;
+   h->size = (u32)size;
+
+   for (u32 i = 0; i < chunks; i++) {
+
+      const u8 *src = data + (size_t)i * CRD_CHUNK_SIZE;
+      const u32 len = crd_get_chunk_size(h, i);
+      u8 *dst = (u8 *)h + off;
+      size_t clen;
+
+      h->index[i] = (u32)off;
+
+      /* Store the chunk as it is, when it's not compressible */
+      if (!(clen = lz_compress(&lz_ctx, src, len, dst, len - 1))) {
+         memcpy(dst, src, len);
+         clen = len;
+      }
+
+      off += clen;
+   }
+
+   h->index[chunks] = (u32)off;
+   h->compr_size = (u32)off;
+
+   rc = write_whole_file(out_file, h, off);
+
+   if (!rc) {
+      printf("rdcomp: %zu KB -> %zu KB (%u chunks of %u KB)\n",
+             size / KB, off / KB, chunks, CRD_CHUNK_SIZE / KB);
+   }
+
+   free(h);
+   return rc;
+}
+
+static int decompress_image(const u8 *data, size_t size, const char *out_file)
+{
+   const struct crd_hdr *h = (const void *)data;
+   u8 *out;
+   int rc;
+
+   if (size < sizeof(*h) || !crd_is_compressed(h) || h->compr_size > size) {
+      fprintf(stderr, "ERROR: not a valid compressed ramdisk\n");
+      return 1;
+   }
+
+   if (!(out = malloc(h->size))) {
+      fprintf(stderr, "ERROR: out of memory\n");
+      return 1;
+   }
+
+   for (u32 i = 0; i < h->chunks_count; i++) {
+
+      const u8 *src = data + h->index[i];
+      const u32 clen = crd_get_chunk_compr_size(h, i);
+      const u32 len = crd_get_chunk_size(h, i);
+      u8 *dst = out + (size_t)i * h->chunk_size;
+
+      if (clen == len) {
+         memcpy(dst, src, len);
+         continue;
+      }
+
+      if (lz_decompress(src, clen, dst, len) != (long)len) {
+         fprintf(stderr, "ERROR: chunk %u is corrupted\n", i);
+         free(out);
+         return 1;
+      }
+   }
+
+   rc = write_whole_file(out_file, out, h->size);
+   free(out);
+   return rc;
+}
+
+static void show_help_and_exit(int argc, char **argv)
+{
+   printf("Syntax:\n");
+   printf("    %s <ramdisk file> <compressed output file>\n", argv[0]);
+   printf("    %s -d <compressed ramdisk file> <output file>\n", argv[0]);
+   exit(1);
+}
+
+int main(int argc, char **argv)
+{
+   const bool decompress = argc == 4 && !strcmp(argv[1], "-d");
+   const char *in_file, *out_file;
+   size_t size;
+   void *data;
+   int rc;
+
+   if (argc != 3 && !decompress)
+      show_help_and_exit(argc, argv);
+
+   in_file = argv[argc - 2];
+   out_file = argv[argc - 1];
+
+   if (!(data = read_whole_file(in_file, &size)))
+      return 1;
+
+   if (decompress)
+      rc = decompress_image(data, size, out_file);
+   else
+      rc = compress_image(data, size, out_file);
+
+   free(data);
+   return rc;
+}
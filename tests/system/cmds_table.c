@@ -17,12 +17,19 @@ DECL_CMD(bad_read);
 DECL_CMD(bad_write);
 DECL_CMD(fork_perf);
 DECL_CMD(vfork_perf);
+DECL_CMD(exec_perf);
 DECL_CMD(syscall_perf);
 DECL_CMD(fpu);
 DECL_CMD(fpu_loop);
 DECL_CMD(brk);
 DECL_CMD(mmap);
 DECL_CMD(mmap2);
+DECL_CMD(mmap_perf);
+DECL_CMD(tlb_perf);
+DECL_CMD(zswap_stress);
+DECL_CMD(ksm);
+DECL_CMD(rusage);
+DECL_CMD(exec_share);
 DECL_CMD(kcow);
 DECL_CMD(wpid1);
 DECL_CMD(wpid2);
@@ -52,6 +59,7 @@ DECL_CMD(fs4);
 DECL_CMD(fs5);
 DECL_CMD(fs6);
 DECL_CMD(fs7);
+DECL_CMD(dcache);
 DECL_CMD(fmmap1);
 DECL_CMD(fmmap2);
 DECL_CMD(fmmap3);
@@ -59,19 +67,41 @@ DECL_CMD(fmmap4);
 DECL_CMD(fmmap5);
 DECL_CMD(fmmap6);
 DECL_CMD(fmmap7);
+DECL_CMD(fmmap8);
 DECL_CMD(fs_perf1);
 DECL_CMD(fs_perf2);
+DECL_CMD(stat_perf);
+DECL_CMD(ramfs_perf);
+DECL_CMD(ramfs_seqwr);
+DECL_CMD(dir_perf);
+DECL_CMD(ramfs_dmem);
+DECL_CMD(fmmap_perf);
+DECL_CMD(rw_perf);
+DECL_CMD(pread_perf);
+DECL_CMD(writev_perf);
+DECL_CMD(cp_perf);
+DECL_CMD(fat_rd_perf);
+DECL_CMD(fat_lk_perf);
+DECL_CMD(getdents_perf);
+DECL_CMD(fd_perf);
 DECL_CMD(pipe1);
 DECL_CMD(pipe2);
 DECL_CMD(pipe3);
 DECL_CMD(pipe4);
 DECL_CMD(pipe5);
+DECL_CMD(pipe6);
+DECL_CMD(pipe7);
 DECL_CMD(pollerr);
 DECL_CMD(pollhup);
+DECL_CMD(epoll1);
+DECL_CMD(epoll_perf);
 DECL_CMD(execve0);
 DECL_CMD(vfork0);
+DECL_CMD(auxv);
+DECL_CMD(dynexec);
 DECL_CMD(extra);
 DECL_CMD(fatmm1);
+DECL_CMD(initrd_rw);
 DECL_CMD(sigmask);
 DECL_CMD(sig1);
 DECL_CMD(sig2);
@@ -102,12 +132,19 @@ static struct test_cmd_entry _cmds_table[] =
    CMD_ENTRY(bad_write,    TT_SHORT,  true),
    CMD_ENTRY(fork_perf,    TT_LONG,   true),
    CMD_ENTRY(vfork_perf,   TT_LONG,   true),
+   CMD_ENTRY(exec_perf,    TT_MED,    true),
    CMD_ENTRY(syscall_perf, TT_MED,    true),
    CMD_ENTRY(fpu,          TT_SHORT,  true),
    CMD_ENTRY(fpu_loop,     TT_LONG,  false),
    CMD_ENTRY(brk,          TT_SHORT,  true),
    CMD_ENTRY(mmap,         TT_MED,    true),
    CMD_ENTRY(mmap2,        TT_SHORT,  true),
+   CMD_ENTRY(mmap_perf,    TT_MED,    true),
+   CMD_ENTRY(tlb_perf,     TT_SHORT,  true),
+   CMD_ENTRY(zswap_stress, TT_LONG,   true),
+   CMD_ENTRY(ksm,          TT_LONG,   true),
+   CMD_ENTRY(rusage,       TT_SHORT,  true),
+   CMD_ENTRY(exec_share,   TT_SHORT,  true),
    CMD_ENTRY(kcow,         TT_SHORT,  true),
    CMD_ENTRY(wpid1,        TT_SHORT,  true),
    CMD_ENTRY(wpid2,        TT_SHORT,  true),
@@ -130,8 +167,23 @@ static struct test_cmd_entry _cmds_table[] =
    CMD_ENTRY(fs5,          TT_SHORT,  true),
    CMD_ENTRY(fs6,          TT_SHORT,  true),
    CMD_ENTRY(fs7,          TT_SHORT,  true),
+   CMD_ENTRY(dcache,       TT_SHORT,  true),
    CMD_ENTRY(fs_perf1,     TT_SHORT,  true),
    CMD_ENTRY(fs_perf2,     TT_SHORT,  true),
+   CMD_ENTRY(stat_perf,    TT_SHORT,  true),
+   CMD_ENTRY(ramfs_perf,   TT_SHORT,  true),
+   CMD_ENTRY(ramfs_seqwr,  TT_SHORT,  true),
+   CMD_ENTRY(dir_perf,     TT_SHORT,  true),
+   CMD_ENTRY(ramfs_dmem,   TT_SHORT,  true),
+   CMD_ENTRY(fmmap_perf,   TT_SHORT,  true),
+   CMD_ENTRY(rw_perf,      TT_SHORT,  true),
+   CMD_ENTRY(pread_perf,   TT_SHORT,  true),
+   CMD_ENTRY(writev_perf,  TT_SHORT,  true),
+   CMD_ENTRY(cp_perf,      TT_SHORT,  true),
+   CMD_ENTRY(fat_rd_perf,  TT_SHORT,  true),
+   CMD_ENTRY(fat_lk_perf,  TT_SHORT,  true),
+   CMD_ENTRY(getdents_perf, TT_SHORT,  true),
+   CMD_ENTRY(fd_perf,      TT_SHORT,  true),
    CMD_ENTRY(fmmap1,       TT_SHORT,  true),
    CMD_ENTRY(fmmap2,       TT_SHORT,  true),
    CMD_ENTRY(fmmap3,       TT_SHORT,  true),
@@ -139,24 +191,32 @@ static struct test_cmd_entry _cmds_table[] =
    CMD_ENTRY(fmmap5,       TT_SHORT,  true),
    CMD_ENTRY(fmmap6,       TT_SHORT,  true),
    CMD_ENTRY(fmmap7,       TT_SHORT,  true),
+   CMD_ENTRY(fmmap8,       TT_SHORT,  true),
    CMD_ENTRY(pipe1,        TT_SHORT,  true),
    CMD_ENTRY(pipe2,        TT_SHORT,  true),
    CMD_ENTRY(pipe3,        TT_SHORT,  true),
    CMD_ENTRY(pipe4,        TT_SHORT,  true),
    CMD_ENTRY(pipe5,        TT_SHORT,  true),
+   CMD_ENTRY(pipe6,        TT_SHORT,  true),
+   CMD_ENTRY(pipe7,        TT_SHORT,  true),
    CMD_ENTRY(pollerr,      TT_SHORT,  true),
    CMD_ENTRY(pollhup,      TT_SHORT,  true),
    CMD_ENTRY(poll1,        TT_SHORT,  true),
    CMD_ENTRY(poll2,        TT_SHORT,  true),
    CMD_ENTRY(poll3,        TT_SHORT,  true),
+   CMD_ENTRY(epoll1,       TT_SHORT,  true),
+   CMD_ENTRY(epoll_perf,   TT_SHORT,  true),
    CMD_ENTRY(select1,      TT_SHORT,  true),
    CMD_ENTRY(select2,      TT_SHORT,  true),
    CMD_ENTRY(select3,      TT_SHORT,  true),
    CMD_ENTRY(select4,      TT_SHORT,  true),
    CMD_ENTRY(execve0,      TT_SHORT,  true),
    CMD_ENTRY(vfork0,       TT_SHORT,  true),
+   CMD_ENTRY(auxv,         TT_SHORT,  true),
+   CMD_ENTRY(dynexec,      TT_SHORT,  true),
    CMD_ENTRY(extra,        TT_MED,    true),
    CMD_ENTRY(fatmm1,       TT_SHORT,  true),
+   CMD_ENTRY(initrd_rw,    TT_SHORT,  true),
    CMD_ENTRY(sigmask,      TT_SHORT,  true),
    CMD_ENTRY(sig1,         TT_SHORT,  true),
    CMD_ENTRY(sig2,         TT_SHORT,  true),
@@ -8,6 +8,7 @@ int remove_test_file(const char *path, int n);
 void remove_test_file_expecting_success(const char *path, int n);
 bool running_on_tilck(void);
 void not_on_tilck_message(void);
+bool read_sysfs_ulong(const char *path, unsigned long *val);
 
 int test_sig(void (*child_func)(void *),
              void *arg,
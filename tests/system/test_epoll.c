@@ -0,0 +1,290 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+#include "devshell.h"
+
+static int epoll_add(int epfd, int fd, u32 events)
+{
+   struct epoll_event ev = { .events = events, .data.fd = fd };
+   return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static int epoll_mod(int epfd, int fd, u32 events)
+{
+   struct epoll_event ev = { .events = events, .data.fd = fd };
+   return epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+/* Non-blocking epoll_wait(): return the count of ready fds, checking `fd` */
+static int epoll_check(int epfd, int fd, u32 events)
+{
+   struct epoll_event evs[4];
+   int rc = epoll_wait(epfd, evs, 4, 0);
+
+   if (rc == 1) {
+      DEVSHELL_CMD_ASSERT(evs[0].data.fd == fd);
+      DEVSHELL_CMD_ASSERT((evs[0].events & events) == events);
+   }
+
+   return rc;
+}
+
+/* Level-triggered, edge-triggered and one-shot registrations on a pipe */
+int cmd_epoll1(int argc, char **argv)
+{
+   struct epoll_event evs[4];
+   int rc, epfd, pipefd[2], wstatus;
+   pid_t childpid;
+   char buf[8];
+
+   epfd = epoll_create1(EPOLL_CLOEXEC);
+   DEVSHELL_CMD_ASSERT(epfd > 0);
+
+   rc = pipe(pipefd);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* Level-triggered: reported as long as there's data in the pipe */
+   rc = epoll_add(epfd, pipefd[0], EPOLLIN);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(epoll_check(epfd, pipefd[0], 0) == 0);
+
+   rc = write(pipefd[1], "a", 1);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+   DEVSHELL_CMD_ASSERT(epoll_check(epfd, pipefd[0], EPOLLIN) == 1);
+   DEVSHELL_CMD_ASSERT(epoll_check(epfd, pipefd[0], EPOLLIN) == 1);
+
+   rc = read(pipefd[0], buf, sizeof(buf));
+   DEVSHELL_CMD_ASSERT(rc == 1);
+   DEVSHELL_CMD_ASSERT(epoll_check(epfd, pipefd[0], 0) == 0);
+
+   /* Edge-triggered: reported once per write */
+   rc = epoll_mod(epfd, pipefd[0], EPOLLIN | EPOLLET);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = write(pipefd[1], "b", 1);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+   DEVSHELL_CMD_ASSERT(epoll_check(epfd, pipefd[0], EPOLLIN) == 1);
+   DEVSHELL_CMD_ASSERT(epoll_check(epfd, pipefd[0], 0) == 0);
+
+   rc = write(pipefd[1], "c", 1);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+   DEVSHELL_CMD_ASSERT(epoll_check(epfd, pipefd[0], EPOLLIN) == 1);
+   DEVSHELL_CMD_ASSERT(epoll_check(epfd, pipefd[0], 0) == 0);
+
+   rc = read(pipefd[0], buf, sizeof(buf));
+   DEVSHELL_CMD_ASSERT(rc == 2);
+
+   /* One-shot: disabled after the first event, until EPOLL_CTL_MOD */
+   rc = epoll_mod(epfd, pipefd[0], EPOLLIN | EPOLLONESHOT);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = write(pipefd[1], "d", 1);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+   DEVSHELL_CMD_ASSERT(epoll_check(epfd, pipefd[0], EPOLLIN) == 1);
+   DEVSHELL_CMD_ASSERT(epoll_check(epfd, pipefd[0], 0) == 0);
+
+   rc = write(pipefd[1], "e", 1);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+   DEVSHELL_CMD_ASSERT(epoll_check(epfd, pipefd[0], 0) == 0);
+
+   rc = epoll_mod(epfd, pipefd[0], EPOLLIN);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(epoll_check(epfd, pipefd[0], EPOLLIN) == 1);
+
+   rc = read(pipefd[0], buf, sizeof(buf));
+   DEVSHELL_CMD_ASSERT(rc == 2);
+
+   /* Error cases */
+   rc = epoll_add(epfd, pipefd[0], EPOLLIN);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EEXIST);
+
+   rc = epoll_add(epfd, epfd, EPOLLIN);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   rc = epoll_mod(epfd, pipefd[1], EPOLLOUT);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == ENOENT);
+
+   rc = epoll_ctl(epfd, EPOLL_CTL_DEL, pipefd[1], NULL);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == ENOENT);
+
+   rc = epoll_wait(epfd, evs, 0, 0);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   /* The write end is always writable */
+   rc = epoll_add(epfd, pipefd[1], EPOLLOUT);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(epoll_check(epfd, pipefd[1], EPOLLOUT) == 1);
+
+   rc = epoll_ctl(epfd, EPOLL_CTL_DEL, pipefd[1], NULL);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(epoll_check(epfd, pipefd[1], 0) == 0);
+
+   /* Blocking wait: timeout first, then a write from a child process */
+   rc = epoll_wait(epfd, evs, 4, 50 /* ms */);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   childpid = fork();
+   DEVSHELL_CMD_ASSERT(childpid >= 0);
+
+   if (!childpid) {
+      usleep(50 * 1000);
+      rc = write(pipefd[1], "f", 1);
+      exit(rc == 1 ? 0 : 1);
+   }
+
+   do {
+      rc = epoll_wait(epfd, evs, 4, 3000 /* ms */);
+   } while (rc < 0 && errno == EINTR);
+
+   DEVSHELL_CMD_ASSERT(rc == 1);
+   DEVSHELL_CMD_ASSERT(evs[0].data.fd == pipefd[0]);
+   DEVSHELL_CMD_ASSERT(evs[0].events & EPOLLIN);
+
+   rc = waitpid(childpid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == childpid);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+   /* Closing the fd removes its registration */
+   close(pipefd[0]);
+   DEVSHELL_CMD_ASSERT(epoll_check(epfd, pipefd[0], 0) == 0);
+
+   rc = epoll_ctl(epfd, EPOLL_CTL_DEL, pipefd[0], NULL);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EBADF);
+
+   close(pipefd[1]);
+   close(epfd);
+   return 0;
+}
+
+static u64
+epoll_perf_poll(struct pollfd *fds, int *wfds, int n, int iters)
+{
+   u64 start = RDTSC();
+   int rc, ready;
+   char c;
+
+   for (int i = 0; i < iters; i++) {
+
+      rc = write(wfds[rand() % n], "x", 1);
+      DEVSHELL_CMD_ASSERT(rc == 1);
+
+      rc = poll(fds, (nfds_t)n, -1);
+      DEVSHELL_CMD_ASSERT(rc == 1);
+
+      for (ready = 0; !fds[ready].revents; ready++) { }
+
+      rc = read(fds[ready].fd, &c, 1);
+      DEVSHELL_CMD_ASSERT(rc == 1);
+   }
+
+   return RDTSC() - start;
+}
+
+static u64
+epoll_perf_epoll(int epfd, int *wfds, int n, int iters)
+{
+   u64 start = RDTSC();
+   struct epoll_event ev;
+   int rc;
+   char c;
+
+   for (int i = 0; i < iters; i++) {
+
+      rc = write(wfds[rand() % n], "x", 1);
+      DEVSHELL_CMD_ASSERT(rc == 1);
+
+      rc = epoll_wait(epfd, &ev, 1, -1);
+      DEVSHELL_CMD_ASSERT(rc == 1);
+
+      rc = read(ev.data.fd, &c, 1);
+      DEVSHELL_CMD_ASSERT(rc == 1);
+   }
+
+   return RDTSC() - start;
+}
+
+static void epoll_perf_run(int n, int iters)
+{
+   struct pollfd *fds = calloc((size_t)n, sizeof(struct pollfd));
+   int *wfds = calloc((size_t)n, sizeof(int));
+   int rc, epfd, pipefd[2];
+   u64 poll_cycles, epoll_cycles;
+
+   DEVSHELL_CMD_ASSERT(fds != NULL && wfds != NULL);
+
+   epfd = epoll_create1(0);
+   DEVSHELL_CMD_ASSERT(epfd > 0);
+
+   for (int i = 0; i < n; i++) {
+
+      rc = pipe(pipefd);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+
+      fds[i] = (struct pollfd) { .fd = pipefd[0], .events = POLLIN };
+      wfds[i] = pipefd[1];
+
+      rc = epoll_add(epfd, pipefd[0], EPOLLIN);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   poll_cycles = epoll_perf_poll(fds, wfds, n, iters);
+   epoll_cycles = epoll_perf_epoll(epfd, wfds, n, iters);
+
+   printf("    %4d fds: poll(): %8llu cycles, epoll_wait(): %8llu cycles\n",
+          n, poll_cycles / (u64)iters, epoll_cycles / (u64)iters);
+
+   for (int i = 0; i < n; i++) {
+      close(fds[i].fd);
+      close(wfds[i]);
+   }
+
+   close(epfd);
+   free(wfds);
+   free(fds);
+}
+
+/*
+ * One random pipe out of N becomes readable at each iteration: compare the cost
+ * of waiting for it with poll(), which scans all the N fds at every call, and
+ * with epoll_wait(), which just pops the ready list.
+ */
+int cmd_epoll_perf(int argc, char **argv)
+{
+   const int iters = argc > 0 ? atoi(argv[0]) : 1000;
+   static const int counts[] = { 10, 100, 1000 };
+   struct rlimit rlim;
+   int rc;
+
+   DEVSHELL_CMD_ASSERT(iters > 0);
+
+   rc = getrlimit(RLIMIT_NOFILE, &rlim);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* Two fds per pipe, plus some margin */
+   rlim.rlim_cur = 2 * 1000 + 64;
+
+   if (rlim.rlim_max != RLIM_INFINITY && rlim.rlim_max < rlim.rlim_cur)
+      rlim.rlim_max = rlim.rlim_cur;
+
+   rc = setrlimit(RLIMIT_NOFILE, &rlim);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   printf("Wait for one ready pipe out of N (%d iterations)\n", iters);
+
+   for (int i = 0; i < ARRAY_SIZE(counts); i++)
+      epoll_perf_run(counts[i], iters);
+
+   return 0;
+}
@@ -96,3 +96,123 @@ err_end:
    close(fd);
    return 1;
 }
+
+static bool initrd_has_entry(const char *name)
+{
+   struct dirent *de;
+   bool found = false;
+   DIR *d;
+
+   DEVSHELL_CMD_ASSERT((d = opendir("/initrd/etc")) != NULL);
+
+   while ((de = readdir(d))) {
+      if (!strcmp(de->d_name, name))
+         found = true;
+   }
+
+   closedir(d);
+   return found;
+}
+
+static void initrd_rw_create_and_unlink(const char *path)
+{
+   int fd;
+
+   fd = open(path, O_CREAT | O_WRONLY | O_EXCL, 0644);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+   DEVSHELL_CMD_ASSERT(write(fd, "x", 1) == 1);
+   close(fd);
+   DEVSHELL_CMD_ASSERT(unlink(path) == 0);
+}
+
+/*
+ * Test the writable initrd (overlayfs): this test requires the kernel to be
+ * booted with the -initrd_rw option, otherwise it's skipped.
+ */
+int cmd_initrd_rw(int argc, char **argv)
+{
+   static const char test_str[] = "hello from the overlay\n";
+   static const char group_path[] = "/initrd/etc/group";
+   char orig[4096], buf[4096];
+   unsigned long nodes0, nodes;
+   struct stat statbuf;
+   int fd, rc, len;
+
+   if (!running_on_tilck()) {
+      not_on_tilck_message();
+      return 0;
+   }
+
+   fd = open("/initrd/ovl_test", O_CREAT | O_RDWR, 0644);
+
+   if (fd < 0 && errno == EROFS) {
+      printf("[SKIP] /initrd is read-only: boot with -initrd_rw\n");
+      return 0;
+   }
+
+   printf("Create, write and read a new file\n");
+   DEVSHELL_CMD_ASSERT(fd > 0);
+   rc = write(fd, test_str, sizeof(test_str) - 1);
+   DEVSHELL_CMD_ASSERT(rc == sizeof(test_str) - 1);
+   DEVSHELL_CMD_ASSERT(lseek(fd, 0, SEEK_SET) == 0);
+   rc = read(fd, buf, sizeof(buf));
+   DEVSHELL_CMD_ASSERT(rc == sizeof(test_str) - 1);
+   DEVSHELL_CMD_ASSERT(!memcmp(buf, test_str, sizeof(test_str) - 1));
+   close(fd);
+   DEVSHELL_CMD_ASSERT(unlink("/initrd/ovl_test") == 0);
+
+   printf("Copy-up a file of the lower layer\n");
+   fd = open(group_path, O_RDONLY);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+   len = read(fd, orig, sizeof(orig));
+   DEVSHELL_CMD_ASSERT(len > 0 && len < (int)sizeof(orig));
+   close(fd);
+
+   fd = open(group_path, O_WRONLY | O_APPEND);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+   DEVSHELL_CMD_ASSERT(write(fd, test_str, sizeof(test_str) - 1) > 0);
+   close(fd);
+
+   DEVSHELL_CMD_ASSERT(stat(group_path, &statbuf) == 0);
+   DEVSHELL_CMD_ASSERT(statbuf.st_size == len + (int)sizeof(test_str) - 1);
+
+   fd = open(group_path, O_RDONLY);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+   rc = read(fd, buf, sizeof(buf));
+   close(fd);
+   DEVSHELL_CMD_ASSERT(rc == statbuf.st_size);
+   DEVSHELL_CMD_ASSERT(!memcmp(buf, orig, len));
+
+   printf("Unlink it: the lower entry must be hidden\n");
+   DEVSHELL_CMD_ASSERT(unlink(group_path) == 0);
+   DEVSHELL_CMD_ASSERT(stat(group_path, &statbuf) < 0 && errno == ENOENT);
+   DEVSHELL_CMD_ASSERT(!initrd_has_entry("group"));
+   DEVSHELL_CMD_ASSERT(initrd_has_entry("passwd"));
+
+   printf("Re-create it with its original content\n");
+   fd = open(group_path, O_CREAT | O_WRONLY | O_EXCL, 0644);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+   DEVSHELL_CMD_ASSERT(write(fd, orig, len) == len);
+   close(fd);
+   DEVSHELL_CMD_ASSERT(initrd_has_entry("group"));
+
+   printf("Check that the deleted nodes are freed\n");
+   DEVSHELL_CMD_ASSERT(read_sysfs_ulong("/syst/vfs/overlayfs/nodes", &nodes0));
+
+   for (int i = 0; i < 1000; i++) {
+      sprintf(buf, "/initrd/ovl_tmp_%d", i);
+      initrd_rw_create_and_unlink(buf);
+      DEVSHELL_CMD_ASSERT(stat(buf, &statbuf) < 0 && errno == ENOENT);
+   }
+
+   DEVSHELL_CMD_ASSERT(mkdir("/initrd/ovl_dir", 0755) == 0);
+   DEVSHELL_CMD_ASSERT(mkdir("/initrd/ovl_dir/sub", 0755) == 0);
+   initrd_rw_create_and_unlink("/initrd/ovl_dir/sub/file");
+   DEVSHELL_CMD_ASSERT(rmdir("/initrd/ovl_dir/sub") == 0);
+   DEVSHELL_CMD_ASSERT(rmdir("/initrd/ovl_dir") == 0);
+
+   DEVSHELL_CMD_ASSERT(read_sysfs_ulong("/syst/vfs/overlayfs/nodes", &nodes));
+   printf("Overlay nodes: %lu before, %lu after\n", nodes0, nodes);
+   DEVSHELL_CMD_ASSERT(nodes == nodes0);
+   return 0;
+}
@@ -136,6 +136,59 @@ int cmd_vfork_perf(int argc, char **argv)
    return do_fork_perf(&vfork);
 }
 
+/*
+ * Measure the cost of execve() by running the same binary in a loop, like a
+ * shell script calling `true` would do. Except for the first iteration, the
+ * kernel finds the parsed ELF headers in its cache.
+ */
+int cmd_exec_perf(int argc, char **argv)
+{
+   const int iters = 500;
+   const char *devshell_path = get_devshell_path();
+   int rc, wstatus, child_pid;
+   ull_t start, first = 0, duration;
+
+   if (argc >= 1 && !strcmp(argv[0], "--child"))
+      return 0;
+
+   start = RDTSC();
+
+   for (int i = 0; i < iters; i++) {
+
+      child_pid = vfork();
+
+      if (child_pid < 0) {
+         perror("vfork() failed");
+         return 1;
+      }
+
+      if (!child_pid) {
+         execl(devshell_path, "devshell", "-c", "exec_perf", "--child", NULL);
+         _exit(123);
+      }
+
+      rc = waitpid(child_pid, &wstatus, 0);
+
+      if (rc != child_pid) {
+         perror("waitpid() failed");
+         return 1;
+      }
+
+      if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+         printf("child exited with status: %d\n", WEXITSTATUS(wstatus));
+         return 1;
+      }
+
+      if (!i)
+         first = RDTSC() - start;
+   }
+
+   duration = RDTSC() - start;
+   printf("first exec: %llu\n", first);
+   printf("duration: %llu\n", duration/iters);
+   return 0;
+}
+
 int cmd_execve0(int argc, char **argv)
 {
    int rc, pid, wstatus;
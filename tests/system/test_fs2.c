@@ -40,6 +40,100 @@ int cmd_fs7(int argc, char **argv)
    return 0;
 }
 
+/*
+ * Check that the path lookup cache (dcache) never returns stale results, both
+ * for positive and for negative entries.
+ */
+int cmd_dcache(int argc, char **argv)
+{
+   struct stat st;
+   int rc, fd;
+
+   rc = mkdir("/tmp/dc", 0755);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* Negative entry, then creat() */
+   for (int i = 0; i < 2; i++) {
+      rc = stat("/tmp/dc/f1", &st);
+      DEVSHELL_CMD_ASSERT(rc < 0 && errno == ENOENT);
+   }
+
+   fd = creat("/tmp/dc/f1", 0644);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+   close(fd);
+
+   rc = stat("/tmp/dc/f1", &st);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* Positive entries, then rename() */
+   rc = rename("/tmp/dc/f1", "/tmp/dc/f2");
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = stat("/tmp/dc/f1", &st);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == ENOENT);
+
+   rc = stat("/tmp/dc/f2", &st);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* link() and unlink() */
+   rc = link("/tmp/dc/f2", "/tmp/dc/f1");
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = stat("/tmp/dc/f1", &st);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = unlink("/tmp/dc/f2");
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = stat("/tmp/dc/f2", &st);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == ENOENT);
+
+   /* symlink() over a negative entry */
+   rc = symlink("/tmp/dc/f1", "/tmp/dc/f2");
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = stat("/tmp/dc/f2", &st);
+   DEVSHELL_CMD_ASSERT(rc == 0 && S_ISREG(st.st_mode));
+
+   rc = unlink("/tmp/dc/f2");
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = unlink("/tmp/dc/f1");
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* Negative entries in a directory removed and re-created */
+   rc = mkdir("/tmp/dc/d", 0755);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = stat("/tmp/dc/d/x", &st);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == ENOENT);
+
+   rc = rmdir("/tmp/dc/d");
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = stat("/tmp/dc/d", &st);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == ENOENT);
+
+   rc = mkdir("/tmp/dc/d", 0755);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = mkdir("/tmp/dc/d/x", 0755);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = stat("/tmp/dc/d/x", &st);
+   DEVSHELL_CMD_ASSERT(rc == 0 && S_ISDIR(st.st_mode));
+
+   rc = rmdir("/tmp/dc/d/x");
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = rmdir("/tmp/dc/d");
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = rmdir("/tmp/dc");
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
+
 static const char test_str[] = "this is a test string\n";
 static const char test_str2[] = "hello from the 2nd page";
 static const char test_str_exp[] = "This is a test string\n";
@@ -398,7 +492,7 @@ int cmd_fmmap5(int argc, char **argv)
 
    /*
     * This memory write will trigger a page-fault and the kernel should allocate
-    * on-the-fly the page (ramfs_block) for us and, ultimately, resume the
+    * on-the-fly the page (ramfs block) for us and, ultimately, resume the
     * write.
     */
    strcpy(vaddr + page_size, test_str2);
@@ -575,3 +669,116 @@ int cmd_fmmap7(int argc, char **argv)
    unlink(test_file);
    return rc;
 }
+
+static void do_mm_write(void *ptr)
+{
+   printf("[pid: %d] Before write at %p\n", getpid(), ptr);
+   *(volatile char *)ptr = 'x';
+   printf("Write OK at %p\n", ptr);
+}
+
+/* MAP_PRIVATE file mappings, MAP_FIXED and mprotect() */
+int cmd_fmmap8(int argc, char **argv)
+{
+   int fd, rc;
+   char *vaddr, *p;
+   char buf[64];
+   const size_t page_size = getpagesize();
+
+   printf("Using '%s' as test file\n", test_file);
+   fd = open(test_file, O_CREAT | O_RDWR | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+
+   /* The file has 1 page + a few bytes, while we'll map 4 pages */
+   rc = pwrite(fd, test_str, sizeof(test_str)-1, 0);
+   DEVSHELL_CMD_ASSERT(rc == sizeof(test_str)-1);
+
+   rc = pwrite(fd, test_str2, sizeof(test_str2)-1, page_size);
+   DEVSHELL_CMD_ASSERT(rc == sizeof(test_str2)-1);
+
+   vaddr = mmap(NULL, 4 * page_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   DEVSHELL_CMD_ASSERT(vaddr != (void *)-1);
+
+   /* Until the first write to a page, the mapping shares it with the file */
+   rc = pwrite(fd, "X", 1, 1);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+   DEVSHELL_CMD_ASSERT(vaddr[1] == 'X');
+
+   rc = pwrite(fd, test_str + 1, 1, 1);
+   DEVSHELL_CMD_ASSERT(rc == 1);
+
+   /* Private mappings outlive the file descriptor */
+   close(fd);
+
+   DEVSHELL_CMD_ASSERT(!memcmp(vaddr, test_str, sizeof(test_str)-1));
+   DEVSHELL_CMD_ASSERT(!memcmp(vaddr + page_size, test_str2,
+                               sizeof(test_str2)-1));
+
+   /* Past EOF, there must be just zeros */
+   for (p = vaddr + page_size + sizeof(test_str2)-1;
+        p < vaddr + 4 * page_size; p++)
+   {
+      DEVSHELL_CMD_ASSERT(*p == 0);
+   }
+
+   printf("Write to a read-only private mapping: expecting SIGSEGV\n");
+
+   if (test_sig(do_mm_write, vaddr, SIGSEGV, 0, 0))
+      return 1;
+
+   /* Make the first page writable: the file must not change */
+   rc = mprotect(vaddr, page_size, PROT_READ | PROT_WRITE);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   vaddr[0] = 'T';
+
+   fd = open(test_file, O_RDONLY);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+
+   rc = pread(fd, buf, sizeof(test_str)-1, 0);
+   DEVSHELL_CMD_ASSERT(rc == sizeof(test_str)-1);
+   DEVSHELL_CMD_ASSERT(!memcmp(buf, test_str, sizeof(test_str)-1));
+   DEVSHELL_CMD_ASSERT(!memcmp(vaddr, test_str_exp, sizeof(test_str_exp)-1));
+
+   /* The rest of the mapping, instead, is still read-only */
+   if (test_sig(do_mm_write, vaddr + page_size, SIGSEGV, 0, 0))
+      return 1;
+
+   /* Replace the 3rd page with the 2nd page of the file, using MAP_FIXED */
+   p = mmap(vaddr + 2 * page_size, page_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_FIXED, fd, page_size);
+
+   DEVSHELL_CMD_ASSERT(p == vaddr + 2 * page_size);
+   DEVSHELL_CMD_ASSERT(!memcmp(p, test_str2, sizeof(test_str2)-1));
+   p[0] = 'H';
+
+   rc = pread(fd, buf, sizeof(test_str2)-1, page_size);
+   DEVSHELL_CMD_ASSERT(rc == sizeof(test_str2)-1);
+   DEVSHELL_CMD_ASSERT(!memcmp(buf, test_str2, sizeof(test_str2)-1));
+
+   /* Read-only again: the content of the private page must be preserved */
+   rc = mprotect(vaddr, 3 * page_size, PROT_READ);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(vaddr[0] == 'T' && p[0] == 'H');
+
+   if (test_sig(do_mm_write, vaddr, SIGSEGV, 0, 0))
+      return 1;
+
+   /* Un-map all the 3 mappings at once, then re-use the address as a hint */
+   rc = munmap(vaddr, 4 * page_size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   p = mmap(vaddr, page_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+   DEVSHELL_CMD_ASSERT(p == vaddr);
+   DEVSHELL_CMD_ASSERT(*p == 0);
+
+   rc = munmap(p, page_size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   close(fd);
+   rc = unlink(test_file);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return 0;
+}
@@ -8,15 +8,23 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <time.h>
+#include <dirent.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <sys/mman.h>
 #include <sys/time.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/resource.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
 
 #include "devshell.h"
 #include "sysenter.h"
+#include "test_common.h"
 
 void create_test_file(const char *path, int n)
 {
@@ -109,3 +117,1498 @@ int cmd_fs_perf2(int argc, char **argv)
    DEVSHELL_CMD_ASSERT(rc == 0);
    return 0;
 }
+
+static u64 fmmap_perf_read(int fd, size_t file_size, int flags, int advice)
+{
+   volatile unsigned sum = 0;
+   unsigned *vaddr;
+   u64 start, end;
+   int rc;
+
+   start = RDTSC();
+
+   vaddr = mmap(NULL, file_size, PROT_READ, MAP_SHARED | flags, fd, 0);
+   DEVSHELL_CMD_ASSERT(vaddr != (void *)-1);
+
+   if (advice != MADV_NORMAL) {
+      rc = madvise(vaddr, file_size, advice);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   for (size_t i = 0; i < file_size / sizeof(unsigned); i++)
+      sum += vaddr[i];
+
+   end = RDTSC();
+
+   rc = munmap(vaddr, file_size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return end - start;
+}
+
+static u64 mmap_perf_anon_write(size_t size, int flags)
+{
+   char *vaddr;
+   u64 start, end;
+   int rc;
+
+   start = RDTSC();
+
+   vaddr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+
+   DEVSHELL_CMD_ASSERT(vaddr != (void *)-1);
+
+   for (size_t i = 0; i < size; i += 64)
+      vaddr[i] = 1;
+
+   end = RDTSC();
+
+   rc = munmap(vaddr, size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return end - start;
+}
+
+/*
+ * Measure the throughput of sequentially reading a memory-mapped file with and
+ * without fault-around (disabled with MADV_RANDOM) and with MAP_POPULATE. Also,
+ * measure the cost of writing a fresh anonymous mapping with and without
+ * MAP_POPULATE.
+ */
+int cmd_fmmap_perf(int argc, char **argv)
+{
+   const int iters = 16;
+   const size_t file_size = 1 * MB;
+   const char *dest_dir = argc > 0 ? argv[0] : "/tmp";
+   u64 fa = 0, no_fa = 0, pop = 0, anon = 0, anon_pop = 0;
+   char path[256];
+   char *buf;
+   int fd, rc;
+
+   printf("Using '%s' as test dir\n", dest_dir);
+   sprintf(path, "%s/test_file", dest_dir);
+
+   buf = malloc(file_size);
+   DEVSHELL_CMD_ASSERT(buf != NULL);
+   memset(buf, 'a', file_size);
+
+   fd = open(path, O_RDWR | O_CREAT, 0644);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+
+   rc = write(fd, buf, file_size);
+   DEVSHELL_CMD_ASSERT(rc == (int)file_size);
+   free(buf);
+
+   for (int i = 0; i < iters; i++) {
+      fa += fmmap_perf_read(fd, file_size, 0, MADV_NORMAL);
+      no_fa += fmmap_perf_read(fd, file_size, 0, MADV_RANDOM);
+      pop += fmmap_perf_read(fd, file_size, MAP_POPULATE, MADV_NORMAL);
+      anon += mmap_perf_anon_write(file_size, 0);
+      anon_pop += mmap_perf_anon_write(file_size, MAP_POPULATE);
+   }
+
+   close(fd);
+   rc = unlink(path);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   printf("Avg. cycles per KB (mmap + sequential access of 1 MB)\n");
+   printf("    file read, fault-around:    %6llu\n", fa / iters / KB);
+   printf("    file read, no fault-around: %6llu\n", no_fa / iters / KB);
+   printf("    file read, MAP_POPULATE:    %6llu\n", pop / iters / KB);
+   printf("    anon write:                 %6llu\n", anon / iters / KB);
+   printf("    anon write, MAP_POPULATE:   %6llu\n", anon_pop / iters / KB);
+   return 0;
+}
+
+/*
+ * stat() storm: repeatedly stat() a deep path and a missing file in it, like
+ * a shell searching for commands in $PATH does.
+ */
+int cmd_stat_perf(int argc, char **argv)
+{
+   const int n = 10000;
+   const char *dirs[] = {
+      "/tmp/sp", "/tmp/sp/a1", "/tmp/sp/a1/b22", "/tmp/sp/a1/b22/c333",
+      "/tmp/sp/a1/b22/c333/d4444", "/tmp/sp/a1/b22/c333/d4444/e55555",
+   };
+   const char *file = "/tmp/sp/a1/b22/c333/d4444/e55555/file";
+   const char *missing = "/tmp/sp/a1/b22/c333/d4444/e55555/missing";
+   unsigned long hits0 = 0, neg0 = 0, miss0 = 0, hits, neg, miss;
+   bool have_stats;
+   u64 start, pos, negative;
+   struct stat st;
+   int rc, fd;
+
+   for (int i = 0; i < (int)ARRAY_SIZE(dirs); i++) {
+      rc = mkdir(dirs[i], 0755);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   fd = creat(file, 0644);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+   close(fd);
+
+   have_stats =
+      read_sysfs_ulong("/syst/vfs/dcache/hits", &hits0) &&
+      read_sysfs_ulong("/syst/vfs/dcache/neg_hits", &neg0) &&
+      read_sysfs_ulong("/syst/vfs/dcache/misses", &miss0);
+
+   start = RDTSC();
+
+   for (int i = 0; i < n; i++) {
+      rc = stat(file, &st);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   pos = (RDTSC() - start) / n;
+   start = RDTSC();
+
+   for (int i = 0; i < n; i++) {
+      rc = stat(missing, &st);
+      DEVSHELL_CMD_ASSERT(rc < 0 && errno == ENOENT);
+   }
+
+   negative = (RDTSC() - start) / n;
+
+   printf("Avg. stat() cost, existing file: %6llu cycles\n", pos);
+   printf("Avg. stat() cost, missing file:  %6llu cycles\n", negative);
+
+   if (have_stats &&
+       read_sysfs_ulong("/syst/vfs/dcache/hits", &hits) &&
+       read_sysfs_ulong("/syst/vfs/dcache/neg_hits", &neg) &&
+       read_sysfs_ulong("/syst/vfs/dcache/misses", &miss))
+   {
+      printf("dcache: hits: %lu, neg_hits: %lu, misses: %lu\n",
+             hits - hits0, neg - neg0, miss - miss0);
+   }
+
+   rc = unlink(file);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   for (int i = (int)ARRAY_SIZE(dirs) - 1; i >= 0; i--) {
+      rc = rmdir(dirs[i]);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   return 0;
+}
+
+static u64 ramfs_perf_seq(int fd, char *buf, size_t file_size, bool wr)
+{
+   u64 start;
+   int rc;
+
+   rc = (int)lseek(fd, 0, SEEK_SET);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   start = RDTSC();
+
+   for (size_t off = 0; off < file_size; off += 4 * KB) {
+
+      rc = wr ? write(fd, buf, 4 * KB) : read(fd, buf, 4 * KB);
+      DEVSHELL_CMD_ASSERT(rc == 4 * KB);
+   }
+
+   return RDTSC() - start;
+}
+
+static u64
+ramfs_perf_rand(int fd, char *buf, size_t file_size, bool wr, int n)
+{
+   const size_t pages = file_size / (4 * KB);
+   u64 start;
+   int rc;
+
+   srand(1234);
+   start = RDTSC();
+
+   for (int i = 0; i < n; i++) {
+
+      off_t off = (off_t)((size_t)rand() % pages) * 4 * KB;
+
+      rc = (int)lseek(fd, off, SEEK_SET);
+      DEVSHELL_CMD_ASSERT(rc == (int)off);
+
+      rc = wr ? write(fd, buf, 4 * KB) : read(fd, buf, 4 * KB);
+      DEVSHELL_CMD_ASSERT(rc == 4 * KB);
+   }
+
+   return RDTSC() - start;
+}
+
+/*
+ * Measure the cost of sequential and random 4 KB reads and writes on ramfs
+ * files of growing size, stressing the index of the file blocks. The max file
+ * size (in MB) can be passed as an argument. The default is 16 MB, in order to
+ * fit in the memory of the test VM.
+ */
+int cmd_ramfs_perf(int argc, char **argv)
+{
+   const int n_rand = 4096;
+   const size_t max_size = (argc > 0 ? (size_t)atoi(argv[0]) : 16) * MB;
+   const char *path = "/tmp/test_file";
+   u64 seq_wr, seq_rd, rand_wr, rand_rd;
+   char *buf;
+   int fd, rc;
+
+   buf = malloc(4 * KB);
+   DEVSHELL_CMD_ASSERT(buf != NULL);
+   memset(buf, 'a', 4 * KB);
+
+   printf("Avg. cycles per 4 KB op:\n");
+   printf("    %8s %8s %8s %8s %8s\n",
+          "size", "seq wr", "seq rd", "rand wr", "rand rd");
+
+   for (size_t size = 1 * MB; size <= max_size; size *= 4) {
+
+      const u64 n_seq = size / (4 * KB);
+
+      fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+      DEVSHELL_CMD_ASSERT(fd > 0);
+
+      seq_wr = ramfs_perf_seq(fd, buf, size, true) / n_seq;
+      seq_rd = ramfs_perf_seq(fd, buf, size, false) / n_seq;
+      rand_wr = ramfs_perf_rand(fd, buf, size, true, n_rand) / n_rand;
+      rand_rd = ramfs_perf_rand(fd, buf, size, false, n_rand) / n_rand;
+
+      close(fd);
+      rc = unlink(path);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+
+      printf("    %5u MB %8llu %8llu %8llu %8llu\n",
+             (unsigned)(size / MB), seq_wr, seq_rd, rand_wr, rand_rd);
+   }
+
+   free(buf);
+   return 0;
+}
+
+static int get_extents_count(int fd)
+{
+   struct fiemap fm = {
+      .fm_start = 0,
+      .fm_length = FIEMAP_MAX_OFFSET,
+      .fm_extent_count = 0,
+   };
+
+   int rc = ioctl(fd, FS_IOC_FIEMAP, &fm);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return (int)fm.fm_mapped_extents;
+}
+
+/*
+ * Measure the throughput of large sequential writes (using 64 KB buffers) and
+ * check that the blocks of the file get allocated in a few big extents, while
+ * the pre-allocated blocks past EOF are released on close.
+ */
+int cmd_ramfs_seqwr(int argc, char **argv)
+{
+   const size_t buf_size = 64 * KB;
+   const size_t file_size = (argc > 0 ? (size_t)atoi(argv[0]) : 16) * MB;
+   const char *path = "/tmp/test_file";
+   struct stat st;
+   u64 start, elapsed;
+   int fd, rc, extents;
+   char *buf;
+
+   buf = malloc(buf_size);
+   DEVSHELL_CMD_ASSERT(buf != NULL);
+   memset(buf, 'a', buf_size);
+
+   fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+
+   start = RDTSC();
+
+   for (size_t off = 0; off < file_size; off += buf_size) {
+      rc = write(fd, buf, buf_size);
+      DEVSHELL_CMD_ASSERT(rc == (int)buf_size);
+   }
+
+   elapsed = RDTSC() - start;
+
+   /* Append a few bytes, in order to leave pre-allocated blocks past EOF */
+   rc = write(fd, buf, 10);
+   DEVSHELL_CMD_ASSERT(rc == 10);
+
+   extents = get_extents_count(fd);
+   close(fd);
+
+   rc = stat(path, &st);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   printf("Sequential write of %u MB\n", (unsigned)(file_size / MB));
+   printf("    Avg. cycles per KB: %llu\n", elapsed / (file_size / KB));
+   printf("    Extents:            %d\n", extents);
+   printf("    Blocks (512 B):     %lu\n", (unsigned long)st.st_blocks);
+
+   DEVSHELL_CMD_ASSERT(extents > 0);
+   DEVSHELL_CMD_ASSERT((size_t)extents < file_size / (2 * MB) + 16);
+   DEVSHELL_CMD_ASSERT(st.st_blocks == (blkcnt_t)(file_size / 512 + 8));
+
+   /* Random writes, instead, allocate one block at the time */
+   fd = open(path, O_WRONLY | O_TRUNC);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+
+   for (int i = 0; i < 4; i++) {
+      rc = (int)lseek(fd, (3 - i) * 2 * 4096, SEEK_SET);
+      DEVSHELL_CMD_ASSERT(rc >= 0);
+      rc = write(fd, buf, 4096);
+      DEVSHELL_CMD_ASSERT(rc == 4096);
+   }
+
+   extents = get_extents_count(fd);
+   DEVSHELL_CMD_ASSERT(extents == 4);
+   close(fd);
+
+   rc = unlink(path);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   free(buf);
+   return 0;
+}
+
+static int dir_perf_get_id(struct dirent *de)
+{
+   return de->d_name[0] == 'f' ? atoi(de->d_name + 1) : -1;
+}
+
+/*
+ * Measure the cost of lookups, readdir() and seekdir() in a directory with
+ * many entries (10k by default: the count can be passed as an argument, e.g.
+ * 100000, memory permitting). Then, check that removing the entries while
+ * iterating over the directory does not skip or repeat any of them.
+ */
+int cmd_dir_perf(int argc, char **argv)
+{
+   const int n = argc > 0 ? atoi(argv[0]) : 10000;
+   const int n_seeks = 1000;
+   const char *dir_path = "/tmp/dir_perf";
+   u64 start, creat_c, stat_c, readdir_c, seek_c, unlink_c;
+   struct dirent *de;
+   struct stat st;
+   char path[512];
+   long *pos;
+   int *ids;
+   int rc, cnt, removed;
+   DIR *d;
+
+   DEVSHELL_CMD_ASSERT(n > 0);
+
+   pos = malloc(sizeof(long) * (size_t)(n + 2));
+   ids = malloc(sizeof(int) * (size_t)(n + 2));
+   DEVSHELL_CMD_ASSERT(pos != NULL && ids != NULL);
+
+   rc = mkdir(dir_path, 0755);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   start = RDTSC();
+
+   for (int i = 0; i < n; i++) {
+      sprintf(path, "%s/f%06d", dir_path, i);
+      rc = creat(path, 0644);
+      DEVSHELL_CMD_ASSERT(rc > 0);
+      close(rc);
+   }
+
+   creat_c = (RDTSC() - start) / (u64)n;
+
+   srand(1234);
+   start = RDTSC();
+
+   for (int i = 0; i < n; i++) {
+      sprintf(path, "%s/f%06d", dir_path, rand() % n);
+      rc = stat(path, &st);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   stat_c = (RDTSC() - start) / (u64)n;
+
+   d = opendir(dir_path);
+   DEVSHELL_CMD_ASSERT(d != NULL);
+
+   cnt = 0;
+   start = RDTSC();
+
+   while ((de = readdir(d))) {
+      DEVSHELL_CMD_ASSERT(cnt < n + 2);
+      ids[cnt] = dir_perf_get_id(de);
+      pos[cnt++] = telldir(d);
+   }
+
+   readdir_c = (RDTSC() - start) / (u64)cnt;
+   DEVSHELL_CMD_ASSERT(cnt == n + 2);
+
+   /* Seek right after a random entry and check that we get the next one */
+   start = RDTSC();
+
+   for (int i = 0; i < n_seeks; i++) {
+
+      const int k = rand() % (n + 1);
+
+      seekdir(d, pos[k]);
+      de = readdir(d);
+      DEVSHELL_CMD_ASSERT(de != NULL);
+      DEVSHELL_CMD_ASSERT(dir_perf_get_id(de) == ids[k + 1]);
+   }
+
+   seek_c = (RDTSC() - start) / n_seeks;
+
+   /* Remove all the entries while iterating over the directory */
+   rewinddir(d);
+   removed = 0;
+   start = RDTSC();
+
+   while ((de = readdir(d))) {
+
+      if (dir_perf_get_id(de) < 0)
+         continue;
+
+      snprintf(path, sizeof(path), "%s/%s", dir_path, de->d_name);
+      rc = unlink(path);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+      removed++;
+   }
+
+   unlink_c = (RDTSC() - start) / (u64)n;
+   closedir(d);
+
+   DEVSHELL_CMD_ASSERT(removed == n);
+
+   rc = rmdir(dir_path);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   free(ids);
+   free(pos);
+
+   printf("Directory with %d entries, avg. cycles per op:\n", n);
+   printf("    creat():             %8llu\n", creat_c);
+   printf("    stat():              %8llu\n", stat_c);
+   printf("    readdir():           %8llu\n", readdir_c);
+   printf("    seekdir()+readdir(): %8llu\n", seek_c);
+   printf("    readdir()+unlink():  %8llu\n", unlink_c);
+   return 0;
+}
+
+static bool read_ramfs_dir_stats(unsigned long *entries, unsigned long *mem)
+{
+   return read_sysfs_ulong("/syst/vfs/ramfs/dir_entries", entries) &&
+          read_sysfs_ulong("/syst/vfs/ramfs/dir_entries_mem", mem);
+}
+
+/*
+ * Check the heap memory used by the entries of a directory with many small
+ * files, as reported by sysfs and by st_size of the directory itself.
+ */
+int cmd_ramfs_dmem(int argc, char **argv)
+{
+   const int n = argc > 0 ? atoi(argv[0]) : 10000;
+   const char *dir_path = "/tmp/dmem";
+   unsigned long entries0, mem0, entries, mem;
+   unsigned long per_entry;
+   struct stat st;
+   char path[256];
+   int rc;
+
+   DEVSHELL_CMD_ASSERT(n > 0);
+
+   if (!read_ramfs_dir_stats(&entries0, &mem0)) {
+      printf("SKIP: sysfs not available\n");
+      return 0;
+   }
+
+   rc = mkdir(dir_path, 0755);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   for (int i = 0; i < n; i++) {
+      sprintf(path, "%s/f%06d", dir_path, i);
+      rc = creat(path, 0644);
+      DEVSHELL_CMD_ASSERT(rc > 0);
+      close(rc);
+   }
+
+   DEVSHELL_CMD_ASSERT(read_ramfs_dir_stats(&entries, &mem));
+
+   rc = stat(dir_path, &st);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   /* The n files, plus ".", ".." and the entry of the dir in /tmp */
+   DEVSHELL_CMD_ASSERT(entries - entries0 == (unsigned long)n + 3);
+   per_entry = (mem - mem0) / (entries - entries0);
+
+   printf("Directory with %d entries\n", n);
+   printf("    Heap used by the entries: %lu KB\n", (mem - mem0) / KB);
+   printf("    Avg. bytes per entry:     %lu\n", per_entry);
+   printf("    Dir st_size:              %lu KB\n",
+          (unsigned long)st.st_size / KB);
+
+   /* Short names must fit in a 64 bytes block (128 bytes on 64-bit) */
+   DEVSHELL_CMD_ASSERT(per_entry <= 16 * sizeof(void *));
+   DEVSHELL_CMD_ASSERT((unsigned long)st.st_size <= mem - mem0);
+
+   for (int i = 0; i < n; i++) {
+      sprintf(path, "%s/f%06d", dir_path, i);
+      rc = unlink(path);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   rc = rmdir(dir_path);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   DEVSHELL_CMD_ASSERT(read_ramfs_dir_stats(&entries, &mem));
+   DEVSHELL_CMD_ASSERT(entries == entries0);
+   DEVSHELL_CMD_ASSERT(mem == mem0);
+   return 0;
+}
+
+static u64 rw_perf_get_usecs(void)
+{
+   struct timespec ts;
+   int rc = clock_gettime(CLOCK_MONOTONIC, &ts);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   return (u64)ts.tv_sec * 1000000 + (u64)ts.tv_nsec / 1000;
+}
+
+static unsigned rw_perf_mb_per_sec(size_t bytes, u64 usecs)
+{
+   return usecs ? (unsigned)((u64)bytes * 1000000 / MB / usecs) : 0;
+}
+
+/* Transfer `tot` bytes from/to `fd` with `buf_size` bytes per syscall */
+static u64
+rw_perf_transfer(int fd, char *buf, size_t buf_size, size_t tot, bool wr)
+{
+   u64 start = rw_perf_get_usecs();
+   ssize_t rc;
+
+   for (size_t done = 0; done < tot; done += (size_t)rc) {
+
+      rc = wr
+         ? write(fd, buf, MIN(buf_size, tot - done))
+         : read(fd, buf, MIN(buf_size, tot - done));
+
+      DEVSHELL_CMD_ASSERT(rc > 0);
+   }
+
+   return rw_perf_get_usecs() - start;
+}
+
+static u64 rw_perf_pipe(char *buf, size_t buf_size, size_t tot)
+{
+   int fds[2], wstatus;
+   u64 elapsed;
+   int rc, pid;
+
+   rc = pipe(fds);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   pid = fork();
+   DEVSHELL_CMD_ASSERT(pid >= 0);
+
+   if (!pid) {
+      close(fds[0]);
+      rw_perf_transfer(fds[1], buf, buf_size, tot, true);
+      exit(0);
+   }
+
+   close(fds[1]);
+   elapsed = rw_perf_transfer(fds[0], buf, buf_size, tot, false);
+   close(fds[0]);
+
+   rc = waitpid(pid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == pid);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+   return elapsed;
+}
+
+/*
+ * dd-style throughput test: write and read back a file with read() and write()
+ * using buffers of different sizes, then move data through a pipe. The file
+ * size (in MB) can be passed as an argument.
+ */
+int cmd_rw_perf(int argc, char **argv)
+{
+   const size_t buf_sizes[] = { 4 * KB, 64 * KB, 1 * MB, 8 * MB };
+   const size_t file_size = (argc > 0 ? (size_t)atoi(argv[0]) : 8) * MB;
+   const size_t pipe_tot = 4 * MB;
+   const char *path = "/tmp/test_file";
+   u64 wr, rd, pp;
+   char *buf;
+   int fd, rc;
+
+   buf = malloc(8 * MB);
+   DEVSHELL_CMD_ASSERT(buf != NULL);
+
+   for (size_t i = 0; i < 8 * MB; i++)
+      buf[i] = (char)i;
+
+   printf("Throughput in MB/s (file: %u MB, pipe: %u MB)\n",
+          (unsigned)(file_size / MB), (unsigned)(pipe_tot / MB));
+   printf("    %8s %8s %8s %8s\n", "buf", "write", "read", "pipe");
+
+   for (int i = 0; i < (int)ARRAY_SIZE(buf_sizes); i++) {
+
+      const size_t bs = buf_sizes[i];
+
+      fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+      DEVSHELL_CMD_ASSERT(fd > 0);
+
+      wr = rw_perf_transfer(fd, buf, bs, file_size, true);
+
+      rc = (int)lseek(fd, 0, SEEK_SET);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+
+      rd = rw_perf_transfer(fd, buf, bs, file_size, false);
+
+      /* The last buffer read must contain the data we wrote */
+      for (size_t k = 0; k < MIN(bs, file_size); k++)
+         DEVSHELL_CMD_ASSERT(buf[k] == (char)k);
+
+      close(fd);
+      rc = unlink(path);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+
+      pp = rw_perf_pipe(buf, bs, pipe_tot);
+
+      printf("    %5u KB %8u %8u %8u\n",
+             (unsigned)(bs / KB),
+             rw_perf_mb_per_sec(file_size, wr),
+             rw_perf_mb_per_sec(file_size, rd),
+             rw_perf_mb_per_sec(pipe_tot, pp));
+   }
+
+   free(buf);
+   return 0;
+}
+
+static inline u32 pread_perf_word(size_t off)
+{
+   return (u32)(off / sizeof(u32)) * 2654435761u;
+}
+
+/*
+ * Read `n` random 4 KB pages of the file with pread(), or with lseek() + read()
+ * when `use_seek` is true, checking their content.
+ */
+static u64
+pread_perf_run(int fd, size_t file_size, int n, bool use_seek, unsigned seed)
+{
+   const size_t pages = file_size / (4 * KB);
+   u32 buf[4 * KB / sizeof(u32)];
+   u64 start;
+   int rc;
+
+   srand(seed);
+   start = RDTSC();
+
+   for (int i = 0; i < n; i++) {
+
+      const size_t off = ((size_t)rand() % pages) * 4 * KB;
+
+      if (use_seek) {
+         rc = (int)lseek(fd, (off_t)off, SEEK_SET);
+         DEVSHELL_CMD_ASSERT(rc == (int)off);
+         rc = read(fd, buf, sizeof(buf));
+      } else {
+         rc = pread(fd, buf, sizeof(buf), (off_t)off);
+      }
+
+      DEVSHELL_CMD_ASSERT(rc == sizeof(buf));
+      DEVSHELL_CMD_ASSERT(buf[0] == pread_perf_word(off));
+   }
+
+   return RDTSC() - start;
+}
+
+/*
+ * Measure the cost of random 4 KB reads with pread() vs. lseek() + read() and
+ * run several processes doing concurrent pread() calls on the same (shared)
+ * file descriptor, checking that they always get the right data. The number
+ * of processes can be passed as an argument.
+ */
+int cmd_pread_perf(int argc, char **argv)
+{
+   const int n_procs = argc > 0 ? atoi(argv[0]) : 4;
+   const size_t file_size = 4 * MB;
+   const int n = 4096;
+   const char *path = "/tmp/test_file";
+   u64 seek_c, pread_c, start, conc_c;
+   u32 *buf;
+   int fd, rc, wstatus;
+   int pids[16];
+
+   DEVSHELL_CMD_ASSERT(n_procs > 0 && n_procs <= (int)ARRAY_SIZE(pids));
+
+   buf = malloc(file_size);
+   DEVSHELL_CMD_ASSERT(buf != NULL);
+
+   for (size_t i = 0; i < file_size / sizeof(u32); i++)
+      buf[i] = pread_perf_word(i * sizeof(u32));
+
+   fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+
+   /* Write the file with pwrite(), in reverse order */
+   for (size_t off = file_size; off > 0; off -= 64 * KB) {
+      rc = pwrite(fd, (char *)buf + off - 64 * KB, 64 * KB,
+                  (off_t)(off - 64 * KB));
+      DEVSHELL_CMD_ASSERT(rc == 64 * KB);
+   }
+
+   free(buf);
+
+   /* Positional I/O must not change the file position */
+   DEVSHELL_CMD_ASSERT(lseek(fd, 0, SEEK_CUR) == 0);
+
+   seek_c = pread_perf_run(fd, file_size, n, true, 1234) / n;
+
+   rc = (int)lseek(fd, 123, SEEK_SET);
+   DEVSHELL_CMD_ASSERT(rc == 123);
+
+   pread_c = pread_perf_run(fd, file_size, n, false, 1234) / n;
+   DEVSHELL_CMD_ASSERT(lseek(fd, 0, SEEK_CUR) == 123);
+
+   start = RDTSC();
+
+   for (int i = 0; i < n_procs; i++) {
+
+      pids[i] = fork();
+      DEVSHELL_CMD_ASSERT(pids[i] >= 0);
+
+      if (!pids[i]) {
+         pread_perf_run(fd, file_size, n, false, (unsigned)i);
+         exit(0);
+      }
+   }
+
+   for (int i = 0; i < n_procs; i++) {
+      rc = waitpid(pids[i], &wstatus, 0);
+      DEVSHELL_CMD_ASSERT(rc == pids[i]);
+      DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+   }
+
+   conc_c = (RDTSC() - start) / (u64)(n * n_procs);
+
+   close(fd);
+   rc = unlink(path);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   printf("Avg. cycles per random 4 KB read:\n");
+   printf("    lseek() + read():              %8llu\n", seek_c);
+   printf("    pread():                       %8llu\n", pread_c);
+   printf("    pread(), %2d procs, shared fd:  %8llu\n", n_procs, conc_c);
+   return 0;
+}
+
+/*
+ * Write `n` records the way musl's stdio flushes its buffer: a single writev()
+ * with the buffered data plus the new data. When `split` is true, use two
+ * write() calls instead.
+ */
+static u64 writev_perf_run(int fd, struct iovec *iov, int n, bool split)
+{
+   const size_t tot = iov[0].iov_len + iov[1].iov_len;
+   u64 start = RDTSC();
+   int rc;
+
+   for (int i = 0; i < n; i++) {
+
+      if (split) {
+         rc = write(fd, iov[0].iov_base, iov[0].iov_len);
+         rc += write(fd, iov[1].iov_base, iov[1].iov_len);
+      } else {
+         rc = writev(fd, iov, 2);
+      }
+
+      DEVSHELL_CMD_ASSERT(rc == (int)tot);
+   }
+
+   return RDTSC() - start;
+}
+
+static u64 writev_perf_pipe(struct iovec *iov, int n)
+{
+   const size_t tot = (iov[0].iov_len + iov[1].iov_len) * (size_t)n;
+   char buf[4096];
+   int fds[2], wstatus;
+   size_t done = 0;
+   u64 elapsed;
+   int rc, pid;
+
+   rc = pipe(fds);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   pid = fork();
+   DEVSHELL_CMD_ASSERT(pid >= 0);
+
+   if (!pid) {
+      close(fds[1]);
+
+      while (done < tot) {
+         rc = read(fds[0], buf, sizeof(buf));
+         DEVSHELL_CMD_ASSERT(rc > 0);
+         done += (size_t)rc;
+      }
+
+      exit(0);
+   }
+
+   close(fds[0]);
+   elapsed = writev_perf_run(fds[1], iov, n, false);
+   close(fds[1]);
+
+   rc = waitpid(pid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == pid);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+   return elapsed;
+}
+
+/*
+ * Measure the cost of writev() calls with two buffers (1 KB of buffered data
+ * plus a short line), like the ones made by musl's stdio, on a ramfs file and
+ * on a pipe, compared to two write() calls. Also, measure fprintf() itself.
+ */
+int cmd_writev_perf(int argc, char **argv)
+{
+   const int n = 4096;
+   const char *path = "/tmp/test_file";
+   static char stdio_buf[1024];
+   static char data[1024];
+   static char line[] = "a short line of text, appended to the buffer\n";
+   struct iovec iov[2] = {
+      { data, sizeof(data) },
+      { line, sizeof(line) - 1 },
+   };
+   u64 wv, wr, pp, start, fp;
+   FILE *fh;
+   int fd, rc;
+
+   memset(data, 'x', sizeof(data));
+
+   fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+
+   wv = writev_perf_run(fd, iov, n, false) / n;
+   wr = writev_perf_run(fd, iov, n, true) / n;
+   close(fd);
+
+   pp = writev_perf_pipe(iov, n) / n;
+
+   fh = fopen(path, "w");
+   DEVSHELL_CMD_ASSERT(fh != NULL);
+   setvbuf(fh, stdio_buf, _IOFBF, sizeof(stdio_buf));
+
+   start = RDTSC();
+
+   for (int i = 0; i < n * 16; i++)
+      fprintf(fh, "line %6d: %s", i, line);
+
+   fclose(fh);
+   fp = (RDTSC() - start) / (n * 16);
+
+   rc = unlink(path);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   printf("Avg. cycles per op (1 KB + %u bytes):\n", (unsigned)iov[1].iov_len);
+   printf("    file, writev():       %8llu\n", wv);
+   printf("    file, 2x write():     %8llu\n", wr);
+   printf("    pipe, writev():       %8llu\n", pp);
+   printf("    file, fprintf() line: %8llu\n", fp);
+   return 0;
+}
+
+enum cp_perf_method {
+   CP_READ_WRITE,
+   CP_SENDFILE,
+   CP_COPY_FILE_RANGE,
+   CP_SPLICE,
+};
+
+/* Copy `tot` bytes from `in` to `out` using the given method */
+static u64
+cp_perf_copy(int in, int out, size_t tot, enum cp_perf_method m, char *buf)
+{
+   u64 start = rw_perf_get_usecs();
+   int fds[2];
+   ssize_t rc, n;
+
+   if (m == CP_SPLICE) {
+      rc = pipe(fds);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   for (size_t done = 0; done < tot; done += (size_t)rc) {
+
+      const size_t len = MIN(64 * KB, tot - done);
+
+      switch (m) {
+
+         case CP_READ_WRITE:
+            rc = read(in, buf, len);
+            DEVSHELL_CMD_ASSERT(rc > 0);
+            rc = write(out, buf, (size_t)rc);
+            break;
+
+         case CP_SENDFILE:
+            rc = sendfile(out, in, NULL, len);
+            break;
+
+         case CP_COPY_FILE_RANGE:
+            rc = syscall(SYS_copy_file_range, in, NULL, out, NULL, len, 0);
+            break;
+
+         case CP_SPLICE:
+
+            /* file -> pipe, then pipe -> file */
+            rc = syscall(SYS_splice, in, NULL, fds[1], NULL, len, 0);
+            DEVSHELL_CMD_ASSERT(rc > 0);
+
+            for (ssize_t left = rc; left > 0; left -= n) {
+               n = syscall(SYS_splice, fds[0], NULL, out, NULL, left, 0);
+               DEVSHELL_CMD_ASSERT(n > 0);
+            }
+
+            break;
+      }
+
+      DEVSHELL_CMD_ASSERT(rc > 0);
+   }
+
+   if (m == CP_SPLICE) {
+      close(fds[0]);
+      close(fds[1]);
+   }
+
+   return rw_perf_get_usecs() - start;
+}
+
+/*
+ * Measure the throughput of copying a file with read() + write() and with the
+ * syscalls moving the data entirely in the kernel: sendfile(),
+ * copy_file_range() and splice() through a pipe. The destination is always a
+ * ramfs file, while the source is a ramfs file or the file passed as argument
+ * (e.g. a file on the initrd).
+ */
+int cmd_cp_perf(int argc, char **argv)
+{
+   static const char *names[] = {
+      "read() + write()", "sendfile()", "copy_file_range()", "splice()",
+   };
+
+   const char *src_path = argc > 0 ? argv[0] : "/tmp/cp_perf_src";
+   const char *dst_path = "/tmp/cp_perf_dst";
+   char *buf, *buf2;
+   struct stat st;
+   s64 off_in, off_out;
+   size_t size;
+   u64 elapsed;
+   int in, out, rc;
+
+   buf = malloc(8 * MB);
+   buf2 = malloc(64 * KB);
+   DEVSHELL_CMD_ASSERT(buf != NULL && buf2 != NULL);
+
+   if (argc == 0) {
+
+      for (size_t i = 0; i < 8 * MB; i++)
+         buf[i] = (char)(i * 7 + i / 4096);
+
+      in = open(src_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+      DEVSHELL_CMD_ASSERT(in > 0);
+      rw_perf_transfer(in, buf, 8 * MB, 8 * MB, true);
+      close(in);
+   }
+
+   rc = stat(src_path, &st);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   size = (size_t)st.st_size;
+
+   printf("Copy throughput in MB/s (file: %u KB)\n", (unsigned)(size / KB));
+
+   for (int m = CP_READ_WRITE; m <= CP_SPLICE; m++) {
+
+      in = open(src_path, O_RDONLY);
+      DEVSHELL_CMD_ASSERT(in > 0);
+
+      out = open(dst_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+      DEVSHELL_CMD_ASSERT(out > 0);
+
+      elapsed = cp_perf_copy(in, out, size, m, buf);
+
+      /* Check the copy */
+      rc = (int)lseek(in, 0, SEEK_SET);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+      rc = (int)lseek(out, 0, SEEK_SET);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+
+      for (size_t done = 0; done < size; done += (size_t)rc) {
+
+         rc = read(in, buf, MIN(64 * KB, size - done));
+         DEVSHELL_CMD_ASSERT(rc > 0);
+         DEVSHELL_CMD_ASSERT(read(out, buf2, (size_t)rc) == rc);
+         DEVSHELL_CMD_ASSERT(!memcmp(buf, buf2, (size_t)rc));
+      }
+
+      close(out);
+      close(in);
+
+      printf("    %-20s %8u\n", names[m], rw_perf_mb_per_sec(size, elapsed));
+   }
+
+   /* Overlapping ranges in the same file must be rejected, for any `len` */
+   out = open(dst_path, O_RDWR);
+   DEVSHELL_CMD_ASSERT(out > 0);
+
+   off_in = 0;
+   off_out = 4 * KB;
+   rc = syscall(SYS_copy_file_range,
+                out, &off_in, out, &off_out, (size_t)0x80001000, 0);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   close(out);
+   rc = unlink(dst_path);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   if (argc == 0) {
+      rc = unlink(src_path);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   free(buf2);
+   free(buf);
+   return 0;
+}
+
+/*
+ * Read `n` random 4 KB blocks of the file in the [begin, end) range, using
+ * lseek() + read(). Returns the avg. cycles per read.
+ */
+static u64
+fat_rd_perf_run(int fd, size_t begin, size_t end, int n, char *buf)
+{
+   const size_t blocks = (end - begin) / (4 * KB);
+   u64 start;
+   int rc;
+
+   DEVSHELL_CMD_ASSERT(blocks > 0);
+   start = RDTSC();
+
+   for (int i = 0; i < n; i++) {
+
+      const size_t off = begin + ((size_t)rand() % blocks) * 4 * KB;
+
+      rc = (int)lseek(fd, (off_t)off, SEEK_SET);
+      DEVSHELL_CMD_ASSERT(rc == (int)off);
+
+      rc = read(fd, buf, 4 * KB);
+      DEVSHELL_CMD_ASSERT(rc == 4 * KB);
+   }
+
+   return (RDTSC() - start) / (u64)n;
+}
+
+/*
+ * Measure the cost of random 4 KB reads near the beginning and near the end of
+ * a (big) file on the FAT initrd. Without an index of the cluster chain, the
+ * cost of seeking grows linearly with the offset. Also, check that pread() and
+ * mmap() return the same data as read() at random offsets. The file path can
+ * be passed as an argument: a file of 50 MB or more is recommended, which
+ * requires building Tilck with a bigger initrd.
+ */
+int cmd_fat_rd_perf(int argc, char **argv)
+{
+   const char *path = argc > 0 ? argv[0] : "/initrd/bin/busybox";
+   const int n = 2048;
+   char buf[4 * KB], buf2[4 * KB];
+   u64 head_c, tail_c;
+   struct stat st;
+   size_t size, slice;
+   char *vaddr;
+   int fd, rc;
+
+   fd = open(path, O_RDONLY);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+
+   rc = fstat(fd, &st);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   size = (size_t)st.st_size;
+   slice = MAX(size / 8, 4 * KB);
+   DEVSHELL_CMD_ASSERT(size >= 2 * slice);
+
+   srand(1234);
+   head_c = fat_rd_perf_run(fd, 0, slice, n, buf);
+   tail_c = fat_rd_perf_run(fd, size - slice, size, n, buf);
+
+   vaddr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+   DEVSHELL_CMD_ASSERT(vaddr != MAP_FAILED);
+
+   for (int i = 0; i < n; i++) {
+
+      const size_t off = (size_t)rand() % (size - 4 * KB);
+
+      rc = (int)lseek(fd, (off_t)off, SEEK_SET);
+      DEVSHELL_CMD_ASSERT(rc == (int)off);
+      rc = read(fd, buf, 4 * KB);
+      DEVSHELL_CMD_ASSERT(rc == 4 * KB);
+
+      rc = pread(fd, buf2, 4 * KB, (off_t)off);
+      DEVSHELL_CMD_ASSERT(rc == 4 * KB);
+
+      DEVSHELL_CMD_ASSERT(!memcmp(buf, buf2, 4 * KB));
+      DEVSHELL_CMD_ASSERT(!memcmp(buf, vaddr + off, 4 * KB));
+   }
+
+   rc = munmap(vaddr, size);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   close(fd);
+
+   printf("File: %s (%u KB)\n", path, (unsigned)(size / KB));
+   printf("Avg. cycles per random 4 KB lseek() + read():\n");
+   printf("    first 1/8 of the file: %8llu\n", head_c);
+   printf("    last 1/8 of the file:  %8llu\n", tail_c);
+   return 0;
+}
+
+/*
+ * Measure the cost of path lookups in a (big) directory on the FAT initrd.
+ * Missing names are never found in the dcache, therefore each one of them
+ * requires a lookup in the directory itself: without an index, that means
+ * walking all of its entries. The directory path can be passed as an argument:
+ * one having thousands of entries is recommended, which requires building Tilck
+ * with a custom initrd.
+ */
+int cmd_fat_lk_perf(int argc, char **argv)
+{
+   const char *dir_path = argc > 0 ? argv[0] : "/initrd/bin";
+   const int n = 1000;
+   u64 start, rd_c, miss_c, hit_c;
+   char path[512];
+   struct dirent *de;
+   struct stat st;
+   int cnt = 0, rc;
+   DIR *dir;
+
+   start = RDTSC();
+   dir = opendir(dir_path);
+   DEVSHELL_CMD_ASSERT(dir != NULL);
+
+   while ((de = readdir(dir)))
+      cnt++;
+
+   rd_c = RDTSC() - start;
+   DEVSHELL_CMD_ASSERT(cnt > 0);
+
+   start = RDTSC();
+
+   for (int i = 0; i < n; i++) {
+      snprintf(path, sizeof(path), "%s/missing_%d", dir_path, i);
+      rc = stat(path, &st);
+      DEVSHELL_CMD_ASSERT(rc < 0 && errno == ENOENT);
+   }
+
+   miss_c = (RDTSC() - start) / (u64)n;
+
+   rewinddir(dir);
+   start = RDTSC();
+
+   while ((de = readdir(dir))) {
+      snprintf(path, sizeof(path), "%s/%s", dir_path, de->d_name);
+      rc = stat(path, &st);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   hit_c = (RDTSC() - start) / (u64)cnt;
+   closedir(dir);
+
+   printf("Dir: %s (%d entries)\n", dir_path, cnt);
+   printf("Avg. cycles per readdir():              %8llu\n", rd_c / (u64)cnt);
+   printf("Avg. cycles per stat() of missing name: %8llu\n", miss_c);
+   printf("Avg. cycles per stat() of each entry:   %8llu\n", hit_c);
+   return 0;
+}
+
+/* Mark the test files in `buf` as seen, checking that none was seen before */
+static void
+getdents_mark_seen(char *buf, int len, char *seen, int n, int *cnt)
+{
+   struct linux_dirent64 *de;
+
+   for (int off = 0; off < len; off += de->d_reclen) {
+
+      de = (void *)(buf + off);
+
+      if (de->d_name[0] != 'f')
+         continue;
+
+      const int id = atoi(de->d_name + 1);
+      DEVSHELL_CMD_ASSERT(id >= 0 && id < n);
+      DEVSHELL_CMD_ASSERT(!seen[id]);
+      seen[id] = 1;
+      (*cnt)++;
+   }
+}
+
+/*
+ * Read all the entries of `fd` with getdents64() using a buffer of `buf_size`
+ * bytes, checking that each one of the `n` test files is returned exactly
+ * once. Returns the total cycles spent and sets `*calls` to the number of
+ * syscalls made.
+ */
+static u64
+getdents_perf_run(int fd, char *buf, int buf_size, char *seen, int n, int *calls)
+{
+   u64 start, tot = 0;
+   int rc, cnt = 0;
+
+   rc = (int)lseek(fd, 0, SEEK_SET);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   memset(seen, 0, (size_t)n);
+   *calls = 0;
+
+   while (true) {
+
+      start = RDTSC();
+      rc = getdents64((unsigned)fd, (void *)buf, (unsigned)buf_size);
+      tot += RDTSC() - start;
+      (*calls)++;
+
+      DEVSHELL_CMD_ASSERT(rc >= 0);
+
+      if (!rc)
+         break;
+
+      getdents_mark_seen(buf, rc, seen, n, &cnt);
+   }
+
+   DEVSHELL_CMD_ASSERT(cnt == n);
+   return tot;
+}
+
+/*
+ * Call getdents64() with a 512 KB buffer whose second half is not mapped: the
+ * entries copied before the fault are returned, while the others must be
+ * returned by the next calls, made with a valid buffer.
+ */
+static void getdents_check_partial_efault(int fd, char *buf, char *seen, int n)
+{
+   const size_t size = 512 * KB;
+   char *bad_buf;
+   int rc, cnt = 0;
+
+   rc = (int)lseek(fd, 0, SEEK_SET);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   memset(seen, 0, (size_t)n);
+
+   bad_buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                  MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+
+   DEVSHELL_CMD_ASSERT(bad_buf != MAP_FAILED);
+   rc = munmap(bad_buf + size / 2, size / 2);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = getdents64((unsigned)fd, (void *)bad_buf, (unsigned)size);
+
+   if (rc == -EFAULT) {
+      /* Nothing has been copied: the directory is too small for the test */
+      munmap(bad_buf, size / 2);
+      return;
+   }
+
+   DEVSHELL_CMD_ASSERT(rc > 0 && rc <= (int)size / 2);
+   getdents_mark_seen(bad_buf, rc, seen, n, &cnt);
+   munmap(bad_buf, size / 2);
+
+   while ((rc = getdents64((unsigned)fd, (void *)buf, 32 * KB)) > 0)
+      getdents_mark_seen(buf, rc, seen, n, &cnt);
+
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT(cnt == n);
+}
+
+/*
+ * Measure the throughput of getdents64() on a directory with many entries (10k
+ * by default: the count can be passed as an argument), using buffers of
+ * different sizes. Also, check that a getdents64() call failing with EFAULT
+ * does not consume any entries beyond the ones copied.
+ */
+int cmd_getdents_perf(int argc, char **argv)
+{
+   static const int buf_sizes[] = { 512, 2 * KB, 32 * KB, 256 * KB };
+   const int n = argc > 0 ? atoi(argv[0]) : 10000;
+   const char *dir_path = "/tmp/getdents_perf";
+   struct linux_dirent64 *de;
+   char path[512];
+   char *buf, *seen;
+   int fd, rc, calls;
+   u64 cycles;
+
+   DEVSHELL_CMD_ASSERT(n > 0);
+
+   buf = malloc(256 * KB);
+   seen = malloc((size_t)n);
+   DEVSHELL_CMD_ASSERT(buf != NULL && seen != NULL);
+
+   rc = mkdir(dir_path, 0755);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   for (int i = 0; i < n; i++) {
+      sprintf(path, "%s/f%06d", dir_path, i);
+      rc = creat(path, 0644);
+      DEVSHELL_CMD_ASSERT(rc > 0);
+      close(rc);
+   }
+
+   fd = open(dir_path, O_RDONLY | O_DIRECTORY);
+   DEVSHELL_CMD_ASSERT(fd > 0);
+
+   /* A failed copy to user space must not consume the entries */
+   rc = getdents64((unsigned)fd, (void *)16, 32 * KB);
+   DEVSHELL_CMD_ASSERT(rc == -EFAULT);
+
+   rc = getdents64((unsigned)fd, (void *)buf, 32 * KB);
+   DEVSHELL_CMD_ASSERT(rc > 0);
+   de = (void *)buf;
+   DEVSHELL_CMD_ASSERT(!strcmp(de->d_name, "."));
+
+   /* Also when the copy fails in the middle: no entries lost or repeated */
+   getdents_check_partial_efault(fd, buf, seen, n);
+
+   printf("Directory with %d entries\n", n);
+   printf("    buf size (bytes)   syscalls   cycles/entry\n");
+
+   for (int i = 0; i < (int)ARRAY_SIZE(buf_sizes); i++) {
+
+      cycles = getdents_perf_run(fd, buf, buf_sizes[i], seen, n, &calls);
+
+      printf("    %16d   %8d   %12llu\n", buf_sizes[i], calls, cycles / (u64)n);
+   }
+
+   close(fd);
+
+   for (int i = 0; i < n; i++) {
+      sprintf(path, "%s/f%06d", dir_path, i);
+      rc = unlink(path);
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   rc = rmdir(dir_path);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   free(seen);
+   free(buf);
+   return 0;
+}
+
+static u64 fd_perf_dup_range(int base, int *fds, int n)
+{
+   u64 start = RDTSC();
+
+   for (int i = 0; i < n; i++)
+      fds[i] = dup(base);
+
+   return RDTSC() - start;
+}
+
+/*
+ * Open/close storm: measure dup() and close() with thousands of fds (4096 by
+ * default: the count can be passed as an argument), after raising the
+ * RLIMIT_NOFILE limit. Also, check that the lowest free fd is always returned
+ * and that the limit is enforced.
+ */
+int cmd_fd_perf(int argc, char **argv)
+{
+   const int n = argc > 0 ? atoi(argv[0]) : 4096;
+   struct rlimit old_rlim, rlim;
+   int base, rc, *fds, *order;
+   u64 cycles;
+
+   DEVSHELL_CMD_ASSERT(n > 1);
+
+   fds = malloc(sizeof(int) * (size_t)n);
+   order = malloc(sizeof(int) * (size_t)n);
+   DEVSHELL_CMD_ASSERT(fds != NULL && order != NULL);
+
+   /* The limits not enforced by Tilck can be set anyway, like `ulimit -c 0` */
+   rlim.rlim_cur = rlim.rlim_max = 0;
+   rc = setrlimit(RLIMIT_CORE, &rlim);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = getrlimit(RLIMIT_NOFILE, &old_rlim);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rlim.rlim_cur = (rlim_t)n + 64;
+   rlim.rlim_max = old_rlim.rlim_max;
+
+   if (rlim.rlim_max != RLIM_INFINITY && rlim.rlim_max < rlim.rlim_cur)
+      rlim.rlim_max = rlim.rlim_cur;
+
+   rc = setrlimit(RLIMIT_NOFILE, &rlim);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   base = open("/", O_RDONLY);
+   DEVSHELL_CMD_ASSERT(base > 0);
+
+   printf("Using %d fds\n", n);
+
+   /* Open all the fds: each dup() must return the lowest free fd */
+   cycles = fd_perf_dup_range(base, fds, n);
+   printf("    dup():                %6llu cycles/fd\n", cycles / (u64)n);
+
+   for (int i = 0; i < n; i++) {
+      DEVSHELL_CMD_ASSERT(fds[i] > 0);
+      DEVSHELL_CMD_ASSERT(i == 0 || fds[i] > fds[i - 1]);
+   }
+
+   /* Close every other fd, in random order */
+   for (int i = 0; i < n / 2; i++)
+      order[i] = 2 * i;
+
+   for (int i = n / 2 - 1; i > 0; i--) {
+      const int j = rand() % (i + 1);
+      const int tmp = order[i];
+      order[i] = order[j];
+      order[j] = tmp;
+   }
+
+   cycles = RDTSC();
+
+   for (int i = 0; i < n / 2; i++)
+      close(fds[order[i]]);
+
+   cycles = RDTSC() - cycles;
+   printf("    close() [random]:     %6llu cycles/fd\n", cycles / (u64)(n / 2));
+
+   /* Re-open them: the holes must be filled in increasing order */
+   cycles = fd_perf_dup_range(base, order, n / 2);
+   printf("    dup() [holes]:        %6llu cycles/fd\n", cycles / (u64)(n / 2));
+
+   for (int i = 0; i < n / 2; i++)
+      DEVSHELL_CMD_ASSERT(order[i] == fds[2 * i]);
+
+   /* The limit must be enforced */
+   rc = dup2(base, (int)rlim.rlim_cur - 1);
+   DEVSHELL_CMD_ASSERT(rc == (int)rlim.rlim_cur - 1);
+   close(rc);
+
+   rc = dup2(base, (int)rlim.rlim_cur);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EBADF);
+
+   rc = fcntl(base, F_DUPFD, (int)rlim.rlim_cur);
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   while ((rc = dup(base)) >= 0) {
+      DEVSHELL_CMD_ASSERT(rc < (int)rlim.rlim_cur);
+   }
+
+   DEVSHELL_CMD_ASSERT(errno == EMFILE);
+
+   for (int fd = fds[0]; fd < (int)rlim.rlim_cur; fd++)
+      close(fd);
+
+   close(base);
+
+   rc = setrlimit(RLIMIT_NOFILE, &old_rlim);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   free(order);
+   free(fds);
+   return 0;
+}
@@ -14,6 +14,8 @@
 #include <sys/syscall.h>
 #include <sys/mman.h>
 #include <sys/time.h>
+#include <sys/auxv.h>
+#include <elf.h>
 
 #include "devshell.h"
 #include "sysenter.h"
@@ -306,6 +308,78 @@ static int run_extra_test(const char *name)
    return !rc;
 }
 
+/*
+ * Check the auxiliary vector passed by the kernel on execve(). The devshell
+ * is a static executable, so AT_BASE must be 0 and AT_PHDR must point to our
+ * own program headers, one of which has to contain this very function.
+ */
+int cmd_auxv(int argc, char **argv)
+{
+   const Elf32_Phdr *phdrs = (void *)getauxval(AT_PHDR);
+   const unsigned long phnum = getauxval(AT_PHNUM);
+   const unsigned long func = (unsigned long)&cmd_auxv;
+   bool found = false;
+
+   DEVSHELL_CMD_ASSERT(getauxval(AT_PAGESZ) == 4096);
+   DEVSHELL_CMD_ASSERT(getauxval(AT_PHENT) == sizeof(Elf32_Phdr));
+   DEVSHELL_CMD_ASSERT(getauxval(AT_BASE) == 0);
+   DEVSHELL_CMD_ASSERT(getauxval(AT_ENTRY) != 0);
+   DEVSHELL_CMD_ASSERT(phdrs != NULL);
+   DEVSHELL_CMD_ASSERT(phnum > 0);
+
+   for (unsigned long i = 0; i < phnum; i++) {
+
+      const Elf32_Phdr *p = phdrs + i;
+
+      if (p->p_type != PT_LOAD)
+         continue;
+
+      if (p->p_vaddr <= func && func < p->p_vaddr + p->p_memsz) {
+         DEVSHELL_CMD_ASSERT(p->p_flags & PF_X);
+         found = true;
+      }
+   }
+
+   DEVSHELL_CMD_ASSERT(found);
+   return 0;
+}
+
+/*
+ * Run `dyntest`, a dynamically linked program using a shared library. That
+ * requires the kernel to load musl's dynamic loader (PT_INTERP) and the loader
+ * to map the library using private file mappings, MAP_FIXED and mprotect().
+ */
+int cmd_dynexec(int argc, char **argv)
+{
+   static const char path[] = "/initrd/usr/bin/dyntest";
+   int rc, pid, wstatus;
+
+   if (!running_on_tilck()) {
+      not_on_tilck_message();
+      return 0;
+   }
+
+   if (access(path, X_OK)) {
+      printf(PFX "[SKIP] because %s is missing (USE_SYSCC?)\n", path);
+      return 0;
+   }
+
+   pid = fork();
+   DEVSHELL_CMD_ASSERT(pid >= 0);
+
+   if (!pid) {
+      execl(path, path, NULL);
+      perror("execl() failed");
+      _exit(1);
+   }
+
+   rc = waitpid(pid, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(rc == pid);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus));
+   DEVSHELL_CMD_ASSERT(WEXITSTATUS(wstatus) == 0);
+   return 0;
+}
+
 int cmd_extra(int argc, char **argv)
 {
    int rc = 0;
@@ -12,8 +12,11 @@
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <elf.h>
 
 #include "devshell.h"
+#include "test_common.h"
 #include "sysenter.h"
 
 int cmd_brk(int argc, char **argv)
@@ -155,3 +158,585 @@ int cmd_mmap2(int argc, char **argv)
    waitpid(child, &wstatus, 0);
    return 0;
 }
+
+/*
+ * Measure the cost of many incremental mmap() calls, reporting also the worst
+ * case, in order to catch latency spikes (e.g. when the mmap area grows).
+ */
+int cmd_mmap_perf(int argc, char **argv)
+{
+   const int iters_count = 4;
+   const int n = 2048;
+   const size_t alloc_size = 64 * KB;
+   ull_t tot_duration = 0, max_duration = 0;
+   void **arr;
+
+   arr = malloc(n * sizeof(void *));
+   DEVSHELL_CMD_ASSERT(arr != NULL);
+
+   for (int iter = 0; iter < iters_count; iter++) {
+
+      for (int i = 0; i < n; i++) {
+
+         ull_t start = RDTSC();
+
+         arr[i] = mmap(NULL,
+                       alloc_size,
+                       PROT_READ | PROT_WRITE,
+                       MAP_ANONYMOUS | MAP_PRIVATE,
+                       -1,
+                       0);
+
+         ull_t duration = RDTSC() - start;
+         DEVSHELL_CMD_ASSERT(arr[i] != (void *) -1);
+
+         tot_duration += duration;
+         max_duration = duration > max_duration ? duration : max_duration;
+      }
+
+      for (int i = 0; i < n; i++) {
+         int rc = munmap(arr[i], alloc_size);
+         DEVSHELL_CMD_ASSERT(rc == 0);
+      }
+   }
+
+   free(arr);
+   printf("Incremental mmap() of %d x %u KB\n", n, (unsigned)(alloc_size / KB));
+   printf("    Avg. cycles per mmap(): %llu\n",
+          tot_duration / iters_count / n);
+   printf("    Max. cycles per mmap(): %llu\n", max_duration);
+   return 0;
+}
+
+static ull_t tlb_perf_munmap(size_t size)
+{
+   const int iters_count = 8;
+   ull_t tot_duration = 0;
+   char *buf;
+   int rc;
+
+   for (int iter = 0; iter < iters_count; iter++) {
+
+      buf = mmap(NULL,
+                 size,
+                 PROT_READ | PROT_WRITE,
+                 MAP_ANONYMOUS | MAP_PRIVATE | MAP_POPULATE,
+                 -1,
+                 0);
+
+      DEVSHELL_CMD_ASSERT(buf != (void *) -1);
+
+      /* Make sure all the pages are in the TLB, or at least were */
+      for (size_t off = 0; off < size; off += 4 * KB)
+         buf[off] = 1;
+
+      ull_t start = RDTSC();
+      rc = munmap(buf, size);
+      tot_duration += RDTSC() - start;
+      DEVSHELL_CMD_ASSERT(rc == 0);
+   }
+
+   return tot_duration / iters_count;
+}
+
+static ull_t tlb_perf_ctx_switch(void)
+{
+   const int n = 2000;
+   int p2c[2], c2p[2];
+   int rc, child, wstatus;
+   char c = 'x';
+   ull_t start, duration;
+
+   DEVSHELL_CMD_ASSERT(pipe(p2c) == 0);
+   DEVSHELL_CMD_ASSERT(pipe(c2p) == 0);
+
+   child = fork();
+   DEVSHELL_CMD_ASSERT(child >= 0);
+
+   if (!child) {
+
+      for (int i = 0; i < n; i++) {
+
+         if (read(p2c[0], &c, 1) != 1)
+            exit(1);
+
+         if (write(c2p[1], &c, 1) != 1)
+            exit(1);
+      }
+
+      exit(0);
+   }
+
+   start = RDTSC();
+
+   for (int i = 0; i < n; i++) {
+
+      rc = write(p2c[1], &c, 1);
+      DEVSHELL_CMD_ASSERT(rc == 1);
+
+      rc = read(c2p[0], &c, 1);
+      DEVSHELL_CMD_ASSERT(rc == 1);
+   }
+
+   duration = RDTSC() - start;
+
+   waitpid(child, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+   close(p2c[0]); close(p2c[1]);
+   close(c2p[0]); close(c2p[1]);
+
+   /* Each round-trip requires two context switches */
+   return duration / n / 2;
+}
+
+/*
+ * Measure the cost of munmap() for mappings of different sizes (TLB flush
+ * batching) and the cost of a context switch between two processes, using a
+ * pipe ping-pong (kernel TLB entries surviving the CR3 reload).
+ */
+int cmd_tlb_perf(int argc, char **argv)
+{
+   static const size_t sizes[] = { 16 * KB, 128 * KB, 1 * MB, 16 * MB };
+
+   for (size_t i = 0; i < ARRAY_SIZE(sizes); i++) {
+
+      ull_t cycles = tlb_perf_munmap(sizes[i]);
+
+      printf("munmap() of %5u KB: %8llu cycles (%llu per page)\n",
+             (unsigned)(sizes[i] / KB), cycles,
+             cycles / (sizes[i] / (4 * KB)));
+   }
+
+   printf("Context switch (pipe ping-pong): %llu cycles\n",
+          tlb_perf_ctx_switch());
+   return 0;
+}
+
+bool read_sysfs_ulong(const char *path, unsigned long *val)
+{
+   char buf[32] = {0};
+   int fd, rc;
+
+   if ((fd = open(path, O_RDONLY)) < 0)
+      return false;
+
+   rc = read(fd, buf, sizeof(buf) - 1);
+   close(fd);
+
+   if (rc <= 0)
+      return false;
+
+   *val = strtoul(buf, NULL, 10);
+   return true;
+}
+
+static void zswap_stress_fill_page(unsigned *page, size_t page_idx)
+{
+   /* Compressible, but different for each page */
+   for (size_t i = 0; i < 4 * KB / sizeof(unsigned); i++)
+      page[i] = (unsigned)((i / 64) ^ page_idx);
+}
+
+static int zswap_stress_child(size_t size)
+{
+   unsigned expected[4 * KB / sizeof(unsigned)];
+   char *buf;
+
+   buf = mmap(NULL,
+              size,
+              PROT_READ | PROT_WRITE,
+              MAP_ANONYMOUS | MAP_PRIVATE,
+              -1,
+              0);
+
+   if (buf == (void *) -1) {
+      printf("[zswap_stress] mmap() failed with: %s\n", strerror(errno));
+      return 1;
+   }
+
+   for (size_t off = 0; off < size; off += 4 * KB)
+      zswap_stress_fill_page((void *)(buf + off), off / (4 * KB));
+
+   for (size_t off = 0; off < size; off += 4 * KB) {
+
+      zswap_stress_fill_page(expected, off / (4 * KB));
+
+      if (memcmp(buf + off, expected, sizeof(expected))) {
+         printf("[zswap_stress] Corrupted page at offset %zu\n", off);
+         return 1;
+      }
+   }
+
+   munmap(buf, size);
+   return 0;
+}
+
+/*
+ * Allocate and touch more anonymous memory than the free kernel heap, with
+ * compressible data, and check that every page survives the swap-out/swap-in
+ * cycle through zswap.
+ */
+int cmd_zswap_stress(int argc, char **argv)
+{
+   unsigned long enabled, free_kb, swap_outs, swap_ins, ratio;
+   int wstatus;
+   pid_t child;
+   size_t size;
+
+   if (!read_sysfs_ulong("/syst/config/kernel/zswap", &enabled) || !enabled) {
+      printf("[zswap_stress] zswap not enabled: skipping the test\n");
+      return 0;
+   }
+
+   DEVSHELL_CMD_ASSERT(read_sysfs_ulong("/syst/mm/heap_free_kb", &free_kb));
+   size = (free_kb + free_kb / 2) * KB;
+   size &= ~(4 * KB - 1);
+
+   printf("[zswap_stress] Free heap: %lu KB, allocating: %zu KB\n",
+          free_kb, size / KB);
+
+   child = fork();
+   DEVSHELL_CMD_ASSERT(child >= 0);
+
+   if (!child)
+      exit(zswap_stress_child(size));
+
+   waitpid(child, &wstatus, 0);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+   DEVSHELL_CMD_ASSERT(
+      read_sysfs_ulong("/syst/mm/zswap/swap_outs", &swap_outs) &&
+      read_sysfs_ulong("/syst/mm/zswap/swap_ins", &swap_ins) &&
+      read_sysfs_ulong("/syst/mm/zswap/compr_ratio", &ratio)
+   );
+
+   printf("[zswap_stress] swap-outs: %lu, swap-ins: %lu, ratio: %lu%%\n",
+          swap_outs, swap_ins, ratio);
+
+   DEVSHELL_CMD_ASSERT(swap_outs > 0 && swap_ins > 0);
+   return 0;
+}
+
+static void ksm_test_fill_page(unsigned *page, size_t page_idx)
+{
+   for (size_t i = 0; i < 4 * KB / sizeof(unsigned); i++)
+      page[i] = (unsigned)(i * 7 + page_idx + 1);
+}
+
+static int ksm_test_child(size_t size, int ready_fd, int go_fd)
+{
+   unsigned expected[4 * KB / sizeof(unsigned)];
+   char c = 0;
+   char *buf;
+
+   buf = mmap(NULL,
+              size,
+              PROT_READ | PROT_WRITE,
+              MAP_ANONYMOUS | MAP_PRIVATE,
+              -1,
+              0);
+
+   if (buf == (void *) -1)
+      return 1;
+
+   for (size_t off = 0; off < size; off += 4 * KB)
+      ksm_test_fill_page((void *)(buf + off), off / (4 * KB));
+
+   if (write(ready_fd, &c, 1) != 1)
+      return 1;
+
+   /* Wait for the parent: meanwhile, our pages will get merged */
+   if (read(go_fd, &c, 1) < 0)
+      return 1;
+
+   for (size_t off = 0; off < size; off += 4 * KB) {
+
+      ksm_test_fill_page(expected, off / (4 * KB));
+
+      if (memcmp(buf + off, expected, sizeof(expected)))
+         return 1;
+
+      /* Break the sharing and check that the write didn't leak */
+      buf[off] = (char)getpid();
+
+      if (buf[off] != (char)getpid())
+         return 1;
+   }
+
+   munmap(buf, size);
+   return 0;
+}
+
+/*
+ * Create two processes with identical private anonymous pages and check that
+ * KSM merges them, without breaking the copy-on-write semantics.
+ */
+int cmd_ksm(int argc, char **argv)
+{
+   const size_t size = 64 * 4 * KB;
+   unsigned long enabled, saved0, saved = 0;
+   int ready_pipe[2], go_pipe[2], wstatus, rc;
+   pid_t children[2];
+   char c;
+
+   if (!read_sysfs_ulong("/syst/config/kernel/ksm", &enabled) || !enabled) {
+      printf("[ksm] KSM not enabled: skipping the test\n");
+      return 0;
+   }
+
+   DEVSHELL_CMD_ASSERT(read_sysfs_ulong("/syst/mm/ksm/saved_kb", &saved0));
+   DEVSHELL_CMD_ASSERT(pipe(ready_pipe) == 0);
+   DEVSHELL_CMD_ASSERT(pipe(go_pipe) == 0);
+
+   for (int i = 0; i < 2; i++) {
+
+      children[i] = fork();
+      DEVSHELL_CMD_ASSERT(children[i] >= 0);
+
+      if (!children[i]) {
+         close(go_pipe[1]);
+         exit(ksm_test_child(size, ready_pipe[1], go_pipe[0]));
+      }
+   }
+
+   close(go_pipe[0]);
+
+   for (int i = 0; i < 2; i++)
+      DEVSHELL_CMD_ASSERT(read(ready_pipe[0], &c, 1) == 1);
+
+   for (int i = 0; i < 120 && saved < saved0 + size / KB / 2; i++) {
+      usleep(500 * 1000);
+      DEVSHELL_CMD_ASSERT(read_sysfs_ulong("/syst/mm/ksm/saved_kb", &saved));
+   }
+
+   printf("[ksm] saved: %lu KB (before: %lu KB)\n", saved, saved0);
+
+   /* Let the children verify their pages */
+   close(go_pipe[1]);
+
+   for (int i = 0; i < 2; i++) {
+      rc = waitpid(children[i], &wstatus, 0);
+      DEVSHELL_CMD_ASSERT(rc == children[i]);
+      DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+   }
+
+   close(ready_pipe[0]);
+   close(ready_pipe[1]);
+   DEVSHELL_CMD_ASSERT(saved >= saved0 + size / KB / 2);
+   return 0;
+}
+
+/*
+ * Check the memory accounting: a child touching `size` bytes of anonymous
+ * memory must have a peak RSS and a minor faults count reflecting that, both
+ * in wait4()'s rusage and in getrusage(RUSAGE_CHILDREN).
+ */
+int cmd_rusage(int argc, char **argv)
+{
+   const size_t size = 256 * 4 * KB;
+   struct rusage ru, ru_ch0, ru_ch;
+   int wstatus, rc;
+   pid_t pid;
+   FILE *fh;
+
+   DEVSHELL_CMD_ASSERT(getrusage(RUSAGE_CHILDREN, &ru_ch0) == 0);
+   DEVSHELL_CMD_ASSERT(getrusage(RUSAGE_SELF, &ru) == 0);
+   DEVSHELL_CMD_ASSERT(ru.ru_maxrss > 0);
+   DEVSHELL_CMD_ASSERT(getrusage(1234, &ru) < 0 && errno == EINVAL);
+
+   pid = fork();
+   DEVSHELL_CMD_ASSERT(pid >= 0);
+
+   if (!pid) {
+
+      char *buf = mmap(NULL, size,
+                       PROT_READ | PROT_WRITE,
+                       MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+
+      if (buf == MAP_FAILED)
+         exit(1);
+
+      for (size_t off = 0; off < size; off += 4 * KB)
+         buf[off] = 1; /* CoW fault on the zero page */
+
+      exit(0);
+   }
+
+   rc = wait4(pid, &wstatus, 0, &ru);
+   DEVSHELL_CMD_ASSERT(rc == pid);
+   DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+
+   printf("[rusage] child maxrss: %ld KB, minflt: %ld, majflt: %ld\n",
+          ru.ru_maxrss, ru.ru_minflt, ru.ru_majflt);
+
+   DEVSHELL_CMD_ASSERT(ru.ru_maxrss >= (long)(size / KB));
+   DEVSHELL_CMD_ASSERT(ru.ru_minflt >= (long)(size / (4 * KB)));
+
+   DEVSHELL_CMD_ASSERT(getrusage(RUSAGE_CHILDREN, &ru_ch) == 0);
+   DEVSHELL_CMD_ASSERT(ru_ch.ru_maxrss >= ru.ru_maxrss);
+   DEVSHELL_CMD_ASSERT(ru_ch.ru_minflt - ru_ch0.ru_minflt == ru.ru_minflt);
+
+   /* Check that the per-process table has a line for us */
+   fh = fopen("/syst/mm/rusage", "r");
+   DEVSHELL_CMD_ASSERT(fh != NULL);
+
+   {
+      char line[128];
+      bool found = false;
+
+      while (fgets(line, sizeof(line), fh))
+         if (atoi(line) == getpid())
+            found = true;
+
+      fclose(fh);
+      DEVSHELL_CMD_ASSERT(found);
+   }
+
+   return 0;
+}
+
+#define EXEC_SHARE_INSTANCES          8
+#define EXEC_SHARE_PATH               "/tmp/exec_share_ds"
+
+static int copy_file(const char *src, const char *dst, mode_t mode)
+{
+   static char buf[4 * KB];
+   int in, out, rc = -1;
+   ssize_t n;
+
+   if ((in = open(src, O_RDONLY)) < 0)
+      return -1;
+
+   if ((out = open(dst, O_CREAT | O_TRUNC | O_WRONLY, mode)) < 0)
+      goto out_in;
+
+   while ((n = read(in, buf, sizeof(buf))) > 0)
+      if (write(out, buf, (size_t)n) != n)
+         goto out;
+
+   rc = n < 0 ? -1 : 0;
+
+out:
+   close(out);
+out_in:
+   close(in);
+   return rc;
+}
+
+/* Total size of the read-only PT_LOAD segments of an ELF file, in KB */
+static long get_elf_ro_segments_kb(const char *path)
+{
+   Elf32_Ehdr h;
+   Elf32_Phdr ph;
+   long tot = 0;
+   int fd;
+
+   if ((fd = open(path, O_RDONLY)) < 0)
+      return -1;
+
+   if (read(fd, &h, sizeof(h)) != sizeof(h))
+      goto err;
+
+   for (int i = 0; i < h.e_phnum; i++) {
+
+      if (lseek(fd, (off_t)(h.e_phoff + i * h.e_phentsize), SEEK_SET) < 0)
+         goto err;
+
+      if (read(fd, &ph, sizeof(ph)) != sizeof(ph))
+         goto err;
+
+      if (ph.p_type == PT_LOAD && !(ph.p_flags & PF_W))
+         tot += (long)ph.p_memsz;
+   }
+
+   close(fd);
+   return tot / KB;
+
+err:
+   close(fd);
+   return -1;
+}
+
+/*
+ * Copy devshell to ramfs, run several instances of it and check that their
+ * read-only segments are shared, instead of being copied for each instance.
+ * Also, unlink the executable while the instances are still running.
+ */
+int cmd_exec_share(int argc, char **argv)
+{
+   pid_t children[EXEC_SHARE_INSTANCES];
+   unsigned long free0, free1;
+   int ready_pipe[2], go_pipe[2], wstatus, rc;
+   long ro_kb, per_instance_kb;
+   char c = 0;
+
+   if (argc >= 1 && !strcmp(argv[0], "--child")) {
+
+      /* Running in a new instance: tell the parent we're here and wait */
+      if (write(3, &c, 1) != 1 || read(0, &c, 1) < 0)
+         return 1;
+
+      return 0;
+   }
+
+   rc = copy_file(get_devshell_path(), EXEC_SHARE_PATH, 0755);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   DEVSHELL_CMD_ASSERT((ro_kb = get_elf_ro_segments_kb(EXEC_SHARE_PATH)) > 0);
+   DEVSHELL_CMD_ASSERT(pipe(ready_pipe) == 0);
+   DEVSHELL_CMD_ASSERT(pipe(go_pipe) == 0);
+   DEVSHELL_CMD_ASSERT(read_sysfs_ulong("/syst/mm/heap_free_kb", &free0));
+
+   for (int i = 0; i < EXEC_SHARE_INSTANCES; i++) {
+
+      children[i] = fork();
+      DEVSHELL_CMD_ASSERT(children[i] >= 0);
+
+      if (!children[i]) {
+
+         dup2(go_pipe[0], 0);
+         dup2(ready_pipe[1], 3);
+         close(go_pipe[1]);
+
+         execl(EXEC_SHARE_PATH,
+               "devshell", "-c", "exec_share", "--child", NULL);
+
+         perror("execl");
+         exit(123);
+      }
+   }
+
+   close(go_pipe[0]);
+   close(ready_pipe[1]);
+
+   for (int i = 0; i < EXEC_SHARE_INSTANCES; i++)
+      DEVSHELL_CMD_ASSERT(read(ready_pipe[0], &c, 1) == 1);
+
+   DEVSHELL_CMD_ASSERT(read_sysfs_ulong("/syst/mm/heap_free_kb", &free1));
+
+   /* The file's pages must survive as long as they're mapped somewhere */
+   DEVSHELL_CMD_ASSERT(unlink(EXEC_SHARE_PATH) == 0);
+
+   per_instance_kb = ((long)free0 - (long)free1) / EXEC_SHARE_INSTANCES;
+
+   printf("[exec_share] read-only segments: %ld KB\n", ro_kb);
+   printf("[exec_share] memory per instance: %ld KB\n", per_instance_kb);
+
+   /* Let the children exit */
+   close(go_pipe[1]);
+
+   for (int i = 0; i < EXEC_SHARE_INSTANCES; i++) {
+      rc = waitpid(children[i], &wstatus, 0);
+      DEVSHELL_CMD_ASSERT(rc == children[i]);
+      DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+   }
+
+   close(ready_pipe[0]);
+
+   /*
+    * Without sharing, each instance would need at least `ro_kb` of memory
+    * just for its copy of the read-only segments.
+    */
+   DEVSHELL_CMD_ASSERT(per_instance_kb < ro_kb);
+   return 0;
+}
@@ -10,6 +10,8 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
 
 #include "devshell.h"
 #include "test_common.h"
@@ -469,3 +471,152 @@ int cmd_pipe5(int argc, char **argv)
 
    return 0;
 }
+
+#define PIPE6_REC_SIZE     1000
+
+static void pipe6_writer_child(int id, int fd, int n)
+{
+   char hdr[8], body[PIPE6_REC_SIZE - 16], trailer[8];
+   struct iovec iov[3] = {
+      { hdr, sizeof(hdr) },
+      { body, sizeof(body) },
+      { trailer, sizeof(trailer) },
+   };
+   int rc;
+
+   memset(hdr, 'a' + id, sizeof(hdr));
+   memset(body, 'a' + id, sizeof(body));
+   memset(trailer, 'a' + id, sizeof(trailer));
+
+   for (int i = 0; i < n; i++) {
+
+      rc = writev(fd, iov, 3);
+
+      if (rc != PIPE6_REC_SIZE) {
+         printf("[writer %d]: writev() returned %d\n", id, rc);
+         exit(1);
+      }
+   }
+
+   exit(0);
+}
+
+/*
+ * Check that writev() calls of less than PIPE_BUF bytes are atomic: several
+ * writers write fixed-size records, each one with its own byte, and the reader
+ * checks that each record contains a single byte value.
+ */
+int cmd_pipe6(int argc, char **argv)
+{
+   const int writers = 4;
+   const int recs = 256;
+   char rec[PIPE6_REC_SIZE];
+   int pipefd[2];
+   int wstatus, rc, pid, cnt = 0;
+
+   STATIC_ASSERT(PIPE6_REC_SIZE <= PIPE_BUF);
+
+   rc = pipe(pipefd);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   for (int i = 0; i < writers; i++) {
+
+      pid = fork();
+      DEVSHELL_CMD_ASSERT(pid >= 0);
+
+      if (!pid) {
+         close(pipefd[0]);
+         pipe6_writer_child(i, pipefd[1], recs);
+      }
+   }
+
+   close(pipefd[1]);
+
+   while (true) {
+
+      size_t tot = 0;
+
+      /* Read exactly one record */
+      while (tot < sizeof(rec)) {
+
+         rc = read(pipefd[0], rec + tot, sizeof(rec) - tot);
+         DEVSHELL_CMD_ASSERT(rc >= 0);
+
+         if (!rc)
+            break;
+
+         tot += (size_t)rc;
+      }
+
+      if (!tot)
+         break;
+
+      DEVSHELL_CMD_ASSERT(tot == sizeof(rec));
+
+      for (size_t i = 1; i < sizeof(rec); i++) {
+
+         if (rec[i] != rec[0]) {
+            printf("Record %d: interleaved data at offset %u\n",
+                   cnt, (unsigned)i);
+            return 1;
+         }
+      }
+
+      cnt++;
+   }
+
+   close(pipefd[0]);
+
+   for (int i = 0; i < writers; i++) {
+      rc = waitpid(-1, &wstatus, 0);
+      DEVSHELL_CMD_ASSERT(rc > 0);
+      DEVSHELL_CMD_ASSERT(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+   }
+
+   printf("Read %d records, none interleaved\n", cnt);
+   DEVSHELL_CMD_ASSERT(cnt == writers * recs);
+   return 0;
+}
+
+/* sendfile() from a pipe to another pipe, and from a pipe to itself */
+int cmd_pipe7(int argc, char **argv)
+{
+   static const char msg[] = "hello";
+   int a[2], b[2];
+   char buf[16];
+   int rc;
+
+   rc = pipe(a);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+   rc = pipe(b);
+   DEVSHELL_CMD_ASSERT(rc == 0);
+
+   rc = write(a[1], msg, sizeof(msg));
+   DEVSHELL_CMD_ASSERT(rc == sizeof(msg));
+
+   /* Same pipe: must fail instead of deadlocking on the pipe's lock */
+   rc = sendfile(a[1], a[0], NULL, sizeof(msg));
+   DEVSHELL_CMD_ASSERT(rc < 0 && errno == EINVAL);
+
+   rc = sendfile(b[1], a[0], NULL, sizeof(msg));
+   DEVSHELL_CMD_ASSERT(rc == sizeof(msg));
+
+   rc = read(b[0], buf, sizeof(buf));
+   DEVSHELL_CMD_ASSERT(rc == sizeof(msg));
+   DEVSHELL_CMD_ASSERT(!strcmp(buf, msg));
+
+   /* The data can flow in the opposite direction as well */
+   rc = write(b[1], msg, sizeof(msg));
+   DEVSHELL_CMD_ASSERT(rc == sizeof(msg));
+
+   rc = sendfile(a[1], b[0], NULL, sizeof(msg));
+   DEVSHELL_CMD_ASSERT(rc == sizeof(msg));
+
+   rc = read(a[0], buf, sizeof(buf));
+   DEVSHELL_CMD_ASSERT(rc == sizeof(msg));
+   DEVSHELL_CMD_ASSERT(!strcmp(buf, msg));
+
+   close(a[0]); close(a[1]);
+   close(b[0]); close(b[1]);
+   return 0;
+}
@@ -399,6 +399,40 @@ TEST(avl_bintree, first_last_obj)
    ASSERT_TRUE(l == &arr[elems - 1]);
 }
 
+struct long_struct {
+
+   long val;
+   struct bintree_node node;
+};
+
+TEST(avl_bintree, find_ptr_ge)
+{
+   constexpr const int elems = 32;
+   long_struct arr[elems];
+   long_struct *root = NULL;
+   long_struct *obj;
+
+   for (int i = 0; i < elems; i++) {
+      arr[i].val = 10 * (i + 1);
+      bintree_node_init(&arr[i].node);
+      bintree_insert_ptr(&root, &arr[i], long_struct, node, val);
+   }
+
+   for (long v = 0; v <= 10 * elems; v++) {
+
+      obj = (long_struct *)
+         bintree_find_ptr_ge(root, v, long_struct, node, val);
+
+      ASSERT_TRUE(obj != NULL);
+      ASSERT_EQ(obj->val, (v + 9) / 10 * 10 + (v ? 0 : 10));
+   }
+
+   obj = (long_struct *)
+      bintree_find_ptr_ge(root, 10 * elems + 1, long_struct, node, val);
+
+   ASSERT_TRUE(obj == NULL);
+}
+
 static void test_insert_rand_data(int iters, int elems, bool slow_checks)
 {
    random_device rdev;
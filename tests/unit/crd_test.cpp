@@ -0,0 +1,311 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "vfs_test.h"
+
+extern "C" {
+   #include <tilck_gen_headers/config_mm.h>
+   #include <tilck/common/fat32_base.h>
+   #include <tilck/kernel/fs/crd.h>
+   #include <tilck/kernel/lz.h>
+   #include <tilck/kernel/paging.h>
+   #include <tilck/kernel/kmalloc.h>
+
+   struct crd;
+   struct crd *crd_create(void *compr, size_t compr_size, void *va);
+   void crd_destroy(struct crd *c);
+}
+
+using namespace std;
+using namespace testing;
+
+/* Fake vaddr of the uncompressed data: in the tests, paging is mocked */
+#define TEST_CRD_VA    ((char *)(LINEAR_MAPPING_END + 64 * MB))
+
+/* Same logic as the rdcomp build app */
+static vector<u8> crd_build(const u8 *data, size_t size)
+{
+   static struct lz_ctx ctx;
+   const u32 chunks = (u32)((size + CRD_CHUNK_SIZE - 1) / CRD_CHUNK_SIZE);
+   const size_t hdr_size = crd_get_hdr_size(chunks);
+   vector<u8> res(hdr_size + size);
+   struct crd_hdr *h = (struct crd_hdr *)res.data();
+   size_t off = hdr_size;
+
+   h->magic = CRD_MAGIC;
+   h->version = CRD_VERSION;
+   h->chunk_size = CRD_CHUNK_SIZE;
+   h->chunks_count = chunks;
+   h->size = (u32)size;
+
+   for (u32 i = 0; i < chunks; i++) {
+
+      const u8 *src = data + (size_t)i * CRD_CHUNK_SIZE;
+      const u32 len = crd_get_chunk_size(h, i);
+      size_t clen;
+
+      h->index[i] = (u32)off;
+
+      if (!(clen = lz_compress(&ctx, src, len, &res[off], len - 1))) {
+         memcpy(&res[off], src, len);
+         clen = len;
+      }
+
+      off += clen;
+   }
+
+   h->index[chunks] = (u32)off;
+   h->compr_size = (u32)off;
+   res.resize(off);
+   return res;
+}
+
+static inline bool is_va_mapped(char *va)
+{
+   const ulong pa = get_mapping(get_kernel_pdir(), va);
+   return pa != 0 && pa != INVALID_PADDR;
+}
+
+/*
+ * Read from the fake vaddr of the compressed ramdisk, calling the fault handler
+ * like the CPU would do, for each page not mapped.
+ */
+static bool crd_read(size_t off, void *dst, size_t len)
+{
+   char *out = (char *)dst;
+
+   while (len > 0) {
+
+      char *va = TEST_CRD_VA + off;
+      const size_t page_off = (ulong)va & OFFSET_IN_PAGE_MASK;
+      char *page = va - page_off;
+      const size_t n = MIN(len, PAGE_SIZE - page_off);
+
+      if (!is_va_mapped(page) && !crd_handle_fault(page))
+         return false;
+
+      memcpy(out, (char *)KERNEL_PA_TO_VA(get_mapping(NULL, page)) + page_off, n);
+      out += n;
+      off += n;
+      len -= n;
+   }
+
+   return true;
+}
+
+class crd_test : public Test {
+public:
+
+   vector<u8> image;
+   vector<u8> compr;
+   struct crd *c = nullptr;
+
+   void SetUp() override {
+      init_kmalloc_for_tests();
+      crd_max_cache_kb = 0;
+      crd_min_free_kb = CRD_DEFAULT_MIN_FREE_KB;
+   }
+
+   void TearDown() override {
+
+      if (c)
+         crd_destroy(c);
+
+      crd_max_cache_kb = CRD_DEFAULT_MAX_CACHE_KB;
+   }
+
+   void create(const vector<u8> &data) {
+      image = data;
+      compr = crd_build(image.data(), image.size());
+      c = crd_create(compr.data(), compr.size(), TEST_CRD_VA);
+      ASSERT_TRUE(c != nullptr);
+   }
+
+   void load_fatpart() {
+
+      size_t fatpart_size;
+      const u8 *buf = (const u8 *)load_once_file(TEST_FATPART_FILE,
+                                                 &fatpart_size);
+
+      const u32 used = fat_calculate_used_bytes((struct fat_hdr *)buf);
+      ASSERT_LE(used, fatpart_size);
+      create(vector<u8>(buf, buf + used));
+   }
+};
+
+TEST_F(crd_test, read_back)
+{
+   vector<u8> buf;
+   load_fatpart();
+
+   ASSERT_TRUE(crd_is_crd_vaddr(TEST_CRD_VA));
+   ASSERT_FALSE(crd_is_crd_vaddr(TEST_CRD_VA - 1));
+
+   /* Nothing is decompressed before the first access */
+   ASSERT_EQ(crd_stats.cached_chunks, 0u);
+
+   /* Reading the FAT header decompresses just the first chunk */
+   buf.resize(512);
+   ASSERT_TRUE(crd_read(0, buf.data(), buf.size()));
+   ASSERT_EQ(memcmp(buf.data(), image.data(), buf.size()), 0);
+   ASSERT_EQ(crd_stats.cached_chunks, 1u);
+
+   /* A read crossing a chunk boundary */
+   buf.resize(3 * PAGE_SIZE);
+   ASSERT_TRUE(crd_read(CRD_CHUNK_SIZE - PAGE_SIZE - 7, buf.data(), buf.size()));
+   ASSERT_EQ(
+      memcmp(buf.data(),
+             image.data() + CRD_CHUNK_SIZE - PAGE_SIZE - 7,
+             buf.size()),
+      0
+   );
+   ASSERT_EQ(crd_stats.cached_chunks, 2u);
+
+   /* Read the whole image */
+   buf.resize(image.size());
+   ASSERT_TRUE(crd_read(0, buf.data(), buf.size()));
+   ASSERT_EQ(buf, image);
+
+   const struct crd_hdr *h = (struct crd_hdr *)compr.data();
+   ASSERT_EQ(crd_stats.cached_chunks, h->chunks_count);
+   ASSERT_EQ(crd_stats.evictions, 0u);
+
+   cout << "[ INFO     ] fatpart: " << image.size() / KB << " KB, "
+        << "compressed: " << compr.size() / KB << " KB" << endl;
+}
+
+TEST_F(crd_test, lru_eviction)
+{
+   const ulong evictions = crd_stats.evictions;
+   vector<u8> data(8 * CRD_CHUNK_SIZE);
+   u8 b;
+
+   for (size_t i = 0; i < data.size(); i++)
+      data[i] = (u8)(i / CRD_CHUNK_SIZE + (i % 251 == 0));
+
+   create(data);
+   crd_max_cache_kb = 2 * CRD_CHUNK_SIZE / KB;
+
+   ASSERT_TRUE(crd_read(0 * CRD_CHUNK_SIZE, &b, 1));
+   ASSERT_TRUE(crd_read(1 * CRD_CHUNK_SIZE, &b, 1));
+   ASSERT_TRUE(is_va_mapped(TEST_CRD_VA + 0 * CRD_CHUNK_SIZE));
+   ASSERT_TRUE(is_va_mapped(TEST_CRD_VA + 1 * CRD_CHUNK_SIZE));
+
+   /* The third chunk makes the first one (the oldest) to be dropped */
+   ASSERT_TRUE(crd_read(2 * CRD_CHUNK_SIZE, &b, 1));
+   ASSERT_EQ(b, 2);
+   ASSERT_EQ(crd_stats.cached_chunks, 2u);
+   ASSERT_EQ(crd_stats.evictions, evictions + 1);
+   ASSERT_FALSE(is_va_mapped(TEST_CRD_VA + 0 * CRD_CHUNK_SIZE));
+   ASSERT_FALSE(is_va_mapped(TEST_CRD_VA + 7 * PAGE_SIZE));
+   ASSERT_TRUE(is_va_mapped(TEST_CRD_VA + 1 * CRD_CHUNK_SIZE));
+   ASSERT_TRUE(is_va_mapped(TEST_CRD_VA + 2 * CRD_CHUNK_SIZE));
+
+   /* The dropped chunk gets decompressed again on the next access */
+   ASSERT_TRUE(crd_read(0 * CRD_CHUNK_SIZE + 1, &b, 1));
+   ASSERT_EQ(b, 0);
+   ASSERT_FALSE(is_va_mapped(TEST_CRD_VA + 1 * CRD_CHUNK_SIZE));
+
+   /* Memory pressure: drop the chunks on demand */
+   ASSERT_EQ(crd_shrink(10), 2u);
+   ASSERT_EQ(crd_stats.cached_chunks, 0u);
+   ASSERT_FALSE(is_va_mapped(TEST_CRD_VA + 2 * CRD_CHUNK_SIZE));
+   ASSERT_EQ(crd_shrink(10), 0u);
+}
+
+TEST_F(crd_test, min_free_mem)
+{
+   vector<u8> data(16 * CRD_CHUNK_SIZE, 0xaa);
+   vector<u8> buf(data.size());
+
+   create(data);
+
+   /* With no free memory at all, we still keep a minimal working set */
+   crd_min_free_kb = ~0ul;
+   ASSERT_TRUE(crd_read(0, buf.data(), buf.size()));
+   ASSERT_EQ(buf, data);
+   ASSERT_EQ(crd_stats.cached_chunks, (ulong)CRD_MIN_CACHED_CHUNKS);
+}
+
+TEST_F(crd_test, incompressible_chunks)
+{
+   vector<u8> data(3 * CRD_CHUNK_SIZE + 1234);
+   vector<u8> buf(data.size());
+   mt19937 e(1234);
+
+   for (auto &v : data)
+      v = (u8)e();
+
+   create(data);
+
+   /* Random data is stored uncompressed (+ the header) */
+   ASSERT_EQ(compr.size(), data.size() + crd_get_hdr_size(4));
+
+   /* The last, partial, chunk has its tail zeroed */
+   ASSERT_TRUE(crd_read(0, buf.data(), buf.size()));
+   ASSERT_EQ(buf, data);
+   ASSERT_TRUE(crd_read(data.size(), &buf[0], 16));
+
+   for (int i = 0; i < 16; i++)
+      ASSERT_EQ(buf[i], 0);
+}
+
+TEST_F(crd_test, corrupted_images)
+{
+   vector<u8> data(2 * CRD_CHUNK_SIZE, 'x');
+   vector<u8> bad;
+   struct crd_hdr *h;
+
+   bad = crd_build(data.data(), data.size());
+   h = (struct crd_hdr *)bad.data();
+   h->magic++;
+   ASSERT_TRUE(crd_create(bad.data(), bad.size(), TEST_CRD_VA) == nullptr);
+
+   bad = crd_build(data.data(), data.size());
+   h = (struct crd_hdr *)bad.data();
+   ASSERT_TRUE(crd_create(bad.data(), bad.size() - 1, TEST_CRD_VA) == nullptr);
+
+   h->index[1] = h->index[2] + 1;
+   ASSERT_TRUE(crd_create(bad.data(), bad.size(), TEST_CRD_VA) == nullptr);
+
+   /* Corrupted compressed data: detected at the first access */
+   create(data);
+   memset(compr.data() + ((struct crd_hdr *)compr.data())->index[1], 0xff, 8);
+   ASSERT_TRUE(crd_read(0, &data[0], 1));
+   ASSERT_FALSE(crd_read(CRD_CHUNK_SIZE, &data[0], 1));
+}
+
+TEST_F(crd_test, boot_memory_vs_full_image)
+{
+   using namespace chrono;
+   load_fatpart();
+
+   const struct crd_hdr *h = (struct crd_hdr *)compr.data();
+   vector<u8> buf(512);
+   size_t first_read_kb;
+   u64 ns;
+
+   auto start = high_resolution_clock::now();
+   {
+      /* What mounting the FAT ramdisk touches: header and FAT table */
+      ASSERT_TRUE(crd_read(0, buf.data(), buf.size()));
+      ASSERT_TRUE(crd_read(fat_get_first_data_sector((struct fat_hdr *)buf.data())
+                             * 512, buf.data(), 1));
+   }
+   ns = (u64)duration_cast<nanoseconds>(
+      high_resolution_clock::now() - start
+   ).count();
+
+   first_read_kb = crd_stats.cached_chunks * h->chunk_size / KB;
+   ASSERT_LT(crd_stats.cached_chunks, h->chunks_count);
+
+   cout << "[ INFO     ] loaded at boot: " << compr.size() / KB << " KB "
+        << "instead of " << image.size() / KB << " KB; decompressed on "
+        << "mount: " << first_read_kb << " KB in " << ns / 1000 << " us"
+        << endl;
+}
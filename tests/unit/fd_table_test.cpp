@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <random>
+#include <set>
+
+#include <gtest/gtest.h>
+
+#include "kernel_init_funcs.h"
+
+extern "C" {
+   #include <tilck/kernel/fd_table.h>
+   #include <tilck/kernel/errno.h>
+}
+
+using namespace std;
+using namespace testing;
+
+#define TEST_LIMIT      4096u
+
+static fs_handle fd_to_handle(int fd)
+{
+   return (fs_handle)(ulong)(0x1000 + fd);
+}
+
+class fd_table_test : public Test {
+public:
+
+   struct fd_table t;
+
+   void SetUp() override {
+      init_kmalloc_for_tests();
+      fdt_init(&t);
+   }
+
+   void TearDown() override {
+      fdt_destroy(&t);
+   }
+
+   int open_fd(int ge = 0) {
+
+      int fd = fdt_get_free_fd(&t, ge, TEST_LIMIT);
+
+      if (fd >= 0)
+         fdt_set(&t, fd, fd_to_handle(fd));
+
+      return fd;
+   }
+};
+
+TEST_F(fd_table_test, lowest_free_fd)
+{
+   for (int i = 0; i < 200; i++)
+      ASSERT_EQ(open_fd(), i);
+
+   ASSERT_GE(t.size, 200u);
+
+   fdt_set(&t, 150, NULL);
+   fdt_set(&t, 3, NULL);
+   fdt_set(&t, 64, NULL);
+
+   ASSERT_EQ(open_fd(), 3);
+   ASSERT_EQ(open_fd(10), 64);
+   ASSERT_EQ(open_fd(), 150);
+   ASSERT_EQ(open_fd(), 200);
+   ASSERT_EQ(open_fd(1000), 1000);
+   ASSERT_EQ(fdt_get(&t, 1000), fd_to_handle(1000));
+   ASSERT_EQ(fdt_get(&t, 999), (fs_handle)NULL);
+}
+
+TEST_F(fd_table_test, limit)
+{
+   for (u32 i = 0; i < TEST_LIMIT; i++)
+      ASSERT_EQ(open_fd(), (int)i);
+
+   ASSERT_EQ(open_fd(), -EMFILE);
+   ASSERT_EQ(open_fd((int)TEST_LIMIT), -EMFILE);
+
+   fdt_set(&t, 1234, NULL);
+   ASSERT_EQ(open_fd(1235), -EMFILE);
+   ASSERT_EQ(open_fd(), 1234);
+}
+
+TEST_F(fd_table_test, random_ops_and_dup)
+{
+   random_device rdev;
+   const auto seed = rdev();
+   default_random_engine engine(seed);
+   uniform_int_distribution<int> dist(0, (int)TEST_LIMIT - 1);
+   struct fd_table t2;
+   set<int> used;
+   int fd, ge;
+
+   cout << "[ INFO     ] random seed: " << seed << endl;
+
+   for (int iter = 0; iter < 10000; iter++) {
+
+      if (dist(engine) % 3 && used.size() < TEST_LIMIT) {
+
+         ge = dist(engine) % 8 ? 0 : dist(engine);
+         fd = ge;
+
+         while (used.count(fd))
+            fd++;
+
+         if (fd >= (int)TEST_LIMIT) {
+            ASSERT_EQ(open_fd(ge), -EMFILE);
+            continue;
+         }
+
+         ASSERT_EQ(open_fd(ge), fd);
+         used.insert(fd);
+
+      } else if (!used.empty()) {
+
+         auto it = used.lower_bound(dist(engine));
+
+         if (it == used.end())
+            it = used.begin();
+
+         fdt_set(&t, *it, NULL);
+         used.erase(it);
+      }
+   }
+
+   ASSERT_EQ(fdt_dup(&t2, &t), 0);
+
+   auto it = used.begin();
+
+   fdt_for_each_fd(&t2, fd) {
+      ASSERT_TRUE(it != used.end());
+      ASSERT_EQ(fd, *it);
+      ASSERT_EQ(fdt_get(&t2, fd), fd_to_handle(fd));
+      ++it;
+   }
+
+   ASSERT_TRUE(it == used.end());
+   fdt_destroy(&t2);
+}
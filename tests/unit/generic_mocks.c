@@ -6,7 +6,9 @@
 #include <string.h>
 
 #include <tilck/common/basic_defs.h>
+#include <tilck/common/page_size.h>
 #include <tilck/kernel/datetime.h>
+#include <tilck/kernel/kmalloc.h>
 
 u32 spur_irq_count;
 u32 unhandled_irq_count[256];
@@ -89,6 +91,7 @@ bool hi_vmem_avail(void) { return false; }
 int kthread_create2() { return -12; /* ENOMEM */}
 
 void invalidate_page() {}
+void tlb_gather_flush() {}
 void init_serial_port() { }
 void serial_write() { }
 void handle_fault() { }
@@ -112,6 +115,7 @@ void switch_to_task() { }
 void pdir_clone() { }
 void pdir_deep_clone() { }
 void pdir_destroy() { }
+void pdir_get_mm_stats() { }
 void set_curr_pdir() { }
 void set_current_task_in_user_mode() { }
 void arch_specific_new_task_setup() { NOT_REACHED(); }
@@ -121,13 +125,23 @@ void arch_specific_free_proc() { NOT_REACHED(); }
 void fpu_context_begin() { }
 void fpu_context_end() { }
 void map_zero_pages() { NOT_REACHED(); }
+void map_zero_page() { NOT_REACHED(); }
 void dump_var_mtrrs() { }
 void set_page_rw() { }
+size_t set_user_pages_rw() { return 0; }
+bool test_and_clear_accessed() { return false; }
+void make_page_cow() { NOT_REACHED(); }
+void replace_with_cow_page() { NOT_REACHED(); }
+void set_swap_entry() { NOT_REACHED(); }
+int swap_check_page() { NOT_REACHED(); return 0; }
+ulong find_private_user_page() { return 0; }
 void poweroff() { NOT_REACHED(); }
 int get_irq_num(void *ctx) { return -1; }
 int get_int_num(void *ctx) { return -1; }
 void retain_pageframes_mapped_at() { }
 void release_pageframes_mapped_at() { }
+u32 get_pageframe_ref_count() { return 0; }
+void put_pageframe(void *kvaddr) { kfree2(kvaddr, PAGE_SIZE); }
 bool irq_is_masked() { NOT_REACHED(); return false; }
 
 void *hi_vmem_reserve(size_t size) { return NULL; }
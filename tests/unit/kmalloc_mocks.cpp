@@ -114,6 +114,17 @@ int unmap_page_permissive(pdir_t *, void *vaddrp, bool free_pageframe)
    return 0;
 }
 
+void unmap_page_batched(pdir_t *, void *vaddrp, bool do_free, tlb_gather *)
+{
+   unmap_page(nullptr, vaddrp, do_free);
+}
+
+int unmap_page_permissive_batched(pdir_t *, void *vaddrp, bool do_free,
+                                  tlb_gather *)
+{
+   return unmap_page_permissive(nullptr, vaddrp, do_free);
+}
+
 void
 unmap_pages(pdir_t *pdir,
             void *vaddr,
@@ -0,0 +1,121 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+extern "C" {
+   #include <tilck/kernel/lz.h>
+}
+
+using namespace std;
+using namespace testing;
+
+static struct lz_ctx ctx;
+
+static void lz_roundtrip(const vector<u8> &in)
+{
+   vector<u8> compr(in.size() + in.size() / 64 + 64);
+   vector<u8> out(in.size());
+   size_t len;
+   long rc;
+
+   len = lz_compress(&ctx, in.data(), in.size(), compr.data(), compr.size());
+   ASSERT_GT(len, 0u);
+
+   rc = lz_decompress(compr.data(), len, out.data(), out.size());
+   ASSERT_EQ(rc, (long)in.size());
+   ASSERT_EQ(in, out);
+}
+
+TEST(lz, zeros)
+{
+   vector<u8> in(4096, 0);
+   vector<u8> compr(4096);
+
+   lz_roundtrip(in);
+
+   /* A page full of zeros must compress really well */
+   ASSERT_LT(lz_compress(&ctx, in.data(), in.size(), compr.data(), 4096), 64u);
+}
+
+TEST(lz, patterns)
+{
+   vector<u8> in(4096);
+
+   for (size_t i = 0; i < in.size(); i++)
+      in[i] = (u8)(i % 7 + (i / 512));
+
+   lz_roundtrip(in);
+
+   for (size_t i = 0; i < in.size(); i++)
+      in[i] = (u8)"hello world, "[i % 13];
+
+   lz_roundtrip(in);
+}
+
+TEST(lz, tinyInputs)
+{
+   for (size_t n = 0; n < 16; n++)
+      lz_roundtrip(vector<u8>(n, (u8)n));
+}
+
+TEST(lz, random)
+{
+   random_device rdev;
+   const auto seed = rdev();
+   default_random_engine e(seed);
+   uniform_int_distribution<int> dist(0, 255);
+   uniform_int_distribution<int> small_dist(0, 3);
+
+   cout << "[ INFO     ] random seed: " << seed << endl;
+
+   for (int iter = 0; iter < 100; iter++) {
+
+      vector<u8> in(LZ_MAX_INPUT_SIZE / (iter % 8 + 1));
+
+      for (auto &b : in)
+         b = (u8)(iter % 2 ? dist(e) : small_dist(e));
+
+      lz_roundtrip(in);
+   }
+}
+
+TEST(lz, outputTooSmall)
+{
+   vector<u8> in(4096);
+   vector<u8> compr(1024);
+   random_device rdev;
+   default_random_engine e(rdev());
+   uniform_int_distribution<int> dist(0, 255);
+
+   for (auto &b : in)
+      b = (u8)dist(e);
+
+   ASSERT_EQ(lz_compress(&ctx, in.data(), in.size(), compr.data(), 1024), 0u);
+}
+
+TEST(lz, corruptedInput)
+{
+   vector<u8> in(4096, 'a');
+   vector<u8> compr(4096);
+   vector<u8> out(4096);
+   size_t len;
+
+   len = lz_compress(&ctx, in.data(), in.size(), compr.data(), compr.size());
+   ASSERT_GT(len, 0u);
+
+   /* Not enough space in the output buffer */
+   ASSERT_EQ(lz_decompress(compr.data(), len, out.data(), 100), -1);
+
+   /* Truncated input */
+   ASSERT_NE(lz_decompress(compr.data(), len / 2, out.data(), out.size()),
+             (long)in.size());
+
+   /* Invalid match offset */
+   compr[0] = 0x0f;
+   compr[1] = 0xff;
+   compr[2] = 0xff;
+   ASSERT_EQ(lz_decompress(compr.data(), 3, out.data(), out.size()), -1);
+}
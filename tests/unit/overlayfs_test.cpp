@@ -0,0 +1,489 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "vfs_test.h"
+
+extern "C" {
+   #include <tilck/kernel/fs/overlayfs.h>
+   #include <tilck/kernel/kmalloc.h>
+}
+
+using namespace std;
+
+#define REAL_TESTDIR    PROJ_BUILD_DIR "/test_sysroot/testdir"
+#define LONG_NAME_FILE  "This_is_a_file_with_a_veeeery_long_name.txt"
+
+struct dir_names_ctx {
+
+   struct fs_handle_base *h;
+   vector<string> *names;
+   int left;
+};
+
+static int dir_names_cb(struct vfs_dent64 *vde, void *arg)
+{
+   struct dir_names_ctx *ctx = (struct dir_names_ctx *)arg;
+
+   if (!ctx->left)
+      return 1; /* stop: the next call has to resume from h->pos */
+
+   ctx->names->push_back(vde->name);
+   ctx->left--;
+   ctx->h->pos++;
+   return 0;
+}
+
+/*
+ * Get the entries of the directory `h`, calling getdents() directly (like in
+ * vfs_test.cpp) and getting just 3 entries per call, in order to check that
+ * it can always resume from the right entry.
+ */
+static vector<string> read_dir_entries(fs_handle h)
+{
+   struct fs_handle_base *hb = (struct fs_handle_base *)h;
+   vector<string> names;
+   struct dir_names_ctx ctx = { hb, &names, 0 };
+   int rc;
+
+   do {
+
+      ctx.left = 3;
+
+      vfs_fs_shlock(hb->fs);
+      {
+         rc = hb->fs->fsops->getdents(h, &dir_names_cb, &ctx);
+      }
+      vfs_fs_shunlock(hb->fs);
+
+      EXPECT_GE(rc, 0);
+
+   } while (rc > 0);
+
+   return names;
+}
+
+static vector<string> read_dir(const char *path)
+{
+   vector<string> names;
+   fs_handle h = NULL;
+
+   EXPECT_EQ(vfs_open(path, &h, O_RDONLY, 0), 0) << path;
+
+   if (h) {
+      names = read_dir_entries(h);
+      vfs_close(h);
+   }
+
+   return names;
+}
+
+static set<string> read_dir_set(const char *path)
+{
+   const vector<string> names = read_dir(path);
+   const set<string> res(names.begin(), names.end());
+
+   EXPECT_EQ(res.size(), names.size()) << "Duplicate entries in " << path;
+   return res;
+}
+
+static set<string> read_real_dir_set(const char *path)
+{
+   set<string> res;
+   DIR *dir = opendir(path);
+
+   EXPECT_TRUE(dir != NULL) << path;
+
+   if (dir) {
+
+      while (struct dirent *de = readdir(dir))
+         res.insert(de->d_name);
+
+      closedir(dir);
+   }
+
+   return res;
+}
+
+static string read_file(const char *path)
+{
+   char buf[4096];
+   string res;
+   fs_handle h = NULL;
+   ssize_t rc;
+
+   EXPECT_EQ(vfs_open(path, &h, O_RDONLY, 0), 0) << path;
+
+   if (!h)
+      return res;
+
+   while ((rc = vfs_read(h, buf, sizeof(buf))) > 0)
+      res.append(buf, (size_t)rc);
+
+   EXPECT_EQ(rc, 0);
+   vfs_close(h);
+   return res;
+}
+
+static string read_real_file(const char *path)
+{
+   string res;
+   char buf[4096];
+   ssize_t rc;
+   int fd = open(path, O_RDONLY);
+
+   EXPECT_GE(fd, 0) << path;
+
+   while ((rc = read(fd, buf, sizeof(buf))) > 0)
+      res.append(buf, (size_t)rc);
+
+   close(fd);
+   return res;
+}
+
+static int write_file(const char *path, const string &data, int fl)
+{
+   fs_handle h = NULL;
+   int rc;
+
+   if ((rc = vfs_open(path, &h, O_WRONLY | fl, 0644)))
+      return rc;
+
+   if (vfs_write(h, (void *)data.c_str(), data.size()) != (ssize_t)data.size())
+      rc = -EIO;
+
+   vfs_close(h);
+   return rc;
+}
+
+class overlayfs_test : public vfs_test_base {
+
+protected:
+
+   struct fs *fat_fs;
+   struct fs *upper_fs;
+   struct fs *ovl_fs;
+   size_t fatpart_size;
+
+   void SetUp() override {
+
+      vfs_test_base::SetUp();
+
+      const char *buf = load_once_file(TEST_FATPART_FILE, &fatpart_size);
+
+      /*
+       * The overlay must never touch the lower layer: mount a private copy of
+       * the FAT partition, in order to check that at the end.
+       */
+      char *copy = (char *)malloc(fatpart_size);
+      ASSERT_TRUE(copy != NULL);
+      memcpy(copy, buf, fatpart_size);
+
+      fat_fs = fat_mount_ramdisk(copy, fatpart_size, 0);
+      ASSERT_TRUE(fat_fs != NULL);
+
+      struct fs *root_fs = ramfs_create();
+      ASSERT_TRUE(root_fs != NULL);
+      mp_init(root_fs);
+
+      upper_fs = ramfs_create();
+      ASSERT_TRUE(upper_fs != NULL);
+
+      ovl_fs = overlayfs_create(fat_fs, upper_fs);
+      ASSERT_TRUE(ovl_fs != NULL);
+
+      ASSERT_EQ(vfs_mkdir("/initrd", 0777), 0);
+      ASSERT_EQ(mp_add(ovl_fs, "/initrd"), 0);
+   }
+
+   void TearDown() override {
+
+      const char *buf = load_once_file(TEST_FATPART_FILE);
+      void *copy = ((struct fat_fs_device_data *)fat_fs->device_data)->hdr;
+
+      ASSERT_EQ(memcmp(copy, buf, fatpart_size), 0) << "Lower layer modified";
+
+      /* NOTE: the mount points are reset by mp_init() */
+      overlayfs_destroy(ovl_fs);
+      fat_umount_ramdisk(fat_fs);
+      free(copy);
+      vfs_test_base::TearDown();
+   }
+};
+
+TEST_F(overlayfs_test, read_through)
+{
+   struct k_stat64 st;
+
+   ASSERT_EQ(read_file("/initrd/testdir/dir1/f1"),
+             read_real_file(REAL_TESTDIR "/dir1/f1"));
+
+   ASSERT_EQ(read_file("/initrd/bigfile"),
+             read_real_file(PROJ_BUILD_DIR "/test_sysroot/bigfile"));
+
+   ASSERT_EQ(vfs_stat64("/initrd/testdir/dir2", &st, true), 0);
+   ASSERT_TRUE(S_ISDIR(st.st_mode));
+   ASSERT_EQ(vfs_stat64("/initrd/testdir/nothing", &st, true), -ENOENT);
+
+   ASSERT_EQ(read_dir_set("/initrd/testdir"), read_real_dir_set(REAL_TESTDIR));
+}
+
+TEST_F(overlayfs_test, copy_up_on_write)
+{
+   const string orig = read_real_file(REAL_TESTDIR "/dir1/f1");
+   const ulong copy_ups = overlayfs_stats.copy_ups;
+   fs_handle h = NULL;
+
+   /* Opening for reading does not copy up anything */
+   ASSERT_EQ(vfs_open("/initrd/testdir/dir1/f1", &h, O_RDONLY, 0), 0);
+   vfs_close(h);
+   ASSERT_EQ(overlayfs_stats.copy_ups, copy_ups);
+
+   ASSERT_EQ(write_file("/initrd/testdir/dir1/f1", "more", O_APPEND), 0);
+   ASSERT_EQ(read_file("/initrd/testdir/dir1/f1"), orig + "more");
+
+   /* Just the file and its parent directories have been copied up */
+   ASSERT_EQ(overlayfs_stats.copy_ups, copy_ups + 3);
+   ASSERT_EQ(read_file("/initrd/testdir/dir1/f2"),
+             read_real_file(REAL_TESTDIR "/dir1/f2"));
+
+   /* The copied up directories are merged with the lower ones */
+   ASSERT_EQ(read_dir_set("/initrd/testdir"), read_real_dir_set(REAL_TESTDIR));
+   ASSERT_EQ(read_dir_set("/initrd/testdir/dir1"),
+             read_real_dir_set(REAL_TESTDIR "/dir1"));
+
+   /* Truncate works on lower files as well */
+   ASSERT_EQ(vfs_truncate("/initrd/testdir/" LONG_NAME_FILE, 7), 0);
+   ASSERT_EQ(read_file("/initrd/testdir/" LONG_NAME_FILE), "Content");
+
+   ASSERT_EQ(vfs_open("/initrd/testdir/file.abc", &h, O_RDONLY | O_TRUNC, 0),
+             -EINVAL);
+}
+
+TEST_F(overlayfs_test, create_and_unlink)
+{
+   set<string> expected = read_real_dir_set(REAL_TESTDIR);
+   struct k_stat64 st;
+
+   ASSERT_EQ(write_file("/initrd/testdir/new_file", "hello", O_CREAT), 0);
+   ASSERT_EQ(read_file("/initrd/testdir/new_file"), "hello");
+   ASSERT_EQ(write_file("/initrd/testdir/new_file", "x", O_CREAT | O_EXCL),
+             -EEXIST);
+
+   /* Unlink a lower file: the whiteout has to hide it */
+   ASSERT_EQ(vfs_unlink("/initrd/testdir/file.abc"), 0);
+   ASSERT_EQ(vfs_stat64("/initrd/testdir/file.abc", &st, true), -ENOENT);
+   ASSERT_EQ(vfs_unlink("/initrd/testdir/file.abc"), -ENOENT);
+
+   expected.erase("file.abc");
+   expected.insert("new_file");
+   ASSERT_EQ(read_dir_set("/initrd/testdir"), expected);
+
+   /* Re-creating it must not bring back the lower one */
+   ASSERT_EQ(write_file("/initrd/testdir/file.abc", "new", O_CREAT), 0);
+   ASSERT_EQ(read_file("/initrd/testdir/file.abc"), "new");
+
+   ASSERT_EQ(vfs_unlink("/initrd/testdir/new_file"), 0);
+   ASSERT_EQ(vfs_stat64("/initrd/testdir/new_file", &st, true), -ENOENT);
+   ASSERT_EQ(vfs_unlink("/initrd/testdir/dir1"), -EISDIR);
+}
+
+TEST_F(overlayfs_test, mkdir_and_rmdir)
+{
+   struct k_stat64 st;
+
+   ASSERT_EQ(vfs_mkdir("/initrd/testdir/new_dir", 0755), 0);
+   ASSERT_EQ(vfs_mkdir("/initrd/testdir/new_dir", 0755), -EEXIST);
+   ASSERT_EQ(vfs_mkdir("/initrd/testdir/dir1", 0755), -EEXIST);
+   ASSERT_EQ(write_file("/initrd/testdir/new_dir/a", "a", O_CREAT), 0);
+
+   ASSERT_EQ(vfs_rmdir("/initrd/testdir/new_dir"), -ENOTEMPTY);
+   ASSERT_EQ(vfs_unlink("/initrd/testdir/new_dir/a"), 0);
+   ASSERT_EQ(vfs_rmdir("/initrd/testdir/new_dir"), 0);
+
+   /* A lower-only directory is not empty until all its files are deleted */
+   ASSERT_EQ(vfs_rmdir("/initrd/testdir/dir3"), -ENOTEMPTY);
+   ASSERT_EQ(vfs_unlink("/initrd/testdir/dir3/f5"), 0);
+   ASSERT_EQ(vfs_rmdir("/initrd/testdir/dir3"), 0);
+   ASSERT_EQ(vfs_stat64("/initrd/testdir/dir3", &st, true), -ENOENT);
+
+   /* A re-created directory is opaque: it does not show the lower entries */
+   ASSERT_EQ(vfs_mkdir("/initrd/testdir/dir3", 0755), 0);
+   ASSERT_EQ(read_dir_set("/initrd/testdir/dir3"), set<string>({".", ".."}));
+   ASSERT_EQ(vfs_stat64("/initrd/testdir/dir3/f5", &st, true), -ENOENT);
+}
+
+TEST_F(overlayfs_test, unused_nodes_are_freed)
+{
+   const ulong nodes = overlayfs_stats.nodes;
+   fs_handle h = NULL;
+   struct k_stat64 st;
+
+   /* Negative lookups are not cached */
+   ASSERT_EQ(vfs_stat64("/initrd/testdir/nothing", &st, true), -ENOENT);
+   ASSERT_EQ(vfs_stat64("/initrd/testdir/dir1/x/y", &st, true), -ENOENT);
+   ASSERT_EQ(overlayfs_stats.nodes, nodes + 2); /* testdir, dir1 */
+
+   /* Files and dirs existing only in the overlay are freed once deleted */
+   ASSERT_EQ(vfs_mkdir("/initrd/testdir/new_dir", 0755), 0);
+   ASSERT_EQ(vfs_mkdir("/initrd/testdir/new_dir/sub", 0755), 0);
+   ASSERT_EQ(write_file("/initrd/testdir/new_dir/sub/a", "a", O_CREAT), 0);
+   ASSERT_EQ(overlayfs_stats.nodes, nodes + 5);
+
+   ASSERT_EQ(vfs_unlink("/initrd/testdir/new_dir/sub/a"), 0);
+   ASSERT_EQ(vfs_rmdir("/initrd/testdir/new_dir/sub"), 0);
+   ASSERT_EQ(overlayfs_stats.nodes, nodes + 3);
+
+   /* Open directory handles retain their node */
+   ASSERT_EQ(vfs_open("/initrd/testdir/new_dir", &h, O_RDONLY, 0), 0);
+   ASSERT_EQ(vfs_rmdir("/initrd/testdir/new_dir"), -EBUSY);
+   vfs_close(h);
+   ASSERT_EQ(overlayfs_stats.nodes, nodes + 3);
+   ASSERT_EQ(vfs_rmdir("/initrd/testdir/new_dir"), 0);
+   ASSERT_EQ(overlayfs_stats.nodes, nodes + 2);
+
+   /* The whiteouts hiding a lower entry are kept */
+   ASSERT_EQ(vfs_unlink("/initrd/testdir/file.abc"), 0);
+   ASSERT_EQ(overlayfs_stats.nodes, nodes + 3);
+   ASSERT_EQ(vfs_stat64("/initrd/testdir/file.abc", &st, true), -ENOENT);
+}
+
+TEST_F(overlayfs_test, getdents_and_seek)
+{
+   vector<string> all, rest;
+   fs_handle h = NULL;
+
+   /* Have entries in both the layers */
+   ASSERT_EQ(write_file("/initrd/testdir/manyfiles/new", "x", O_CREAT), 0);
+   ASSERT_EQ(vfs_unlink("/initrd/testdir/manyfiles/f3"), 0);
+
+   set<string> expected = read_real_dir_set(REAL_TESTDIR "/manyfiles");
+   expected.erase("f3");
+   expected.insert("new");
+   ASSERT_EQ(read_dir_set("/initrd/testdir/manyfiles"), expected);
+
+   ASSERT_EQ(vfs_open("/initrd/testdir/manyfiles", &h, O_RDONLY, 0), 0);
+   all = read_dir_entries(h);
+   ASSERT_EQ(all.size(), expected.size());
+
+   /* The offsets are just indexes in the merged directory */
+   for (size_t i = 0; i <= all.size(); i += 5) {
+      ASSERT_EQ(vfs_seek(h, (s64)i, SEEK_SET), (offt)i);
+      rest = read_dir_entries(h);
+      ASSERT_EQ(rest, vector<string>(all.begin() + (long)i, all.end()));
+   }
+
+   ASSERT_EQ(vfs_seek(h, (s64)all.size() + 1, SEEK_SET), -EINVAL);
+
+   /* Duplicated handles have their own layer handles */
+   fs_handle h2 = NULL;
+   ASSERT_EQ(vfs_seek(h, 0, SEEK_SET), 0);
+   ASSERT_EQ(vfs_dup(h, &h2), 0);
+   ASSERT_EQ(read_dir_entries(h2), all);
+   vfs_close(h2);
+   vfs_close(h);
+}
+
+TEST_F(overlayfs_test, rename_and_link)
+{
+   const string f1 = read_real_file(REAL_TESTDIR "/dir1/f1");
+   struct k_stat64 st;
+
+   ASSERT_EQ(vfs_rename("/initrd/testdir/dir1/f1", "/initrd/testdir/r1"), 0);
+   ASSERT_EQ(vfs_stat64("/initrd/testdir/dir1/f1", &st, true), -ENOENT);
+   ASSERT_EQ(read_file("/initrd/testdir/r1"), f1);
+
+   /* Replace a lower file */
+   ASSERT_EQ(vfs_rename("/initrd/testdir/r1", "/initrd/testdir/file.a"), 0);
+   ASSERT_EQ(read_file("/initrd/testdir/file.a"), f1);
+
+   /* Directories cannot be renamed */
+   ASSERT_EQ(vfs_rename("/initrd/testdir/dir2", "/initrd/testdir/d2"), -EXDEV);
+
+   ASSERT_EQ(vfs_link("/initrd/testdir/dir2/f3", "/initrd/testdir/l3"), 0);
+   ASSERT_EQ(read_file("/initrd/testdir/l3"),
+             read_real_file(REAL_TESTDIR "/dir2/f3"));
+   ASSERT_EQ(vfs_unlink("/initrd/testdir/dir2/f3"), 0);
+   ASSERT_EQ(read_file("/initrd/testdir/l3"),
+             read_real_file(REAL_TESTDIR "/dir2/f3"));
+}
+
+static void copy_tree(const string &src, const string &dst)
+{
+   struct k_stat64 st;
+
+   for (const string &name : read_dir(src.c_str())) {
+
+      if (name == "." || name == "..")
+         continue;
+
+      const string s = src + "/" + name;
+      const string d = dst + "/" + name;
+
+      ASSERT_EQ(vfs_stat64(s.c_str(), &st, true), 0);
+
+      if (S_ISDIR(st.st_mode)) {
+         ASSERT_EQ(vfs_mkdir(d.c_str(), 0777), 0);
+         copy_tree(s, d);
+      } else {
+         ASSERT_EQ(write_file(d.c_str(), read_file(s.c_str()), O_CREAT), 0);
+      }
+   }
+}
+
+/*
+ * Compare the cost, at boot, of making the initrd writable with the overlay vs.
+ * copying all of its content in a ramfs.
+ */
+TEST_F(overlayfs_test, boot_time_vs_full_copy)
+{
+   using namespace std::chrono;
+   size_t heap_free;
+   struct fs *ovl2, *upper2;
+
+   ASSERT_EQ(vfs_mkdir("/fat", 0777), 0);
+   ASSERT_EQ(mp_add(fat_fs, "/fat"), 0);
+
+   heap_free = kmalloc_get_tot_heap_free();
+   auto start = steady_clock::now();
+   {
+      upper2 = ramfs_create();
+      ASSERT_TRUE(upper2 != NULL);
+      ovl2 = overlayfs_create(fat_fs, upper2);
+      ASSERT_TRUE(ovl2 != NULL);
+   }
+   auto ovl_time = steady_clock::now() - start;
+   const size_t ovl_mem = heap_free - kmalloc_get_tot_heap_free();
+
+   ASSERT_EQ(vfs_mkdir("/copy", 0777), 0);
+
+   heap_free = kmalloc_get_tot_heap_free();
+   start = steady_clock::now();
+   {
+      copy_tree("/fat", "/copy");
+   }
+   auto copy_time = steady_clock::now() - start;
+   const size_t copy_mem = heap_free - kmalloc_get_tot_heap_free();
+
+   cout << "[ INFO     ] overlay:   "
+        << duration_cast<microseconds>(ovl_time).count() << " us, "
+        << ovl_mem << " bytes" << endl;
+
+   cout << "[ INFO     ] full copy: "
+        << duration_cast<microseconds>(copy_time).count() << " us, "
+        << copy_mem << " bytes" << endl;
+
+   ASSERT_EQ(read_file("/copy/bigfile"), read_file("/initrd/bigfile"));
+   ASSERT_LT(ovl_mem, copy_mem / 100);
+
+   overlayfs_destroy(ovl2);
+}
@@ -248,3 +248,110 @@ TEST(ringbuf, read_write_bytes)
    ASSERT_TRUE(ringbuf_is_empty(&rb));
    ringbuf_destory(&rb);
 }
+
+TEST(ringbuf, read_write_chunks)
+{
+   struct ringbuf rb;
+   char buffer[9] = "--------";
+   size_t len;
+   u8 *ptr;
+
+   ringbuf_init(&rb, 8, 1, buffer);
+
+   ptr = ringbuf_get_read_chunk(&rb, &len);
+   ASSERT_TRUE(ptr == NULL);
+   ASSERT_EQ(len, 0U);
+
+   ptr = ringbuf_get_write_chunk(&rb, &len);
+   ASSERT_EQ((char *)ptr, buffer);
+   ASSERT_EQ(len, 8U);
+
+   memcpy(ptr, "123456", 6);
+   ringbuf_commit_bytes(&rb, 6);
+   ASSERT_EQ(ringbuf_get_elems(&rb), 6U);
+
+   ptr = ringbuf_get_read_chunk(&rb, &len);
+   ASSERT_EQ((char *)ptr, buffer);
+   ASSERT_EQ(len, 6U);
+   ringbuf_consume_bytes(&rb, 4);
+
+   /* The free space wraps around: only the tail is contiguous */
+   ptr = ringbuf_get_write_chunk(&rb, &len);
+   ASSERT_EQ((char *)ptr, buffer + 6);
+   ASSERT_EQ(len, 2U);
+
+   memcpy(ptr, "78", 2);
+   ringbuf_commit_bytes(&rb, 2);
+
+   ptr = ringbuf_get_write_chunk(&rb, &len);
+   ASSERT_EQ((char *)ptr, buffer);
+   ASSERT_EQ(len, 4U);
+
+   memcpy(ptr, "9abc", 4);
+   ringbuf_commit_bytes(&rb, 4);
+   ASSERT_TRUE(ringbuf_is_full(&rb));
+
+   ptr = ringbuf_get_write_chunk(&rb, &len);
+   ASSERT_TRUE(ptr == NULL);
+   ASSERT_EQ(len, 0U);
+
+   ptr = ringbuf_get_read_chunk(&rb, &len);
+   ASSERT_EQ((char *)ptr, buffer + 4);
+   ASSERT_EQ(len, 4U);
+   ASSERT_EQ(memcmp(ptr, "5678", 4), 0);
+   ringbuf_consume_bytes(&rb, 4);
+
+   ptr = ringbuf_get_read_chunk(&rb, &len);
+   ASSERT_EQ((char *)ptr, buffer);
+   ASSERT_EQ(len, 4U);
+   ASSERT_EQ(memcmp(ptr, "9abc", 4), 0);
+   ringbuf_consume_bytes(&rb, 4);
+
+   ASSERT_TRUE(ringbuf_is_empty(&rb));
+   ringbuf_destory(&rb);
+}
+
+TEST(ringbuf, peek_chunks)
+{
+   struct ringbuf rb;
+   char buffer[9] = "--------";
+   size_t len;
+   u8 *ptr;
+
+   ringbuf_init(&rb, 8, 1, buffer);
+
+   ptr = ringbuf_get_write_chunk(&rb, &len);
+   memcpy(ptr, "123456", 6);
+   ringbuf_commit_bytes(&rb, 6);
+   ringbuf_consume_bytes(&rb, 4);
+
+   ptr = ringbuf_get_write_chunk(&rb, &len);
+   memcpy(ptr, "78", 2);
+   ringbuf_commit_bytes(&rb, 2);
+
+   ptr = ringbuf_get_write_chunk(&rb, &len);
+   memcpy(ptr, "9a", 2);
+   ringbuf_commit_bytes(&rb, 2);
+
+   /* The data is: "56" "78" (at the end of the buffer) + "9a" (wrapped) */
+   ptr = ringbuf_peek_chunk(&rb, 0, &len);
+   ASSERT_EQ((char *)ptr, buffer + 4);
+   ASSERT_EQ(len, 4U);
+
+   ptr = ringbuf_peek_chunk(&rb, 3, &len);
+   ASSERT_EQ((char *)ptr, buffer + 7);
+   ASSERT_EQ(len, 1U);
+
+   ptr = ringbuf_peek_chunk(&rb, 4, &len);
+   ASSERT_EQ((char *)ptr, buffer);
+   ASSERT_EQ(len, 2U);
+   ASSERT_EQ(memcmp(ptr, "9a", 2), 0);
+
+   ptr = ringbuf_peek_chunk(&rb, 6, &len);
+   ASSERT_TRUE(ptr == NULL);
+   ASSERT_EQ(len, 0U);
+
+   /* Peeking does not consume anything */
+   ASSERT_EQ(ringbuf_get_elems(&rb), 6U);
+   ringbuf_destory(&rb);
+}
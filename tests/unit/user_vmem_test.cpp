@@ -0,0 +1,185 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+#include <iostream>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include <gtest/gtest.h>
+
+#include "kernel_init_funcs.h"
+
+extern "C" {
+   #include <tilck/kernel/paging.h>
+   #include <tilck/kernel/user_vmem.h>
+   #include <tilck/kernel/errno.h>
+}
+
+using namespace std;
+using namespace testing;
+
+#define TEST_BEGIN      (256 * MB)
+#define TEST_END        (512 * MB)
+
+static vector<pair<ulong, size_t>> get_free_ranges(struct user_vmem *uv)
+{
+   vector<pair<ulong, size_t>> res;
+   struct bintree_walk_ctx ctx;
+   struct user_vmem_range *r;
+
+   bintree_in_order_visit_start(&ctx,
+                                uv->root,
+                                struct user_vmem_range,
+                                node,
+                                false);
+
+   while ((r = (struct user_vmem_range *)bintree_in_order_visit_next(&ctx)))
+      res.push_back(make_pair(r->vaddr, r->len));
+
+   return res;
+}
+
+class user_vmem_test : public Test {
+public:
+
+   struct user_vmem uv;
+
+   void SetUp() override {
+      init_kmalloc_for_tests();
+      ASSERT_EQ(user_vmem_init(&uv, TEST_BEGIN, TEST_END), 0);
+   }
+
+   void TearDown() override {
+      user_vmem_destroy(&uv);
+   }
+};
+
+TEST_F(user_vmem_test, alloc_and_free)
+{
+   ulong a, b, c;
+
+   a = user_vmem_alloc(&uv, 4 * PAGE_SIZE);
+   b = user_vmem_alloc(&uv, 1 * PAGE_SIZE);
+   c = user_vmem_alloc(&uv, 2 * PAGE_SIZE);
+
+   ASSERT_EQ(a, (ulong)TEST_BEGIN);
+   ASSERT_EQ(b, a + 4 * PAGE_SIZE);
+   ASSERT_EQ(c, b + 1 * PAGE_SIZE);
+
+   /* Free the middle range and re-use it (first-fit) */
+   user_vmem_free(&uv, b, PAGE_SIZE);
+   ASSERT_EQ(get_free_ranges(&uv).size(), 2u);
+   ASSERT_EQ(user_vmem_alloc(&uv, PAGE_SIZE), b);
+
+   /* Free everything, in an order requiring all the merge cases */
+   user_vmem_free(&uv, a, 4 * PAGE_SIZE);
+   user_vmem_free(&uv, c, 2 * PAGE_SIZE);
+   user_vmem_free(&uv, b, PAGE_SIZE);
+
+   auto ranges = get_free_ranges(&uv);
+   ASSERT_EQ(ranges.size(), 1u);
+   ASSERT_EQ(ranges[0].first, (ulong)TEST_BEGIN);
+   ASSERT_EQ(ranges[0].second, (size_t)(TEST_END - TEST_BEGIN));
+}
+
+TEST_F(user_vmem_test, out_of_vspace)
+{
+   ulong a = user_vmem_alloc(&uv, TEST_END - TEST_BEGIN);
+
+   ASSERT_EQ(a, (ulong)TEST_BEGIN);
+   ASSERT_EQ(user_vmem_alloc(&uv, PAGE_SIZE), 0ul);
+
+   user_vmem_free(&uv, a + PAGE_SIZE, PAGE_SIZE);
+   ASSERT_EQ(user_vmem_alloc(&uv, 2 * PAGE_SIZE), 0ul);
+   ASSERT_EQ(user_vmem_alloc(&uv, PAGE_SIZE), a + PAGE_SIZE);
+}
+
+TEST_F(user_vmem_test, alloc_at)
+{
+   const ulong a = TEST_BEGIN + 16 * PAGE_SIZE;
+
+   /* Split the only free range in two */
+   ASSERT_EQ(user_vmem_alloc_at(&uv, a, 4 * PAGE_SIZE), 0);
+   ASSERT_EQ(get_free_ranges(&uv).size(), 2u);
+
+   /* Overlapping or out-of-bounds ranges */
+   ASSERT_EQ(user_vmem_alloc_at(&uv, a + 3 * PAGE_SIZE, 2 * PAGE_SIZE),
+             -ENOMEM);
+   ASSERT_EQ(user_vmem_alloc_at(&uv, a - PAGE_SIZE, 2 * PAGE_SIZE), -ENOMEM);
+   ASSERT_EQ(user_vmem_alloc_at(&uv, TEST_END, PAGE_SIZE), -ENOMEM);
+   ASSERT_EQ(user_vmem_alloc_at(&uv, TEST_BEGIN - PAGE_SIZE, 2 * PAGE_SIZE),
+             -ENOMEM);
+
+   /* Take the beginning and the end of a free range */
+   ASSERT_EQ(user_vmem_alloc_at(&uv, TEST_BEGIN, PAGE_SIZE), 0);
+   ASSERT_EQ(user_vmem_alloc_at(&uv, a - PAGE_SIZE, PAGE_SIZE), 0);
+   ASSERT_EQ(get_free_ranges(&uv).size(), 2u);
+
+   /* Take a whole free range */
+   ASSERT_EQ(user_vmem_alloc_at(&uv, TEST_BEGIN + PAGE_SIZE, 14 * PAGE_SIZE),
+             0);
+   ASSERT_EQ(get_free_ranges(&uv).size(), 1u);
+
+   /* The first-fit allocator must skip the ranges allocated above */
+   ASSERT_EQ(user_vmem_alloc(&uv, PAGE_SIZE), a + 4 * PAGE_SIZE);
+
+   user_vmem_free(&uv, TEST_BEGIN, 21 * PAGE_SIZE);
+
+   auto ranges = get_free_ranges(&uv);
+   ASSERT_EQ(ranges.size(), 1u);
+   ASSERT_EQ(ranges[0].second, (size_t)(TEST_END - TEST_BEGIN));
+}
+
+TEST_F(user_vmem_test, dup)
+{
+   struct user_vmem uv2;
+   ulong a = user_vmem_alloc(&uv, 8 * PAGE_SIZE);
+
+   user_vmem_free(&uv, a + 2 * PAGE_SIZE, PAGE_SIZE);
+   ASSERT_EQ(user_vmem_dup(&uv2, &uv), 0);
+   ASSERT_EQ(get_free_ranges(&uv), get_free_ranges(&uv2));
+
+   user_vmem_destroy(&uv2);
+}
+
+TEST_F(user_vmem_test, chaos)
+{
+   random_device rdev;
+   const auto seed = rdev();
+   default_random_engine eng(seed);
+   uniform_int_distribution<size_t> dist(1, 64);
+   vector<pair<ulong, size_t>> allocs;
+
+   cout << "[ INFO     ] random seed: " << seed << endl;
+
+   for (int iter = 0; iter < 10; iter++) {
+
+      for (int i = 0; i < 500; i++) {
+
+         const size_t len = dist(eng) * PAGE_SIZE;
+         const ulong va = user_vmem_alloc(&uv, len);
+
+         ASSERT_NE(va, 0ul);
+         ASSERT_GE(va, (ulong)TEST_BEGIN);
+         ASSERT_LE(va + len, (ulong)TEST_END);
+
+         for (const auto &e : allocs) {
+            ASSERT_TRUE(va + len <= e.first || e.first + e.second <= va);
+         }
+
+         allocs.push_back(make_pair(va, len));
+      }
+
+      shuffle(allocs.begin(), allocs.end(), eng);
+
+      for (size_t i = 0; i < allocs.size() / 2; i++)
+         user_vmem_free(&uv, allocs[i].first, allocs[i].second);
+
+      allocs.erase(allocs.begin(), allocs.begin() + allocs.size() / 2);
+   }
+
+   for (const auto &e : allocs)
+      user_vmem_free(&uv, e.first, e.second);
+
+   ASSERT_EQ(get_free_ranges(&uv).size(), 1u);
+}
@@ -45,3 +45,61 @@ TEST_F(ramfs_perf, creat)
    for (int i = 0; i < 100; i++)
       create_test_file(i);
 }
+
+struct dents_ctx {
+
+   struct fs_handle_base *h;
+   vector<string> names;
+   vector<offt> pos;
+   size_t max;
+};
+
+static int dents_cb(struct vfs_dent64 *vde, void *arg)
+{
+   struct dents_ctx *ctx = (struct dents_ctx *)arg;
+
+   if (ctx->names.size() == ctx->max)
+      return 1;
+
+   /* Move forward the position like vfs_getdents64() does */
+   ctx->h->pos = vde->next_off ? vde->next_off : ctx->h->pos + 1;
+   ctx->names.push_back(vde->name);
+   ctx->pos.push_back(ctx->h->pos);
+   return 0;
+}
+
+/*
+ * Seeking back to the position of an entry already returned has to rewind
+ * ramfs's own cursor as well: vfs_getdents64() relies on that to "un-return"
+ * the entries it failed to copy to user space.
+ */
+TEST_F(ramfs_perf, getdents_seek_back)
+{
+   fs_handle h;
+   int rc;
+
+   for (int i = 0; i < 20; i++)
+      create_test_file(i);
+
+   rc = vfs_open("/", &h, O_RDONLY, 0);
+   ASSERT_EQ(rc, 0);
+
+   struct fs_handle_base *hb = (struct fs_handle_base *)h;
+   struct dents_ctx all = { hb, {}, {}, 1000 };
+   struct dents_ctx part = { hb, {}, {}, 8 };
+   struct dents_ctx rest = { hb, {}, {}, 1000 };
+
+   ASSERT_EQ(hb->fs->fsops->getdents(h, &dents_cb, &all), 0);
+   ASSERT_EQ(all.names.size(), 22u);
+
+   ASSERT_EQ(vfs_seek(h, 0, SEEK_SET), 0);
+   ASSERT_EQ(hb->fs->fsops->getdents(h, &dents_cb, &part), 1);
+
+   /* Pretend that only the first 5 entries have been copied */
+   ASSERT_EQ(vfs_seek(h, part.pos[4], SEEK_SET), part.pos[4]);
+   ASSERT_EQ(hb->fs->fsops->getdents(h, &dents_cb, &rest), 0);
+
+   const vector<string> expected(all.names.begin() + 5, all.names.end());
+   ASSERT_EQ(rest.names, expected);
+   vfs_close(h);
+}
@@ -3,9 +3,12 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <dirent.h>
 
 #include <iostream>
 #include <random>
+#include <set>
+#include <string>
 
 #include "vfs_test.h"
 
@@ -166,6 +169,128 @@ TEST_F(vfs_misc, fseek)
    close(fd);
 }
 
+TEST_F(vfs_misc, pread)
+{
+   random_device rdev;
+   const auto seed = rdev();
+   default_random_engine engine(seed);
+
+   cout << "[ INFO     ] random seed: " << seed << endl;
+
+   const char *fatpart_file_path = "/bigfile";
+   const char *real_file_path = PROJ_BUILD_DIR "/test_sysroot/bigfile";
+
+   int fd = open(real_file_path, O_RDONLY);
+   const off_t file_size = lseek(fd, 0, SEEK_END);
+   uniform_int_distribution<off_t> off_dist(0, file_size + 100);
+   uniform_int_distribution<size_t> len_dist(1, 3 * 4096 + 100);
+
+   static char buf_tilck[3 * 4096 + 100];
+   static char buf_linux[3 * 4096 + 100];
+
+   fs_handle h = NULL;
+   int r = vfs_open(fatpart_file_path, &h, 0, O_RDONLY);
+   ASSERT_TRUE(r == 0);
+   ASSERT_TRUE(h != NULL);
+
+   for (int i = 0; i < 10000; i++) {
+
+      /* Random reads, often spanning multiple clusters */
+      const off_t off = off_dist(engine);
+      const size_t len = len_dist(engine);
+      struct iovec iov = { buf_tilck, len };
+      struct io_iter it;
+
+      io_iter_init(&it, &iov, 1, false);
+
+      ssize_t linux_read = pread(fd, buf_linux, len, off);
+      ssize_t tilck_read = vfs_pread_iter(h, &it, off);
+
+      ASSERT_EQ(tilck_read, linux_read) << "Offset: " << off << endl;
+      ASSERT_EQ(memcmp(buf_tilck, buf_linux, (size_t)linux_read), 0)
+         << "Offset: " << off << ", len: " << len << endl;
+   }
+
+   /* Positional reads must not move the file position */
+   ASSERT_EQ(vfs_seek(h, 0, SEEK_CUR), 0);
+
+   /* Seeking past the end, relative to the end */
+   ASSERT_EQ(vfs_seek(h, 10, SEEK_END), file_size + 10);
+   ASSERT_EQ(vfs_read(h, buf_tilck, 10), 0);
+
+   vfs_close(h);
+   close(fd);
+}
+
+struct getdents_test_ctx {
+
+   struct fs_handle_base *h;
+   set<string> *names;
+   int left;
+};
+
+static int getdents_test_cb(struct vfs_dent64 *vde, void *arg)
+{
+   struct getdents_test_ctx *ctx = (struct getdents_test_ctx *)arg;
+
+   if (!ctx->left)
+      return 1; /* stop: the next call has to resume from h->pos */
+
+   if (!ctx->names->insert(vde->name).second)
+      return -EEXIST;
+
+   ctx->left--;
+   ctx->h->pos++;
+   return 0;
+}
+
+TEST_F(vfs_misc, getdents_and_lookup)
+{
+   const char *fat_dir = "/testdir/manyfiles";
+   const char *real_dir = PROJ_BUILD_DIR "/test_sysroot/testdir/manyfiles";
+
+   set<string> expected, actual;
+   struct k_stat64 statbuf;
+   char path[256];
+   int rc;
+
+   DIR *dir = opendir(real_dir);
+   ASSERT_TRUE(dir != NULL);
+
+   while (struct dirent *de = readdir(dir))
+      expected.insert(de->d_name);
+
+   closedir(dir);
+
+   fs_handle h = NULL;
+   rc = vfs_open(fat_dir, &h, O_RDONLY, 0);
+   ASSERT_EQ(rc, 0);
+
+   struct fs_handle_base *hb = (struct fs_handle_base *)h;
+   struct getdents_test_ctx ctx = { hb, &actual, 0 };
+
+   /* Get 3 entries per call: getdents() has to resume each time */
+   do {
+      ctx.left = 3;
+      rc = hb->fs->fsops->getdents(h, &getdents_test_cb, &ctx);
+      ASSERT_GE(rc, 0);
+   } while (rc);
+
+   vfs_close(h);
+   ASSERT_EQ(actual, expected);
+
+   for (const string &name : expected) {
+      sprintf(path, "%s/%s", fat_dir, name.c_str());
+      ASSERT_EQ(vfs_stat64(path, &statbuf, true), 0) << path;
+   }
+
+   sprintf(path, "%s/%s", fat_dir, "F1");
+   ASSERT_EQ(vfs_stat64(path, &statbuf, true), -ENOENT);
+
+   sprintf(path, "%s/%s", fat_dir, "f1_");
+   ASSERT_EQ(vfs_stat64(path, &statbuf, true), -ENOENT);
+}
+
 class compute_abs_path_test :
    public TestWithParam<
       tuple<const char *, const char *, const char *>
@@ -9,6 +9,7 @@ extern "C" {
    #include <tilck/kernel/sched.h>
    #include <tilck/kernel/process.h>
    #include <tilck/kernel/fs/fat32.h>
+   #include <tilck/kernel/fs/dcache.h>
    #include "kernel/fs/fs_int.h"
 
    struct fs *ramfs_create(void);
@@ -31,6 +32,7 @@ protected:
 
    void TearDown() override {
 
-      /* do nothing, for the moment */
+      /* The dcache entries live in the heap re-initialized by SetUp() */
+      dcache_invalidate_fs(NULL);
    }
 };
@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ * Dynamically linked test app, run by the `dynexec` devshell test: check that
+ * it's been started by the dynamic loader and that it can use the shared
+ * library `libdyntest.so`.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/auxv.h>
+
+extern int dyntest_counter;
+extern const char *const dyntest_str;
+int dyntest_lib_func(int n);
+
+int main(int argc, char **argv)
+{
+   int rc;
+
+   if (!getauxval(AT_BASE)) {
+      fprintf(stderr, "dyntest: AT_BASE is 0: not started by ld.so\n");
+      return 1;
+   }
+
+   if (strcmp(dyntest_str, "libdyntest")) {
+      fprintf(stderr, "dyntest: unexpected dyntest_str: '%s'\n", dyntest_str);
+      return 1;
+   }
+
+   /* dyntest_counter == 42 + 4 and dyntest_bss[1024] == 1 */
+   if ((rc = dyntest_lib_func(4)) != 47) {
+      fprintf(stderr, "dyntest: dyntest_lib_func() returned %d\n", rc);
+      return 1;
+   }
+
+   if (dyntest_counter != 46) {
+      fprintf(stderr, "dyntest: dyntest_counter is %d\n", dyntest_counter);
+      return 1;
+   }
+
+   printf("dyntest: OK\n");
+   return 0;
+}
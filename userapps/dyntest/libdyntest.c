@@ -0,0 +1,19 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/*
+ * Shared library used by `dyntest`. Its data, bss and RELRO pages live in the
+ * private file mappings made by musl's dynamic loader.
+ */
+
+int dyntest_counter = 42;
+const char *const dyntest_str = "libdyntest";    /* relocated, then RELRO */
+static int dyntest_bss[4096];                    /* spans multiple pages */
+
+int dyntest_lib_func(int n)
+{
+   for (int i = 0; i < n; i++)
+      dyntest_bss[(i * 1024) % 4096] += i;
+
+   dyntest_counter += n;
+   return dyntest_counter + dyntest_bss[1024];
+}